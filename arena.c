@@ -0,0 +1,271 @@
+/*                                                                       */
+/*                                                                       */
+/*   ARENA ALLOCATOR                                                     */
+/*                                                                       */
+/*      Memory for contexts and compiled programs, handed out from a     */
+/*      few large blocks instead of one heap allocation per object.      */
+/*                                                                       */
+/*        (1) void calc_arena_init (calc_arena *a, allocate, release,    */
+/*                                  void *pool)                          */
+/*                                                                       */
+/*            sets up empty arena whose blocks come from                 */
+/*            allocate (pool, n) and go back through                     */
+/*            release (pool, block).  Either may be NULL (see            */
+/*            arena.h).  Blocks must be aligned for double.  Use this    */
+/*            to take the memory of calc_context_new_arena from a        */
+/*            caller's pool.                                             */
+/*                                                                       */
+/*        (2) void calc_arena_reset (calc_arena *a)                      */
+/*                                                                       */
+/*            makes all memory of the arena free again, keeping its      */
+/*            blocks for reuse.  Takes constant time.                    */
+/*                                                                       */
+/*        (3) void calc_arena_free (calc_arena *a)                       */
+/*                                                                       */
+/*            returns all blocks and leaves the arena empty.             */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Allocations are rounded to ALIGNMENT and taken from the      */
+/*          current block.  When it is full the next kept block is       */
+/*          used, or a new one twice the size of the last is added       */
+/*          after it, so an arena holds few blocks.                      */
+/*                                                                       */
+/*          ArenaResize extends the last allocation in place when it     */
+/*          fits, otherwise copies; the old copy is reclaimed with the   */
+/*          arena.  ArenaRewind gives back a temporary and everything    */
+/*          allocated after it, so temporaries must be released in       */
+/*          the reverse order of allocation, with nothing kept           */
+/*          allocated after them.                                        */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define ALIGNMENT      16
+#define INITIALBLOCK   4096
+#define MAXBLOCKSTEP   1048576
+#define ALIGNED(n)     (((n) + ALIGNMENT-1) & ~(size_t) (ALIGNMENT-1))
+#define BLOCKBASE(b)   ((char *) (b) + ALIGNED (sizeof(arenablock_t)))
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  HEADER OF EACH BLOCK - MEMORY FOLLOWS AT BLOCKBASE  */
+struct arenablock
+   {
+   arenablock_t *Next;
+   size_t        Size;          /*  bytes after header                  */
+   };
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static arenablock_t *NewBlock (calc_arena *Arena, size_t Size);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  ADD BLOCK OF AT LEAST Size BYTES AFTER CURRENT - RETURN NULL IF NO HEAP  */
+static arenablock_t *NewBlock (calc_arena *Arena, size_t Size)
+   {
+   arenablock_t *Block;
+   size_t        BlockSize;
+
+   BlockSize = Arena->BlockSize ? Arena->BlockSize : INITIALBLOCK;
+   while (BlockSize < Size)
+      BlockSize *= 2;
+   if (Arena->Allocate != NULL)
+      Block = (arenablock_t *) Arena->Allocate
+         (Arena->Pool, ALIGNED (sizeof(arenablock_t)) + BlockSize);
+   else
+      Block = (arenablock_t *)
+         malloc (ALIGNED (sizeof(arenablock_t)) + BlockSize);
+   if (Block == NULL)
+      return NULL;
+
+   Block->Size = BlockSize;
+   if (Arena->Current != NULL)
+      {
+      Block->Next = Arena->Current->Next;
+      Arena->Current->Next = Block;
+      }
+   else
+      {
+      Block->Next  = Arena->First;
+      Arena->First = Block;
+      }
+   Arena->BlockSize = (BlockSize < MAXBLOCKSTEP) ? 2*BlockSize
+                                                 : BlockSize;
+   return Block;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+void calc_arena_init (calc_arena *Arena,
+                      void *(*Allocate) (void *Pool, size_t Size),
+                      void (*Release) (void *Pool, void *Block),
+                      void *Pool)
+   {
+   memset (Arena, 0, sizeof(calc_arena));
+   Arena->Allocate = Allocate;
+   Arena->Release  = Release;
+   Arena->Pool     = Pool;
+   }
+
+
+void calc_arena_reset (calc_arena *Arena)
+   {
+   Arena->Current = NULL;
+   Arena->Used    = 0;
+   Arena->Last    = 0;
+   }
+
+
+void calc_arena_free (calc_arena *Arena)
+   {
+   arenablock_t *Block;
+   arenablock_t *Next;
+
+   for (Block=Arena->First; Block != NULL; Block=Next)
+      {
+      Next = Block->Next;
+      if (Arena->Release != NULL)
+         Arena->Release (Arena->Pool, Block);
+      else if (Arena->Allocate == NULL)
+         free (Block);
+      }
+   calc_arena_init (Arena, Arena->Allocate, Arena->Release, Arena->Pool);
+   }
+
+
+/*  RETURN Size BYTES ALIGNED FOR ANY TYPE, OR NULL  */
+void *ArenaAllocate (calc_arena *Arena, size_t Size)
+   {
+   arenablock_t *Block;
+   char         *Pointer;
+
+   if (Arena == NULL)
+      return malloc (Size);
+
+   Size = ALIGNED (Size);
+   if (Arena->Current == NULL || Arena->Used + Size > Arena->Current->Size)
+      {
+      /*  MOVE TO NEXT KEPT BLOCK, OR ADD ONE  */
+      Block = (Arena->Current != NULL) ? Arena->Current->Next : Arena->First;
+      if (Block == NULL || Block->Size < Size)
+         {
+         Block = NewBlock (Arena, Size);
+         if (Block == NULL)
+            return NULL;
+         }
+      Arena->Current = Block;
+      Arena->Used    = 0;
+      }
+   Pointer = BLOCKBASE (Arena->Current) + Arena->Used;
+   Arena->Last  = Arena->Used;
+   Arena->Used += Size;
+   return Pointer;
+   }
+
+
+/*  SAME AS realloc - Old STAYS VALID IF NULL IS RETURNED  */
+void *ArenaResize (calc_arena *Arena, void *Old, size_t OldSize,
+                   size_t NewSize)
+   {
+   void *New;
+
+   if (Arena == NULL)
+      return realloc (Old, NewSize);
+
+   /*  EXTEND LAST ALLOCATION IN PLACE  */
+   if (Old != NULL && Arena->Current != NULL && Arena->Last < Arena->Used &&
+       (char *) Old == BLOCKBASE (Arena->Current) + Arena->Last &&
+       Arena->Last + ALIGNED (NewSize) <= Arena->Current->Size)
+      {
+      Arena->Used = Arena->Last + ALIGNED (NewSize);
+      return Old;
+      }
+
+   New = ArenaAllocate (Arena, NewSize);
+   if (New != NULL && Old != NULL)
+      memcpy (New, Old, (OldSize < NewSize) ? OldSize : NewSize);
+   return New;
+   }
+
+
+/*  GIVE BACK MEMORY NO LONGER USED - KEPT UNTIL RESET UNLESS LAST  */
+void ArenaDiscard (calc_arena *Arena, void *Pointer)
+   {
+   if (Arena == NULL)
+      free (Pointer);
+   else if (Pointer != NULL && Arena->Current != NULL &&
+            Arena->Last < Arena->Used &&
+            (char *) Pointer == BLOCKBASE (Arena->Current) + Arena->Last)
+      Arena->Used = Arena->Last;
+   }
+
+
+/*  GIVE BACK TEMPORARY AND EVERYTHING ALLOCATED AFTER IT  */
+void ArenaRewind (calc_arena *Arena, void *Pointer)
+   {
+   arenablock_t *Block;
+   char         *Base;
+
+   if (Arena == NULL)
+      {
+      free (Pointer);
+      return;
+      }
+   if (Pointer == NULL || Arena->Current == NULL)
+      return;
+
+   /*  FIND BLOCK HOLDING POINTER, AT OR BEFORE CURRENT BLOCK  */
+   Block = Arena->Current;
+   Base  = BLOCKBASE (Block);
+   if ((char *) Pointer < Base || (char *) Pointer > Base + Arena->Used)
+      {
+      for (Block=Arena->First; Block != Arena->Current; Block=Block->Next)
+         {
+         Base = BLOCKBASE (Block);
+         if ((char *) Pointer >= Base &&
+             (char *) Pointer <= Base + Block->Size)
+            break;
+         }
+      if (Block == Arena->Current)
+         return;
+      }
+   Arena->Current = Block;
+   Arena->Used    = (char *) Pointer - Base;
+   Arena->Last    = Arena->Used;
+   }
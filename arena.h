@@ -0,0 +1,41 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+typedef struct arenablock arenablock_t;
+
+/*
+   Bump allocator - memory is handed out from a chain of blocks and
+   given back all at once.  Blocks come from Allocate (malloc if NULL)
+   and go back through Release (free if both are NULL; kept by the
+   pool if only Release is NULL).  A zero-filled calc_arena is an
+   empty arena using malloc and free.
+*/
+typedef struct
+   {
+   arenablock_t *First;         /*  chain of blocks, kept by reset      */
+   arenablock_t *Current;       /*  block being allocated from          */
+   size_t        Used;          /*  bytes used in Current               */
+   size_t        Last;          /*  offset of last allocation           */
+   size_t        BlockSize;     /*  size of next block, 0 for default   */
+   void       *(*Allocate) (void *Pool, size_t Size);
+   void        (*Release)  (void *Pool, void *Block);
+   void         *Pool;
+   } calc_arena;
+
+void   calc_arena_init  (calc_arena *a,
+                         void *(*allocate) (void *pool, size_t n),
+                         void (*release) (void *pool, void *block),
+                         void *pool);
+void   calc_arena_reset (calc_arena *a);
+void   calc_arena_free  (calc_arena *a);
+
+/*  Used by the library - a NULL arena means the heap  */
+void  *ArenaAllocate (calc_arena *Arena, size_t Size);
+void  *ArenaResize   (calc_arena *Arena, void *Old, size_t OldSize,
+                      size_t NewSize);
+void   ArenaDiscard  (calc_arena *Arena, void *Pointer);
+void   ArenaRewind   (calc_arena *Arena, void *Pointer);
+
+#endif
@@ -0,0 +1,500 @@
+/*                                                                       */
+/*                                                                       */
+/*   MICRO-BENCHMARKS FOR THE PARSER AND EVALUATOR                       */
+/*                                                                       */
+/*        calcbench [name]                                               */
+/*                                                                       */
+/*            runs every benchmark whose name contains name (all if      */
+/*            omitted) and prints one line per benchmark:                */
+/*                                                                       */
+/*            ns/op      time per operation                              */
+/*            allocs/op  heap allocations per operation                  */
+/*            ops/s      operations per second                           */
+/*            MB/s       formula text parsed per second, where it        */
+/*                       applies                                         */
+/*                                                                       */
+/*            Built and run by "make bench".                             */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Each benchmark is run with a doubling number of operations   */
+/*          until one run takes at least MINTIME seconds; that run is    */
+/*          reported.  Allocations are counted by routing malloc,        */
+/*          calloc and realloc of the library sources through the        */
+/*          counters below (bench.h is included ahead of them).          */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#undef malloc
+#undef calloc
+#undef realloc
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "parse.h"
+#include "number.h"
+#include "compile.h"
+#include "pool.h"
+#include "parallel.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define MINTIME     0.25
+#define MAXFORMULA  2048
+#define NUMBERCOUNT 8
+#define SUMTERMS    65536
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  ONE BENCHMARK - Run PERFORMS Count OPERATIONS  */
+typedef struct
+   {
+   const char  *Name;
+   void       (*Setup) (void);
+   void       (*Run) (long Count);
+   size_t     (*BytesPerOp) (void);
+   } benchmark_t;
+
+
+/*
+************************************************************************
+Module-Wide Variables
+************************************************************************
+*/
+
+unsigned long BenchAllocations = 0;
+
+/*  RESULTS ARE ADDED HERE SO THAT NO WORK IS OPTIMIZED AWAY  */
+static volatile double Sink_m;
+
+/*  FORMULA EVALUATED BY THE evalform BENCHMARKS  */
+static char Formula_m[MAXFORMULA];
+
+/*  CONTEXT AND NAMES FOR THE SYMBOL TABLE BENCHMARKS  */
+static calc_context *TableContext_m = NULL;
+static char        **TableNames_m = NULL;
+static int           TableSize_m = 0;
+
+/*  COMPILED SUM OF SUMTERMS PRODUCTS, WITH ITS VARIABLES, AND THREADS  */
+static calc_program *Sum_m = NULL;
+static double        SumSlots_m[4];
+static calc_pool    *SumPool_m = NULL;
+
+/*  TEXT FOR THE NUMBER PARSING BENCHMARKS  */
+static const char *Numbers_m[NUMBERCOUNT] = {
+   "3.14159", "2.5e-3", "1e3", "123456789", "0.000123",
+   "42", "6.02214076e23", "0.5"
+};
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static double  Seconds (void);
+static size_t  FormulaBytes (void);
+static void    RunEvalform (long Count);
+static void    SetupParentheses (void);
+static void    SetupChain (void);
+static void    SetupVariables (void);
+static void    SetupFunctions (void);
+static void    SetupAssignment (void);
+static void    SetupNumber (void);
+static void    SetupSum (void);
+static void    RunSum (long Count);
+static void    RunSumParallel (long Count);
+static void    SetupTable (int Size);
+static void    SetupTable16 (void);
+static void    SetupTable1k (void);
+static void    SetupTable64k (void);
+static void    SetupTable1M (void);
+static void    RunTable (long Count);
+static void    RunStrtod (long Count);
+static void    RunParse (long Count);
+static void    RunPrintf (long Count);
+static void    RunFormat (long Count);
+static size_t  NumberBytes (void);
+static void    RunBenchmark (const benchmark_t *Benchmark);
+
+
+/*
+************************************************************************
+Benchmarks
+************************************************************************
+*/
+
+static const benchmark_t Benchmarks_m[] = {
+   { "evalform/parentheses",  SetupParentheses, RunEvalform, FormulaBytes },
+   { "evalform/chain",        SetupChain,       RunEvalform, FormulaBytes },
+   { "evalform/variables",    SetupVariables,   RunEvalform, FormulaBytes },
+   { "evalform/functions",    SetupFunctions,   RunEvalform, FormulaBytes },
+   { "evalform/assignment",   SetupAssignment,  RunEvalform, FormulaBytes },
+   { "evalform/number",       SetupNumber,      RunEvalform, FormulaBytes },
+   { "calc_run/sum64k",       SetupSum,         RunSum,      NULL },
+   { "calc_run_parallel/sum64k", SetupSum,      RunSumParallel, NULL },
+   { "GetVariableID/16",      SetupTable16,     RunTable,    NULL },
+   { "GetVariableID/1k",      SetupTable1k,     RunTable,    NULL },
+   { "GetVariableID/64k",     SetupTable64k,    RunTable,    NULL },
+   { "GetVariableID/1M",      SetupTable1M,     RunTable,    NULL },
+   { "strtod",                NULL,             RunStrtod,   NumberBytes },
+   { "calc_strtod",           NULL,             RunParse,    NumberBytes },
+   { "snprintf/%f",           NULL,             RunPrintf,   NULL },
+   { "calc_format/f",         NULL,             RunFormat,   NULL },
+   { NULL,                    NULL,             NULL,        NULL }
+};
+
+
+/*
+************************************************************************
+Allocation Counters
+************************************************************************
+*/
+
+void *BenchMalloc (size_t Size)
+   {
+   BenchAllocations++;
+   return malloc (Size);
+   }
+
+void *BenchCalloc (size_t Number, size_t Size)
+   {
+   BenchAllocations++;
+   return calloc (Number, Size);
+   }
+
+void *BenchRealloc (void *Pointer, size_t Size)
+   {
+   BenchAllocations++;
+   return realloc (Pointer, Size);
+   }
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+static double Seconds (void)
+   {
+   struct timespec Now;
+
+   clock_gettime (CLOCK_MONOTONIC, &Now);
+   return Now.tv_sec + 1e-9 * Now.tv_nsec;
+   }
+
+
+static size_t FormulaBytes (void)
+   {
+   return strlen (Formula_m);
+   }
+
+
+static void RunEvalform (long Count)
+   {
+   char   *FormulaPtr;
+   double  Sum = 0.0;
+   int     ErrorCode;
+   long    iop;
+
+   for (iop=0; iop<Count; iop++)
+      {
+      FormulaPtr = Formula_m;
+      Sum += evalform (&FormulaPtr, &ErrorCode);
+      }
+   Sink_m += Sum;
+   }
+
+
+/*  20 LEVELS OF NESTING  */
+static void SetupParentheses (void)
+   {
+   int level;
+
+   Formula_m[0] = 0;
+   for (level=0; level<20; level++)
+      strcat (Formula_m, "(1+");
+   strcat (Formula_m, "1");
+   for (level=0; level<20; level++)
+      strcat (Formula_m, ")");
+   }
+
+
+/*  64 TERMS WITH MIXED OPERATORS  */
+static void SetupChain (void)
+   {
+   static const char *Operators = "+-*/";
+   char               Term[16];
+   int                iterm;
+
+   strcpy (Formula_m, "1");
+   for (iterm=1; iterm<64; iterm++)
+      {
+      sprintf (Term, "%c%d", Operators[iterm%4], 1 + iterm%9);
+      strcat (Formula_m, Term);
+      }
+   }
+
+
+/*  32 DISTINCT VARIABLES  */
+static void SetupVariables (void)
+   {
+   char Name[16];
+   char Term[24];
+   int  ivar;
+
+   Formula_m[0] = 0;
+   for (ivar=0; ivar<32; ivar++)
+      {
+      sprintf (Name, "VAR%d", ivar);
+      AssignVariable (Name, 1.0 + ivar);
+      sprintf (Term, "%svar%d", ivar ? (ivar%2 ? "*" : "+") : "", ivar);
+      strcat (Formula_m, Term);
+      }
+   }
+
+
+static void SetupFunctions (void)
+   {
+   strcpy (Formula_m,
+           "sin(cos(tan(0.5)))+exp(log(sqrt(2)))+atan(abs(-3))"
+           "+log10(int(123.4))+asin(0.5)*acos(0.25)");
+   }
+
+
+static void SetupAssignment (void)
+   {
+   strcpy (Formula_m, "x = y = z = 3*4 + w");
+   }
+
+
+static void SetupNumber (void)
+   {
+   strcpy (Formula_m, "6.02214076e23");
+   }
+
+
+/*  SUMTERMS DISTINCT PRODUCTS OF 4 VARIABLES AND A FUNCTION, COMPILED ONCE  */
+static void SetupSum (void)
+   {
+   char  *Formula;
+   char  *End;
+   int    ErrorCode;
+   int    iterm;
+   int    islot;
+
+   if (Sum_m != NULL)
+      return;
+   Formula = (char *) malloc (SUMTERMS * 32);
+   if (Formula == NULL)
+      return;
+   End = Formula;
+   for (iterm=0; iterm<SUMTERMS; iterm++)
+      End += sprintf (End, "%s%d.5*s%d*sqrt(s%d+%d)", iterm ? "+" : "",
+                      iterm, iterm%4, (iterm+1)%4, iterm%7);
+   Sum_m = calc_compile (Formula, &ErrorCode);
+   free (Formula);
+   for (islot=0; Sum_m != NULL && islot<calc_nslots (Sum_m); islot++)
+      SumSlots_m[islot] = 1.25 + islot;
+   SumPool_m = calc_pool_new ((int) sysconf (_SC_NPROCESSORS_ONLN));
+   }
+
+
+static void RunSum (long Count)
+   {
+   double Sum = 0.0;
+   int    ErrorCode;
+   long   iop;
+
+   for (iop=0; Sum_m != NULL && iop<Count; iop++)
+      Sum += calc_run (Sum_m, SumSlots_m, &ErrorCode);
+   Sink_m += Sum;
+   }
+
+
+static void RunSumParallel (long Count)
+   {
+   double Sum = 0.0;
+   int    ErrorCode;
+   long   iop;
+
+   for (iop=0; Sum_m != NULL && iop<Count; iop++)
+      Sum += calc_run_parallel (Sum_m, SumSlots_m, SumPool_m, &ErrorCode);
+   Sink_m += Sum;
+   }
+
+
+/*  TABLE OF Size VARIABLES, LOOKED UP IN SCATTERED ORDER  */
+static void SetupTable (int Size)
+   {
+   char Name[16];
+   int  ivar;
+
+   if (TableContext_m != NULL)
+      {
+      for (ivar=0; ivar<TableSize_m; ivar++)
+         free (TableNames_m[ivar]);
+      free (TableNames_m);
+      calc_context_free (TableContext_m);
+      }
+   TableContext_m = calc_context_new ();
+   TableNames_m   = (char **) malloc (Size * sizeof(char *));
+   TableSize_m    = Size;
+   for (ivar=0; ivar<Size; ivar++)
+      {
+      sprintf (Name, "V%d", ivar);
+      AssignVariable_r (TableContext_m, Name, ivar);
+      TableNames_m[ivar] = (char *) malloc (strlen (Name) + 1);
+      strcpy (TableNames_m[ivar], Name);
+      }
+   }
+
+static void SetupTable16  (void) { SetupTable (16); }
+static void SetupTable1k  (void) { SetupTable (1024); }
+static void SetupTable64k (void) { SetupTable (65536); }
+static void SetupTable1M  (void) { SetupTable (1048576); }
+
+
+static void RunTable (long Count)
+   {
+   long Sum = 0;
+   long Slot = 0;
+   long iop;
+
+   for (iop=0; iop<Count; iop++)
+      {
+      Sum += GetVariableID (TableContext_m, TableNames_m[Slot]);
+      Slot = (Slot + 7919) % TableSize_m;
+      }
+   Sink_m += Sum;
+   }
+
+
+static void RunStrtod (long Count)
+   {
+   double Sum = 0.0;
+   long   iop;
+
+   for (iop=0; iop<Count; iop++)
+      Sum += strtod (Numbers_m[iop % NUMBERCOUNT], NULL);
+   Sink_m += Sum;
+   }
+
+
+static void RunParse (long Count)
+   {
+   double Sum = 0.0;
+   long   iop;
+
+   for (iop=0; iop<Count; iop++)
+      Sum += calc_strtod (Numbers_m[iop % NUMBERCOUNT], NULL);
+   Sink_m += Sum;
+   }
+
+
+/*  PRINTING RESULTS AS calc DOES, BEFORE AND AFTER calc_format  */
+static void RunPrintf (long Count)
+   {
+   char Buffer[CALC_NUMBERSIZE];
+   long Sum = 0;
+   long iop;
+
+   for (iop=0; iop<Count; iop++)
+      Sum += snprintf (Buffer, sizeof(Buffer), "%f", (double) iop / 7.0);
+   Sink_m += Sum;
+   }
+
+
+static void RunFormat (long Count)
+   {
+   char Buffer[CALC_NUMBERSIZE];
+   long Sum = 0;
+   long iop;
+
+   for (iop=0; iop<Count; iop++)
+      Sum += calc_format (Buffer, sizeof(Buffer), (double) iop / 7.0, 'f');
+   Sink_m += Sum;
+   }
+
+
+/*  AVERAGE LENGTH OF THE NUMBERS PARSED  */
+static size_t NumberBytes (void)
+   {
+   size_t Length = 0;
+   int    inum;
+
+   for (inum=0; inum<NUMBERCOUNT; inum++)
+      Length += strlen (Numbers_m[inum]);
+   return Length / NUMBERCOUNT;
+   }
+
+
+static void RunBenchmark (const benchmark_t *Benchmark)
+   {
+   unsigned long Allocations;
+   double        Start;
+   double        Elapsed;
+   double        PerOp;
+   long          Count;
+
+   if (Benchmark->Setup != NULL)
+      Benchmark->Setup ();
+
+   /*  WARM UP, THEN DOUBLE UNTIL LONG ENOUGH TO TIME  */
+   Benchmark->Run (1);
+   Count = 1;
+   do
+      {
+      Count *= 2;
+      Allocations = BenchAllocations;
+      Start = Seconds ();
+      Benchmark->Run (Count);
+      Elapsed = Seconds () - Start;
+      Allocations = BenchAllocations - Allocations;
+      }
+   while (Elapsed < MINTIME);
+
+   PerOp = Elapsed / Count;
+   printf ("%-24s %10.1f ns/op %8.2f allocs/op %12.0f ops/s",
+           Benchmark->Name, 1e9 * PerOp, (double) Allocations / Count,
+           1.0 / PerOp);
+   if (Benchmark->BytesPerOp != NULL)
+      printf (" %8.1f MB/s", 1e-6 * Benchmark->BytesPerOp () / PerOp);
+   printf ("\n");
+   fflush (stdout);
+   }
+
+
+/*
+************************************************************************
+Main Function
+************************************************************************
+*/
+
+int main (int argc, char *argv[])
+   {
+   const benchmark_t *Benchmark;
+
+   for (Benchmark=Benchmarks_m; Benchmark->Name != NULL; Benchmark++)
+      if (argc < 2 || strstr (Benchmark->Name, argv[1]) != NULL)
+         RunBenchmark (Benchmark);
+   return 0;
+   }
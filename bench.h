@@ -0,0 +1,21 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+/*
+   Included ahead of every library source when building calcbench
+   (see Makefile) so that allocations can be counted.  bench.c undoes
+   the macros for itself.
+*/
+#include <stdlib.h>
+
+extern unsigned long BenchAllocations;
+
+void *BenchMalloc  (size_t Size);
+void *BenchCalloc  (size_t Number, size_t Size);
+void *BenchRealloc (void *Pointer, size_t Size);
+
+#define malloc(n)     BenchMalloc (n)
+#define calloc(n, s)  BenchCalloc (n, s)
+#define realloc(p, n) BenchRealloc (p, n)
+
+#endif
@@ -0,0 +1,133 @@
+/*                                                                       */
+/*                                                                       */
+/*   BUILT-IN FUNCTIONS AND CONSTANTS                                    */
+/*                                                                       */
+/*        (1) const calc_builtin *FindBuiltin (const char *name,         */
+/*                                             int length)               */
+/*                                                                       */
+/*            returns built-in with upper case name, or NULL if name     */
+/*            is not built in (and so is a variable).                    */
+/*                                                                       */
+/*        (2) const calc_builtin *calc_builtins (void)                   */
+/*                                                                       */
+/*            returns list of all built-ins in the order they are        */
+/*            shown by HELP, ended by an entry with a NULL name.         */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Names are found through a perfect hash on the length and     */
+/*          the first two characters, so each name costs one table       */
+/*          probe and at most one string compare.  The slot table is     */
+/*          filled at compile time with the same BUILTINHASH macro       */
+/*          used for lookup.  A new built-in must hash to a free slot;   */
+/*          gcc -Wextra reports a slot given twice (-Woverride-init).    */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <string.h>
+#include "parse.h"
+#include "builtin.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#ifndef M_E
+#define M_E        2.7182818284590452354E0
+#endif
+#ifndef M_PI
+#define M_PI       3.1415926535897931160E0
+#endif
+
+/*  SIZE OF SLOT TABLE (POWER OF TWO) AND HASH OF A NAME  */
+#define BUILTINSLOTS 64
+#define BUILTINHASH(c0, c1, Length) \
+   ((12*(Length) + (c0) + (c1)) & (BUILTINSLOTS-1))
+
+
+/*
+************************************************************************
+Module-Wide Variables
+************************************************************************
+*/
+
+static const calc_builtin Builtins_m[] = {
+   { "SIN",   BUILTIN_function, FUNC_sin,   1, 0.0  },
+   { "COS",   BUILTIN_function, FUNC_cos,   1, 0.0  },
+   { "TAN",   BUILTIN_function, FUNC_tan,   1, 0.0  },
+   { "EXP",   BUILTIN_function, FUNC_exp,   1, 0.0  },
+   { "LOG",   BUILTIN_function, FUNC_log,   1, 0.0  },
+   { "LOG10", BUILTIN_function, FUNC_log10, 1, 0.0  },
+   { "ABS",   BUILTIN_function, FUNC_fabs,  1, 0.0  },
+   { "SQRT",  BUILTIN_function, FUNC_sqrt,  1, 0.0  },
+   { "ACOS",  BUILTIN_function, FUNC_acos,  1, 0.0  },
+   { "ASIN",  BUILTIN_function, FUNC_asin,  1, 0.0  },
+   { "ATAN",  BUILTIN_function, FUNC_atan,  1, 0.0  },
+   { "INT",   BUILTIN_function, FUNC_int,   1, 0.0  },
+   { "MIN",   BUILTIN_function, FUNC_min,   2, 0.0  },
+   { "MAX",   BUILTIN_function, FUNC_max,   2, 0.0  },
+   { "ATAN2", BUILTIN_function, FUNC_atan2, 2, 0.0  },
+   { "HYPOT", BUILTIN_function, FUNC_hypot, 2, 0.0  },
+   { "FMA",   BUILTIN_function, FUNC_fma,   3, 0.0  },
+   { "%E",    BUILTIN_constant, FUNC_err,   0, M_E  },
+   { "%PI",   BUILTIN_constant, FUNC_err,   0, M_PI },
+   { NULL,    BUILTIN_constant, FUNC_err,   0, 0.0  }
+};
+
+/*  1 + INDEX IN Builtins_m OF NAME HASHED TO SLOT, 0 IF EMPTY  */
+static const unsigned char BuiltinSlots_m[BUILTINSLOTS] = {
+   [BUILTINHASH('S', 'I', 3)] =  1,
+   [BUILTINHASH('C', 'O', 3)] =  2,
+   [BUILTINHASH('T', 'A', 3)] =  3,
+   [BUILTINHASH('E', 'X', 3)] =  4,
+   [BUILTINHASH('L', 'O', 3)] =  5,
+   [BUILTINHASH('L', 'O', 5)] =  6,
+   [BUILTINHASH('A', 'B', 3)] =  7,
+   [BUILTINHASH('S', 'Q', 4)] =  8,
+   [BUILTINHASH('A', 'C', 4)] =  9,
+   [BUILTINHASH('A', 'S', 4)] = 10,
+   [BUILTINHASH('A', 'T', 4)] = 11,
+   [BUILTINHASH('I', 'N', 3)] = 12,
+   [BUILTINHASH('M', 'I', 3)] = 13,
+   [BUILTINHASH('M', 'A', 3)] = 14,
+   [BUILTINHASH('A', 'T', 5)] = 15,
+   [BUILTINHASH('H', 'Y', 5)] = 16,
+   [BUILTINHASH('F', 'M', 3)] = 17,
+   [BUILTINHASH('%', 'E', 2)] = 18,
+   [BUILTINHASH('%', 'P', 3)] = 19
+};
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+const calc_builtin *FindBuiltin (const char *Name, int Length)
+   {
+   const calc_builtin *Builtin;
+   int                 Slot;
+
+   Slot = BuiltinSlots_m[BUILTINHASH ((unsigned char) Name[0],
+                                      (unsigned char) Name[1], Length)];
+   if (Slot == 0)
+      return NULL;
+   Builtin = Builtins_m + Slot-1;
+   if (strcmp (Builtin->Name, Name) != 0)
+      return NULL;
+   return Builtin;
+   }
+
+
+const calc_builtin *calc_builtins (void)
+   {
+   return Builtins_m;
+   }
@@ -0,0 +1,28 @@
+#ifndef __BUILTIN_H
+#define __BUILTIN_H
+
+#include "parse.h"
+
+typedef enum
+   {
+   BUILTIN_function,
+   BUILTIN_constant
+   } builtinkind_t;
+
+/*  BUILT-IN FUNCTION OR CONSTANT  */
+typedef struct
+   {
+   const char     *Name;        /*  upper case, as in formulas          */
+   builtinkind_t   Kind;
+   function_t      Function;    /*  functions only                      */
+   int             Arity;       /*  number of arguments                 */
+   double          Value;       /*  constants only                      */
+   } calc_builtin;
+
+/*  NAME MUST BE UPPER CASE AND NUL-TERMINATED  */
+const calc_builtin *FindBuiltin (const char *Name, int Length);
+
+/*  ALL BUILT-INS, ENDED BY AN ENTRY WITH A NULL NAME  */
+const calc_builtin *calc_builtins (void);
+
+#endif
@@ -4,6 +4,9 @@ Compile Switches
 ************************************************************************
 */
 
+/*  Files of -f can be larger than 2 GB  */
+#define _FILE_OFFSET_BITS 64
+
 
 /*
 ************************************************************************
@@ -21,6 +24,12 @@ Include Files
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*  GNU readline functions (for input editting)  */
 #ifdef HAVE_LIBREADLINE
@@ -29,6 +38,15 @@ Include Files
 #endif
 
 #include "parse.h"
+#include "memo.h"
+#include "builtin.h"
+#include "pool.h"
+#include "number.h"
+#include "output.h"
+#include "snapshot.h"
+#include "server.h"
+#include "numeric.h"
+#include "trace.h"
 
 
 
@@ -46,6 +64,60 @@ Macros
 
 #define NBUF 1024
 
+/*  Block size for batch input and output  */
+#define BATCHBLOCK 65536
+
+/*  Bytes of a file mapped at a time by -f (grown for longer lines)  */
+#define MAPWINDOW (256L * 1024 * 1024)
+
+/*  Parallel batch mode - lines per chunk of work, and fewest
+    independent lines in a row that are worth spreading over threads  */
+#define CHUNKLINES 64
+#define MINPARALLEL 256
+#define NOWORKER -1
+
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  Kinds of line queued in parallel batch mode  */
+enum { LINE_formula, LINE_comment };
+
+/*  Line queued in parallel batch mode, and its result  */
+typedef struct
+   {
+   char *Text;
+   size_t Length;
+   unsigned long LineNumber;
+   int Kind;
+   double Result;
+   int ErrorCode;
+   int Worker;			/*  NOWORKER to run again in order  */
+   size_t Names;		/*  variables created, in names of Worker  */
+   int NumberOfNames;
+   } batchline_t;
+
+/*  Context and variables created by one worker thread  */
+typedef struct
+   {
+   calc_context *Context;
+   char *Names;
+   size_t NamesLength;
+   size_t NamesSize;
+   } batchworker_t;
+
+/*  Queued lines spread over the workers by RunQueuedLines  */
+typedef struct
+   {
+   batchline_t *Lines;
+   int NumberOfLines;
+   batchworker_t *Workers;
+   } batchjob_t;
+
 
 
 /*
@@ -53,11 +125,33 @@ Macros
 Local Function Prototypes
 ************************************************************************
 */
-void PrintNumber (double);
+void PrintNumber (FILE *, double);
 void PrintHelp (void);
 void PrintGreeting (void);
 void ListVariables (void);
+void PrintStatistics (void);
+void PrintUsage (void);
 int  IsComment (char *, char *);
+int  ExecuteLine (char *, size_t);
+void FirstToken (char *, size_t, char *, int);
+int  CommandArgument (char *, size_t, char *, int);
+void LoadSnapshot (char *);
+void ReportResult (double, int);
+void ReportNumber (double, const calc_number *, int);
+void EndResult (void);
+int  RunBatch (FILE *);
+int  RunMapped (char *);
+char *ExecuteLines (char *, char *, int, int *);
+int  EndBatch (void);
+int  EndTrace (void);
+int  StartWorkers (int);
+void StopWorkers (void);
+int  QueueLine (char *, size_t);
+int  IsIndependent (char *, size_t);
+void RunQueuedLines (void);
+void EvaluateChunk (void *, int, int);
+int  RunServer (char *);
+void StopServer (int);
 
 
 
@@ -67,11 +161,36 @@ Module-Wide Variables
 ************************************************************************
 */
 
-/*  LIST OF FUNCTIONS  */
-char *FunctionNames_m[] = {
-   "sin", "cos", "tan", "exp", "log", "log10", "abs",
-   "sqrt", "acos", "asin", "atan", NULL
-};
+/*  BATCH MODE SETTINGS  */
+int BatchMode_m = FALSE;
+int FlushInterval_m = 0;
+int ResultsSinceFlush_m = 0;
+
+/*  RESULTS AS DATA (NULL FOR TEXT), WITH LISTINGS THEN GOING TO stderr  */
+calc_output *Output_m = NULL;
+FILE *Listing_m = NULL;
+unsigned long LineNumber_m = 0;
+
+/*  CACHE OF RESULTS (NULL IF TURNED OFF)  */
+int MemoSize_m = CALC_MEMOSIZE;
+calc_memo *Memo_m = NULL;
+
+/*  PARALLEL BATCH MODE (Pool_m NULL IF OFF)  */
+int Threads_m = 1;
+calc_pool *Pool_m = NULL;
+batchworker_t *Workers_m = NULL;
+batchline_t *Queue_m = NULL;
+int QueueLength_m = 0;
+int QueueSize_m = 0;
+
+/*  SERVER MODE (NULL IF OFF)  */
+calc_server *Server_m = NULL;
+
+/*  ARITHMETIC OF THE DEFAULT CONTEXT  */
+int Numeric_m = NUMERIC_double;
+
+/*  TRACE OF THE COST OF EACH FORMULA (NULL IF OFF)  */
+calc_trace *Trace_m = NULL;
 
 
 
@@ -83,18 +202,128 @@ Main Function
 
 int 
 main (int argc, char *argv[]) {
-   double Result;
    char *InputString;
-   char *InputStringPtr;
-   char *ErrorMessage;
-   char TokenBuffer[80];
-   char *TokenPtr;
+   char *FileName;
+   char *ServerAddress;
+   char *TraceFile;
+   char *ReportFile;
+   int ReportTop;
+   int Format;
    int Continue;
-   int ErrorCode;
+   int BatchMode;
+   int iarg;
 #ifndef HAVE_LIBREADLINE
 	char InputBuf[NBUF];
 #endif
 
+   /*  Read options  */
+   BatchMode = !isatty (fileno (stdin));
+   FileName = NULL;
+   ServerAddress = NULL;
+   TraceFile = NULL;
+   ReportFile = NULL;
+   ReportTop = CALC_TRACETOP;
+   Format = -1;
+   Listing_m = stdout;
+   for (iarg = 1; iarg < argc; iarg++) {
+		if (!strcmp (argv[iarg], "-b"))
+			BatchMode = TRUE;
+		else if (!strcmp (argv[iarg], "-i"))
+			BatchMode = FALSE;
+		else if (!strcmp (argv[iarg], "-F") && iarg+1 < argc)
+			FlushInterval_m = atoi (argv[++iarg]);
+		else if (!strcmp (argv[iarg], "-m") && iarg+1 < argc)
+			MemoSize_m = atoi (argv[++iarg]);
+		else if (!strcmp (argv[iarg], "-j") && iarg+1 < argc)
+			Threads_m = atoi (argv[++iarg]);
+		else if (!strcmp (argv[iarg], "-f") && iarg+1 < argc) {
+			FileName = argv[++iarg];
+			BatchMode = TRUE;
+		}
+		else if (!strcmp (argv[iarg], "-s") && iarg+1 < argc)
+			ServerAddress = argv[++iarg];
+		else if (!strcmp (argv[iarg], "-t") && iarg+1 < argc)
+			TraceFile = argv[++iarg];
+		else if (!strcmp (argv[iarg], "-T") && iarg+1 < argc)
+			ReportFile = argv[++iarg];
+		else if (!strcmp (argv[iarg], "-N") && iarg+1 < argc)
+			ReportTop = atoi (argv[++iarg]);
+		else if (!strcmp (argv[iarg], "-n") && iarg+1 < argc) {
+			if ((Numeric_m = calc_numeric_find (argv[++iarg])) < 0) {
+				PrintUsage ();
+				return (1);
+			}
+		}
+		else if (!strcmp (argv[iarg], "-o") && iarg+1 < argc) {
+			iarg++;
+			if (strcmp (argv[iarg], "text") != 0 &&
+			    (Format = calc_output_find (argv[iarg])) < 0) {
+				PrintUsage ();
+				return (1);
+			}
+		}
+		else {
+			PrintUsage ();
+			return (1);
+		}
+	}
+
+   /*  Serve connections instead of reading input  */
+   if (ServerAddress != NULL)
+		return (RunServer (ServerAddress));
+
+   /*  Rank the formulas of a trace instead of reading input  */
+   if (ReportFile != NULL) {
+		if (calc_trace_report (stdout, ReportFile, ReportTop) != 0) {
+			fprintf (stderr, "calc: %s is not a trace\n", ReportFile);
+			return (1);
+		}
+		return (0);
+	}
+
+   /*  Other arithmetic than double is neither cached nor threaded  */
+   if (Numeric_m != NUMERIC_double) {
+		calc_context_set_numeric (calc_default_context (),
+					  (calc_numeric) Numeric_m);
+		MemoSize_m = 0;
+		Threads_m = 1;
+	}
+
+   /*  Trace the cost of every line, each evaluated by itself  */
+   if (TraceFile != NULL) {
+		Trace_m = calc_trace_open (TraceFile);
+		if (Trace_m == NULL) {
+			fprintf (stderr, "calc: cannot create %s\n", TraceFile);
+			return (1);
+		}
+		MemoSize_m = 0;
+		Threads_m = 1;
+	}
+
+   /*  Remember results of formulas whose variables did not change  */
+   if (MemoSize_m > 0)
+		Memo_m = calc_memo_new (calc_default_context (), MemoSize_m);
+
+   /*  Results as data - anything else goes to stderr  */
+   if (Format >= 0) {
+		Output_m = calc_output_new (stdout, (calc_resultformat) Format);
+		if (Output_m == NULL) {
+			fprintf (stderr, "calc: out of memory\n");
+			return (1);
+		}
+		Listing_m = stderr;
+		BatchMode = TRUE;
+	}
+
+   /*  Read input without prompts in batch mode  */
+   if (BatchMode) {
+		if (Threads_m == 0)
+			Threads_m = (int) sysconf (_SC_NPROCESSORS_ONLN);
+		if (Threads_m > 1 && !StartWorkers (Threads_m))
+			fprintf (stderr, "calc: cannot start threads, running one line at a time\n");
+		return (FileName != NULL ? RunMapped (FileName) : RunBatch (stdin));
+	}
+
    /*  Print greeting  */
    PrintGreeting ();
 
@@ -115,62 +344,838 @@ main (int argc, char *argv[]) {
 #endif
 			if (NULL == InputString) {
 				printf("\n");
-				return(0);
+				return (EndTrace ());
 			}
 		} while (!strcmp ("", InputString));
 
-		/*  PASS FIRST SPACES  */
-		InputStringPtr = InputString;
+		LineNumber_m++;
+		Continue = ExecuteLine (InputString, strlen (InputString));
+	}
+	return (EndTrace ());
+}
 
-		while (*InputStringPtr == ' ')
-			InputStringPtr++;
-
-		/*  COPY NON-BLANK CHARACTERS  */
-		TokenPtr = TokenBuffer;
-		while (!isspace (*InputStringPtr) && *InputStringPtr != 0)
-			*(TokenPtr++) = toupper (*(InputStringPtr++));
-		*TokenPtr = 0;
-
-		/*  TEST TOKEN  */
-		/*  Skip comments (beginning with #)   */
-		if (IsComment (TokenBuffer, "#")) {
-			/*  Do nothing  */
-		} else if (!strcmp (TokenBuffer, "HELP")) {
-			  PrintHelp ();
-		} else if (!strcmp (TokenBuffer, "LIST")) {
-			  ListVariables ();
-		} else if (!strcmp (TokenBuffer, "QUIT")) {
-			Continue = FALSE;
-
-		/*  Arithmetic expression entered  */
-		} else {
+/*
+************************************************************************
+Input Processing
+************************************************************************
+*/
+
+/*  Execute one line of input, Length bytes not counting any NUL - return
+    FALSE if program should end  */
+int
+ExecuteLine (char *InputString, size_t Length)
+{
+   double Result;
+   calc_number Number;
+   char *InputStringPtr;
+   char TokenBuffer[80];
+   char FileName[NBUF];
+   int ErrorCode;
+   int Definition;
+
+	/*  TEST FIRST TOKEN  */
+	FirstToken (InputString, Length, TokenBuffer, sizeof(TokenBuffer));
+
+	/*  Skip comments (beginning with #)   */
+	if (IsComment (TokenBuffer, "#")) {
+		/*  Do nothing  */
+	} else if (!strcmp (TokenBuffer, "HELP")) {
+		  PrintHelp ();
+	} else if (!strcmp (TokenBuffer, "LIST")) {
+		  ListVariables ();
+	} else if (!strcmp (TokenBuffer, "STATS")) {
+		  PrintStatistics ();
+	} else if (!strcmp (TokenBuffer, "SAVE") &&
+		   CommandArgument (InputString, Length, FileName,
+				    sizeof(FileName))) {
+		  ErrorCode = calc_snapshot_save (calc_default_context (),
+						  FileName);
+		  if (ErrorCode != NO_ERROR)
+			  fprintf (Listing_m, "%s\n", parsemsg (ErrorCode));
+	} else if (!strcmp (TokenBuffer, "LOAD") &&
+		   CommandArgument (InputString, Length, FileName,
+				    sizeof(FileName))) {
+		  LoadSnapshot (FileName);
+	} else if (!strcmp (TokenBuffer, "QUIT")) {
+		return (FALSE);
+
+	/*  Arithmetic expression entered  */
+	} else {
 
 #ifdef HAVE_LIBREADLINE
-			/*  Save expression in history  */
+		/*  Save expression in history  */
+		if (!BatchMode_m)
 			add_history (InputString);
 #endif
 
-			InputStringPtr = InputString;
-			Result = evalform (&InputStringPtr, &ErrorCode);
-			if (ErrorCode == NO_ERROR) {
-				PrintNumber (Result);
-				printf ("\n\n");
-				fflush (stdout);
-				/*  Store this result as special variable %  */
-				AssignVariable ("%", Result);
-
-			/*  Error message  */
-			} else {
-				  ErrorMessage = parsemsg (ErrorCode);
-				  if (ErrorMessage == NULL)
-					  printf ("Unknown error.\n\n");
-				  else
-					  printf ("%s\n\n", ErrorMessage);
-				  fflush (stdout);
-			}
+		InputStringPtr = InputString;
+		Definition = IsFunctionDefinition (InputString,
+						   InputString + Length);
+		if (Trace_m != NULL)
+			calc_trace_begin (Trace_m, calc_default_context ());
+		if (Numeric_m != NUMERIC_double)
+			Result = calc_eval_number_r (calc_default_context (),
+						     InputString, Length,
+						     &Number, &ErrorCode);
+		else if (Memo_m != NULL)
+			Result = calc_memo_eval_n (Memo_m, InputString, Length,
+						   &ErrorCode);
+		else
+			Result = evalform_n (&InputStringPtr, Length, &ErrorCode);
+		if (Trace_m != NULL)
+			calc_trace_end (Trace_m, calc_default_context (),
+					LineNumber_m, InputString, Length,
+					ErrorCode);
+
+		/*  A function defined has no value, and leaves % as it was  */
+		if (Definition && ErrorCode == NO_ERROR)
+			;
+		else if (Numeric_m != NUMERIC_double)
+			ReportNumber (Result, &Number, ErrorCode);
+		else
+			ReportResult (Result, ErrorCode);
+	}
+return (TRUE);
+}
+
+
+/*  Copy first word of line of Length bytes in upper case  */
+void
+FirstToken (char *InputString, size_t Length, char *TokenBuffer, int Size)
+{
+   char *InputStringPtr;
+   char *InputEnd;
+   char *TokenPtr;
+
+	/*  PASS FIRST SPACES  */
+	InputStringPtr = InputString;
+	InputEnd = InputString + Length;
+
+	while (InputStringPtr < InputEnd && *InputStringPtr == ' ')
+		InputStringPtr++;
+
+	/*  COPY NON-BLANK CHARACTERS  */
+	TokenPtr = TokenBuffer;
+	while (InputStringPtr < InputEnd &&
+	       !isspace (*InputStringPtr) && *InputStringPtr != 0 &&
+	       TokenPtr < TokenBuffer + Size - 1)
+		*(TokenPtr++) = toupper (*(InputStringPtr++));
+	*TokenPtr = 0;
+}
+
+
+/*  Copy what follows the first word of line, without surrounding spaces -
+    FALSE if that is nothing or an assignment, so the line is a formula  */
+int
+CommandArgument (char *InputString, size_t Length, char *Argument, int Size)
+{
+   char *InputStringPtr;
+   char *InputEnd;
+
+	/*  PASS FIRST SPACES AND WORD, THEN SPACES AGAIN  */
+	InputStringPtr = InputString;
+	InputEnd = InputString + Length;
+	while (InputStringPtr < InputEnd && *InputStringPtr == ' ')
+		InputStringPtr++;
+	while (InputStringPtr < InputEnd && !isspace (*InputStringPtr))
+		InputStringPtr++;
+	while (InputStringPtr < InputEnd && isspace (*InputStringPtr))
+		InputStringPtr++;
+	while (InputEnd > InputStringPtr && isspace (InputEnd[-1]))
+		InputEnd--;
+
+	if (InputStringPtr == InputEnd || *InputStringPtr == '=' ||
+	    InputEnd - InputStringPtr >= Size)
+		return (FALSE);
+	memcpy (Argument, InputStringPtr, InputEnd - InputStringPtr);
+	Argument[InputEnd - InputStringPtr] = '\0';
+	return (TRUE);
+}
+
+
+/*  Replace variables and functions by a snapshot - results cached and
+    variables copied to the threads are then out of date  */
+void
+LoadSnapshot (char *FileName)
+{
+   int ErrorCode;
+   int iworker;
+
+	ErrorCode = calc_snapshot_load (calc_default_context (), FileName);
+	if (ErrorCode != NO_ERROR)
+		fprintf (Listing_m, "%s\n", parsemsg (ErrorCode));
+
+	if (Memo_m != NULL) {
+		calc_memo_free (Memo_m);
+		Memo_m = calc_memo_new (calc_default_context (), MemoSize_m);
+	}
+	for (iworker = 0; Pool_m != NULL && iworker < calc_pool_size (Pool_m);
+	     iworker++)
+		calc_context_reset (Workers_m[iworker].Context);
+}
+
+
+/*  Print result of formula, or its error  */
+void
+ReportResult (double Result, int ErrorCode)
+{
+   char *ErrorMessage;
+
+	/*  Data - flushed every FlushInterval_m results  */
+	if (Output_m != NULL) {
+		calc_output_result (Output_m, LineNumber_m, ErrorCode, Result);
+		if (ErrorCode == NO_ERROR)
+			AssignVariable ("%", Result);
+		if (FlushInterval_m > 0 &&
+		    ++ResultsSinceFlush_m >= FlushInterval_m) {
+			calc_output_flush (Output_m);
+			ResultsSinceFlush_m = 0;
 		}
+		return;
+	}
+
+	if (ErrorCode == NO_ERROR) {
+		PrintNumber (stdout, Result);
+		EndResult ();
+		/*  Store this result as special variable %  */
+		AssignVariable ("%", Result);
+
+	/*  Error message  */
+	} else {
+		  ErrorMessage = parsemsg (ErrorCode);
+		  if (ErrorMessage == NULL)
+			  printf ("Unknown error.");
+		  else
+			  printf ("%s", ErrorMessage);
+		  EndResult ();
 	}
-	return (0);
+}
+
+
+/*  Print result in the arithmetic of -n to all its digits - data is
+    written as double  */
+void
+ReportNumber (double Result, const calc_number *Number, int ErrorCode)
+{
+   char Buffer[CALC_NUMBERTEXT];
+
+	if (Output_m != NULL || ErrorCode != NO_ERROR ||
+	    calc_number_format ((calc_numeric) Numeric_m, Number, Buffer,
+				sizeof(Buffer)) < 0) {
+		ReportResult (Result, ErrorCode);
+		if (ErrorCode == NO_ERROR)
+			calc_assign_number_r (calc_default_context (), "%",
+					      Number);
+		return;
+	}
+
+	fputs (Buffer, stdout);
+	EndResult ();
+	/*  Store this result as special variable %  */
+	calc_assign_number_r (calc_default_context (), "%", Number);
+}
+
+
+/*  End output of one result  */
+void
+EndResult (void)
+{
+   /*  Interactive - blank line after each result  */
+   if (!BatchMode_m)
+     {
+	printf ("\n\n");
+	fflush (stdout);
+	return;
+     }
+
+   /*  Batch - one line per result, flushed every FlushInterval_m lines  */
+   printf ("\n");
+   if (FlushInterval_m > 0 && ++ResultsSinceFlush_m >= FlushInterval_m)
+     {
+	fflush (stdout);
+	ResultsSinceFlush_m = 0;
+     }
+}
+
+
+/*  Read all of Input in large blocks and execute each line  */
+int
+RunBatch (FILE *Input)
+{
+   char *Buffer;
+   char *NewBuffer;
+   char *LineStart;
+   size_t BufferSize;
+   size_t Length;
+   size_t ReadLength;
+   int Continue;
+   int AtEnd;
+
+   BatchMode_m = TRUE;
+   setvbuf (stdout, NULL, _IOFBF, BATCHBLOCK);
+
+   BufferSize = BATCHBLOCK;
+   Buffer = (char *) malloc (BufferSize);
+   if (Buffer == NULL)
+     {
+	fprintf (stderr, "calc: out of memory\n");
+	return (1);
+     }
+
+   Length = 0;
+   Continue = TRUE;
+   AtEnd = FALSE;
+   while (Continue && !AtEnd)
+     {
+	/*  Grow buffer if a line fills all of it  */
+	if (Length >= BufferSize)
+	  {
+	     NewBuffer = (char *) realloc (Buffer, 2 * BufferSize);
+	     if (NewBuffer == NULL)
+	       {
+		  fprintf (stderr, "calc: line too long\n");
+		  break;
+	       }
+	     Buffer = NewBuffer;
+	     BufferSize *= 2;
+	  }
+
+	/*  Fill rest of buffer  */
+	ReadLength = fread (Buffer + Length, 1, BufferSize - Length, Input);
+	Length += ReadLength;
+	AtEnd = (ReadLength == 0);
+
+	/*  Execute complete lines  */
+	LineStart = ExecuteLines (Buffer, Buffer + Length, AtEnd, &Continue);
+
+	/*  Finish queued lines before their text is moved  */
+	if (Pool_m != NULL)
+	   RunQueuedLines ();
+
+	/*  Keep partial line for next block  */
+	Length -= LineStart - Buffer;
+	memmove (Buffer, LineStart, Length);
+     }
+
+   free (Buffer);
+   StopWorkers ();
+   return (EndBatch ());
+}
+
+
+/*  Execute each line of a file, evaluated in place in memory mapped
+    MAPWINDOW bytes at a time, so that files larger than memory pass
+    through without being copied  */
+int
+RunMapped (char *FileName)
+{
+   struct stat Status;
+   FILE *Input;
+   char *Window;
+   char *LineStart;
+   off_t Offset;
+   size_t WindowSize;
+   size_t Length;
+   size_t Skip;
+   size_t Used;
+   size_t PageSize;
+   int Continue;
+   int AtEnd;
+   int File;
+
+   File = open (FileName, O_RDONLY);
+   if (File < 0)
+     {
+	fprintf (stderr, "calc: cannot open %s\n", FileName);
+	return (1);
+     }
+
+   /*  Pipes and such cannot be mapped - read them like stdin  */
+   if (fstat (File, &Status) != 0 || !S_ISREG (Status.st_mode))
+     {
+	Input = fdopen (File, "r");
+	if (Input == NULL)
+	  {
+	     fprintf (stderr, "calc: cannot read %s\n", FileName);
+	     close (File);
+	     return (1);
+	  }
+	Continue = RunBatch (Input);
+	fclose (Input);
+	return (Continue);
+     }
+
+   BatchMode_m = TRUE;
+   setvbuf (stdout, NULL, _IOFBF, BATCHBLOCK);
+   PageSize = (size_t) sysconf (_SC_PAGESIZE);
+
+   /*  Window starts at Offset (a page boundary), next line at Skip  */
+   Offset = 0;
+   Skip = 0;
+   WindowSize = MAPWINDOW;
+   Continue = TRUE;
+   while (Continue && Offset + (off_t) Skip < Status.st_size)
+     {
+	AtEnd = (Status.st_size - Offset <= (off_t) WindowSize);
+	Length = AtEnd ? (size_t) (Status.st_size - Offset) : WindowSize;
+	Window = (char *) mmap (NULL, Length, PROT_READ, MAP_PRIVATE, File,
+				Offset);
+	if (Window == MAP_FAILED)
+	  {
+	     fprintf (stderr, "calc: cannot map %s\n", FileName);
+	     break;
+	  }
+	madvise (Window, Length, MADV_SEQUENTIAL);
+
+	LineStart = ExecuteLines (Window + Skip, Window + Length, AtEnd,
+				  &Continue);
+
+	/*  Finish queued lines before their text is unmapped  */
+	if (Pool_m != NULL)
+	   RunQueuedLines ();
+	munmap (Window, Length);
+
+	/*  Line longer than the window - map more of it at once  */
+	Used = LineStart - Window;
+	if (Used == Skip)
+	   WindowSize *= 2;
+	Offset += Used - Used % PageSize;
+	Skip = Used % PageSize;
+     }
+
+   close (File);
+   StopWorkers ();
+   return (EndBatch ());
+}
+
+
+/*  Write remaining output - return exit status  */
+int
+EndBatch (void)
+{
+   int Status;
+
+   Status = calc_output_free (Output_m);
+   Output_m = NULL;
+   if (fflush (stdout) != 0)
+      Status = EOF;
+   if (Status != 0)
+     {
+	fprintf (stderr, "calc: cannot write results\n");
+	EndTrace ();
+	return (1);
+     }
+   return (EndTrace ());
+}
+
+
+/*  Write rest of any trace - return exit status  */
+int
+EndTrace (void)
+{
+   int Status;
+
+   Status = calc_trace_close (Trace_m);
+   Trace_m = NULL;
+   if (Status != 0)
+     {
+	fprintf (stderr, "calc: cannot write trace\n");
+	return (1);
+     }
+   return (0);
+}
+
+
+/*  Execute (or queue) each line from Start to End; the last one only if
+    AtEnd, as it may go on past End.  Returns start of the first line not
+    executed  */
+char *
+ExecuteLines (char *Start, char *End, int AtEnd, int *Continue)
+{
+   char *LineEnd;
+   size_t Length;
+
+   while (*Continue && Start < End)
+     {
+	LineEnd = memchr (Start, '\n', End - Start);
+	if (LineEnd == NULL)
+	  {
+	     if (!AtEnd)
+		break;
+	     LineEnd = End;
+	  }
+	LineNumber_m++;
+	Length = LineEnd - Start;
+	if (Length > 0 && Start[Length - 1] == '\r')
+	   Length--;
+	if (Length > 0)
+	   *Continue = (Pool_m != NULL) ? QueueLine (Start, Length)
+				       : ExecuteLine (Start, Length);
+	Start = (LineEnd < End) ? LineEnd + 1 : End;
+     }
+   return (Start);
+}
+
+
+/*
+************************************************************************
+Parallel Batch Mode
+************************************************************************
+
+   Runs of lines that neither assign nor read % or defined variables
+   are queued and evaluated by a pool of threads, each in a context
+   mirroring the variables of evalform.  Results are then printed in
+   input order, and the variables each line created by reading them
+   are created as if the lines had run one at a time.  Any other line
+   first finishes the queue and then runs by itself, so it sees the
+   effect of every line before it.
+*/
+
+/*  Start pool of Threads workers, each with its own context  */
+int
+StartWorkers (int Threads)
+{
+   int iworker;
+
+   Pool_m = calc_pool_new (Threads);
+   Workers_m = (batchworker_t *) calloc (Threads, sizeof(batchworker_t));
+   if (Pool_m == NULL || Workers_m == NULL)
+     {
+	StopWorkers ();
+	return (FALSE);
+     }
+   for (iworker = 0; iworker < Threads; iworker++)
+     {
+	Workers_m[iworker].Context = calc_context_new ();
+	if (Workers_m[iworker].Context == NULL)
+	  {
+	     StopWorkers ();
+	     return (FALSE);
+	  }
+     }
+   return (TRUE);
+}
+
+
+void
+StopWorkers (void)
+{
+   int iworker;
+
+   if (Workers_m != NULL)
+     {
+	for (iworker = 0; Pool_m != NULL && iworker < calc_pool_size (Pool_m);
+	     iworker++)
+	  {
+	     calc_context_free (Workers_m[iworker].Context);
+	     free (Workers_m[iworker].Names);
+	  }
+	free (Workers_m);
+     }
+   calc_pool_free (Pool_m);
+   free (Queue_m);
+   Workers_m = NULL;
+   Pool_m = NULL;
+   Queue_m = NULL;
+   QueueLength_m = QueueSize_m = 0;
+}
+
+
+/*  Queue line, or finish the queue and run line if it depends on earlier
+    lines - return FALSE if program should end  */
+int
+QueueLine (char *InputString, size_t Length)
+{
+   batchline_t *NewQueue;
+   char TokenBuffer[80];
+   int Kind;
+
+   FirstToken (InputString, Length, TokenBuffer, sizeof(TokenBuffer));
+   if (IsComment (TokenBuffer, "#"))
+      Kind = LINE_comment;
+   else if (!strcmp (TokenBuffer, "HELP") || !strcmp (TokenBuffer, "LIST") ||
+	    !strcmp (TokenBuffer, "STATS") || !strcmp (TokenBuffer, "QUIT") ||
+	    !strcmp (TokenBuffer, "SAVE") || !strcmp (TokenBuffer, "LOAD") ||
+	    !IsIndependent (InputString, Length))
+     {
+	RunQueuedLines ();
+	return (ExecuteLine (InputString, Length));
+     }
+   else
+      Kind = LINE_formula;
+
+   if (QueueLength_m >= QueueSize_m)
+     {
+	NewQueue = (batchline_t *) realloc (Queue_m,
+		(QueueSize_m ? 2 * QueueSize_m : 1024) * sizeof(batchline_t));
+	if (NewQueue == NULL)
+	  {
+	     RunQueuedLines ();
+	     return (ExecuteLine (InputString, Length));
+	  }
+	Queue_m = NewQueue;
+	QueueSize_m = QueueSize_m ? 2 * QueueSize_m : 1024;
+     }
+   Queue_m[QueueLength_m].Text = InputString;
+   Queue_m[QueueLength_m].Length = Length;
+   Queue_m[QueueLength_m].LineNumber = LineNumber_m;
+   Queue_m[QueueLength_m].Kind = Kind;
+   QueueLength_m++;
+   return (TRUE);
+}
+
+
+/*  TRUE if formula neither assigns nor reads % or a defined variable,
+    directly or in the body of a function it calls, so that its result
+    does not depend on the lines run before it  */
+int
+IsIndependent (char *Formula, size_t Length)
+{
+   char Token[MAXTOKENLENGTH];
+   char *cptr;
+   char *End;
+   int TokenLength;
+   int VariableID;
+   int FunctionID;
+   calc_context *Context;
+
+   /*  Every name is checked, including any the parser would not reach  */
+   End = Formula + Length;
+   for (cptr = Formula; cptr < End && *cptr != '\0'; cptr += TokenLength)
+     {
+	if (*cptr == '=')
+	   return (FALSE);
+	TokenLength = GetBoundedTokenLength (cptr, End);
+	if (TokenLength == 0)
+	  {
+	     TokenLength = 1;
+	     continue;
+	  }
+	if (TokenLength >= MAXTOKENLENGTH)
+	   continue;
+	CopyUppercaseString (Token, cptr, TokenLength);
+	if (!strcmp (Token, "%"))
+	   return (FALSE);
+	Context = calc_default_context ();
+	VariableID = GetVariableID (Context, Token);
+	if (VariableID != NOTFOUND && listdef (VariableID) != NULL)
+	   return (FALSE);
+
+	/*  Bodies cannot call themselves, so this recursion ends  */
+	FunctionID = FindFunction (Context, Token);
+	if (FunctionID != NOTFOUND &&
+	    !IsIndependent (Context->Functions[FunctionID].Body,
+			    strlen (Context->Functions[FunctionID].Body)))
+	   return (FALSE);
+     }
+   return (TRUE);
+}
+
+
+/*  Evaluate queued lines on all threads, then report them in order  */
+void
+RunQueuedLines (void)
+{
+   calc_context *Context;
+   batchline_t *Line;
+   batchjob_t Job;
+   char *Name;
+   unsigned long LineNumber;
+   int Mirrored;
+   int iworker;
+   int iline;
+   int iname;
+
+   if (QueueLength_m == 0)
+      return;
+   Context = calc_default_context ();
+   LineNumber = LineNumber_m;
+
+   /*  Give every worker the current variables  */
+   Mirrored = (QueueLength_m >= MINPARALLEL);
+   for (iworker = 0; Mirrored && iworker < calc_pool_size (Pool_m); iworker++)
+     {
+	Mirrored = (calc_context_mirror (Workers_m[iworker].Context, Context)
+		    == NO_ERROR);
+	Workers_m[iworker].NamesLength = 0;
+     }
+
+   /*  Too few lines to gain from threads - run them here  */
+   if (!Mirrored)
+     {
+	for (iline = 0; iline < QueueLength_m; iline++)
+	  {
+	     LineNumber_m = Queue_m[iline].LineNumber;
+	     ExecuteLine (Queue_m[iline].Text, Queue_m[iline].Length);
+	  }
+	QueueLength_m = 0;
+	LineNumber_m = LineNumber;
+	return;
+     }
+
+   Job.Lines = Queue_m;
+   Job.NumberOfLines = QueueLength_m;
+   Job.Workers = Workers_m;
+   calc_pool_run (Pool_m, (QueueLength_m + CHUNKLINES - 1) / CHUNKLINES,
+		  EvaluateChunk, &Job);
+
+   /*  Report in input order, creating variables as lines would have  */
+   for (iline = 0; iline < QueueLength_m; iline++)
+     {
+	Line = Queue_m + iline;
+	if (Line->Kind == LINE_comment)
+	   continue;
+	LineNumber_m = Line->LineNumber;
+	if (Line->Worker == NOWORKER)
+	  {
+	     ExecuteLine (Line->Text, Line->Length);
+	     continue;
+	  }
+	Name = Workers_m[Line->Worker].Names + Line->Names;
+	for (iname = 0; iname < Line->NumberOfNames; iname++)
+	  {
+	     if (GetVariableID (Context, Name) == NOTFOUND)
+		AssignVariable (Name, 0.0);
+	     Name += strlen (Name) + 1;
+	  }
+	ReportResult (Line->Result, Line->ErrorCode);
+     }
+   QueueLength_m = 0;
+   LineNumber_m = LineNumber;
+}
+
+
+/*  Evaluate one chunk of the lines of Argument (a batchjob_t) on a
+    worker thread  */
+void
+EvaluateChunk (void *Argument, int Worker, int Chunk)
+{
+   batchjob_t *Job;
+   batchworker_t *State;
+   batchline_t *Line;
+   batchline_t *EndLine;
+   char *FormulaPtr;
+   char *Name;
+   char *NewNames;
+   double Value;
+   size_t Length;
+   int NumberOfVariables;
+   int ivar;
+
+   Job = (batchjob_t *) Argument;
+   State = Job->Workers + Worker;
+   Line = Job->Lines + Chunk * CHUNKLINES;
+   EndLine = Line + CHUNKLINES;
+   if (EndLine > Job->Lines + Job->NumberOfLines)
+      EndLine = Job->Lines + Job->NumberOfLines;
+
+   for (; Line < EndLine; Line++)
+     {
+	if (Line->Kind == LINE_comment)
+	   continue;
+	NumberOfVariables = calc_context_nvars (State->Context);
+	FormulaPtr = Line->Text;
+	Line->Result = evalform_rn (State->Context, &FormulaPtr, Line->Length,
+				    &Line->ErrorCode);
+	Line->Worker = Worker;
+	Line->Names = State->NamesLength;
+	Line->NumberOfNames = 0;
+
+	/*  Keep names of variables created by reading them, then remove
+	    them so that every line sees the variables as they were  */
+	for (ivar = NumberOfVariables;
+	     ivar < calc_context_nvars (State->Context); ivar++)
+	  {
+	     Name = listvar_r (State->Context, ivar, &Value);
+	     Length = strlen (Name) + 1;
+	     if (State->NamesLength + Length > State->NamesSize)
+	       {
+		  NewNames = (char *) realloc (State->Names,
+					       2 * State->NamesSize + Length);
+		  if (NewNames == NULL)
+		    {
+		       Line->Worker = NOWORKER;
+		       break;
+		    }
+		  State->Names = NewNames;
+		  State->NamesSize = 2 * State->NamesSize + Length;
+	       }
+	     memcpy (State->Names + State->NamesLength, Name, Length);
+	     State->NamesLength += Length;
+	     Line->NumberOfNames++;
+	  }
+	calc_context_rollback (State->Context, NumberOfVariables);
+     }
+}
+
+
+/*  Serve formulas at Address until stopped by a signal - exit status  */
+int
+RunServer (char *Address)
+{
+   int Threads;
+   int Result;
+
+   Threads = Threads_m;
+   if (Threads == 0)
+		Threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+   Server_m = calc_server_new (Address, Threads, MemoSize_m);
+   if (Server_m == NULL) {
+		fprintf (stderr, "calc: cannot listen at %s: %s\n", Address,
+			 strerror (errno));
+		return (1);
+	}
+   signal (SIGINT, StopServer);
+   signal (SIGTERM, StopServer);
+   Result = calc_server_run (Server_m);
+   if (Result != 0)
+		fprintf (stderr, "calc: server failed: %s\n", strerror (errno));
+   calc_server_free (Server_m);
+   Server_m = NULL;
+   return (Result != 0);
+}
+
+
+/*  Signal handler ending server mode  */
+void
+StopServer (int Signal)
+{
+   (void) Signal;
+   calc_server_stop (Server_m);
+}
+
+
+void
+PrintUsage (void)
+{
+   fprintf (stderr, "usage: calc [-b | -i] [-F lines] [-m formulas] [-j threads]\n");
+   fprintf (stderr, "            [-f file] [-o format] [-s address] [-n numeric]\n");
+   fprintf (stderr, "            [-t trace] [-T trace [-N formulas]]\n");
+   fprintf (stderr, "   -b        batch mode: no prompts, one result per line\n");
+   fprintf (stderr, "             (default when input is not a terminal)\n");
+   fprintf (stderr, "   -i        interactive mode\n");
+   fprintf (stderr, "   -F lines  in batch mode, flush output every 'lines' results\n");
+   fprintf (stderr, "             (default: only when the output buffer is full)\n");
+   fprintf (stderr, "   -m n      cache results of up to n formulas, 0 turns\n");
+   fprintf (stderr, "             the cache off (default: %d)\n", CALC_MEMOSIZE);
+   fprintf (stderr, "   -j n      in batch mode, evaluate independent lines on\n");
+   fprintf (stderr, "             n threads, 0 for one per processor (default: 1)\n");
+   fprintf (stderr, "   -f file   batch mode reading formulas from file, which is\n");
+   fprintf (stderr, "             mapped into memory instead of read\n");
+   fprintf (stderr, "   -o format in batch mode, write results as text (default),\n");
+   fprintf (stderr, "             binary (doubles), framed (line, error, value\n");
+   fprintf (stderr, "             records) or csv; other output goes to stderr\n");
+   fprintf (stderr, "   -s address serve formulas on a socket: a path for a Unix\n");
+   fprintf (stderr, "             socket, else [host:]port (host 127.0.0.1 unless\n");
+   fprintf (stderr, "             given); -j sets the number of event loops\n");
+   fprintf (stderr, "   -n numeric arithmetic of formulas: double (default), long\n");
+   fprintf (stderr, "             (long double) or fixed (decimal, 18 places); not\n");
+   fprintf (stderr, "             cached, threaded or served\n");
+   fprintf (stderr, "   -t trace  write the time, tokens, nesting and error of\n");
+   fprintf (stderr, "             each formula to file trace; not cached or threaded\n");
+   fprintf (stderr, "   -T trace  list the formulas of file trace that took longest\n");
+   fprintf (stderr, "   -N n      number of formulas listed by -T (default: %d)\n",
+	    CALC_TRACETOP);
 }
 
 /*
@@ -180,88 +1185,167 @@ Local Functions
 */
 
 void
-PrintNumber (double Value)
+PrintNumber (FILE *Stream, double Value)
 {
+   char Buffer[CALC_NUMBERSIZE];
+
    if (fabs (Value) < 1.0e-4)
-      printf ("%e", Value);
+      calc_format (Buffer, sizeof(Buffer), Value, 'e');
 
    else if (fabs (Value) > 1.0e4)
-      printf ("%e", Value);
+      calc_format (Buffer, sizeof(Buffer), Value, 'e');
 
    else
-      printf ("%f", Value);
+      calc_format (Buffer, sizeof(Buffer), Value, 'f');
+
+   fputs (Buffer, Stream);
 }
 
 
 void
 PrintHelp (void)
 {
+   const calc_builtin *Builtin;
+   char Constants[NBUF];
+   char Name[MAXTOKENLENGTH];
    int ifunc;
+   int ichar;
 
-   printf ("\n");
-   printf ("CALC    A Simple Calculator\n");
-   printf ("---------------------------\n");
-   printf ("\n");
-   printf ("   LIST - list current variables.\n");
-   printf ("   QUIT - end program.\n");
-   printf ("\n");
-   printf ("   BUILT-IN FUNCTIONS\n");
+   fprintf (Listing_m, "\n");
+   fprintf (Listing_m, "CALC    A Simple Calculator\n");
+   fprintf (Listing_m, "---------------------------\n");
+   fprintf (Listing_m, "\n");
+   fprintf (Listing_m, "   LIST - list current variables and functions.\n");
+   fprintf (Listing_m, "   STATS - show cache and evaluator statistics.\n");
+   fprintf (Listing_m, "   SAVE file - save variables and functions to file.\n");
+   fprintf (Listing_m, "   LOAD file - replace them by those saved in file.\n");
+   fprintf (Listing_m, "   QUIT - end program.\n");
+   fprintf (Listing_m, "\n");
+   fprintf (Listing_m, "   BUILT-IN FUNCTIONS\n");
    ifunc = 0;
-   while (FunctionNames_m[ifunc] != NULL)
+   Constants[0] = '\0';
+   for (Builtin = calc_builtins (); Builtin->Name != NULL; Builtin++)
      {
+	/*  Constants are listed with the operators below  */
+	if (Builtin->Kind == BUILTIN_constant)
+	  {
+	     strcat (Constants, Builtin->Name);
+	     strcat (Constants, " ");
+	     continue;
+	  }
+	for (ichar = 0; Builtin->Name[ichar] != '\0'; ichar++)
+	   Name[ichar] = tolower (Builtin->Name[ichar]);
+	Name[ichar] = '\0';
 	if (ifunc % 8 == 0)
-	   printf ("   ");
-	printf ("%-8s", FunctionNames_m[ifunc]);
+	   fprintf (Listing_m, "   ");
+	fprintf (Listing_m, "%-8s", Name);
 	ifunc++;
 	if (ifunc % 8 == 0)
-	   printf ("\n");
+	   fprintf (Listing_m, "\n");
      }
    if (ifunc % 8 != 0)
-      printf ("\n");
+      fprintf (Listing_m, "\n");
 
-   printf ("\n");
-   printf ("   OPERATORS AND SYMBOLS\n");
-   printf ("      + - * / ^ ( ) =    Mathematical operators\n");
-   printf ("      %%                  Stands for previous result\n");
-   printf ("      %%PI %%E             Constants pi and e\n");
-   printf ("      (variables)        Up to 128 of them\n");
+   fprintf (Listing_m, "\n");
+   fprintf (Listing_m, "   OPERATORS AND SYMBOLS\n");
+   fprintf (Listing_m, "      + - * / ^ ( ) =    Mathematical operators\n");
+   fprintf (Listing_m, "      :=                 Define variable by formula\n");
+   fprintf (Listing_m, "      ,                  Separates function arguments\n");
+   fprintf (Listing_m, "      f(x,y) = x*y+1     Define function by formula\n");
+   fprintf (Listing_m, "      %%                  Stands for previous result\n");
+   fprintf (Listing_m, "      %-19sBuilt-in constants e and pi\n", Constants);
+   fprintf (Listing_m, "      (variables)        Up to 1048576 of them\n");
 
 
-   printf ("\n");
-   printf ("   EXAMPLE\n");
-   printf ("      calc> x = 5\n");
-   printf ("         x = 5.000000\n");
-   printf ("      calc> 5*x^2\n");
-   printf ("         x = 125.000000\n");
-   printf ("      calc> (%% + 5) / 5\n");
-   printf ("         25.000000\n");
-   printf ("      calc> cos(%%pi/4)\n");
-   printf ("         0.707107\n");
-   printf ("      calc> exp(1.7)\n");
-   printf ("         5.473947\n");
-   printf ("      calc> %%e^1.7\n");
-   printf ("         5.473947\n");
-   printf ("\n");
-   fflush (stdout);
+   fprintf (Listing_m, "\n");
+   fprintf (Listing_m, "   EXAMPLE\n");
+   fprintf (Listing_m, "      calc> x = 5\n");
+   fprintf (Listing_m, "         x = 5.000000\n");
+   fprintf (Listing_m, "      calc> 5*x^2\n");
+   fprintf (Listing_m, "         x = 125.000000\n");
+   fprintf (Listing_m, "      calc> (%% + 5) / 5\n");
+   fprintf (Listing_m, "         25.000000\n");
+   fprintf (Listing_m, "      calc> cos(%%pi/4)\n");
+   fprintf (Listing_m, "         0.707107\n");
+   fprintf (Listing_m, "      calc> exp(1.7)\n");
+   fprintf (Listing_m, "         5.473947\n");
+   fprintf (Listing_m, "      calc> %%e^1.7\n");
+   fprintf (Listing_m, "         5.473947\n");
+   fprintf (Listing_m, "\n");
+   fflush (Listing_m);
 }
 
 void
 ListVariables (void)
 {
    int ivar;
+   int ifunc;
    char *VariableName;
+   char *Definition;
    double VariableValue;
 
-   printf ("CURRENT VARIABLES\n");
+   fprintf (Listing_m, "CURRENT VARIABLES\n");
    ivar = 0;
    while ((VariableName = listvar (ivar++, &VariableValue)) != NULL)
      {
-	printf ("   %s ", VariableName);
-	PrintNumber (VariableValue);
-	printf ("\n");
+	fprintf (Listing_m, "   %s ", VariableName);
+	PrintNumber (Listing_m, VariableValue);
+	if ((Definition = listdef (ivar-1)) != NULL)
+	   fprintf (Listing_m, "   := %s", Definition);
+	fprintf (Listing_m, "\n");
      }
-   printf ("\n");
-   fflush (stdout);
+   fprintf (Listing_m, "\n");
+
+   /*  Functions, which are listed only once one is defined  */
+   if ((Definition = listfunc (0)) != NULL)
+     {
+	fprintf (Listing_m, "CURRENT FUNCTIONS\n");
+	ifunc = 0;
+	while ((Definition = listfunc (ifunc++)) != NULL)
+	   fprintf (Listing_m, "   %s\n", Definition);
+	fprintf (Listing_m, "\n");
+     }
+   fflush (Listing_m);
+}
+
+void
+PrintStatistics (void)
+{
+   unsigned long Hits;
+   unsigned long Misses;
+   int Entries;
+   calc_stats Total;
+   calc_stats Stats;
+   int iworker;
+
+   fprintf (Listing_m, "CACHE STATISTICS\n");
+   if (Memo_m == NULL)
+      fprintf (Listing_m, "   cache is off\n");
+   else
+     {
+	calc_memo_stats (Memo_m, &Hits, &Misses, &Entries);
+	fprintf (Listing_m, "   hits      %lu\n", Hits);
+	fprintf (Listing_m, "   misses    %lu\n", Misses);
+	fprintf (Listing_m, "   formulas  %d of %d\n", Entries, MemoSize_m);
+     }
+   fprintf (Listing_m, "\n");
+
+   fprintf (Listing_m, "EVALUATOR STATISTICS\n");
+   if (!calc_stats_enabled ())
+      fprintf (Listing_m, "   not counted (build with -DCALC_STATS)\n");
+   else
+     {
+	calc_stats_get (calc_default_context (), &Total);
+	for (iworker = 0; Pool_m != NULL && iworker < calc_pool_size (Pool_m);
+	     iworker++)
+	  {
+	     calc_stats_get (Workers_m[iworker].Context, &Stats);
+	     calc_stats_add (&Total, &Stats);
+	  }
+	calc_stats_print (Listing_m, &Total);
+     }
+   fprintf (Listing_m, "\n");
+   fflush (Listing_m);
 }
 
 void
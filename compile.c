@@ -0,0 +1,1342 @@
+/*                                                                       */
+/*                                                                       */
+/*   FORMULA COMPILER                                                    */
+/*                                                                       */
+/*      USER CALLABLE ROUTINES                                           */
+/*                                                                       */
+/*        (1) calc_program *calc_compile (const char *f, int *err)       */
+/*                                                                       */
+/*            translates formula into a program that can be run          */
+/*            many times without parsing the text again.                 */
+/*                                                                       */
+/*            f      ASCII string containing formula.  Accepts the       */
+/*                   same syntax as evalform.                            */
+/*            *err   Returns 0 if OK, >0 for error.  Use value to        */
+/*                   call parsemsg for error message.  Returns NULL      */
+/*                   on error.                                           */
+/*                                                                       */
+/*            calc_compile_r (calc_context *c, const char *f, int *err)  */
+/*            compiles against the variables of context c instead of     */
+/*            those of evalform.                                         */
+/*                                                                       */
+/*        (2) double calc_run (calc_program *p, double *vars, int *err)  */
+/*                                                                       */
+/*            returns value of compiled formula.                         */
+/*                                                                       */
+/*            vars   value of each variable slot of the program          */
+/*                   (see calc_nslots and calc_slotname).  Assignments   */
+/*                   in the formula are stored back into vars.  If       */
+/*                   NULL, the variables of the context the program      */
+/*                   was compiled in are used.                           */
+/*            *err   Returns 0 if OK, >0 for error.                      */
+/*                                                                       */
+/*            After CALC_JITTHRESHOLD runs the program is translated     */
+/*            to native code where supported (see jit.c).                */
+/*                                                                       */
+/*        (3) int calc_nremoved (calc_program *p)                        */
+/*                                                                       */
+/*            returns number of instructions removed by the optimizer    */
+/*            (see optimize.c).                                          */
+/*                                                                       */
+/*        (4) void calc_free (calc_program *p)                           */
+/*                                                                       */
+/*            releases compiled formula.                                 */
+/*                                                                       */
+/*                                                                       */
+/*        PROGRAM FORMAT                                                 */
+/*                                                                       */
+/*          A program is a list of instructions in evaluation order.     */
+/*          Each instruction stores its result in its own register,      */
+/*          so running a program is one pass over the list.  Variable    */
+/*          names are resolved to slots when compiling.                  */
+/*          Numbers compiled for a context in another arithmetic         */
+/*          (numeric.c) also keep their text, numbered by A of their     */
+/*          OPC_Const, to be read to all the precision of that one.      */
+/*                                                                       */
+/*          Variables read after being assigned in the same formula      */
+/*          use the assigned register directly, so loads only ever       */
+/*          see the values passed to calc_run.                           */
+/*                                                                       */
+/*          Calls of defined functions are inlined: the formula of the   */
+/*          function is compiled in place of the call, reading the       */
+/*          registers of the arguments for its parameters (see           */
+/*          function.c).  A program keeps the functions as they were     */
+/*          when it was compiled.                                        */
+/*                                                                       */
+/*          A program first runs with IEEE arithmetic and no test        */
+/*          between instructions: a division by zero or a function       */
+/*          parameter outside its domain (see FunctionDomains in         */
+/*          parse.c) only sets a flag, and assignments wait until the    */
+/*          run is over.  Only a run that set the flag is done again     */
+/*          one checked instruction at a time.  That run stops at the    */
+/*          first error; assignments made before it are kept.  When      */
+/*          running with the variables of its context, the assignments   */
+/*          are undone instead and the formula text is handed to         */
+/*          evalform_r, so errors are reported exactly as evalform       */
+/*          reports them.  A program made by calc_derive has no text     */
+/*          and reports its errors directly.                             */
+/*                                                                       */
+/*          A program and everything it holds come from one arena of     */
+/*          its own (see arena.c), drawing on the pool of its            */
+/*          context's arena, so calc_free is a single release.  Large    */
+/*          temporaries of calc_run come from the context's arena.       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "parse.h"
+#include "compile.h"
+#include "builtin.h"
+#include "number.h"
+#include "numeric.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define NOREGISTER -1
+#define INITIALCODESIZE 32
+#define INITIALSLOTSIZE 8
+#define LOCALSLOTS 64
+#define MAXCOMPILEDEPTH 10000
+#define MAXINLINECODE 65536
+#define PROGRAMBLOCK 1024
+#define STEP_failed 1
+#define STEP_stored 2
+
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  DEFINED FUNCTION BEING INLINED, AND THE ONE WHOSE FORMULA CALLED IT  */
+typedef struct inline_s
+   {
+   int              FunctionID;
+   const calc_function *Function;
+   const int       *Registers;  /*  value of each parameter         */
+   struct inline_s *Outer;
+   } inline_t;
+
+/*  STATE OF FORMULA BEING COMPILED  */
+typedef struct
+   {
+   const char    *FormulaString;
+   char           TokenString[MAXTOKENLENGTH];
+   int            ParenthesisLevel;
+   errorcode_t    ErrorCode;
+   calc_context  *Context;
+   calc_program  *Program;
+   int           *SlotStore;    /*  register last assigned to slot  */
+   int            Depth;        /*  nesting of CompileFormula       */
+   inline_t      *Local;        /*  function being inlined, or NULL */
+   } compiler_t;
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static void  SkipWhiteSpace (const char **f);
+static int   GetSlot (compiler_t *Compiler, int VariableID);
+static int   Emit (compiler_t *Compiler, opcode_t Opcode, int A, int B,
+                   double Value);
+static int   AddLiteral (compiler_t *Compiler, const char *Text,
+                         size_t Length);
+static int   CompileFormula (compiler_t *Compiler,
+                             operator_t *PendingOperator);
+static int   CompileLevel (compiler_t *Compiler,
+                           operator_t *PendingOperator);
+static int   CompileCall (compiler_t *Compiler, function_t Function,
+                          int Defined, int Arity);
+static int   EmitFunction (compiler_t *Compiler, function_t Function,
+                           const int *Arguments);
+static int   InlineFunction (compiler_t *Compiler, int Defined,
+                             const int *Arguments);
+static calc_program *AllocateProgram (calc_context *Context,
+                                      const char *Formula, int CodeSize,
+                                      int SlotSize);
+static calc_program *NewProgram (calc_context *Context,
+                                 const char *Formula,
+                                 compiler_t *Compiler);
+static BOOLEAN RunUnchecked (const calc_program *Program,
+                             double *Registers, const double *Slots,
+                             BOOLEAN *Stored);
+static void  StoreResults (const calc_program *Program,
+                           const double *Registers, double *Slots,
+                           const double *Variables);
+static int   RunChecked (const calc_program *Program, double *Registers,
+                         double *Slots, const double *Variables,
+                         int *Executed);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+static void SkipWhiteSpace (const char **f)
+   {
+   while (**f==' ' || **f==9 || **f==10 || **f==13)
+      (*f)++;
+   }
+
+
+/*  RETURN SLOT OF VARIABLE - ADD ONE IF NOT YET USED BY PROGRAM  */
+static int GetSlot (compiler_t *Compiler, int VariableID)
+   {
+   calc_program *Program = Compiler->Program;
+   int           Slot;
+   int          *NewIDs;
+   int          *NewStore;
+
+   for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+      if (Program->VariableIDs[Slot] == VariableID)
+         return Slot;
+
+   /*  GROW SLOT LIST  */
+   if (Program->NumberOfSlots >= Program->SlotSize)
+      {
+      NewIDs = (int *) ArenaResize (&Program->Arena, Program->VariableIDs,
+                                    Program->SlotSize * sizeof(int),
+                                    2 * Program->SlotSize * sizeof(int));
+      if (NewIDs == NULL)
+         return NOREGISTER;
+      Program->VariableIDs = NewIDs;
+      NewStore = (int *) ArenaResize (&Program->Arena, Compiler->SlotStore,
+                                      Program->SlotSize * sizeof(int),
+                                      2 * Program->SlotSize * sizeof(int));
+      if (NewStore == NULL)
+         return NOREGISTER;
+      Compiler->SlotStore = NewStore;
+      Program->SlotSize *= 2;
+      }
+
+   Program->VariableIDs [ Program->NumberOfSlots ] = VariableID;
+   Compiler->SlotStore  [ Program->NumberOfSlots ] = NOREGISTER;
+   return Program->NumberOfSlots++;
+   }
+
+
+/*  APPEND INSTRUCTION - RETURN ITS REGISTER  */
+static int Emit (compiler_t *Compiler, opcode_t Opcode, int A, int B,
+                 double Value)
+   {
+   calc_program *Program = Compiler->Program;
+   calc_instr   *NewCode;
+   calc_instr   *Instr;
+
+   if (Program->CodeLength >= Program->CodeSize)
+      {
+      NewCode = (calc_instr *)
+         ArenaResize (&Program->Arena, Program->Code,
+                      Program->CodeSize * sizeof(calc_instr),
+                      2 * Program->CodeSize * sizeof(calc_instr));
+      if (NewCode == NULL)
+         {
+         Compiler->ErrorCode = ERROR_heap_full;
+         return NOREGISTER;
+         }
+      Program->Code = NewCode;
+      Program->CodeSize *= 2;
+      }
+
+   Instr = &Program->Code [ Program->CodeLength ];
+   Instr->Opcode = Opcode;
+   Instr->A      = A;
+   Instr->B      = B;
+   Instr->C      = 0;
+   Instr->Value  = Value;
+   return Program->CodeLength++;
+   }
+
+
+/*  KEEP TEXT OF A NUMBER - RETURNS ITS INDEX+1, OR 0 IF NO HEAP  */
+static int AddLiteral (compiler_t *Compiler, const char *Text,
+                       size_t Length)
+   {
+   calc_program *Program = Compiler->Program;
+   char        **NewLiterals;
+   char         *Copy;
+   int           NewSize;
+
+   if (Program->NumberOfLiterals >= Program->LiteralSize)
+      {
+      NewSize = Program->LiteralSize ? 2*Program->LiteralSize : 8;
+      NewLiterals = (char **)
+         ArenaResize (&Program->Arena, Program->Literals,
+                      Program->LiteralSize * sizeof(char *),
+                      NewSize * sizeof(char *));
+      if (NewLiterals == NULL)
+         {
+         Compiler->ErrorCode = ERROR_heap_full;
+         return 0;
+         }
+      Program->Literals    = NewLiterals;
+      Program->LiteralSize = NewSize;
+      }
+   Copy = (char *) ArenaAllocate (&Program->Arena, Length+1);
+   if (Copy == NULL)
+      {
+      Compiler->ErrorCode = ERROR_heap_full;
+      return 0;
+      }
+   memcpy (Copy, Text, Length);
+   Copy[Length] = '\0';
+   Program->Literals[Program->NumberOfLiterals] = Copy;
+   return ++Program->NumberOfLiterals;
+   }
+
+
+/*
+   Limits the recursion of CompileLevel.  evalform does not recurse
+   (see EvaluateFormula in parse.c), so formulas nested deeper than
+   this are still evaluated, just never compiled.
+*/
+static int CompileFormula (compiler_t *Compiler, operator_t *PendingOperator)
+   {
+   int Register;
+
+   if (Compiler->Depth >= MAXCOMPILEDEPTH)
+      {
+      Compiler->ErrorCode = ERROR_nesting;
+      return NOREGISTER;
+      }
+   Compiler->Depth++;
+   Register = CompileLevel (Compiler, PendingOperator);
+   Compiler->Depth--;
+   return Register;
+   }
+
+
+/*
+   Mirrors ParseFormula in parse.c, emitting instructions in the order
+   ParseFormula would evaluate them.  Returns the register holding the
+   value, or NOREGISTER on error.
+*/
+static int CompileLevel (compiler_t *Compiler, operator_t *PendingOperator)
+   {
+   operator_t CurrentOperator;
+   const calc_builtin *Builtin;
+   int        CurrentValue;
+   int        RightValue;
+   BOOLEAN    MinusSignPresent;
+   BOOLEAN    ApplyOperator;
+   int        VariableID;
+   int        Slot;
+   int        TokenLength;
+   int        Parameter;
+   int        Defined;
+   char      *NumberEnd;
+
+                              /*  PARSE VALUE  */
+
+   /*  INITIALIZE VARIABLE SLOT TO NONE   */
+   Slot = NOTFOUND;
+
+   /*  REMOVE OPENING WHITE SPACE   */
+   SkipWhiteSpace (&Compiler->FormulaString);
+
+   /*  CHECK FOR MINUS SIGN   */
+   MinusSignPresent = FALSE;
+   if (*Compiler->FormulaString=='-')
+      {
+      MinusSignPresent = TRUE;
+      Compiler->FormulaString++;
+      }
+
+   /*  .. OR PLUS SIGN   */
+   else if (*Compiler->FormulaString=='+')
+      Compiler->FormulaString++;
+
+
+   /*  GET VALUE -- PARENTHETICAL EXPRESSION .. */
+   if ( *Compiler->FormulaString=='(' )
+      {
+      Compiler->FormulaString++;
+      Compiler->ParenthesisLevel++;
+      CurrentOperator = OP_OpenParenthesis;
+      /*  OPERATOR SHOULD RETURN AS OP_CloseParenthesis ')'  */
+      CurrentValue = CompileFormula (Compiler, &CurrentOperator);
+      if ( Compiler->ErrorCode != ERROR_none )
+         return NOREGISTER;
+      /*  COMMAS ONLY SEPARATE FUNCTION ARGUMENTS  */
+      if (CurrentOperator==OP_Comma)
+         {
+         Compiler->ErrorCode = ERROR_operator;
+         return NOREGISTER;
+         }
+      if (CurrentOperator!=OP_CloseParenthesis)
+         {
+         Compiler->ErrorCode = ERROR_openparen;
+         return NOREGISTER;
+         }
+      }
+   /* .. GET VALUE -- CONSTANT  */
+   else if
+   (
+   (Compiler->FormulaString[0] >= '0' && Compiler->FormulaString[0] <= '9') ||
+   Compiler->FormulaString[0]=='.'
+   )
+      {
+      CurrentValue = Emit (Compiler, OPC_Const, 0, 0,
+                           calc_strtod (Compiler->FormulaString, &NumberEnd));
+      /*  OTHER ARITHMETIC READS THE NUMBER FROM ITS TEXT (numeric.c)  */
+      if (CurrentValue != NOREGISTER &&
+          Compiler->Context->Numeric != NUMERIC_double)
+         Compiler->Program->Code[CurrentValue].A =
+            AddLiteral (Compiler, Compiler->FormulaString,
+                        NumberEnd - Compiler->FormulaString);
+      Compiler->FormulaString = NumberEnd;
+      }
+   /* .. GET VALUE -- NAME (EITHER FUNCTION, VARIABLE, SPECIAL CONSTANT)   */
+   else
+      {
+      /*  SCAN NAME TOKEN IN FORMULA  */
+      TokenLength = GetNextTokenLength ( Compiler->FormulaString );
+      /*  .. ERROR - NO NAME TOKEN FOUND   */
+      if (TokenLength == 0)
+         {
+         Compiler->ErrorCode = ERROR_operand;
+         return NOREGISTER;
+         }
+      /*  .. ERROR - NAME TOKEN TOO LONG   */
+      if (TokenLength >= MAXTOKENLENGTH )
+         {
+         Compiler->ErrorCode = ERROR_variable_long;
+         return NOREGISTER;
+         }
+      /*  REMOVE LEADING NAME TOKEN FROM FORMULA  */
+      CopyUppercaseString (Compiler->TokenString, Compiler->FormulaString,
+                           TokenLength);
+      Compiler->FormulaString += TokenLength;
+      /*  COMPARE TOKEN TO BUILT-IN CONSTANTS AND FUNCTIONS  */
+      Builtin = FindBuiltin (Compiler->TokenString, TokenLength);
+      /*  SKIP WHITE SPACE  */
+      SkipWhiteSpace (&Compiler->FormulaString);
+      if (Builtin != NULL && Builtin->Kind == BUILTIN_constant)
+         CurrentValue = Emit (Compiler, OPC_Const, 0, 0, Builtin->Value);
+      /*  PARAMETER OF THE DEFINED FUNCTION BEING INLINED  */
+      else if (Builtin == NULL && Compiler->Local != NULL &&
+               (Parameter = FindParameter (Compiler->Local->Function,
+                                           Compiler->TokenString))
+               != NOTFOUND)
+         CurrentValue = Compiler->Local->Registers[Parameter];
+      /*  INTERPRET FUNCTIONS  */
+      else if (Builtin != NULL)
+         CurrentValue = CompileCall (Compiler, Builtin->Function,
+                                     NOTFOUND, Builtin->Arity);
+      else if (*Compiler->FormulaString=='(')
+         {
+         Defined = FindFunction (Compiler->Context, Compiler->TokenString);
+         if (Defined == NOTFOUND)
+            {
+            Compiler->ErrorCode = ERROR_function;
+            return NOREGISTER;
+            }
+         CurrentValue = CompileCall (Compiler, FUNC_err, Defined,
+             Compiler->Context->Functions[Defined].NumberOfParameters);
+         }
+      /*  GET VALUE ... VARIABLE  */
+      else
+         {
+         VariableID = GetVariableID (Compiler->Context,
+                                     Compiler->TokenString);
+         if (VariableID==NOTFOUND)
+            {
+            /*  CREATE VARIABLE - INITIALIZE TO ZERO   */
+            VariableID = AssignVariable_r (Compiler->Context,
+                                           Compiler->TokenString, 0.0);
+            if (VariableID == NOROOM)
+               /*  VARIABLE LIST FILLED  */
+               {
+               Compiler->ErrorCode = ERROR_variable_full;
+               return NOREGISTER;
+               }
+            else if (VariableID == NOHEAP )
+               /*  HEAP FILLED  */
+               {
+               Compiler->ErrorCode = ERROR_heap_full;
+               return NOREGISTER;
+               }
+            }
+         Slot = GetSlot (Compiler, VariableID);
+         if (Slot == NOREGISTER)
+            {
+            Compiler->ErrorCode = ERROR_heap_full;
+            return NOREGISTER;
+            }
+         /*  USE VALUE ASSIGNED EARLIER IN THIS FORMULA  */
+         if (Compiler->SlotStore[Slot] != NOREGISTER)
+            CurrentValue = Compiler->SlotStore[Slot];
+         else
+            CurrentValue = Emit (Compiler, OPC_Load, Slot, 0, 0.0);
+         }
+      }
+   if (Compiler->ErrorCode != ERROR_none)
+      return NOREGISTER;
+
+   /*  APPLY UNARY OPERATOR TO NUMBER */
+   if (MinusSignPresent)
+      CurrentValue = Emit (Compiler, OPC_Negate, CurrentValue, 0, 0.0);
+
+                             /*   PARSE OPERATOR  */
+
+   /* REMOVE LEADING WHITESPACE   */
+   SkipWhiteSpace (&Compiler->FormulaString);
+
+   /*  GET OPERATOR   */
+   switch (*Compiler->FormulaString) {
+      case '+' : CurrentOperator = OP_Add;                 break;
+      case '-' : CurrentOperator = OP_Subtract;            break;
+      case '*' : CurrentOperator = OP_Multiply;            break;
+      case '/' : CurrentOperator = OP_Divide;              break;
+      case '^' : CurrentOperator = OP_RaisePower;          break;
+      case ')' : CurrentOperator = OP_CloseParenthesis;    break;
+      case ',' : CurrentOperator = OP_Comma;               break;
+      case '=' : CurrentOperator = OP_Assignment;          break;
+      case '\0': CurrentOperator = OP_EndLine;             break;
+      default   : Compiler->ErrorCode = ERROR_operator;
+                 return NOREGISTER;
+   }
+   /*  increment pointer beyond operator (but not beyond end)  */
+   if (CurrentOperator != OP_EndLine)
+      ++Compiler->FormulaString;
+
+
+   /*  APPLY OPERATOR IF NO HIGHER PENDING OPERATORS   */
+   ApplyOperator = TRUE;
+   while (ApplyOperator)
+      {
+      /*  CRITERIA FOR APPLYING OPERATOR   */
+      if ( Compiler->ErrorCode == ERROR_none )
+         {
+         /*  EVALUATE REPEATING ASSIGNMENT OPERATORS RIGHT TO LEFT  */
+         if (CurrentOperator==OP_Assignment)
+            ApplyOperator = ( CurrentOperator >= *PendingOperator );
+         /*  ... OTHERWISE EVALUATE FROM LEFT TO RIGHT  */
+         else
+            ApplyOperator = ( CurrentOperator >  *PendingOperator );
+         }
+      else
+         return NOREGISTER;
+
+      if (ApplyOperator)
+         {
+         switch (CurrentOperator)
+            {
+            case OP_Add:
+               RightValue = CompileFormula (Compiler, &CurrentOperator);
+               CurrentValue = Emit (Compiler, OPC_Add,
+                                    CurrentValue, RightValue, 0.0);
+               break;
+            case OP_Subtract:
+               RightValue = CompileFormula (Compiler, &CurrentOperator);
+               CurrentValue = Emit (Compiler, OPC_Subtract,
+                                    CurrentValue, RightValue, 0.0);
+               break;
+            case OP_Multiply :
+               RightValue = CompileFormula (Compiler, &CurrentOperator);
+               CurrentValue = Emit (Compiler, OPC_Multiply,
+                                    CurrentValue, RightValue, 0.0);
+               break;
+            case OP_Divide :
+               RightValue = CompileFormula (Compiler, &CurrentOperator);
+               CurrentValue = Emit (Compiler, OPC_Divide,
+                                    CurrentValue, RightValue, 0.0);
+               break;
+            case OP_RaisePower:
+               RightValue = CompileFormula (Compiler, &CurrentOperator);
+               CurrentValue = Emit (Compiler, OPC_Power,
+                                    CurrentValue, RightValue, 0.0);
+               break;
+            case OP_CloseParenthesis :
+               Compiler->ParenthesisLevel--;
+               if ( Compiler->ParenthesisLevel<0 )
+                  Compiler->ErrorCode = ERROR_closeparen;
+               break;
+            /*  COMMA OUTSIDE FUNCTION ARGUMENTS  */
+            case OP_Comma :
+               Compiler->ErrorCode = ERROR_operator;
+               break;
+            case OP_Assignment:
+               if (Slot == NOTFOUND)
+                  {
+                  /*  VARIABLE EXPECTED  */
+                  Compiler->ErrorCode = ERROR_variable_expected;
+                  return NOREGISTER;
+                  }
+               RightValue = CompileFormula (Compiler, &CurrentOperator);
+               if (Compiler->ErrorCode != ERROR_none)
+                  return NOREGISTER;
+               CurrentValue = Emit (Compiler, OPC_Store,
+                                    Slot, RightValue, 0.0);
+               Compiler->SlotStore[Slot] = CurrentValue;
+               break;
+            default:
+               break;
+            }
+         }
+      }
+
+   *PendingOperator = CurrentOperator;
+   return (CurrentValue);
+   }
+
+
+/*
+   Compile arguments of call after the function name, then the call -
+   Defined is the defined function called, or NOTFOUND for built-in
+   Function.
+*/
+static int CompileCall (compiler_t *Compiler, function_t Function,
+                        int Defined, int Arity)
+   {
+   operator_t CurrentOperator;
+   int        Arguments[MAXARGUMENTS];
+   int        NumberOfArguments;
+
+   /*  MISSING OPERAND AFTER FUNCTION NAME  */
+   if (*Compiler->FormulaString!='(')
+      {
+      Compiler->ErrorCode = ERROR_operand;
+      return NOREGISTER;
+      }
+   Compiler->FormulaString++;
+   Compiler->ParenthesisLevel++;
+
+   /*  COMPILE ARGUMENTS, SEPARATED BY COMMAS  */
+   NumberOfArguments = 0;
+   do
+      {
+      CurrentOperator = OP_OpenParenthesis;
+      Arguments[NumberOfArguments] =
+         CompileFormula (Compiler, &CurrentOperator);
+      if (Compiler->ErrorCode != ERROR_none)
+         return NOREGISTER;
+      if (CurrentOperator == OP_Comma && NumberOfArguments+1 >= Arity)
+         {
+         Compiler->ErrorCode = ERROR_arguments;
+         return NOREGISTER;
+         }
+      NumberOfArguments++;
+      }
+   while (CurrentOperator == OP_Comma);
+   /*  IF NO CLOSE PARENTHESIS - RETURN ERROR  */
+   if (CurrentOperator!=OP_CloseParenthesis)
+      {
+      Compiler->ErrorCode = ERROR_openparen;
+      return NOREGISTER;
+      }
+   if (NumberOfArguments != Arity)
+      {
+      Compiler->ErrorCode = ERROR_arguments;
+      return NOREGISTER;
+      }
+
+   if (Defined != NOTFOUND)
+      return InlineFunction (Compiler, Defined, Arguments);
+   /*  EVALUATE FUNCTION WHEN PROGRAM RUNS  */
+   return EmitFunction (Compiler, Function, Arguments);
+   }
+
+
+/*  APPEND INSTRUCTION FOR BUILT-IN FUNCTION OF ARGUMENT REGISTERS  */
+static int EmitFunction (compiler_t *Compiler, function_t Function,
+                         const int *Arguments)
+   {
+   int Register;
+
+   switch (Function)
+      {
+      case FUNC_min:
+         return Emit (Compiler, OPC_Min, Arguments[0], Arguments[1], 0.0);
+      case FUNC_max:
+         return Emit (Compiler, OPC_Max, Arguments[0], Arguments[1], 0.0);
+      case FUNC_atan2:
+         return Emit (Compiler, OPC_Atan2, Arguments[0], Arguments[1], 0.0);
+      case FUNC_hypot:
+         return Emit (Compiler, OPC_Hypot, Arguments[0], Arguments[1], 0.0);
+      case FUNC_fma:
+         Register = Emit (Compiler, OPC_Fma, Arguments[0], Arguments[1],
+                          0.0);
+         if (Register != NOREGISTER)
+            Compiler->Program->Code[Register].C = Arguments[2];
+         return Register;
+      default:
+         return Emit (Compiler, OPC_Function, Arguments[0], Function, 0.0);
+      }
+   }
+
+
+/*
+   Compile formula of defined function in place of its call, with the
+   argument registers for its parameters.  A function that is already
+   being inlined would be inlined forever, so it is a cycle.
+*/
+static int InlineFunction (compiler_t *Compiler, int Defined,
+                           const int *Arguments)
+   {
+   inline_t    Inline;
+   inline_t   *Outer;
+   operator_t  CurrentOperator;
+   const char *ReturnString;
+   int         ReturnLevel;
+   int         Register;
+
+   for (Outer=Compiler->Local; Outer!=NULL; Outer=Outer->Outer)
+      if (Outer->FunctionID == Defined)
+         {
+         Compiler->ErrorCode = ERROR_cycle;
+         return NOREGISTER;
+         }
+   /*  ENOUGH CODE - FUNCTIONS CALLING OTHERS TWICE GROW EXPONENTIALLY  */
+   if (Compiler->Program->CodeLength > MAXINLINECODE)
+      {
+      Compiler->ErrorCode = ERROR_nesting;
+      return NOREGISTER;
+      }
+
+   Inline.FunctionID = Defined;
+   Inline.Function   = Compiler->Context->Functions + Defined;
+   Inline.Registers  = Arguments;
+   Inline.Outer      = Compiler->Local;
+   ReturnString = Compiler->FormulaString;
+   ReturnLevel  = Compiler->ParenthesisLevel;
+   Compiler->FormulaString    = Inline.Function->Body;
+   Compiler->ParenthesisLevel = 0;
+   Compiler->Local            = &Inline;
+
+   CurrentOperator = OP_BeginLine;
+   Register = CompileFormula (Compiler, &CurrentOperator);
+
+   Compiler->FormulaString    = ReturnString;
+   Compiler->ParenthesisLevel = ReturnLevel;
+   Compiler->Local            = Inline.Outer;
+   return Register;
+   }
+
+
+/*  EMPTY PROGRAM WITH ROOM FOR CODE AND SLOTS - NULL IF NO HEAP  */
+static calc_program *AllocateProgram (calc_context *Context,
+                                      const char *Formula, int CodeSize,
+                                      int SlotSize)
+   {
+   calc_program  *Program;
+   calc_arena     Arena;
+
+   /*  ALLOCATE EMPTY PROGRAM IN ITS OWN ARENA, FROM THE CONTEXT'S POOL  */
+   if (Context->Arena != NULL)
+      calc_arena_init (&Arena, Context->Arena->Allocate,
+                       Context->Arena->Release, Context->Arena->Pool);
+   else
+      calc_arena_init (&Arena, NULL, NULL, NULL);
+   Arena.BlockSize = PROGRAMBLOCK;
+   Program = (calc_program *) ArenaAllocate (&Arena, sizeof(calc_program));
+   if (Program == NULL)
+      {
+      calc_arena_free (&Arena);
+      return NULL;
+      }
+   memset (Program, 0, sizeof(calc_program));
+   Program->Arena   = Arena;
+   Program->Context = Context;
+   if (Formula != NULL)
+      Program->Formula = (char *) ArenaAllocate (&Program->Arena,
+                                                 strlen(Formula)+1);
+   Program->Code = (calc_instr *) ArenaAllocate
+      (&Program->Arena, CodeSize * sizeof(calc_instr));
+   Program->CodeSize = CodeSize;
+   Program->VariableIDs = (int *) ArenaAllocate
+      (&Program->Arena, SlotSize * sizeof(int));
+   Program->SlotSize = SlotSize;
+   if ((Formula != NULL && Program->Formula == NULL) ||
+       Program->Code == NULL || Program->VariableIDs == NULL)
+      {
+      calc_free (Program);
+      return NULL;
+      }
+   if (Formula != NULL)
+      strcpy (Program->Formula, Formula);
+   return Program;
+   }
+
+
+/*  EMPTY PROGRAM FOR FORMULA AND COMPILER STATE - NULL IF NO HEAP  */
+static calc_program *NewProgram (calc_context *Context, const char *Formula,
+                                 compiler_t *Compiler)
+   {
+   calc_program  *Program;
+
+   Program = AllocateProgram (Context, Formula, INITIALCODESIZE,
+                              INITIALSLOTSIZE);
+   if (Program == NULL)
+      return NULL;
+
+   /*  SET COMPILER STATE  */
+   Compiler->Context          = Context;
+   Compiler->FormulaString    = Formula;
+   Compiler->ParenthesisLevel = 0;
+   Compiler->ErrorCode        = ERROR_none;
+   Compiler->Depth            = 0;
+   Compiler->Local            = NULL;
+   Compiler->Program          = Program;
+   Compiler->SlotStore        = (int *) ArenaAllocate
+      (&Program->Arena, INITIALSLOTSIZE * sizeof(int));
+   if (Compiler->SlotStore == NULL)
+      Compiler->ErrorCode = ERROR_heap_full;
+   return Program;
+   }
+
+
+/*
+   ONE INSTRUCTION WITH IEEE ARITHMETIC AND NO BRANCH ON ERRORS, INTO *r.
+   RETURNS STEP_failed FOR A DIVISION BY ZERO OR A FUNCTION PARAMETER
+   OUTSIDE ITS DOMAIN, AND STEP_stored FOR A STORE, WHICH ONLY SETS ITS
+   REGISTER.
+*/
+static inline int StepUnchecked (const calc_instr *Instr, double *r,
+                                     const double *Registers,
+                                     const double *Slots,
+                                     const calc_domain *Domains)
+   {
+   const calc_domain *Domain;
+   double             x;
+
+   switch (Instr->Opcode)
+      {
+      case OPC_Const:
+         *r = Instr->Value;
+         break;
+      case OPC_Load:
+         *r = Slots[Instr->A];
+         break;
+      case OPC_Store:
+         *r = Registers[Instr->B];
+         return STEP_stored;
+      case OPC_Negate:
+         *r = -Registers[Instr->A];
+         break;
+      case OPC_Add:
+         *r = Registers[Instr->A] + Registers[Instr->B];
+         break;
+      case OPC_Subtract:
+         *r = Registers[Instr->A] - Registers[Instr->B];
+         break;
+      case OPC_Multiply:
+         *r = Registers[Instr->A] * Registers[Instr->B];
+         break;
+      case OPC_Divide:
+         *r = Registers[Instr->A] / Registers[Instr->B];
+         return (Registers[Instr->B] == 0.0) * STEP_failed;
+      case OPC_Power:
+         *r = pow (Registers[Instr->A], Registers[Instr->B]);
+         break;
+      case OPC_Function:
+         x = Registers[Instr->A];
+         Domain = &Domains[Instr->B];
+         *r = ApplyFunction ((function_t) Instr->B, x);
+         return ((x < Domain->Low) | (x > Domain->High)) * STEP_failed;
+      case OPC_Min:
+         *r = fmin (Registers[Instr->A], Registers[Instr->B]);
+         break;
+      case OPC_Max:
+         *r = fmax (Registers[Instr->A], Registers[Instr->B]);
+         break;
+      case OPC_Atan2:
+         *r = atan2 (Registers[Instr->A], Registers[Instr->B]);
+         break;
+      case OPC_Hypot:
+         *r = hypot (Registers[Instr->A], Registers[Instr->B]);
+         break;
+      case OPC_Fma:
+         *r = fma (Registers[Instr->A], Registers[Instr->B],
+                   Registers[Instr->C]);
+         break;
+      }
+   return 0;
+   }
+
+
+/*
+   RUN PROGRAM WITH StepUnchecked - TRUE IF ANY INSTRUCTION FAILED.
+   ASSIGNMENTS ARE LEFT TO StoreResults, SO THE SLOTS ARE UNCHANGED FOR
+   RunChecked; *Stored TELLS IF THERE ARE ANY.
+*/
+static BOOLEAN RunUnchecked (const calc_program *Program,
+                             double *Registers, const double *Slots,
+                             BOOLEAN *Stored)
+   {
+   const calc_domain *Domains;
+   const calc_instr  *Instr;
+   const calc_instr  *EndCode;
+   double            *r;
+   int                Steps;
+
+   Domains = FunctionDomains ();
+   Steps = 0;
+   r = Registers;
+   EndCode = Program->Code + Program->CodeLength;
+   for (Instr=Program->Code; Instr<EndCode; Instr++, r++)
+      Steps |= StepUnchecked (Instr, r, Registers, Slots, Domains);
+   *Stored = (Steps & STEP_stored) != 0;
+   return (Steps & STEP_failed) != 0;
+   }
+
+
+/*  MAKE THE ASSIGNMENTS OF A RUN OF RunUnchecked THAT DID NOT FAIL  */
+static void StoreResults (const calc_program *Program,
+                          const double *Registers, double *Slots,
+                          const double *Variables)
+   {
+   const calc_instr *Instr;
+   int               Register;
+
+   for (Register=0; Register<Program->CodeLength; Register++)
+      {
+      Instr = &Program->Code[Register];
+      if (Instr->Opcode != OPC_Store)
+         continue;
+      if (Variables == NULL)
+         SetVariableValue (Program->Context,
+                           Program->VariableIDs[Instr->A],
+                           Registers[Register]);
+      else
+         Slots[Instr->A] = Registers[Register];
+      }
+   }
+
+
+/*
+   RUN PROGRAM ONE CHECKED STEP AT A TIME, STOPPING AT THE FIRST ERROR.
+   RETURNS ITS CODE, OR ERROR_none.  *Executed IS THE NUMBER OF
+   INSTRUCTIONS THAT COMPLETED, SO ONLY THEIR STORES NEED UNDOING.
+*/
+static int RunChecked (const calc_program *Program, double *Registers,
+                       double *Slots, const double *Variables,
+                       int *Executed)
+   {
+   const calc_instr *Instr;
+   const calc_instr *EndCode;
+   double           *r;
+   int               ErrorCode;
+
+   ErrorCode = ERROR_none;
+   r = Registers;
+   EndCode = Program->Code + Program->CodeLength;
+   for (Instr=Program->Code; Instr<EndCode; Instr++, r++)
+      {
+      switch (Instr->Opcode)
+         {
+         case OPC_Const:
+            *r = Instr->Value;
+            break;
+         case OPC_Load:
+            *r = Slots[Instr->A];
+            break;
+         case OPC_Store:
+            *r = Registers[Instr->B];
+            if (Variables == NULL)
+               SetVariableValue (Program->Context,
+                                 Program->VariableIDs[Instr->A], *r);
+            else
+               Slots[Instr->A] = *r;
+            break;
+         case OPC_Negate:
+            *r = -Registers[Instr->A];
+            break;
+         case OPC_Add:
+            *r = Registers[Instr->A] + Registers[Instr->B];
+            break;
+         case OPC_Subtract:
+            *r = Registers[Instr->A] - Registers[Instr->B];
+            break;
+         case OPC_Multiply:
+            *r = Registers[Instr->A] * Registers[Instr->B];
+            break;
+         case OPC_Divide:
+            if (Registers[Instr->B] == 0)
+               ErrorCode = ERROR_division;
+            else
+               *r = Registers[Instr->A] / Registers[Instr->B];
+            break;
+         case OPC_Power:
+            *r = pow (Registers[Instr->A], Registers[Instr->B]);
+            break;
+         case OPC_Function:
+            if (!FunctionArgumentOk ((function_t) Instr->B,
+                                     Registers[Instr->A]))
+               ErrorCode = ERROR_parameter;
+            else
+               *r = ApplyFunction ((function_t) Instr->B,
+                                   Registers[Instr->A]);
+            break;
+         case OPC_Min:
+            *r = fmin (Registers[Instr->A], Registers[Instr->B]);
+            break;
+         case OPC_Max:
+            *r = fmax (Registers[Instr->A], Registers[Instr->B]);
+            break;
+         case OPC_Atan2:
+            *r = atan2 (Registers[Instr->A], Registers[Instr->B]);
+            break;
+         case OPC_Hypot:
+            *r = hypot (Registers[Instr->A], Registers[Instr->B]);
+            break;
+         case OPC_Fma:
+            *r = fma (Registers[Instr->A], Registers[Instr->B],
+                      Registers[Instr->C]);
+            break;
+         }
+      /*  STOP AT FIRST ERROR  */
+      if (ErrorCode != ERROR_none)
+         break;
+      }
+   *Executed = (int) (Instr - Program->Code);
+   return ErrorCode;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+calc_program *calc_compile (const char *Formula, int *ErrorResult)
+   {
+   return calc_compile_r (calc_default_context (), Formula, ErrorResult);
+   }
+
+
+calc_program *calc_compile_r (calc_context *Context, const char *Formula,
+                              int *ErrorResult)
+   {
+   compiler_t     Compiler;
+   calc_program  *Program;
+   operator_t     CurrentOperator;
+
+   Program = NewProgram (Context, Formula, &Compiler);
+   if (Program == NULL)
+      {
+      *ErrorResult = ERROR_heap_full;
+      return NULL;
+      }
+
+   /*  CALL COMPILING ROUTINE   */
+   if (Compiler.ErrorCode == ERROR_none)
+      {
+      CurrentOperator = OP_BeginLine;
+      Program->Result = CompileFormula (&Compiler, &CurrentOperator);
+      }
+   if (Compiler.ErrorCode == ERROR_none)
+      Program->NumberRemoved = OptimizeProgram (Program);
+   ArenaDiscard (&Program->Arena, Compiler.SlotStore);
+
+   *ErrorResult = (int) Compiler.ErrorCode;
+   if (Compiler.ErrorCode != ERROR_none)
+      {
+      calc_free (Program);
+      return NULL;
+      }
+   return Program;
+   }
+
+
+/*
+   Return error code of compiling the formula of a defined function,
+   with constant arguments - 0 if it can be called.  A formula calling
+   the function again, directly or through others, is ERROR_cycle.
+*/
+int CheckFunction (calc_context *Context, int FunctionID)
+   {
+   compiler_t     Compiler;
+   calc_program  *Program;
+   inline_t       Inline;
+   operator_t     CurrentOperator;
+   int            Arguments[MAXARGUMENTS];
+   int            ErrorCode;
+   int            iparam;
+
+   Inline.FunctionID = FunctionID;
+   Inline.Function   = Context->Functions + FunctionID;
+   Inline.Registers  = Arguments;
+   Inline.Outer      = NULL;
+   Program = NewProgram (Context, Inline.Function->Body, &Compiler);
+   if (Program == NULL)
+      return ERROR_heap_full;
+   for (iparam=0; iparam<Inline.Function->NumberOfParameters; iparam++)
+      Arguments[iparam] = Emit (&Compiler, OPC_Const, 0, 0, 0.0);
+
+   if (Compiler.ErrorCode == ERROR_none)
+      {
+      Compiler.Local  = &Inline;
+      CurrentOperator = OP_BeginLine;
+      CompileFormula (&Compiler, &CurrentOperator);
+      }
+   ArenaDiscard (&Program->Arena, Compiler.SlotStore);
+   ErrorCode = (int) Compiler.ErrorCode;
+   calc_free (Program);
+   return ErrorCode;
+   }
+
+
+/*
+   Return program with the given instructions and variable slots, as
+   they were in a program compiled earlier from Formula (see
+   snapshot.c) - NULL if no heap.  Nothing is compiled or optimized.
+   Formula is NULL for a program made from another (see derive.c).
+*/
+calc_program *RestoreProgram (calc_context *Context, const char *Formula,
+                              const calc_instr *Code, int CodeLength,
+                              const int *VariableIDs, int NumberOfSlots)
+   {
+   calc_program  *Program;
+
+   Program = AllocateProgram (Context, Formula,
+                              CodeLength > 0 ? CodeLength : 1,
+                              NumberOfSlots > 0 ? NumberOfSlots : 1);
+   if (Program == NULL)
+      return NULL;
+   memcpy (Program->Code, Code, CodeLength * sizeof(calc_instr));
+   Program->CodeLength = CodeLength;
+   memcpy (Program->VariableIDs, VariableIDs, NumberOfSlots * sizeof(int));
+   Program->NumberOfSlots = NumberOfSlots;
+   return Program;
+   }
+
+
+double calc_run (calc_program *Program, double *Variables,
+                 int *ErrorResult)
+   {
+   double      LocalRegisters[INITIALCODESIZE];
+   double      LocalSlots[LOCALSLOTS];
+   double     *Registers;
+   double     *Slots;
+   calc_instr *Instr;
+   calc_instr *EndCode;
+   double      Result;
+   char       *Formula;
+   int         Slot;
+   int         Executed;
+   BOOLEAN     InputFailed;
+   BOOLEAN     Stored;
+
+   *ErrorResult = ERROR_none;
+
+   /*  USE STACK STORAGE FOR SMALL PROGRAMS  */
+   Registers = LocalRegisters;
+   if (Program->CodeLength > INITIALCODESIZE)
+      {
+      Registers = (double *) ArenaAllocate
+         (Program->Context->Arena, Program->CodeLength * sizeof(double));
+      if (Registers == NULL)
+         {
+         *ErrorResult = ERROR_heap_full;
+         return 0.0;
+         }
+      }
+
+   /*  COPY VALUES OF CONTEXT VARIABLES INTO SLOTS  */
+   Slots = Variables;
+   if (Variables == NULL)
+      {
+      Slots = LocalSlots;
+      if (Program->NumberOfSlots > LOCALSLOTS)
+         Slots = (double *) ArenaAllocate
+            (Program->Context->Arena, Program->NumberOfSlots * sizeof(double));
+      if (Slots == NULL)
+         {
+         if (Registers != LocalRegisters)
+            ArenaRewind (Program->Context->Arena, Registers);
+         *ErrorResult = ERROR_heap_full;
+         return 0.0;
+         }
+      InputFailed = FALSE;
+      for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+         {
+         Slots[Slot] = GetVariableValue (Program->Context,
+                                         Program->VariableIDs[Slot]);
+         if (Program->Context->Definitions != NULL &&
+             VariableError (Program->Context, Program->VariableIDs[Slot]))
+            InputFailed = TRUE;
+         }
+
+      /*  DEFINED VARIABLE THAT FAILED - LET evalform REPORT IT  */
+      if (InputFailed)
+         {
+         if (Slots != LocalSlots)
+            ArenaRewind (Program->Context->Arena, Slots);
+         if (Registers != LocalRegisters)
+            ArenaRewind (Program->Context->Arena, Registers);
+         if (Program->Formula == NULL)
+            {
+            for (Slot=0; *ErrorResult == ERROR_none; Slot++)
+               *ErrorResult = VariableError (Program->Context,
+                                             Program->VariableIDs[Slot]);
+            return 0.0;
+            }
+         Formula = Program->Formula;
+         return evalform_r (Program->Context, &Formula, ErrorResult);
+         }
+      }
+
+   /*  HOT PROGRAMS RUN AS NATIVE CODE - NaN MEANS RUN INSTRUCTIONS  */
+   if (Program->Jit == NULL && Program->RunCount < CALC_JITTHRESHOLD &&
+       ++Program->RunCount == CALC_JITTHRESHOLD)
+      calc_jit (Program);
+   if (Program->Jit != NULL)
+      {
+      Result = Program->Jit (Slots);
+      if (!isnan (Result))
+         {
+         if (Slots != Variables && Slots != LocalSlots)
+            ArenaRewind (Program->Context->Arena, Slots);
+         if (Registers != LocalRegisters)
+            ArenaRewind (Program->Context->Arena, Registers);
+         return Result;
+         }
+      }
+
+   /*  RUN WITHOUT CHECKS - AGAIN WITH CHECKS ONLY IF AN OPERATION FAILED  */
+   Executed = Program->CodeLength;
+   if (!RunUnchecked (Program, Registers, Slots, &Stored))
+      {
+      if (Stored)
+         StoreResults (Program, Registers, Slots, Variables);
+      }
+   else
+      *ErrorResult = RunChecked (Program, Registers, Slots, Variables,
+                                 &Executed);
+
+   Result = 0.0;
+   if (*ErrorResult == ERROR_none)
+      Result = Registers[Program->Result];
+   /*  UNDO THE ASSIGNMENTS MADE BEFORE THE ERROR  */
+   else if (Variables == NULL && Program->Formula != NULL)
+      {
+      EndCode = Program->Code + Executed;
+      for (Instr=Program->Code; Instr<EndCode; Instr++)
+         if (Instr->Opcode == OPC_Store)
+            SetVariableValue (Program->Context,
+                              Program->VariableIDs[Instr->A],
+                              Slots[Instr->A]);
+      }
+
+   /*  RELEASE TEMPORARY STORAGE  */
+   if (Slots != Variables && Slots != LocalSlots)
+      ArenaRewind (Program->Context->Arena, Slots);
+   if (Registers != LocalRegisters)
+      ArenaRewind (Program->Context->Arena, Registers);
+
+   /*  LET evalform REPORT THE ERROR  */
+   if (*ErrorResult != ERROR_none && Variables == NULL &&
+       Program->Formula != NULL)
+      {
+      Formula = Program->Formula;
+      Result = evalform_r (Program->Context, &Formula, ErrorResult);
+      }
+   return Result;
+   }
+
+
+/*  RETURN NUMBER OF REGISTERS READ BY INSTRUCTION AND STORE THEM IN Operand  */
+int InstructionOperands (const calc_instr *Instr, int *Operand)
+   {
+   switch (Instr->Opcode)
+      {
+      case OPC_Const:
+      case OPC_Load:
+         return 0;
+      case OPC_Store:
+         Operand[0] = Instr->B;
+         return 1;
+      case OPC_Negate:
+      case OPC_Function:
+         Operand[0] = Instr->A;
+         return 1;
+      case OPC_Fma:
+         Operand[0] = Instr->A;
+         Operand[1] = Instr->B;
+         Operand[2] = Instr->C;
+         return 3;
+      default:
+         Operand[0] = Instr->A;
+         Operand[1] = Instr->B;
+         return 2;
+      }
+   }
+
+
+/*
+   RUN THE Count INSTRUCTIONS LISTED IN Select, IN THAT ORDER, AS calc_run
+   FIRST DOES - TRUE IF ANY FAILED.  THE LIST MAY NOT HOLD STORES.
+*/
+int RunSelected (const calc_program *Program, const int *Select, int Count,
+                 double *Registers, const double *Slots)
+   {
+   const calc_domain *Domains;
+   int                Steps;
+   int                iselect;
+
+   Domains = FunctionDomains ();
+   Steps = 0;
+   for (iselect=0; iselect<Count; iselect++)
+      Steps |= StepUnchecked (&Program->Code[Select[iselect]],
+                              &Registers[Select[iselect]], Registers, Slots,
+                              Domains);
+   return (Steps & STEP_failed) != 0;
+   }
+
+
+/*  RETURN NUMBER OF INSTRUCTIONS REMOVED BY THE OPTIMIZER  */
+int calc_nremoved (calc_program *Program)
+   {
+   return Program->NumberRemoved;
+   }
+
+
+int calc_nslots (calc_program *Program)
+   {
+   return Program->NumberOfSlots;
+   }
+
+
+/*  RETURN NAME OF VARIABLE IN SLOT  */
+char *calc_slotname (calc_program *Program, int Slot)
+   {
+   double Value;
+
+   if (Slot<0 || Slot>=Program->NumberOfSlots)
+      return (NULL);
+   return listvar_r (Program->Context, Program->VariableIDs[Slot], &Value);
+   }
+
+
+void calc_free (calc_program *Program)
+   {
+   calc_arena Arena;
+
+   if (Program == NULL)
+      return;
+   FreeNativeCode (Program);
+   Arena = Program->Arena;
+   calc_arena_free (&Arena);
+   }
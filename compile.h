@@ -0,0 +1,111 @@
+#ifndef __COMPILE_H
+#define __COMPILE_H
+
+#include "parse.h"
+
+/*  INSTRUCTIONS OF A COMPILED FORMULA  */
+typedef enum
+   {
+   OPC_Const,                   /*  r = Value - A: Literals[A-1]    */
+   OPC_Load,                    /*  r = vars[A]                     */
+   OPC_Store,                   /*  r = vars[A] = r[B]              */
+   OPC_Negate,                  /*  r = -r[A]                       */
+   OPC_Add,                     /*  r = r[A] + r[B]                 */
+   OPC_Subtract,                /*  r = r[A] - r[B]                 */
+   OPC_Multiply,                /*  r = r[A] * r[B]                 */
+   OPC_Divide,                  /*  r = r[A] / r[B]                 */
+   OPC_Power,                   /*  r = pow (r[A], r[B])            */
+   OPC_Function,                /*  r = function B (r[A])           */
+   OPC_Min,                     /*  r = fmin (r[A], r[B])           */
+   OPC_Max,                     /*  r = fmax (r[A], r[B])           */
+   OPC_Atan2,                   /*  r = atan2 (r[A], r[B])          */
+   OPC_Hypot,                   /*  r = hypot (r[A], r[B])          */
+   OPC_Fma                      /*  r = fma (r[A], r[B], r[C])      */
+   } opcode_t;
+
+/*
+   Every instruction writes its result to the register with the same
+   index as the instruction, so operands always refer to earlier
+   instructions.
+*/
+typedef struct
+   {
+   opcode_t  Opcode;
+   int       A;
+   int       B;
+   int       C;
+   double    Value;
+   } calc_instr;
+
+/*  NATIVE CODE OF A PROGRAM - RETURNS NaN ON ERROR  */
+typedef double (*calc_jitfn) (const double *vars);
+
+/*  RUNS OF calc_run BEFORE A PROGRAM IS TRANSLATED TO NATIVE CODE  */
+#ifndef CALC_JITTHRESHOLD
+#define CALC_JITTHRESHOLD 64
+#endif
+
+/*  MOST INSTRUCTIONS OF A PROGRAM TRANSLATED TO NATIVE CODE, WHOSE
+    REGISTERS ARE KEPT ON THE STACK - LONGER ONES ARE ONLY INTERPRETED  */
+#ifndef CALC_JITREGISTERS
+#define CALC_JITREGISTERS 8192
+#endif
+
+typedef struct calc_program
+   {
+   calc_context  *Context;      /*  context holding the variables   */
+   char          *Formula;      /*  source text, NULL if derived    */
+   calc_instr    *Code;         /*  instructions                    */
+   int            CodeLength;
+   int            CodeSize;     /*  allocated instructions          */
+   int            Result;       /*  register holding formula value  */
+   int           *VariableIDs;  /*  variable table ID of each slot  */
+   int            NumberOfSlots;
+   int            SlotSize;     /*  allocated slots                 */
+   int            NumberRemoved; /* instructions optimized away     */
+   int            RunCount;     /*  runs before native code         */
+   calc_jitfn     Jit;          /*  native code, or NULL            */
+   void          *JitCode;      /*  memory holding native code      */
+   size_t         JitCodeSize;
+   void          *Numbers;      /*  constants for numeric.c, or NULL */
+   char         **Literals;     /*  text of numbers, kept when not  */
+   int            NumberOfLiterals; /* compiling in double          */
+   int            LiteralSize;  /*  allocated texts                 */
+   int            NumbersNumeric; /* their calc_numeric             */
+   void          *Reduction;    /*  plan of parallel.c, or NULL     */
+   calc_arena     Arena;        /*  memory of program, incl. itself */
+   } calc_program;
+
+calc_program *calc_compile  (const char *formula, int *err);
+calc_program *calc_compile_r (calc_context *ctx, const char *formula,
+                              int *err);
+double        calc_run      (calc_program *prog, double *vars, int *err);
+int           calc_nslots   (calc_program *prog);
+int           calc_nremoved (calc_program *prog);
+calc_jitfn    calc_jit      (calc_program *prog);
+char         *calc_slotname (calc_program *prog, int slot);
+void          calc_free     (calc_program *prog);
+
+/*  Derivatives (see derive.c)  */
+calc_program *calc_derive   (calc_program *prog, int slot, int *err);
+double        calc_gradient (calc_program *prog, const double *vars,
+                             double *grad, int *err);
+
+/*  Shared by the compiler modules, define.c, snapshot.c and parallel.c  */
+#define MAXOPERANDS 3
+int           InstructionOperands (const calc_instr *Instr, int *Operand);
+int           RunSelected (const calc_program *Program, const int *Select,
+                           int Count, double *Registers, const double *Slots);
+int           OptimizeProgram (calc_program *Program);
+void          FreeNativeCode (calc_program *Program);
+int           CheckFunction (calc_context *Context, int FunctionID);
+calc_program *RestoreProgram (calc_context *Context, const char *Formula,
+                              const calc_instr *Code, int CodeLength,
+                              const int *VariableIDs, int NumberOfSlots);
+calc_program *GetDefinition (calc_context *Context, int VariableID,
+                             int *Dirty, int *ErrorResult);
+int           RestoreDefinition (calc_context *Context, int VariableID,
+                                 calc_program *Program, int Dirty,
+                                 int ErrorResult);
+
+#endif
@@ -0,0 +1,599 @@
+/*                                                                       */
+/*                                                                       */
+/*   DEFINED VARIABLES                                                   */
+/*                                                                       */
+/*      A defined variable keeps the formula it was defined with.        */
+/*      "a := b*2" makes A follow B: whenever B is set, A is marked      */
+/*      out of date and computed again the next time it is read.         */
+/*      Only variables downstream of the change are touched, and         */
+/*      only when read.                                                  */
+/*                                                                       */
+/*        (1) double DefineVariable (calc_context *c, char *name,        */
+/*                                   const char *f, int *err)            */
+/*                                                                       */
+/*            defines variable name by formula f and returns its         */
+/*            value.  f may not assign variables and may not depend      */
+/*            on name itself, directly or through other definitions.     */
+/*                                                                       */
+/*        (2) void RefreshVariable (calc_context *c, int id)             */
+/*                                                                       */
+/*            computes variable again if any of its inputs changed.      */
+/*            Called by GetVariableValue.                                */
+/*                                                                       */
+/*        (3) void VariableAssigned (calc_context *c, int id)            */
+/*                                                                       */
+/*            records that a value was assigned to variable.  Any        */
+/*            definition of the variable is dropped and everything       */
+/*            depending on it is marked out of date.                     */
+/*                                                                       */
+/*        (4) int VariableError (calc_context *c, int id)                */
+/*                                                                       */
+/*            returns error code of the last computation of a defined    */
+/*            variable, 0 if OK.  The value is 0 after an error.         */
+/*                                                                       */
+/*        (5) char *listdef_r (calc_context *c, int id)                  */
+/*                                                                       */
+/*            returns formula defining variable, or NULL.                */
+/*                                                                       */
+/*        (6) int RecompileDefinitions (calc_context *c)                 */
+/*                                                                       */
+/*            compiles every definition again, after a function it       */
+/*            may call was defined again (see function.c).  Returns      */
+/*            first error, 0 if OK; a definition that fails keeps its    */
+/*            old program.                                               */
+/*                                                                       */
+/*        (7) calc_program *GetDefinition (calc_context *c, int id,      */
+/*                                         int *dirty, int *err)         */
+/*                                                                       */
+/*            returns program defining variable, or NULL, with its       */
+/*            out-of-date flag and error (see snapshot.c).               */
+/*                                                                       */
+/*        (8) int RestoreDefinition (calc_context *c, int id,            */
+/*                                   calc_program *p, int dirty,         */
+/*                                   int err)                            */
+/*                                                                       */
+/*            makes p the definition of variable, which has none, as     */
+/*            it was when saved; nothing is computed or marked.  p       */
+/*            may only read variables with no definition or with one     */
+/*            already restored.  Returns FALSE if memory is exhausted,   */
+/*            after freeing p.                                           */
+/*                                                                       */
+/*        (9) void FreeDefinitions (calc_context *c)                     */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Every variable that is read by a definition lists the        */
+/*          variables defined from it.  Marking stops at variables       */
+/*          already out of date, since everything below them is out      */
+/*          of date too.  Marking also increments the version of the     */
+/*          variable so that cached results notice the change.           */
+/*                                                                       */
+/*          Both marking and computing walk the graph with their own     */
+/*          stack rather than by recursion, so long chains of            */
+/*          definitions do not exhaust the C stack.                      */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "parse.h"
+#include "compile.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define LOCALSLOTS 64
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  DEFINITION AND DEPENDENTS OF ONE VARIABLE  */
+struct calc_definition
+   {
+   calc_program  *Program;        /*  NULL unless variable is defined   */
+   int           *Dependents;     /*  variables defined from this one   */
+   int            NumberOfDependents;
+   int            DependentSize;
+   BOOLEAN        Dirty;          /*  inputs changed since computed     */
+   errorcode_t    Error;          /*  error of last computation         */
+   };
+
+/*  POSITION IN DEPTH-FIRST WALK  */
+typedef struct
+   {
+   int  VariableID;
+   int  Next;                     /*  next input or dependent to visit  */
+   } walk_t;
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static BOOLEAN  GrowDefinitions (calc_context *Context);
+static BOOLEAN  AddDependent (calc_context *Context, calc_definition *Input,
+                              int VariableID);
+static void     RemoveDependent (calc_definition *Input, int VariableID);
+static void     RemoveDefinition (calc_context *Context, int VariableID);
+static void     MarkDependents (calc_context *Context, int VariableID);
+static BOOLEAN  DependsOn (calc_context *Context, calc_program *Program,
+                           int VariableID);
+static void     ComputeVariable (calc_context *Context, int VariableID);
+static BOOLEAN  SetDefinition (calc_context *Context, int VariableID,
+                               calc_program *Program, int *ErrorResult);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  MAKE ROOM FOR A DEFINITION ENTRY FOR EVERY VARIABLE  */
+static BOOLEAN GrowDefinitions (calc_context *Context)
+   {
+   calc_definition *NewDefinitions;
+   int              NewSize;
+
+   NewSize = Context->Variables.NumberOfSymbols;
+   if (NewSize <= Context->DefinitionSize)
+      return TRUE;
+   if (NewSize < 2*Context->DefinitionSize)
+      NewSize = 2*Context->DefinitionSize;
+   NewDefinitions = (calc_definition *)
+      ArenaResize (Context->Arena, Context->Definitions,
+                   Context->DefinitionSize * sizeof(calc_definition),
+                   NewSize * sizeof(calc_definition));
+   if (NewDefinitions == NULL)
+      return FALSE;
+   memset (NewDefinitions + Context->DefinitionSize, 0,
+           (NewSize - Context->DefinitionSize) * sizeof(calc_definition));
+   Context->Definitions    = NewDefinitions;
+   Context->DefinitionSize = NewSize;
+   return TRUE;
+   }
+
+
+static BOOLEAN AddDependent (calc_context *Context, calc_definition *Input,
+                             int VariableID)
+   {
+   int *NewDependents;
+   int  NewSize;
+
+   if (Input->NumberOfDependents >= Input->DependentSize)
+      {
+      NewSize = Input->DependentSize ? 2*Input->DependentSize : 4;
+      NewDependents = (int *)
+         ArenaResize (Context->Arena, Input->Dependents,
+                      Input->DependentSize * sizeof(int),
+                      NewSize * sizeof(int));
+      if (NewDependents == NULL)
+         return FALSE;
+      Input->Dependents    = NewDependents;
+      Input->DependentSize = NewSize;
+      }
+   Input->Dependents[Input->NumberOfDependents++] = VariableID;
+   return TRUE;
+   }
+
+
+static void RemoveDependent (calc_definition *Input, int VariableID)
+   {
+   int idep;
+
+   for (idep=0; idep<Input->NumberOfDependents; idep++)
+      if (Input->Dependents[idep] == VariableID)
+         {
+         Input->Dependents[idep] =
+            Input->Dependents[--Input->NumberOfDependents];
+         return;
+         }
+   }
+
+
+/*  TURN DEFINED VARIABLE BACK INTO A PLAIN ONE  */
+static void RemoveDefinition (calc_context *Context, int VariableID)
+   {
+   calc_definition *Definition = Context->Definitions + VariableID;
+   int              Slot;
+
+   if (Definition->Program == NULL)
+      return;
+   for (Slot=0; Slot<Definition->Program->NumberOfSlots; Slot++)
+      RemoveDependent (Context->Definitions +
+                       Definition->Program->VariableIDs[Slot], VariableID);
+   calc_free (Definition->Program);
+   Definition->Program = NULL;
+   Definition->Dirty   = FALSE;
+   Definition->Error   = ERROR_none;
+   }
+
+
+/*  MARK EVERYTHING DOWNSTREAM OF VARIABLE OUT OF DATE  */
+static void MarkDependents (calc_context *Context, int VariableID)
+   {
+   calc_definition *Definition;
+   walk_t          *Stack;
+   int              Depth;
+   int              Dependent;
+
+   if (!Context->Definitions[VariableID].NumberOfDependents)
+      return;
+   Stack = (walk_t *) ArenaAllocate (Context->Arena,
+                                     Context->DefinitionSize * sizeof(walk_t));
+   if (Stack == NULL)
+      return;
+
+   Depth = 0;
+   Stack[0].VariableID = VariableID;
+   Stack[0].Next       = 0;
+   while (Depth >= 0)
+      {
+      Definition = Context->Definitions + Stack[Depth].VariableID;
+      if (Stack[Depth].Next >= Definition->NumberOfDependents)
+         {
+         Depth--;
+         continue;
+         }
+      Dependent = Definition->Dependents[Stack[Depth].Next++];
+      if (Context->Definitions[Dependent].Dirty)
+         continue;
+      Context->Definitions[Dependent].Dirty = TRUE;
+      Context->Variables.Versions[Dependent]++;
+      Depth++;
+      Stack[Depth].VariableID = Dependent;
+      Stack[Depth].Next       = 0;
+      }
+   ArenaRewind (Context->Arena, Stack);
+   }
+
+
+/*  TRUE IF PROGRAM READS VARIABLE, DIRECTLY OR THROUGH DEFINITIONS  */
+static BOOLEAN DependsOn (calc_context *Context, calc_program *Program,
+                          int VariableID)
+   {
+   calc_definition *Definition;
+   char            *Seen;
+   int             *Stack;
+   int              Depth;
+   int              Input;
+   int              Slot;
+   BOOLEAN          Found;
+
+   Seen  = (char *) ArenaAllocate (Context->Arena, Context->DefinitionSize);
+   Stack = (int *) ArenaAllocate (Context->Arena,
+                                  Context->DefinitionSize * sizeof(int));
+   if (Seen == NULL || Stack == NULL)
+      {
+      ArenaRewind (Context->Arena, Stack);
+      ArenaRewind (Context->Arena, Seen);
+      return TRUE;
+      }
+   memset (Seen, 0, Context->DefinitionSize);
+
+   Depth = 0;
+   for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+      if (!Seen[Program->VariableIDs[Slot]])
+         {
+         Seen[Program->VariableIDs[Slot]] = TRUE;
+         Stack[Depth++] = Program->VariableIDs[Slot];
+         }
+
+   Found = FALSE;
+   while (Depth > 0 && !Found)
+      {
+      Input = Stack[--Depth];
+      if (Input == VariableID)
+         Found = TRUE;
+      Definition = Context->Definitions + Input;
+      if (Definition->Program == NULL)
+         continue;
+      for (Slot=0; Slot<Definition->Program->NumberOfSlots; Slot++)
+         if (!Seen[Definition->Program->VariableIDs[Slot]])
+            {
+            Seen[Definition->Program->VariableIDs[Slot]] = TRUE;
+            Stack[Depth++] = Definition->Program->VariableIDs[Slot];
+            }
+      }
+   ArenaRewind (Context->Arena, Stack);
+   ArenaRewind (Context->Arena, Seen);
+   return Found;
+   }
+
+
+/*  RUN DEFINITION OF VARIABLE WHOSE INPUTS ARE ALL UP TO DATE  */
+static void ComputeVariable (calc_context *Context, int VariableID)
+   {
+   calc_definition *Definition = Context->Definitions + VariableID;
+   calc_program    *Program = Definition->Program;
+   double           LocalSlots[LOCALSLOTS];
+   double          *Slots;
+   double           Value;
+   int              Error;
+   int              Slot;
+
+   Slots = LocalSlots;
+   if (Program->NumberOfSlots > LOCALSLOTS)
+      Slots = (double *) ArenaAllocate
+         (Context->Arena, Program->NumberOfSlots * sizeof(double));
+   if (Slots == NULL)
+      {
+      Value = 0.0;
+      Error = ERROR_heap_full;
+      }
+   else
+      {
+      for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+         Slots[Slot] =
+            Context->Variables.Values[Program->VariableIDs[Slot]];
+      Value = calc_run (Program, Slots, &Error);
+      if (Slots != LocalSlots)
+         ArenaRewind (Context->Arena, Slots);
+      }
+
+   /*  AN INPUT WHICH FAILED MAKES THIS VARIABLE FAIL TOO  */
+   for (Slot=0; Slot<Program->NumberOfSlots && Error == ERROR_none; Slot++)
+      Error = Context->Definitions[Program->VariableIDs[Slot]].Error;
+
+   Context->Variables.Values[VariableID] =
+      (Error == ERROR_none) ? Value : 0.0;
+   Definition->Error = (errorcode_t) Error;
+   Definition->Dirty = FALSE;
+   }
+
+
+/*  MAKE PROGRAM THE DEFINITION OF VARIABLE - FALSE IF IT CANNOT BE  */
+static BOOLEAN SetDefinition (calc_context *Context, int VariableID,
+                              calc_program *Program, int *ErrorResult)
+   {
+   int Slot;
+
+   if (DependsOn (Context, Program, VariableID))
+      {
+      calc_free (Program);
+      *ErrorResult = ERROR_cycle;
+      return FALSE;
+      }
+
+   /*  REPLACE OLD DEFINITION  */
+   RemoveDefinition (Context, VariableID);
+   for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+      if (!AddDependent (Context,
+                         Context->Definitions + Program->VariableIDs[Slot],
+                         VariableID))
+         {
+         while (--Slot >= 0)
+            RemoveDependent (Context->Definitions +
+                             Program->VariableIDs[Slot], VariableID);
+         calc_free (Program);
+         *ErrorResult = ERROR_heap_full;
+         return FALSE;
+         }
+   Context->Definitions[VariableID].Program = Program;
+
+   /*  COMPUTE NOW SO ERRORS ARE REPORTED HERE  */
+   MarkDependents (Context, VariableID);
+   Context->Definitions[VariableID].Dirty = TRUE;
+   Context->Variables.Versions[VariableID]++;
+   RefreshVariable (Context, VariableID);
+   *ErrorResult = ERROR_none;
+   return TRUE;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+double DefineVariable (calc_context *Context, char *Name,
+                       const char *Formula, int *ErrorResult)
+   {
+   calc_program *Program;
+   int           VariableID;
+   int           iinstr;
+
+   Program = calc_compile_r (Context, Formula, ErrorResult);
+   if (Program == NULL)
+      return 0.0;
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      if (Program->Code[iinstr].Opcode == OPC_Store)
+         {
+         calc_free (Program);
+         *ErrorResult = ERROR_definition;
+         return 0.0;
+         }
+
+   /*  FIND OR CREATE VARIABLE  */
+   VariableID = GetVariableID (Context, Name);
+   if (VariableID == NOTFOUND)
+      VariableID = AddSymbol (&Context->Variables, Name, 0.0);
+   if (VariableID == NOROOM || VariableID == NOHEAP ||
+       !GrowDefinitions (Context))
+      {
+      calc_free (Program);
+      *ErrorResult = (VariableID == NOROOM) ? ERROR_variable_full
+                                            : ERROR_heap_full;
+      return 0.0;
+      }
+   if (!SetDefinition (Context, VariableID, Program, ErrorResult))
+      return 0.0;
+   *ErrorResult = (int) Context->Definitions[VariableID].Error;
+   return Context->Variables.Values[VariableID];
+   }
+
+
+/*  THE COMPILED FORMULA KEEPS ITS SOURCE, SO IT IS COMPILED FROM THERE  */
+int RecompileDefinitions (calc_context *Context)
+   {
+   calc_program *Program;
+   int           VariableID;
+   int           Error;
+   int           FirstError;
+
+   FirstError = ERROR_none;
+   for (VariableID=0; VariableID<Context->DefinitionSize; VariableID++)
+      {
+      if (Context->Definitions[VariableID].Program == NULL)
+         continue;
+      Program = calc_compile_r (Context,
+                                Context->Definitions[VariableID].Program
+                                ->Formula, &Error);
+      if (Program != NULL && !GrowDefinitions (Context))
+         {
+         calc_free (Program);
+         Program = NULL;
+         Error   = ERROR_heap_full;
+         }
+      if ((Program == NULL ||
+           !SetDefinition (Context, VariableID, Program, &Error)) &&
+          FirstError == ERROR_none)
+         FirstError = Error;
+      }
+   return FirstError;
+   }
+
+
+calc_program *GetDefinition (calc_context *Context, int VariableID,
+                             int *Dirty, int *ErrorResult)
+   {
+   calc_definition *Definition;
+
+   if (VariableID >= Context->DefinitionSize ||
+       Context->Definitions[VariableID].Program == NULL)
+      return NULL;
+   Definition   = Context->Definitions + VariableID;
+   *Dirty       = Definition->Dirty;
+   *ErrorResult = (int) Definition->Error;
+   return Definition->Program;
+   }
+
+
+/*  INPUTS COME FIRST, SO THERE IS NO CYCLE TO LOOK FOR  */
+int RestoreDefinition (calc_context *Context, int VariableID,
+                       calc_program *Program, int Dirty, int ErrorResult)
+   {
+   int Slot;
+
+   if (!GrowDefinitions (Context))
+      {
+      calc_free (Program);
+      return FALSE;
+      }
+   for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+      if (!AddDependent (Context,
+                         Context->Definitions + Program->VariableIDs[Slot],
+                         VariableID))
+         {
+         while (--Slot >= 0)
+            RemoveDependent (Context->Definitions +
+                             Program->VariableIDs[Slot], VariableID);
+         calc_free (Program);
+         return FALSE;
+         }
+   Context->Definitions[VariableID].Program = Program;
+   Context->Definitions[VariableID].Dirty   = Dirty ? TRUE : FALSE;
+   Context->Definitions[VariableID].Error   = (errorcode_t) ErrorResult;
+   return TRUE;
+   }
+
+
+void RefreshVariable (calc_context *Context, int VariableID)
+   {
+   calc_definition *Definition;
+   calc_program    *Program;
+   walk_t          *Stack;
+   int              Depth;
+   int              Input;
+
+   if (VariableID >= Context->DefinitionSize ||
+       !Context->Definitions[VariableID].Dirty)
+      return;
+   Stack = (walk_t *) ArenaAllocate (Context->Arena,
+                                     Context->DefinitionSize * sizeof(walk_t));
+   if (Stack == NULL)
+      return;
+
+   /*  COMPUTE OUT-OF-DATE INPUTS FIRST  */
+   Depth = 0;
+   Stack[0].VariableID = VariableID;
+   Stack[0].Next       = 0;
+   while (Depth >= 0)
+      {
+      Definition = Context->Definitions + Stack[Depth].VariableID;
+      Program    = Definition->Program;
+      if (Stack[Depth].Next < Program->NumberOfSlots)
+         {
+         Input = Program->VariableIDs[Stack[Depth].Next++];
+         if (Context->Definitions[Input].Dirty)
+            {
+            Depth++;
+            Stack[Depth].VariableID = Input;
+            Stack[Depth].Next       = 0;
+            }
+         continue;
+         }
+      ComputeVariable (Context, Stack[Depth].VariableID);
+      Depth--;
+      }
+   ArenaRewind (Context->Arena, Stack);
+   }
+
+
+void VariableAssigned (calc_context *Context, int VariableID)
+   {
+   if (VariableID >= Context->DefinitionSize)
+      return;
+   RemoveDefinition (Context, VariableID);
+   MarkDependents (Context, VariableID);
+   }
+
+
+int VariableError (calc_context *Context, int VariableID)
+   {
+   if (VariableID >= Context->DefinitionSize)
+      return ERROR_none;
+   return (int) Context->Definitions[VariableID].Error;
+   }
+
+
+char *listdef_r (calc_context *Context, int VariableID)
+   {
+   if (VariableID < 0 || VariableID >= Context->DefinitionSize ||
+       Context->Definitions[VariableID].Program == NULL)
+      return NULL;
+   return Context->Definitions[VariableID].Program->Formula;
+   }
+
+
+void FreeDefinitions (calc_context *Context)
+   {
+   int VariableID;
+
+   for (VariableID=0; VariableID<Context->DefinitionSize; VariableID++)
+      {
+      calc_free (Context->Definitions[VariableID].Program);
+      ArenaDiscard (Context->Arena,
+                    Context->Definitions[VariableID].Dependents);
+      }
+   ArenaDiscard (Context->Arena, Context->Definitions);
+   Context->Definitions    = NULL;
+   Context->DefinitionSize = 0;
+   }
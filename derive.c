@@ -0,0 +1,790 @@
+/*                                                                       */
+/*                                                                       */
+/*   DERIVATIVES OF COMPILED FORMULAS                                    */
+/*                                                                       */
+/*      USER CALLABLE ROUTINES                                           */
+/*                                                                       */
+/*        (1) calc_program *calc_derive (calc_program *p, int slot,      */
+/*                                       int *err)                       */
+/*                                                                       */
+/*            returns program computing the derivative of p by the       */
+/*            variable in slot, with the same slots as p (see            */
+/*            calc_nslots), so it is run with the same values.  The      */
+/*            derivative by a slot p does not have is 0.  Returns NULL   */
+/*            on error.                                                  */
+/*                                                                       */
+/*        (2) double calc_gradient (calc_program *p, const double *vars, */
+/*                                  double *grad, int *err)              */
+/*                                                                       */
+/*            returns value of p, like calc_run, and stores the          */
+/*            derivative by every slot in grad, in one pass over the     */
+/*            program and one back.  vars are the values of the slots,   */
+/*            or NULL for the variables of the context.  Assignments     */
+/*            in the formula are not stored.  On error grad is 0.        */
+/*                                                                       */
+/*                                                                       */
+/*        DERIVATIVES                                                    */
+/*                                                                       */
+/*          Every operator and built-in function is differentiated.      */
+/*          Where one is not smooth the derivative of the side taken     */
+/*          is used: 0 for int, the sign of x for abs (0 at 0), and for  */
+/*          min and max that of the argument chosen, or the mean of      */
+/*          both when they are equal.                                    */
+/*                                                                       */
+/*          A derivative that does not exist is an error, as it would    */
+/*          be when evaluating it: asin or acos at -1                    */
+/*          (ERROR_parameter), x^y with varying y and x <= 0             */
+/*          (ERROR_parameter), and atan2 (0,0) or hypot (0,0) of         */
+/*          varying arguments (ERROR_division).  Errors of the formula   */
+/*          itself are reported as calc_run reports them.                */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          calc_derive applies forward mode to the instructions: each   */
+/*          one is copied to the new program, followed by instructions   */
+/*          for its derivative from those of its operands.  Operands     */
+/*          not depending on the variable have no derivative             */
+/*          instructions at all.  The result is run through the          */
+/*          optimizer (see optimize.c), which folds constants and        */
+/*          drops what the derivative does not need; the program is      */
+/*          then run, translated to native code and vectorized like      */
+/*          any other.  It has no formula text, so errors are reported   */
+/*          directly rather than through evalform.                       */
+/*                                                                       */
+/*          calc_gradient applies reverse mode: one pass computes every  */
+/*          register and one pass back from the result accumulates the   */
+/*          derivative of the result by each register, so the whole      */
+/*          gradient costs a small multiple of one run whatever the      */
+/*          number of variables.                                         */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "parse.h"
+#include "compile.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define ZERO -1                 /*  derivative known to be 0         */
+#define LOCALREGISTERS 64
+#define TINIEST 4.9406564584124654e-324  /*  smallest positive double  */
+#ifndef M_LN10
+#define M_LN10 2.30258509299404568402
+#endif
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  DERIVATIVE BEING BUILT  */
+typedef struct
+   {
+   calc_program  *Program;
+   int           *Map;          /*  register of each source value   */
+   int           *Derivative;   /*  its derivative register, or ZERO */
+   BOOLEAN        Failed;       /*  no heap                         */
+   } deriver_t;
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static int   Emit (deriver_t *Deriver, opcode_t Opcode, int A, int B,
+                   double Value);
+static int   Constant (deriver_t *Deriver, double Value);
+static int   Apply (deriver_t *Deriver, function_t Function, int A);
+static int   Sum (deriver_t *Deriver, int A, int B);
+static int   Difference (deriver_t *Deriver, int A, int B);
+static int   Product (deriver_t *Deriver, int A, int B);
+static int   Quotient (deriver_t *Deriver, int A, int B);
+static int   Sign (deriver_t *Deriver, int A);
+static int   DeriveFunction (deriver_t *Deriver, function_t Function,
+                             int a, int r, int dA);
+static int   DeriveInstruction (deriver_t *Deriver, const calc_instr *Instr,
+                                int Register, int Slot);
+static int   GradientError (const calc_instr *Instr, const double *Registers,
+                            const BOOLEAN *Varies);
+static double FunctionSlope (function_t Function, double a, double r);
+static void  Backpropagate (const calc_instr *Instr, const double *Registers,
+                            int Register, double *Adjoints, double *Gradient);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  APPEND INSTRUCTION AND RETURN ITS REGISTER  */
+static int Emit (deriver_t *Deriver, opcode_t Opcode, int A, int B,
+                 double Value)
+   {
+   calc_program *Program = Deriver->Program;
+   calc_instr   *NewCode;
+   calc_instr   *Instr;
+
+   if (Deriver->Failed)
+      return 0;
+   if (Program->CodeLength >= Program->CodeSize)
+      {
+      NewCode = (calc_instr *)
+         ArenaResize (&Program->Arena, Program->Code,
+                      Program->CodeSize * sizeof(calc_instr),
+                      2 * Program->CodeSize * sizeof(calc_instr));
+      if (NewCode == NULL)
+         {
+         Deriver->Failed = TRUE;
+         return 0;
+         }
+      Program->Code      = NewCode;
+      Program->CodeSize *= 2;
+      }
+   Instr = Program->Code + Program->CodeLength;
+   Instr->Opcode = Opcode;
+   Instr->A      = A;
+   Instr->B      = B;
+   Instr->C      = 0;
+   Instr->Value  = Value;
+   return Program->CodeLength++;
+   }
+
+
+static int Constant (deriver_t *Deriver, double Value)
+   {
+   return Emit (Deriver, OPC_Const, 0, 0, Value);
+   }
+
+
+static int Apply (deriver_t *Deriver, function_t Function, int A)
+   {
+   return Emit (Deriver, OPC_Function, A, (int) Function, 0.0);
+   }
+
+
+/*  ARITHMETIC ON DERIVATIVES - ZERO OPERANDS EMIT NOTHING  */
+static int Sum (deriver_t *Deriver, int A, int B)
+   {
+   if (A == ZERO)
+      return B;
+   if (B == ZERO)
+      return A;
+   return Emit (Deriver, OPC_Add, A, B, 0.0);
+   }
+
+
+static int Difference (deriver_t *Deriver, int A, int B)
+   {
+   if (B == ZERO)
+      return A;
+   if (A == ZERO)
+      return Emit (Deriver, OPC_Negate, B, 0, 0.0);
+   return Emit (Deriver, OPC_Subtract, A, B, 0.0);
+   }
+
+
+static int Product (deriver_t *Deriver, int A, int B)
+   {
+   if (A == ZERO || B == ZERO)
+      return ZERO;
+   return Emit (Deriver, OPC_Multiply, A, B, 0.0);
+   }
+
+
+/*  B IS NEVER ZERO  */
+static int Quotient (deriver_t *Deriver, int A, int B)
+   {
+   if (A == ZERO)
+      return ZERO;
+   return Emit (Deriver, OPC_Divide, A, B, 0.0);
+   }
+
+
+/*  -1, 0 OR 1 - THE DIVISOR IS NEVER 0 AND x/x IS EXACTLY 1  */
+static int Sign (deriver_t *Deriver, int A)
+   {
+   return Emit (Deriver, OPC_Divide, A,
+                Emit (Deriver, OPC_Max, Apply (Deriver, FUNC_fabs, A),
+                      Constant (Deriver, TINIEST), 0.0),
+                0.0);
+   }
+
+
+/*  DERIVATIVE OF r = Function (a), WHOSE ARGUMENT HAS DERIVATIVE dA  */
+static int DeriveFunction (deriver_t *Deriver, function_t Function,
+                           int a, int r, int dA)
+   {
+   int One;
+
+   if (dA == ZERO)
+      return ZERO;
+   One = Constant (Deriver, 1.0);
+   switch (Function)
+      {
+      case FUNC_sin:
+         return Product (Deriver, dA, Apply (Deriver, FUNC_cos, a));
+      case FUNC_cos:
+         return Difference (Deriver, ZERO,
+                            Product (Deriver, dA,
+                                     Apply (Deriver, FUNC_sin, a)));
+      case FUNC_tan:
+         return Product (Deriver, dA,
+                         Sum (Deriver, One, Product (Deriver, r, r)));
+      case FUNC_exp:
+         return Product (Deriver, dA, r);
+      case FUNC_log:
+         return Quotient (Deriver, dA, a);
+      case FUNC_log10:
+         return Quotient (Deriver, dA,
+                          Product (Deriver, a,
+                                   Constant (Deriver, M_LN10)));
+      case FUNC_fabs:
+         return Product (Deriver, dA, Sign (Deriver, a));
+      case FUNC_acos:
+      case FUNC_asin:
+         dA = Quotient (Deriver, dA,
+                        Apply (Deriver, FUNC_sqrt,
+                               Difference (Deriver, One,
+                                           Product (Deriver, a, a))));
+         return (Function == FUNC_acos) ? Difference (Deriver, ZERO, dA)
+                                        : dA;
+      case FUNC_atan:
+         return Quotient (Deriver, dA,
+                          Sum (Deriver, One, Product (Deriver, a, a)));
+      case FUNC_sqrt:
+         return Quotient (Deriver, dA,
+                          Product (Deriver, Constant (Deriver, 2.0), r));
+      default:
+         return ZERO;
+      }
+   }
+
+
+/*  DERIVATIVE OF INSTRUCTION WHOSE VALUE IS IN Register, BY Slot  */
+static int DeriveInstruction (deriver_t *Deriver, const calc_instr *Instr,
+                              int Register, int Slot)
+   {
+   const int *Map = Deriver->Map;
+   const int *D = Deriver->Derivative;
+   int        Operand[MAXOPERANDS];
+   int        NumberOfOperands;
+   int        a, b, dA, dB;
+   int        Term;
+   int        Half;
+   int        Side;
+   int        WeightA;
+   int        WeightB;
+
+   /*  REGISTERS OF OPERANDS IN THE NEW PROGRAM, AND THEIR DERIVATIVES  */
+   NumberOfOperands = InstructionOperands (Instr, Operand);
+   a  = (NumberOfOperands > 0) ? Map[Operand[0]] : 0;
+   dA = (NumberOfOperands > 0) ? D[Operand[0]] : ZERO;
+   b  = (NumberOfOperands > 1) ? Map[Operand[1]] : 0;
+   dB = (NumberOfOperands > 1) ? D[Operand[1]] : ZERO;
+   switch (Instr->Opcode)
+      {
+      case OPC_Const:
+         return ZERO;
+      case OPC_Load:
+         return (Instr->A == Slot) ? Constant (Deriver, 1.0) : ZERO;
+      case OPC_Negate:
+         return Difference (Deriver, ZERO, dA);
+      case OPC_Add:
+         return Sum (Deriver, dA, dB);
+      case OPC_Subtract:
+         return Difference (Deriver, dA, dB);
+      case OPC_Multiply:
+         return Sum (Deriver, Product (Deriver, dA, b),
+                     Product (Deriver, a, dB));
+      case OPC_Divide:
+         return Quotient (Deriver,
+                          Difference (Deriver, dA,
+                                      Product (Deriver, Register, dB)),
+                          b);
+      case OPC_Power:
+         /*  b * a^(b-1) da + a^b log(a) db - log ONLY IF NEEDED  */
+         Term = ZERO;
+         if (dA != ZERO)
+            Term = Product (Deriver, dA,
+                            Product (Deriver, b,
+                                     Emit (Deriver, OPC_Power, a,
+                                           Difference (Deriver, b,
+                                              Constant (Deriver, 1.0)),
+                                           0.0)));
+         if (dB != ZERO)
+            Term = Sum (Deriver, Term,
+                        Product (Deriver, dB,
+                                 Product (Deriver, Register,
+                                          Apply (Deriver, FUNC_log, a))));
+         return Term;
+      case OPC_Function:
+         return DeriveFunction (Deriver, (function_t) Instr->B, a, Register,
+                                dA);
+      case OPC_Min:
+      case OPC_Max:
+         /*  EACH WEIGHTED 1 OR 0 BY THE SIDE CHOSEN, OR 1/2 IF EQUAL - NOT
+             MIXED, SO A LARGE dB DOES NOT SWALLOW THE dA CHOSEN  */
+         if (dA == ZERO && dB == ZERO)
+            return ZERO;
+         Half    = Constant (Deriver, 0.5);
+         Side    = Product (Deriver, Sign (Deriver,
+                                           Difference (Deriver, b, a)),
+                            Half);
+         WeightA = (Instr->Opcode == OPC_Min) ? Sum (Deriver, Half, Side)
+                                              : Difference (Deriver, Half,
+                                                            Side);
+         WeightB = (Instr->Opcode == OPC_Min) ? Difference (Deriver, Half,
+                                                            Side)
+                                              : Sum (Deriver, Half, Side);
+         return Sum (Deriver, Product (Deriver, dA, WeightA),
+                     Product (Deriver, dB, WeightB));
+      case OPC_Atan2:
+         return Quotient (Deriver,
+                          Difference (Deriver, Product (Deriver, dA, b),
+                                      Product (Deriver, a, dB)),
+                          Sum (Deriver, Product (Deriver, a, a),
+                               Product (Deriver, b, b)));
+      case OPC_Hypot:
+         return Quotient (Deriver,
+                          Sum (Deriver, Product (Deriver, a, dA),
+                               Product (Deriver, b, dB)),
+                          Register);
+      case OPC_Fma:
+         return Sum (Deriver,
+                     Sum (Deriver, Product (Deriver, dA, b),
+                          Product (Deriver, a, dB)),
+                     D[Operand[2]]);
+      default:
+         return ZERO;
+      }
+   }
+
+
+/*  ERROR OF A DERIVATIVE THAT DOES NOT EXIST, 0 IF IT DOES  */
+static int GradientError (const calc_instr *Instr, const double *Registers,
+                          const BOOLEAN *Varies)
+   {
+   double a;
+   double b;
+
+   switch (Instr->Opcode)
+      {
+      case OPC_Power:
+         if (Varies[Instr->B] && Registers[Instr->A] <= 0.0)
+            return ERROR_parameter;
+         break;
+      case OPC_Function:
+         a = Registers[Instr->A];
+         if (Varies[Instr->A] && (Instr->B == FUNC_acos ||
+                                  Instr->B == FUNC_asin) &&
+             1.0 - a*a <= 0.0)
+            return ERROR_parameter;
+         break;
+      case OPC_Atan2:
+      case OPC_Hypot:
+         a = Registers[Instr->A];
+         b = Registers[Instr->B];
+         if ((Varies[Instr->A] || Varies[Instr->B]) && a*a + b*b == 0.0)
+            return ERROR_division;
+         break;
+      default:
+         break;
+      }
+   return ERROR_none;
+   }
+
+
+/*  DERIVATIVE OF r = Function (a)  */
+static double FunctionSlope (function_t Function, double a, double r)
+   {
+   switch (Function)
+      {
+      case FUNC_sin:   return cos (a);
+      case FUNC_cos:   return -sin (a);
+      case FUNC_tan:   return 1.0 + r*r;
+      case FUNC_exp:   return r;
+      case FUNC_log:   return 1.0 / a;
+      case FUNC_log10: return 1.0 / (a * M_LN10);
+      case FUNC_fabs:  return (a > 0.0) ? 1.0 : (a < 0.0) ? -1.0 : 0.0;
+      case FUNC_acos:  return -1.0 / sqrt (1.0 - a*a);
+      case FUNC_asin:  return 1.0 / sqrt (1.0 - a*a);
+      case FUNC_atan:  return 1.0 / (1.0 + a*a);
+      case FUNC_sqrt:  return 0.5 / r;
+      default:         return 0.0;
+      }
+   }
+
+
+/*  ADD DERIVATIVE OF RESULT BY THE OPERANDS OF INSTRUCTION IN Register  */
+static void Backpropagate (const calc_instr *Instr, const double *Registers,
+                           int Register, double *Adjoints, double *Gradient)
+   {
+   double  g = Adjoints[Register];
+   double  r = Registers[Register];
+   double  a, b;
+   double *dA;
+   double *dB;
+   double  Weight;
+   int     Operand[MAXOPERANDS];
+   int     NumberOfOperands;
+
+   /*  A LOAD HAS NO OPERANDS - ITS SLOT GETS THE ADJOINT  */
+   if (Instr->Opcode == OPC_Load)
+      {
+      Gradient[Instr->A] += g;
+      return;
+      }
+   NumberOfOperands = InstructionOperands (Instr, Operand);
+   if (NumberOfOperands == 0)
+      return;
+   a  = Registers[Operand[0]];
+   dA = Adjoints + Operand[0];
+   b  = (NumberOfOperands > 1) ? Registers[Operand[1]] : 0.0;
+   dB = (NumberOfOperands > 1) ? Adjoints + Operand[1] : NULL;
+
+   switch (Instr->Opcode)
+      {
+      case OPC_Store:
+         *dA += g;
+         break;
+      case OPC_Negate:
+         *dA -= g;
+         break;
+      case OPC_Add:
+         *dA += g;
+         *dB += g;
+         break;
+      case OPC_Subtract:
+         *dA += g;
+         *dB -= g;
+         break;
+      case OPC_Multiply:
+         *dA += g * b;
+         *dB += g * a;
+         break;
+      case OPC_Divide:
+         *dA += g / b;
+         *dB -= g * r / b;
+         break;
+      case OPC_Power:
+         if (b != 0.0)
+            *dA += g * b * pow (a, b - 1.0);
+         if (a > 0.0)
+            *dB += g * r * log (a);
+         break;
+      case OPC_Function:
+         *dA += g * FunctionSlope ((function_t) Instr->B, a, r);
+         break;
+      case OPC_Min:
+      case OPC_Max:
+         /*  THE ARGUMENT CHOSEN, OR HALF EACH IF EQUAL  */
+         if (a == b)
+            Weight = 0.5;
+         else
+            Weight = (r == a) ? 1.0 : 0.0;
+         *dA += g * Weight;
+         *dB += g * (1.0 - Weight);
+         break;
+      case OPC_Atan2:
+         *dA += g * b / (a*a + b*b);
+         *dB -= g * a / (a*a + b*b);
+         break;
+      case OPC_Hypot:
+         *dA += g * a / r;
+         *dB += g * b / r;
+         break;
+      case OPC_Fma:
+         *dA += g * b;
+         *dB += g * a;
+         Adjoints[Operand[2]] += g;
+         break;
+      default:
+         break;
+      }
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+calc_program *calc_derive (calc_program *Source, int Slot, int *ErrorResult)
+   {
+   calc_arena    *Arena = Source->Context->Arena;
+   calc_program  *Program;
+   deriver_t      Deriver;
+   calc_instr     Instr;
+   int            iinstr;
+
+   /*  SAME SLOTS, NO CODE YET  */
+   Program = RestoreProgram (Source->Context, NULL, Source->Code, 0,
+                             Source->VariableIDs, Source->NumberOfSlots);
+   Deriver.Map        = (int *) ArenaAllocate
+      (Arena, Source->CodeLength * sizeof(int));
+   Deriver.Derivative = (int *) ArenaAllocate
+      (Arena, Source->CodeLength * sizeof(int));
+   if (Program == NULL || Deriver.Map == NULL || Deriver.Derivative == NULL)
+      {
+      ArenaRewind (Arena, Deriver.Derivative);
+      ArenaRewind (Arena, Deriver.Map);
+      calc_free (Program);
+      *ErrorResult = ERROR_heap_full;
+      return NULL;
+      }
+   Deriver.Program = Program;
+   Deriver.Failed  = FALSE;
+
+   /*  EACH VALUE, THEN ITS DERIVATIVE - A STORE IS ONLY ITS OPERAND  */
+   for (iinstr=0; iinstr<Source->CodeLength; iinstr++)
+      {
+      Instr = Source->Code[iinstr];
+      if (Instr.Opcode == OPC_Store)
+         {
+         Deriver.Map[iinstr]        = Deriver.Map[Instr.B];
+         Deriver.Derivative[iinstr] = Deriver.Derivative[Instr.B];
+         continue;
+         }
+      switch (Instr.Opcode)
+         {
+         case OPC_Const:
+         case OPC_Load:
+            break;
+         case OPC_Negate:
+         case OPC_Function:
+            Instr.A = Deriver.Map[Instr.A];
+            break;
+         case OPC_Fma:
+            Instr.C = Deriver.Map[Instr.C];
+            /*  FALL THROUGH  */
+         default:
+            Instr.A = Deriver.Map[Instr.A];
+            Instr.B = Deriver.Map[Instr.B];
+            break;
+         }
+      Deriver.Map[iinstr] = Emit (&Deriver, Instr.Opcode, Instr.A, Instr.B,
+                                  Instr.Value);
+      if (Instr.Opcode == OPC_Fma && !Deriver.Failed)
+         Program->Code[Deriver.Map[iinstr]].C = Instr.C;
+      Instr = Source->Code[iinstr];
+      Deriver.Derivative[iinstr] =
+         DeriveInstruction (&Deriver, &Instr, Deriver.Map[iinstr], Slot);
+      }
+
+   /*  RESULT MUST BE A REGISTER  */
+   Program->Result = Deriver.Derivative[Source->Result];
+   if (Program->Result == ZERO)
+      Program->Result = Constant (&Deriver, 0.0);
+   ArenaRewind (Arena, Deriver.Derivative);
+   ArenaRewind (Arena, Deriver.Map);
+   if (Deriver.Failed)
+      {
+      calc_free (Program);
+      *ErrorResult = ERROR_heap_full;
+      return NULL;
+      }
+   Program->NumberRemoved = OptimizeProgram (Program);
+   *ErrorResult = ERROR_none;
+   return Program;
+   }
+
+
+double calc_gradient (calc_program *Program, const double *Variables,
+                      double *Gradient, int *ErrorResult)
+   {
+   calc_arena  *Arena = Program->Context->Arena;
+   double       LocalRegisters[2*LOCALREGISTERS];
+   BOOLEAN      LocalVaries[LOCALREGISTERS];
+   double      *Registers;
+   double      *Adjoints;
+   BOOLEAN     *Varies;
+   const double *Slots;
+   double      *Values;
+   calc_instr  *Instr;
+   double       Result;
+   int          Operand[MAXOPERANDS];
+   int          NumberOfOperands;
+   int          Length;
+   int          SlopeError = ERROR_none;
+   int          Slot;
+   int          iinstr;
+   int          iop;
+
+   *ErrorResult = ERROR_none;
+   for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+      Gradient[Slot] = 0.0;
+
+   /*  REGISTERS AND THEIR ADJOINTS, AND THE SLOT VALUES IF NOT GIVEN  */
+   Length    = Program->CodeLength;
+   Registers = LocalRegisters;
+   Varies    = LocalVaries;
+   Values    = NULL;
+   if (Length > LOCALREGISTERS)
+      {
+      Registers = (double *) ArenaAllocate (Arena, 2*Length*sizeof(double));
+      Varies    = (BOOLEAN *) ArenaAllocate (Arena, Length*sizeof(BOOLEAN));
+      }
+   if (Variables == NULL)
+      Values = (double *) ArenaAllocate
+         (Arena, (Program->NumberOfSlots+1) * sizeof(double));
+   if (Registers == NULL || Varies == NULL ||
+       (Variables == NULL && Values == NULL))
+      {
+      *ErrorResult = ERROR_heap_full;
+      Result = 0.0;
+      goto Release;
+      }
+   Adjoints = Registers + Length;
+   Slots    = Variables;
+   if (Variables == NULL)
+      {
+      for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+         {
+         Values[Slot] = GetVariableValue (Program->Context,
+                                          Program->VariableIDs[Slot]);
+         if (*ErrorResult == ERROR_none &&
+             Program->Context->Definitions != NULL)
+            *ErrorResult = VariableError (Program->Context,
+                                          Program->VariableIDs[Slot]);
+         }
+      Slots = Values;
+      }
+
+   /*  VALUES, AND WHETHER EACH DEPENDS ON A VARIABLE  */
+   Instr = Program->Code;
+   for (iinstr=0; iinstr<Length && *ErrorResult == ERROR_none;
+        iinstr++, Instr++)
+      {
+      switch (Instr->Opcode)
+         {
+         case OPC_Const:
+            Registers[iinstr] = Instr->Value;
+            break;
+         case OPC_Load:
+            Registers[iinstr] = Slots[Instr->A];
+            break;
+         case OPC_Store:
+            Registers[iinstr] = Registers[Instr->B];
+            break;
+         case OPC_Negate:
+            Registers[iinstr] = -Registers[Instr->A];
+            break;
+         case OPC_Add:
+            Registers[iinstr] = Registers[Instr->A] + Registers[Instr->B];
+            break;
+         case OPC_Subtract:
+            Registers[iinstr] = Registers[Instr->A] - Registers[Instr->B];
+            break;
+         case OPC_Multiply:
+            Registers[iinstr] = Registers[Instr->A] * Registers[Instr->B];
+            break;
+         case OPC_Divide:
+            if (Registers[Instr->B] == 0)
+               *ErrorResult = ERROR_division;
+            else
+               Registers[iinstr] = Registers[Instr->A] / Registers[Instr->B];
+            break;
+         case OPC_Power:
+            Registers[iinstr] = pow (Registers[Instr->A],
+                                     Registers[Instr->B]);
+            break;
+         case OPC_Function:
+            if (!FunctionArgumentOk ((function_t) Instr->B,
+                                     Registers[Instr->A]))
+               *ErrorResult = ERROR_parameter;
+            else
+               Registers[iinstr] = ApplyFunction ((function_t) Instr->B,
+                                                  Registers[Instr->A]);
+            break;
+         case OPC_Min:
+            Registers[iinstr] = fmin (Registers[Instr->A],
+                                      Registers[Instr->B]);
+            break;
+         case OPC_Max:
+            Registers[iinstr] = fmax (Registers[Instr->A],
+                                      Registers[Instr->B]);
+            break;
+         case OPC_Atan2:
+            Registers[iinstr] = atan2 (Registers[Instr->A],
+                                       Registers[Instr->B]);
+            break;
+         case OPC_Hypot:
+            Registers[iinstr] = hypot (Registers[Instr->A],
+                                       Registers[Instr->B]);
+            break;
+         case OPC_Fma:
+            Registers[iinstr] = fma (Registers[Instr->A],
+                                     Registers[Instr->B],
+                                     Registers[Instr->C]);
+            break;
+         }
+      Varies[iinstr] = (Instr->Opcode == OPC_Load);
+      NumberOfOperands = InstructionOperands (Instr, Operand);
+      for (iop=0; iop<NumberOfOperands; iop++)
+         Varies[iinstr] |= Varies[Operand[iop]];
+      if (*ErrorResult == ERROR_none && SlopeError == ERROR_none)
+         SlopeError = GradientError (Instr, Registers, Varies);
+      Adjoints[iinstr] = 0.0;
+      }
+
+   /*  ERRORS OF THE FORMULA COME FIRST, AS calc_run REPORTS THEM: IT LETS
+       evalform REPORT ONE IF THE SLOTS ARE THE CONTEXT'S AND NOTHING IS
+       STORED  */
+   if (*ErrorResult != ERROR_none && Variables == NULL &&
+       Program->Formula != NULL)
+      {
+      for (iinstr=0; iinstr<Length; iinstr++)
+         if (Program->Code[iinstr].Opcode == OPC_Store)
+            break;
+      if (iinstr == Length)
+         {
+         calc_run (Program, NULL, &SlopeError);
+         if (SlopeError != ERROR_none)
+            *ErrorResult = SlopeError;
+         }
+      }
+   if (*ErrorResult == ERROR_none)
+      *ErrorResult = SlopeError;
+   if (*ErrorResult != ERROR_none)
+      {
+      Result = 0.0;
+      goto Release;
+      }
+
+   /*  BACK FROM THE RESULT - ONLY REGISTERS IT DEPENDS ON GET AN ADJOINT  */
+   Result = Registers[Program->Result];
+   Adjoints[Program->Result] = 1.0;
+   for (iinstr=Program->Result; iinstr>=0; iinstr--)
+      if (Adjoints[iinstr] != 0.0 && Varies[iinstr])
+         Backpropagate (Program->Code + iinstr, Registers, iinstr, Adjoints,
+                        Gradient);
+
+Release:
+   if (Values != NULL)
+      ArenaRewind (Arena, Values);
+   if (Varies != LocalVaries)
+      ArenaRewind (Arena, Varies);
+   if (Registers != LocalRegisters)
+      ArenaRewind (Arena, Registers);
+   return Result;
+   }
@@ -0,0 +1,420 @@
+/*                                                                       */
+/*                                                                       */
+/*   USER-DEFINED FUNCTIONS                                              */
+/*                                                                       */
+/*      A function is defined by a formula of its parameters.            */
+/*      "f(x,y) = x*y+1" defines F of two arguments, and "f(2,3)"        */
+/*      is then 7.  The formula may read variables and call other        */
+/*      functions, but may not assign variables or call itself,          */
+/*      directly or through other functions.                             */
+/*                                                                       */
+/*        (1) int IsFunctionDefinition (const char *f, const char *end)  */
+/*                                                                       */
+/*            returns TRUE if formula f (ending at end, or at its NUL    */
+/*            if end is NULL) has the form "name(name,...) = ...".       */
+/*                                                                       */
+/*        (2) double DefineFunction (calc_context *c, char *f, int *err) */
+/*                                                                       */
+/*            defines function by formula f and returns 0.  A function   */
+/*            defined again replaces the old formula everywhere it is    */
+/*            used, including the definitions of variables (":=").       */
+/*                                                                       */
+/*        (3) int FindFunction (calc_context *c, const char *name)       */
+/*                                                                       */
+/*            returns ID of function with upper case name, or NOTFOUND.  */
+/*                                                                       */
+/*        (4) int FindParameter (const calc_function *f,                 */
+/*                               const char *name)                       */
+/*                                                                       */
+/*            returns position of parameter with upper case name, or     */
+/*            NOTFOUND.                                                  */
+/*                                                                       */
+/*        (5) char *listfunc_r (calc_context *c, int id)                 */
+/*                                                                       */
+/*            returns definition of function id, or NULL past the last.  */
+/*                                                                       */
+/*        (6) int MirrorFunctions (calc_context *m, calc_context *c)     */
+/*                                                                       */
+/*            copies functions of c to m if they changed since the       */
+/*            last copy (see calc_context_mirror).                       */
+/*                                                                       */
+/*        (7) int AddFunction (calc_context *c, const char *name,        */
+/*                             const calc_function *f)                   */
+/*                                                                       */
+/*            adds a copy of f, which was checked when it was defined,   */
+/*            as function name (see snapshot.c).  Returns 0 if OK.       */
+/*                                                                       */
+/*        (8) void FreeFunctions (calc_context *c)                       */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Names are kept in a symbol table of their own, so a          */
+/*          function and a variable may have the same name.  A call      */
+/*          is recognized by the "(" after the name.  Up to              */
+/*          MAXARGUMENTS parameters are allowed; within the formula      */
+/*          they hide variables of the same name.                        */
+/*                                                                       */
+/*          evalform evaluates the formula of a function in place of     */
+/*          the call, with the arguments on a stack in the context.      */
+/*          The compiler inlines it: the instructions of the formula     */
+/*          are emitted into the calling program with the registers of   */
+/*          the arguments for the parameters, so a compiled call costs   */
+/*          nothing beyond its formula and is optimized together with    */
+/*          the rest of the program (see compile.c).                     */
+/*                                                                       */
+/*          A definition is checked by compiling its formula, which      */
+/*          also finds calls that would recurse.  Every definition       */
+/*          changes FunctionVersion, telling cached programs to          */
+/*          compile again.                                               */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "parse.h"
+#include "compile.h"
+#include "builtin.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+
+/*  CHARACTER AT p - '\0' AT THE END OF A BOUNDED FORMULA  */
+#define CHARAT(p, End)  ((p) == (End) ? '\0' : *(p))
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static void     SkipWhiteSpace (const char **f, const char *End);
+static BOOLEAN  ReadName (const char **f, char *Name, int *ErrorResult);
+static BOOLEAN  GrowFunctions (calc_context *Context);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  End IS THE END OF A LENGTH-BOUNDED FORMULA, NULL IF NUL-TERMINATED  */
+static void SkipWhiteSpace (const char **f, const char *End)
+   {
+   while (*f != End && (**f==' ' || **f==9 || **f==10 || **f==13))
+      (*f)++;
+   }
+
+
+/*  READ UPPER CASE NAME OF FUNCTION OR PARAMETER - FALSE IF NOT ONE  */
+static BOOLEAN ReadName (const char **f, char *Name, int *ErrorResult)
+   {
+   int TokenLength;
+
+   SkipWhiteSpace (f, NULL);
+   TokenLength = GetNextTokenLength (*f);
+   if (TokenLength >= MAXTOKENLENGTH)
+      {
+      *ErrorResult = ERROR_variable_long;
+      return FALSE;
+      }
+   CopyUppercaseString (Name, *f, TokenLength);
+   /*  CONSTANTS AND FUNCTIONS CANNOT BE DEFINED  */
+   if (TokenLength == 0 || FindBuiltin (Name, TokenLength) != NULL)
+      {
+      *ErrorResult = ERROR_variable_expected;
+      return FALSE;
+      }
+   *f += TokenLength;
+   SkipWhiteSpace (f, NULL);
+   return TRUE;
+   }
+
+
+/*  MAKE ROOM FOR AN ENTRY FOR EVERY FUNCTION NAME  */
+static BOOLEAN GrowFunctions (calc_context *Context)
+   {
+   calc_function *NewFunctions;
+   int            NewSize;
+
+   NewSize = Context->FunctionNames.NumberOfSymbols;
+   if (NewSize <= Context->FunctionSize)
+      return TRUE;
+   if (NewSize < 2*Context->FunctionSize)
+      NewSize = 2*Context->FunctionSize;
+   NewFunctions = (calc_function *)
+      ArenaResize (Context->Arena, Context->Functions,
+                   Context->FunctionSize * sizeof(calc_function),
+                   NewSize * sizeof(calc_function));
+   if (NewFunctions == NULL)
+      return FALSE;
+   memset (NewFunctions + Context->FunctionSize, 0,
+           (NewSize - Context->FunctionSize) * sizeof(calc_function));
+   Context->Functions    = NewFunctions;
+   Context->FunctionSize = NewSize;
+   return TRUE;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+int IsFunctionDefinition (const char *Formula, const char *End)
+   {
+   int TokenLength;
+
+   SkipWhiteSpace (&Formula, End);
+   TokenLength = GetBoundedTokenLength (Formula, End);
+   if (TokenLength == 0)
+      return FALSE;
+   Formula += TokenLength;
+   SkipWhiteSpace (&Formula, End);
+   if (CHARAT (Formula, End) != '(')
+      return FALSE;
+
+   /*  NAMES OF PARAMETERS, SEPARATED BY COMMAS  */
+   do
+      {
+      Formula++;
+      SkipWhiteSpace (&Formula, End);
+      TokenLength = GetBoundedTokenLength (Formula, End);
+      if (TokenLength == 0)
+         return FALSE;
+      Formula += TokenLength;
+      SkipWhiteSpace (&Formula, End);
+      }
+   while (CHARAT (Formula, End) == ',');
+   if (CHARAT (Formula, End) != ')')
+      return FALSE;
+   Formula++;
+   SkipWhiteSpace (&Formula, End);
+   return CHARAT (Formula, End) == '=';
+   }
+
+
+/*  Text IS NUL-TERMINATED AND PASSED IsFunctionDefinition  */
+double DefineFunction (calc_context *Context, const char *Text,
+                       int *ErrorResult)
+   {
+   calc_function  New;
+   calc_function  Old;
+   char           Name[MAXTOKENLENGTH];
+   const char    *Formula;
+   const char    *Start;
+   const char    *Body;
+   size_t         Length;
+   int            FunctionID;
+   int            NumberOfFunctions;
+   int            iparam;
+   int            Error;
+   BOOLEAN        Recompiled;
+
+   /*  NAME  */
+   Formula = Text;
+   SkipWhiteSpace (&Formula, NULL);
+   Start = Formula;
+   if (!ReadName (&Formula, Name, ErrorResult))
+      return 0.0;
+
+   /*  PARAMETERS - EACH NAMED ONCE  */
+   memset (&New, 0, sizeof(calc_function));
+   do
+      {
+      Formula++;
+      if (New.NumberOfParameters >= MAXARGUMENTS)
+         {
+         *ErrorResult = ERROR_arguments;
+         return 0.0;
+         }
+      if (!ReadName (&Formula, New.Parameters[New.NumberOfParameters],
+                     ErrorResult))
+         return 0.0;
+      for (iparam=0; iparam<New.NumberOfParameters; iparam++)
+         if (strcmp (New.Parameters[iparam],
+                     New.Parameters[New.NumberOfParameters]) == 0)
+            {
+            *ErrorResult = ERROR_arguments;
+            return 0.0;
+            }
+      New.NumberOfParameters++;
+      }
+   while (*Formula == ',');
+
+   /*  FORMULA AFTER "=" - IT MAY NOT ASSIGN VARIABLES  */
+   Formula++;
+   SkipWhiteSpace (&Formula, NULL);
+   Formula++;
+   SkipWhiteSpace (&Formula, NULL);
+   Body = Formula;
+   if (strchr (Body, '=') != NULL)
+      {
+      *ErrorResult = ERROR_definition;
+      return 0.0;
+      }
+
+   /*  FIND OR CREATE FUNCTION  */
+   NumberOfFunctions = Context->FunctionNames.NumberOfSymbols;
+   FunctionID = FindSymbol (&Context->FunctionNames, Name);
+   if (FunctionID == NOTFOUND)
+      FunctionID = AddSymbol (&Context->FunctionNames, Name, 0.0);
+   if (FunctionID == NOROOM || FunctionID == NOHEAP ||
+       !GrowFunctions (Context))
+      {
+      if (FunctionID >= NumberOfFunctions)
+         TruncateSymbols (&Context->FunctionNames, NumberOfFunctions);
+      *ErrorResult = (FunctionID == NOROOM) ? ERROR_variable_full
+                                            : ERROR_heap_full;
+      return 0.0;
+      }
+
+   /*  KEEP DEFINITION IN UPPER CASE, WITHOUT TRAILING WHITE SPACE  */
+   Length = strlen (Start);
+   while (Length > 0 && (Start[Length-1]==' ' || Start[Length-1]==9 ||
+                         Start[Length-1]==10 || Start[Length-1]==13))
+      Length--;
+   New.Text = (char *) ArenaAllocate (Context->Arena, Length+1);
+   if (New.Text == NULL)
+      {
+      if (FunctionID >= NumberOfFunctions)
+         TruncateSymbols (&Context->FunctionNames, NumberOfFunctions);
+      *ErrorResult = ERROR_heap_full;
+      return 0.0;
+      }
+   CopyUppercaseString (New.Text, Start, (int) Length);
+   New.Body = New.Text + (Body - Start);
+   if ((size_t) (Body - Start) > Length)
+      New.Body = New.Text + Length;
+
+   /*  TRY NEW FORMULA - DEFINITIONS CALLING THE OLD ONE CHANGE WITH IT  */
+   Old = Context->Functions[FunctionID];
+   Context->Functions[FunctionID] = New;
+   Error = CheckFunction (Context, FunctionID);
+   Recompiled = FALSE;
+   if (Error == ERROR_none && Old.Body != NULL &&
+       Context->Definitions != NULL)
+      {
+      Error = RecompileDefinitions (Context);
+      Recompiled = TRUE;
+      }
+
+   /*  .. AND PUT BACK THE OLD ONE IF IT FAILED  */
+   if (Error != ERROR_none)
+      {
+      Context->Functions[FunctionID] = Old;
+      if (Recompiled)
+         RecompileDefinitions (Context);
+      if (FunctionID >= NumberOfFunctions)
+         TruncateSymbols (&Context->FunctionNames, NumberOfFunctions);
+      ArenaDiscard (Context->Arena, New.Text);
+      *ErrorResult = Error;
+      return 0.0;
+      }
+
+   ArenaDiscard (Context->Arena, Old.Text);
+   Context->FunctionVersion++;
+   *ErrorResult = ERROR_none;
+   return 0.0;
+   }
+
+
+int FindFunction (calc_context *Context, const char *Name)
+   {
+   int FunctionID;
+
+   FunctionID = FindSymbol (&Context->FunctionNames, Name);
+   if (FunctionID == NOTFOUND || Context->Functions[FunctionID].Body == NULL)
+      return NOTFOUND;
+   return FunctionID;
+   }
+
+
+int FindParameter (const calc_function *Function, const char *Name)
+   {
+   int iparam;
+
+   for (iparam=0; iparam<Function->NumberOfParameters; iparam++)
+      if (strcmp (Function->Parameters[iparam], Name) == 0)
+         return iparam;
+   return NOTFOUND;
+   }
+
+
+char *listfunc_r (calc_context *Context, int FunctionID)
+   {
+   if (FunctionID < 0 || FunctionID >= Context->FunctionNames.NumberOfSymbols)
+      return NULL;
+   return Context->Functions[FunctionID].Text;
+   }
+
+
+/*  COPY OF Function UNDER Name, WHICH IS NOT DEFINED IN Context YET  */
+int AddFunction (calc_context *Context, const char *Name,
+                 const calc_function *Function)
+   {
+   calc_function *To;
+   int            FunctionID;
+
+   FunctionID = AddSymbol (&Context->FunctionNames, Name, 0.0);
+   if (FunctionID < 0 || !GrowFunctions (Context))
+      return ERROR_heap_full;
+   To  = Context->Functions + FunctionID;
+   *To = *Function;
+   To->Text = (char *) ArenaAllocate (Context->Arena,
+                                      strlen (Function->Text) + 1);
+   if (To->Text == NULL)
+      {
+      To->Body = NULL;
+      return ERROR_heap_full;
+      }
+   strcpy (To->Text, Function->Text);
+   To->Body = To->Text + (Function->Body - Function->Text);
+   return ERROR_none;
+   }
+
+
+/*  UNCHANGED UNTIL A COPY SUCCEEDS, SO A FAILED ONE IS TRIED AGAIN  */
+int MirrorFunctions (calc_context *Mirror, calc_context *Context)
+   {
+   int FunctionID;
+
+   if (Mirror->FunctionVersion == Context->FunctionVersion)
+      return ERROR_none;
+   FreeFunctions (Mirror);
+   for (FunctionID=0; FunctionID<Context->FunctionNames.NumberOfSymbols;
+        FunctionID++)
+      if (AddFunction (Mirror,
+                       SymbolName (&Context->FunctionNames, FunctionID),
+                       Context->Functions + FunctionID) != ERROR_none)
+         return ERROR_heap_full;
+   Mirror->FunctionVersion = Context->FunctionVersion;
+   return ERROR_none;
+   }
+
+
+void FreeFunctions (calc_context *Context)
+   {
+   int FunctionID;
+
+   for (FunctionID=0; FunctionID<Context->FunctionSize; FunctionID++)
+      ArenaDiscard (Context->Arena, Context->Functions[FunctionID].Text);
+   ArenaDiscard (Context->Arena, Context->Functions);
+   FreeSymbolTable (&Context->FunctionNames);
+   Context->Functions    = NULL;
+   Context->FunctionSize = 0;
+   }
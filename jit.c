@@ -0,0 +1,415 @@
+/*                                                                       */
+/*                                                                       */
+/*   NATIVE CODE FOR COMPILED FORMULAS                                   */
+/*                                                                       */
+/*      USER CALLABLE ROUTINES                                           */
+/*                                                                       */
+/*        (1) calc_jitfn calc_jit (calc_program *p)                      */
+/*                                                                       */
+/*            translates program into machine code and returns a         */
+/*            function  double f (const double *vars)  that computes     */
+/*            the formula from the values of the variable slots.         */
+/*            Returns NULL if the platform is not supported, if the      */
+/*            program assigns variables, if it has more than             */
+/*            CALC_JITREGISTERS instructions (whose registers would not  */
+/*            fit the stack), or if memory is exhausted.                 */
+/*                                                                       */
+/*            f returns NaN when the formula reports an error, and       */
+/*            may return NaN early when a function or power sees NaN.    */
+/*            Run the program with calc_run to get the error code.       */
+/*                                                                       */
+/*            calc_run calls calc_jit by itself after a program has      */
+/*            been run CALC_JITTHRESHOLD times, and falls back to the    */
+/*            instructions whenever native code returns NaN.             */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Only x86-64 with SSE2 is supported.  Each instruction is     */
+/*          translated on its own; registers of the program live in      */
+/*          the stack frame.  Powers and functions call the same C       */
+/*          routines calc_run uses, so results are bit-identical.        */
+/*          Functions of several arguments take them in xmm0 to xmm2.    */
+/*          Code is written to anonymous memory which is made            */
+/*          executable only after it has been written.                   */
+/*                                                                       */
+/*          Compile with -DCALC_NOJIT to leave native code out.          */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Compile Switches
+************************************************************************
+*/
+#if defined(__x86_64__) && defined(__unix__) && !defined(CALC_NOJIT)
+#define JIT_X86_64
+#endif
+
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "parse.h"
+#include "compile.h"
+
+#ifdef JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define INITIALBYTES 256
+
+
+#ifdef JIT_X86_64
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  MACHINE CODE BEING WRITTEN  */
+typedef struct
+   {
+   unsigned char *Bytes;
+   size_t         Length;
+   size_t         Size;
+   BOOLEAN        Failed;      /*  out of memory  */
+   calc_arena    *Arena;       /*  arena of program  */
+   } codebuffer_t;
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static double   CallFunction (int Function, double x);
+static void     EmitBytes (codebuffer_t *Buffer, const char *Bytes, int n);
+static void     EmitInt32 (codebuffer_t *Buffer, long Value);
+static void     EmitInt64 (codebuffer_t *Buffer, const void *Value);
+static void     EmitLoadRegister (codebuffer_t *Buffer, int x, int Register);
+static void     EmitStoreRegister (codebuffer_t *Buffer, int Register);
+static void     EmitLoadRax (codebuffer_t *Buffer, const void *Value);
+static void     EmitEpilogue (codebuffer_t *Buffer, long FrameSize);
+static BOOLEAN  TranslateProgram (codebuffer_t *Buffer,
+                                  const calc_program *Program);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  FUNCTION CALLED FROM NATIVE CODE - NaN FOR PARAMETER ERROR  */
+static double CallFunction (int Function, double x)
+   {
+   if (!FunctionArgumentOk ((function_t) Function, x))
+      return NAN;
+   return ApplyFunction ((function_t) Function, x);
+   }
+
+
+static void EmitBytes (codebuffer_t *Buffer, const char *Bytes, int n)
+   {
+   unsigned char *NewBytes;
+   size_t         NewSize;
+
+   if (Buffer->Failed)
+      return;
+   if (Buffer->Length + n > Buffer->Size)
+      {
+      NewSize = Buffer->Size ? 2*Buffer->Size : INITIALBYTES;
+      NewBytes = (unsigned char *) ArenaResize (Buffer->Arena, Buffer->Bytes,
+                                                Buffer->Size, NewSize);
+      if (NewBytes == NULL)
+         {
+         Buffer->Failed = TRUE;
+         return;
+         }
+      Buffer->Bytes = NewBytes;
+      Buffer->Size  = NewSize;
+      }
+   memcpy (Buffer->Bytes + Buffer->Length, Bytes, n);
+   Buffer->Length += n;
+   }
+
+
+/*  LITTLE-ENDIAN 32 BIT IMMEDIATE OR DISPLACEMENT  */
+static void EmitInt32 (codebuffer_t *Buffer, long Value)
+   {
+   char Bytes[4];
+   int  ibyte;
+
+   for (ibyte=0; ibyte<4; ibyte++)
+      Bytes[ibyte] = (char) ((unsigned long) Value >> (8*ibyte));
+   EmitBytes (Buffer, Bytes, 4);
+   }
+
+
+/*  64 BIT IMMEDIATE (x86-64 IS LITTLE-ENDIAN, SO COPY AS IS)  */
+static void EmitInt64 (codebuffer_t *Buffer, const void *Value)
+   {
+   EmitBytes (Buffer, (const char *) Value, 8);
+   }
+
+
+/*  movsd xmm<x>, [rsp + 8*Register]  */
+static void EmitLoadRegister (codebuffer_t *Buffer, int x, int Register)
+   {
+   char Code[5] = { '\xF2', '\x0F', '\x10', '\x84', '\x24' };
+
+   Code[3] = (char) (0x84 | (x << 3));
+   EmitBytes (Buffer, Code, 5);
+   EmitInt32 (Buffer, 8L*Register);
+   }
+
+
+/*  movsd [rsp + 8*Register], xmm0  */
+static void EmitStoreRegister (codebuffer_t *Buffer, int Register)
+   {
+   EmitBytes (Buffer, "\xF2\x0F\x11\x84\x24", 5);
+   EmitInt32 (Buffer, 8L*Register);
+   }
+
+
+/*  mov rax, imm64  */
+static void EmitLoadRax (codebuffer_t *Buffer, const void *Value)
+   {
+   EmitBytes (Buffer, "\x48\xB8", 2);
+   EmitInt64 (Buffer, Value);
+   }
+
+
+/*  add rsp, FrameSize / pop rbx / ret  */
+static void EmitEpilogue (codebuffer_t *Buffer, long FrameSize)
+   {
+   EmitBytes (Buffer, "\x48\x81\xC4", 3);
+   EmitInt32 (Buffer, FrameSize);
+   EmitBytes (Buffer, "\x5B\xC3", 2);
+   }
+
+
+/*  WRITE MACHINE CODE FOR PROGRAM - RETURN FALSE IF NOT POSSIBLE  */
+static BOOLEAN TranslateProgram (codebuffer_t *Buffer,
+                                 const calc_program *Program)
+   {
+   const calc_instr *Instr;
+   double            NotANumber = NAN;
+   double            SignBit = -0.0;
+   double          (*PowerRoutine) (double, double) = pow;
+   double          (*FunctionRoutine) (int, double) = CallFunction;
+   double          (*BinaryRoutine) (double, double);
+   double          (*FmaRoutine) (double, double, double) = fma;
+   long              FrameSize;
+   size_t            BodyJump;
+   size_t            ErrorExit;
+   long              Offset;
+   int               iinstr;
+
+   /*  REGISTERS OF LONG PROGRAMS WOULD OVERFLOW THE STACK  */
+   if (Program->CodeLength > CALC_JITREGISTERS)
+      return FALSE;
+
+   /*  ASSIGNMENTS NEED THE CONTEXT - LEAVE THEM TO calc_run  */
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      if (Program->Code[iinstr].Opcode == OPC_Store)
+         return FALSE;
+
+   /*  FRAME KEEPS rsp 16-BYTE ALIGNED FOR CALLS AFTER push rbx  */
+   FrameSize = (8L*Program->CodeLength + 15) & ~15L;
+
+   /*  PROLOGUE: push rbx / mov rbx, rdi / sub rsp, FrameSize / jmp body  */
+   EmitBytes (Buffer, "\x53\x48\x89\xFB\x48\x81\xEC", 7);
+   EmitInt32 (Buffer, FrameSize);
+   EmitBytes (Buffer, "\xE9", 1);
+   BodyJump = Buffer->Length;
+   EmitInt32 (Buffer, 0);
+
+   /*  ERROR EXIT RETURNS NaN: movq xmm0, rax  */
+   ErrorExit = Buffer->Length;
+   EmitLoadRax (Buffer, &NotANumber);
+   EmitBytes (Buffer, "\x66\x48\x0F\x6E\xC0", 5);
+   EmitEpilogue (Buffer, FrameSize);
+   if (Buffer->Failed)
+      return FALSE;
+   Offset = (long) (Buffer->Length - (BodyJump+4));
+   Buffer->Length = BodyJump;
+   EmitInt32 (Buffer, Offset);
+   Buffer->Length = BodyJump + 4 + Offset;
+
+   /*  BODY - RESULT OF EVERY INSTRUCTION IS LEFT IN xmm0 AND SAVED  */
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      {
+      Instr = Program->Code + iinstr;
+      switch (Instr->Opcode)
+         {
+         case OPC_Const:
+            EmitLoadRax (Buffer, &Instr->Value);
+            EmitBytes (Buffer, "\x66\x48\x0F\x6E\xC0", 5);
+            break;
+         case OPC_Load:
+            /*  movsd xmm0, [rbx + 8*slot]  */
+            EmitBytes (Buffer, "\xF2\x0F\x10\x83", 4);
+            EmitInt32 (Buffer, 8L*Instr->A);
+            break;
+         case OPC_Negate:
+            /*  movq xmm1, rax / xorpd xmm0, xmm1  */
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitLoadRax (Buffer, &SignBit);
+            EmitBytes (Buffer, "\x66\x48\x0F\x6E\xC8\x66\x0F\x57\xC1", 9);
+            break;
+         case OPC_Add:
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitLoadRegister (Buffer, 1, Instr->B);
+            EmitBytes (Buffer, "\xF2\x0F\x58\xC1", 4);
+            break;
+         case OPC_Subtract:
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitLoadRegister (Buffer, 1, Instr->B);
+            EmitBytes (Buffer, "\xF2\x0F\x5C\xC1", 4);
+            break;
+         case OPC_Multiply:
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitLoadRegister (Buffer, 1, Instr->B);
+            EmitBytes (Buffer, "\xF2\x0F\x59\xC1", 4);
+            break;
+         case OPC_Divide:
+            /*  xorpd xmm2, xmm2 / ucomisd xmm1, xmm2 / je error  */
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitLoadRegister (Buffer, 1, Instr->B);
+            EmitBytes (Buffer, "\x66\x0F\x57\xD2\x66\x0F\x2E\xCA\x0F\x84", 10);
+            EmitInt32 (Buffer, (long) ErrorExit - (long) (Buffer->Length+4));
+            EmitBytes (Buffer, "\xF2\x0F\x5E\xC1", 4);
+            break;
+         case OPC_Power:
+            /*  call rax  */
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitLoadRegister (Buffer, 1, Instr->B);
+            EmitLoadRax (Buffer, &PowerRoutine);
+            EmitBytes (Buffer, "\xFF\xD0", 2);
+            break;
+         case OPC_Function:
+            /*  mov edi, function / call rax / ucomisd xmm0, xmm0 / jp error  */
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitBytes (Buffer, "\xBF", 1);
+            EmitInt32 (Buffer, Instr->B);
+            EmitLoadRax (Buffer, &FunctionRoutine);
+            EmitBytes (Buffer, "\xFF\xD0\x66\x0F\x2E\xC0\x0F\x8A", 8);
+            EmitInt32 (Buffer, (long) ErrorExit - (long) (Buffer->Length+4));
+            break;
+         case OPC_Min:
+         case OPC_Max:
+         case OPC_Atan2:
+         case OPC_Hypot:
+            /*  call rax  */
+            BinaryRoutine = (Instr->Opcode == OPC_Min)   ? fmin  :
+                            (Instr->Opcode == OPC_Max)   ? fmax  :
+                            (Instr->Opcode == OPC_Atan2) ? atan2 : hypot;
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitLoadRegister (Buffer, 1, Instr->B);
+            EmitLoadRax (Buffer, &BinaryRoutine);
+            EmitBytes (Buffer, "\xFF\xD0", 2);
+            break;
+         case OPC_Fma:
+            /*  call rax  */
+            EmitLoadRegister (Buffer, 0, Instr->A);
+            EmitLoadRegister (Buffer, 1, Instr->B);
+            EmitLoadRegister (Buffer, 2, Instr->C);
+            EmitLoadRax (Buffer, &FmaRoutine);
+            EmitBytes (Buffer, "\xFF\xD0", 2);
+            break;
+         default:
+            return FALSE;
+         }
+      EmitStoreRegister (Buffer, iinstr);
+      }
+
+   /*  RETURN RESULT REGISTER  */
+   EmitLoadRegister (Buffer, 0, Program->Result);
+   EmitEpilogue (Buffer, FrameSize);
+   return !Buffer->Failed;
+   }
+
+#endif
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+calc_jitfn calc_jit (calc_program *Program)
+   {
+#ifdef JIT_X86_64
+   codebuffer_t  Buffer;
+   void         *Memory;
+
+   if (Program->Jit != NULL)
+      return Program->Jit;
+
+   Buffer.Bytes  = NULL;
+   Buffer.Length = 0;
+   Buffer.Size   = 0;
+   Buffer.Failed = FALSE;
+   Buffer.Arena  = &Program->Arena;
+   if (!TranslateProgram (&Buffer, Program))
+      {
+      ArenaRewind (&Program->Arena, Buffer.Bytes);
+      return NULL;
+      }
+
+   /*  COPY TO MEMORY THAT IS EXECUTABLE BUT NOT WRITABLE  */
+   Memory = mmap (NULL, Buffer.Length, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (Memory == MAP_FAILED)
+      {
+      ArenaRewind (&Program->Arena, Buffer.Bytes);
+      return NULL;
+      }
+   memcpy (Memory, Buffer.Bytes, Buffer.Length);
+   ArenaRewind (&Program->Arena, Buffer.Bytes);
+   if (mprotect (Memory, Buffer.Length, PROT_READ | PROT_EXEC) != 0)
+      {
+      munmap (Memory, Buffer.Length);
+      return NULL;
+      }
+
+   Program->JitCode     = Memory;
+   Program->JitCodeSize = Buffer.Length;
+   Program->Jit         = (calc_jitfn) Memory;
+   return Program->Jit;
+#else
+   (void) Program;
+   return NULL;
+#endif
+   }
+
+
+/*  RELEASE NATIVE CODE OF PROGRAM  */
+void FreeNativeCode (calc_program *Program)
+   {
+#ifdef JIT_X86_64
+   if (Program->JitCode != NULL)
+      munmap (Program->JitCode, Program->JitCodeSize);
+#endif
+   Program->JitCode     = NULL;
+   Program->JitCodeSize = 0;
+   Program->Jit         = NULL;
+   }
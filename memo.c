@@ -0,0 +1,517 @@
+/*                                                                       */
+/*                                                                       */
+/*   CACHE OF FORMULA RESULTS                                            */
+/*                                                                       */
+/*      USER CALLABLE ROUTINES                                           */
+/*                                                                       */
+/*        (1) calc_memo *calc_memo_new (calc_context *c, int capacity)   */
+/*                                                                       */
+/*            returns empty cache for formulas evaluated with the        */
+/*            variables of context c, holding up to capacity formulas.   */
+/*            Returns NULL if memory is exhausted.                       */
+/*                                                                       */
+/*        (2) double calc_memo_eval (calc_memo *m, const char *f,        */
+/*                                   int *err)                           */
+/*                                                                       */
+/*            returns value of formula f exactly as evalform_r would,    */
+/*            but without parsing f again when it was evaluated before,  */
+/*            nor running it again when it assigns no variable and none  */
+/*            of the variables it reads has been set since.              */
+/*                                                                       */
+/*        (3) double calc_memo_eval_n (calc_memo *m, const char *f,      */
+/*                                     size_t n, int *err)               */
+/*                                                                       */
+/*            same for the formula in the first n bytes of f, which      */
+/*            need not be NUL-terminated.                                */
+/*                                                                       */
+/*        (4) void calc_memo_stats (calc_memo *m, unsigned long *hits,   */
+/*                                  unsigned long *misses, int *n)       */
+/*                                                                       */
+/*            returns number of results taken from the cache, number    */
+/*            of formulas that had to be evaluated, and number of        */
+/*            formulas held.                                             */
+/*                                                                       */
+/*        (5) void calc_memo_free (calc_memo *m)                         */
+/*                                                                       */
+/*            releases cache.                                            */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Formulas are looked up by their text with letters turned     */
+/*          to upper case and surrounding white space removed.  Each     */
+/*          formula is compiled once; its result is kept together        */
+/*          with the version of every variable the program reads.        */
+/*          Setting a variable changes its version, so a changed input   */
+/*          makes the program run again instead of using the result.     */
+/*                                                                       */
+/*          Formulas that assign variables keep their program but        */
+/*          no result; they run again each time without being parsed,    */
+/*          unless they read a defined variable, which has to follow     */
+/*          the assignments of the formula: those go to evalform_r.      */
+/*          Formulas that do not compile are remembered as such and      */
+/*          always passed to evalform_r.                                 */
+/*          Defining a function compiles every formula again the next    */
+/*          time it is evaluated, since programs inline the functions    */
+/*          they call (see function.c).                                  */
+/*          When the cache is full the least recently used formula       */
+/*          is dropped.                                                  */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "parse.h"
+#include "compile.h"
+#include "memo.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define EMPTY -1
+#define INITIALTEXTSIZE 256
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  ONE FORMULA IN THE CACHE  */
+typedef struct
+   {
+   char           *Text;        /*  normalized formula                  */
+   unsigned        Hash;
+   int             HashNext;    /*  next entry with same bucket         */
+   int             Older;       /*  neighbours in order of last use     */
+   int             Newer;
+   calc_program   *Program;     /*  NULL if formula cannot be cached    */
+   BOOLEAN         Assigns;     /*  Program stores into variables       */
+   BOOLEAN         Valid;       /*  Value holds a result                */
+   double          Value;
+   unsigned long  *Versions;    /*  version of each slot for Value      */
+   unsigned long   FunctionVersion;  /*  of context when compiled       */
+   } memoentry_t;
+
+struct calc_memo
+   {
+   calc_context   *Context;
+   memoentry_t    *Entries;
+   int             NumberOfEntries;
+   int             Capacity;
+   int            *Buckets;     /*  first entry of each hash chain      */
+   int             BucketMask;
+   int             Newest;
+   int             Oldest;
+   char           *Text;        /*  normalized text of current formula  */
+   size_t          TextSize;
+   unsigned long   Hits;
+   unsigned long   Misses;
+   };
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static BOOLEAN  NormalizeFormula (calc_memo *Memo, const char *Formula,
+                                  size_t Length);
+static unsigned HashText (const char *Text);
+static int      FindEntry (calc_memo *Memo, unsigned Hash);
+static void     Unlink (calc_memo *Memo, int Entry);
+static void     LinkNewest (calc_memo *Memo, int Entry);
+static void     ClearEntry (memoentry_t *Entry);
+static int      NewEntry (calc_memo *Memo, unsigned Hash);
+static BOOLEAN  VersionsCurrent (calc_memo *Memo, memoentry_t *Entry);
+static void     CompileEntry (calc_memo *Memo, memoentry_t *Entry);
+static BOOLEAN  ReadsDefinition (calc_memo *Memo, memoentry_t *Entry);
+static double   RunEntry (calc_memo *Memo, memoentry_t *Entry, int *Error);
+static double   EvaluateText (calc_memo *Memo, const char *Formula,
+                              size_t Length, int *Error);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  COPY FORMULA TO Memo->Text IN UPPER CASE WITHOUT SURROUNDING BLANKS  */
+static BOOLEAN NormalizeFormula (calc_memo *Memo, const char *Formula,
+                                 size_t Length)
+   {
+   const char *End;
+   size_t      ichar;
+   char       *NewText;
+
+   End = Formula + Length;
+   while (Formula < End && (*Formula==' ' || *Formula=='\t' ||
+                            *Formula=='\n' || *Formula=='\r'))
+      Formula++;
+   while (End > Formula && (End[-1]==' ' || End[-1]=='\t' ||
+                            End[-1]=='\n' || End[-1]=='\r'))
+      End--;
+   Length = End - Formula;
+
+   if (Length + 1 > Memo->TextSize)
+      {
+      NewText = (char *) realloc (Memo->Text, Length + 1);
+      if (NewText == NULL)
+         return FALSE;
+      Memo->Text     = NewText;
+      Memo->TextSize = Length + 1;
+      }
+   for (ichar=0; ichar<Length; ichar++)
+      Memo->Text[ichar] = toupper ((unsigned char) Formula[ichar]);
+   Memo->Text[Length] = 0;
+   return TRUE;
+   }
+
+
+/*  FNV-1a HASH OF TEXT  */
+static unsigned HashText (const char *Text)
+   {
+   unsigned Hash = 2166136261u;
+
+   while (*Text)
+      {
+      Hash ^= (unsigned char) *Text++;
+      Hash *= 16777619u;
+      }
+   return Hash;
+   }
+
+
+/*  RETURN ENTRY HOLDING Memo->Text, OR EMPTY  */
+static int FindEntry (calc_memo *Memo, unsigned Hash)
+   {
+   int Entry;
+
+   Entry = Memo->Buckets[Hash & Memo->BucketMask];
+   while (Entry != EMPTY)
+      {
+      if (Memo->Entries[Entry].Hash == Hash &&
+          strcmp (Memo->Entries[Entry].Text, Memo->Text) == 0)
+         return Entry;
+      Entry = Memo->Entries[Entry].HashNext;
+      }
+   return EMPTY;
+   }
+
+
+/*  TAKE ENTRY OUT OF ORDER OF USE  */
+static void Unlink (calc_memo *Memo, int Entry)
+   {
+   memoentry_t *e = Memo->Entries + Entry;
+
+   if (e->Older != EMPTY)
+      Memo->Entries[e->Older].Newer = e->Newer;
+   else
+      Memo->Oldest = e->Newer;
+   if (e->Newer != EMPTY)
+      Memo->Entries[e->Newer].Older = e->Older;
+   else
+      Memo->Newest = e->Older;
+   }
+
+
+/*  MAKE ENTRY MOST RECENTLY USED  */
+static void LinkNewest (calc_memo *Memo, int Entry)
+   {
+   memoentry_t *e = Memo->Entries + Entry;
+
+   e->Older = Memo->Newest;
+   e->Newer = EMPTY;
+   if (Memo->Newest != EMPTY)
+      Memo->Entries[Memo->Newest].Newer = Entry;
+   else
+      Memo->Oldest = Entry;
+   Memo->Newest = Entry;
+   }
+
+
+static void ClearEntry (memoentry_t *Entry)
+   {
+   free (Entry->Text);
+   calc_free (Entry->Program);
+   free (Entry->Versions);
+   Entry->Text     = NULL;
+   Entry->Program  = NULL;
+   Entry->Versions = NULL;
+   Entry->Valid    = FALSE;
+   }
+
+
+/*  ADD ENTRY FOR Memo->Text, DROPPING OLDEST IF FULL - EMPTY IF NO HEAP  */
+static int NewEntry (calc_memo *Memo, unsigned Hash)
+   {
+   memoentry_t *e;
+   int          Entry;
+   int         *Link;
+   char        *Text;
+
+   Text = (char *) malloc (strlen (Memo->Text) + 1);
+   if (Text == NULL)
+      return EMPTY;
+   strcpy (Text, Memo->Text);
+
+   if (Memo->NumberOfEntries < Memo->Capacity)
+      Entry = Memo->NumberOfEntries++;
+   else
+      {
+      /*  DROP LEAST RECENTLY USED FORMULA  */
+      Entry = Memo->Oldest;
+      Unlink (Memo, Entry);
+      Link = Memo->Buckets + (Memo->Entries[Entry].Hash & Memo->BucketMask);
+      while (*Link != Entry)
+         Link = &Memo->Entries[*Link].HashNext;
+      *Link = Memo->Entries[Entry].HashNext;
+      ClearEntry (Memo->Entries + Entry);
+      }
+
+   e = Memo->Entries + Entry;
+   e->Text     = Text;
+   e->Hash     = Hash;
+   e->HashNext = Memo->Buckets[Hash & Memo->BucketMask];
+   Memo->Buckets[Hash & Memo->BucketMask] = Entry;
+   LinkNewest (Memo, Entry);
+   return Entry;
+   }
+
+
+/*  TRUE IF NO VARIABLE READ BY ENTRY HAS BEEN SET SINCE ITS RESULT  */
+static BOOLEAN VersionsCurrent (calc_memo *Memo, memoentry_t *Entry)
+   {
+   int Slot;
+
+   for (Slot=0; Slot<Entry->Program->NumberOfSlots; Slot++)
+      if (Entry->Versions[Slot] !=
+          GetVariableVersion (Memo->Context,
+                              Entry->Program->VariableIDs[Slot]))
+         return FALSE;
+   return TRUE;
+   }
+
+
+/*  COMPILE Memo->Text FOR ENTRY - NO Program IF IT CANNOT BE CACHED  */
+static void CompileEntry (calc_memo *Memo, memoentry_t *Entry)
+   {
+   calc_program *Program;
+   int           Error;
+   int           iinstr;
+
+   calc_free (Entry->Program);
+   free (Entry->Versions);
+   Entry->Program         = NULL;
+   Entry->Versions        = NULL;
+   Entry->Assigns         = FALSE;
+   Entry->Valid           = FALSE;
+   Entry->FunctionVersion = Memo->Context->FunctionVersion;
+
+   /*  THE NORMALIZED TEXT COMPILES THE SAME, AND IS NUL-TERMINATED.
+       COMPILING THE CALL IN "f(x) = ..." WOULD CREATE ITS PARAMETERS
+       AS VARIABLES  */
+   if (IsFunctionDefinition (Memo->Text, NULL))
+      return;
+   Program = calc_compile_r (Memo->Context, Memo->Text, &Error);
+   if (Program == NULL)
+      return;
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      if (Program->Code[iinstr].Opcode == OPC_Store)
+         break;
+   Entry->Assigns  = (iinstr < Program->CodeLength);
+   Entry->Versions = (unsigned long *)
+      malloc ((Program->NumberOfSlots+1) * sizeof(unsigned long));
+   if (Entry->Versions == NULL)
+      {
+      calc_free (Program);
+      free (Entry->Versions);
+      Entry->Versions = NULL;
+      return;
+      }
+   Entry->Program = Program;
+   }
+
+
+/*  TRUE IF ENTRY ASSIGNS AND READS A DEFINED VARIABLE - calc_run READS
+    EVERY SLOT BEFORE THE PROGRAM STARTS, SO THE VARIABLE WOULD MISS AN
+    ASSIGNMENT TO ITS INPUTS MADE BY THE FORMULA ITSELF  */
+static BOOLEAN ReadsDefinition (calc_memo *Memo, memoentry_t *Entry)
+   {
+   int Dirty;
+   int Error;
+   int Slot;
+
+   if (!Entry->Assigns || Memo->Context->Definitions == NULL)
+      return FALSE;
+   for (Slot=0; Slot<Entry->Program->NumberOfSlots; Slot++)
+      if (GetDefinition (Memo->Context, Entry->Program->VariableIDs[Slot],
+                         &Dirty, &Error) != NULL)
+         return TRUE;
+   return FALSE;
+   }
+
+
+/*  RUN PROGRAM OF ENTRY AND REMEMBER RESULT - A PROGRAM THAT ASSIGNS
+    VARIABLES HAS TO RUN EVERY TIME, BUT IS NOT PARSED AGAIN  */
+static double RunEntry (calc_memo *Memo, memoentry_t *Entry, int *Error)
+   {
+   double Value;
+   int    Slot;
+
+   Value = calc_run (Entry->Program, NULL, Error);
+   Entry->Valid = (*Error == ERROR_none && !Entry->Assigns);
+   if (Entry->Valid)
+      {
+      Entry->Value = Value;
+      for (Slot=0; Slot<Entry->Program->NumberOfSlots; Slot++)
+         Entry->Versions[Slot] =
+            GetVariableVersion (Memo->Context,
+                                Entry->Program->VariableIDs[Slot]);
+      }
+   return Value;
+   }
+
+
+/*  EVALUATE FORMULA WITHOUT THE CACHE  */
+static double EvaluateText (calc_memo *Memo, const char *Formula,
+                            size_t Length, int *Error)
+   {
+   return calc_eval (Memo->Context, Formula, Length, NULL, Error);
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+calc_memo *calc_memo_new (calc_context *Context, int Capacity)
+   {
+   calc_memo *Memo;
+   int        NumberOfBuckets;
+   int        Bucket;
+
+   if (Capacity < 1)
+      Capacity = 1;
+   NumberOfBuckets = 1;
+   while (NumberOfBuckets < 2*Capacity)
+      NumberOfBuckets *= 2;
+
+   Memo = (calc_memo *) calloc (1, sizeof(calc_memo));
+   if (Memo == NULL)
+      return NULL;
+   Memo->Context    = Context;
+   Memo->Capacity   = Capacity;
+   Memo->BucketMask = NumberOfBuckets-1;
+   Memo->Newest     = EMPTY;
+   Memo->Oldest     = EMPTY;
+   Memo->Entries    = (memoentry_t *) calloc (Capacity, sizeof(memoentry_t));
+   Memo->Buckets    = (int *) malloc (NumberOfBuckets * sizeof(int));
+   Memo->Text       = (char *) malloc (INITIALTEXTSIZE);
+   Memo->TextSize   = INITIALTEXTSIZE;
+   if (Memo->Entries == NULL || Memo->Buckets == NULL || Memo->Text == NULL)
+      {
+      calc_memo_free (Memo);
+      return NULL;
+      }
+   for (Bucket=0; Bucket<NumberOfBuckets; Bucket++)
+      Memo->Buckets[Bucket] = EMPTY;
+   return Memo;
+   }
+
+
+double calc_memo_eval (calc_memo *Memo, const char *Formula, int *Error)
+   {
+   return calc_memo_eval_n (Memo, Formula, strlen (Formula), Error);
+   }
+
+
+double calc_memo_eval_n (calc_memo *Memo, const char *Formula, size_t Length,
+                         int *Error)
+   {
+   memoentry_t  *e;
+   unsigned      Hash;
+   int           Entry;
+
+   if (!NormalizeFormula (Memo, Formula, Length))
+      {
+      Memo->Misses++;
+      return EvaluateText (Memo, Formula, Length, Error);
+      }
+   Hash = HashText (Memo->Text);
+
+   /*  FORMULA SEEN BEFORE  */
+   Entry = FindEntry (Memo, Hash);
+   if (Entry != EMPTY)
+      {
+      e = Memo->Entries + Entry;
+      Unlink (Memo, Entry);
+      LinkNewest (Memo, Entry);
+      if (e->FunctionVersion != Memo->Context->FunctionVersion)
+         CompileEntry (Memo, e);
+      if (e->Program == NULL || ReadsDefinition (Memo, e))
+         {
+         Memo->Misses++;
+         return EvaluateText (Memo, Formula, Length, Error);
+         }
+      if (e->Valid && VersionsCurrent (Memo, e))
+         {
+         Memo->Hits++;
+         *Error = ERROR_none;
+         return e->Value;
+         }
+      Memo->Misses++;
+      return RunEntry (Memo, e, Error);
+      }
+
+   /*  NEW FORMULA  */
+   Memo->Misses++;
+   Entry = NewEntry (Memo, Hash);
+   if (Entry == EMPTY)
+      return EvaluateText (Memo, Formula, Length, Error);
+   e = Memo->Entries + Entry;
+   CompileEntry (Memo, e);
+   if (e->Program == NULL || ReadsDefinition (Memo, e))
+      return EvaluateText (Memo, Formula, Length, Error);
+   return RunEntry (Memo, e, Error);
+   }
+
+
+void calc_memo_stats (calc_memo *Memo, unsigned long *Hits,
+                      unsigned long *Misses, int *NumberOfEntries)
+   {
+   *Hits            = Memo->Hits;
+   *Misses          = Memo->Misses;
+   *NumberOfEntries = Memo->NumberOfEntries;
+   }
+
+
+void calc_memo_free (calc_memo *Memo)
+   {
+   int Entry;
+
+   if (Memo == NULL)
+      return;
+   if (Memo->Entries != NULL)
+      for (Entry=0; Entry<Memo->NumberOfEntries; Entry++)
+         ClearEntry (Memo->Entries + Entry);
+   free (Memo->Entries);
+   free (Memo->Buckets);
+   free (Memo->Text);
+   free (Memo);
+   }
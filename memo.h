@@ -0,0 +1,19 @@
+#ifndef __MEMO_H
+#define __MEMO_H
+
+#include "parse.h"
+
+/*  DEFAULT NUMBER OF FORMULAS KEPT BY calc  */
+#define CALC_MEMOSIZE 256
+
+typedef struct calc_memo calc_memo;
+
+calc_memo *calc_memo_new   (calc_context *ctx, int capacity);
+double     calc_memo_eval  (calc_memo *memo, const char *formula, int *err);
+double     calc_memo_eval_n (calc_memo *memo, const char *formula, size_t len,
+                             int *err);
+void       calc_memo_stats (calc_memo *memo, unsigned long *hits,
+                            unsigned long *misses, int *entries);
+void       calc_memo_free  (calc_memo *memo);
+
+#endif
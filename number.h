@@ -0,0 +1,13 @@
+#ifndef __NUMBER_H
+#define __NUMBER_H
+
+#include <stddef.h>
+
+/*  ROOM FOR ANY DOUBLE PRINTED BY calc_format  */
+#define CALC_NUMBERSIZE 320
+
+double calc_strtod  (const char *s, char **end);
+double calc_strntod (const char *s, size_t n, char **end);
+int    calc_format  (char *buf, size_t size, double v, int conversion);
+
+#endif
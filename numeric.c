@@ -0,0 +1,1075 @@
+/*                                                                       */
+/*                                                                       */
+/*   ARITHMETIC OTHER THAN DOUBLE                                        */
+/*                                                                       */
+/*      USER CALLABLE ROUTINES                                           */
+/*                                                                       */
+/*        (1) int calc_context_set_numeric (calc_context *c,             */
+/*                                          calc_numeric n)              */
+/*                                                                       */
+/*            chooses the arithmetic of calc_eval_number_r and           */
+/*            calc_run_number in context c.  Returns 0 if OK, or         */
+/*            ERROR_parameter if n is not built in.                      */
+/*                                                                       */
+/*              NUMERIC_double  IEEE double, as evalform (the default).  */
+/*              NUMERIC_long    long double (80 bits on x86).            */
+/*              NUMERIC_fixed   decimal with 18 places in a 128-bit      */
+/*                              integer: exact for + - * and whole       */
+/*                              powers up to +-1.7e20, rounded half away */
+/*                              from zero to 18 places for /, and        */
+/*                              ERROR_overflow past that range.  Other   */
+/*                              functions are computed in long double.   */
+/*                                                                       */
+/*        (2) double calc_eval_number_r (calc_context *c, const char *f, */
+/*                                       size_t n, calc_number *v,       */
+/*                                       int *err)                       */
+/*                                                                       */
+/*            evaluates the formula in the n bytes at f in the           */
+/*            arithmetic of c, stores the value in *v and returns it as  */
+/*            a double.  Formulas that do not compile (:= and function   */
+/*            definitions, syntax errors) are handed to evalform.        */
+/*                                                                       */
+/*        (3) double calc_run_number (calc_program *p, calc_number *vars,*/
+/*                                    calc_number *v, int *err)          */
+/*                                                                       */
+/*            same for a compiled formula, with slots as for calc_run:   */
+/*            vars holds a calc_number per slot, or is NULL for the      */
+/*            variables of the program's context.                        */
+/*                                                                       */
+/*        (4) int calc_assign_number_r (calc_context *c,                 */
+/*                                      const char *name,                */
+/*                                      const calc_number *v)            */
+/*                                                                       */
+/*            sets variable name of c to v.  Returns 0 if OK, >0 for     */
+/*            error.                                                     */
+/*                                                                       */
+/*        (5) calc_numeric_find, calc_number_parse,                      */
+/*            calc_number_from_double, calc_number_double and            */
+/*            calc_number_format convert names, text and doubles.        */
+/*                                                                       */
+/*                                                                       */
+/*        VARIABLES                                                      */
+/*                                                                       */
+/*          A context keeps one double per variable, which evalform and  */
+/*          calc_run use.  Variables set in another arithmetic also keep */
+/*          their value in it, with the version of the variable when it  */
+/*          was set (see symtab.c).  A variable set since then by        */
+/*          evalform, a definition or LOAD has another version, and its  */
+/*          double is read in instead.                                   */
+/*                                                                       */
+/*          Numbers in formulas are read from their text in the          */
+/*          arithmetic of the context they are compiled in, so           */
+/*          9007199254740993 and 0.123456789012345678 are exact in       */
+/*          NUMERIC_fixed and as close as long double goes in            */
+/*          NUMERIC_long.  Programs compiled for doubles only have       */
+/*          doubles, read back from the shortest text that gives the     */
+/*          same double.  %PI and %E are taken to the precision of the   */
+/*          arithmetic.                                                  */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          The interpreter of numrun.h is included once for each        */
+/*          arithmetic, with its operations as macros, so each one       */
+/*          runs with no tests of which arithmetic it is.  Doubles       */
+/*          still go through evalform and calc_run, which are            */
+/*          unchanged.  Programs keep their constants converted, so      */
+/*          converting them costs one pass for each program.             */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "parse.h"
+#include "compile.h"
+#include "number.h"
+#include "numeric.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define LOCALREGISTERS 32
+#define LOCALSLOTS 64
+#define LOCALTEXT 256
+
+/*  CONSTANTS OF builtin.c TO LONG DOUBLE PRECISION  */
+#define LONGPI 3.141592653589793238462643383279502884L
+#define LONGE  2.718281828459045235360287471352662498L
+
+#ifdef __SIZEOF_INT128__
+typedef __int128          fixed_t;
+typedef unsigned __int128 ufixed_t;
+
+#define PLACES    18
+#define FIXEDONE  ((fixed_t) 1000000000000000000LL)
+#define FIXEDMAX  ((fixed_t) (~(ufixed_t) 0 >> 1))
+#define FIXEDMIN  (-FIXEDMAX - 1)
+#define MAXDIGITS 38            /*  decimal digits always in ufixed_t */
+
+/*  %PI AND %E TO 18 PLACES  */
+#define FIXEDPI   ((fixed_t) 3141592653589793238LL)
+#define FIXEDE    ((fixed_t) 2718281828459045235LL)
+
+/*  LARGEST MAGNITUDE OF A FIXED VALUE, AS A LONG DOUBLE  */
+#define FIXEDRANGE 1.7e20L
+#endif
+
+
+/*
+************************************************************************
+Module-Wide Variables
+************************************************************************
+*/
+static const char *NumericNames_m[] = { "double", "long", "fixed", NULL };
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static void         ShortestText (double Value, char *Text, size_t Size);
+static BOOLEAN      GrowNumbers (calc_context *Context);
+static void         SetNumber (calc_context *Context, int VariableID,
+                               const calc_number *Value);
+static int          GetNumber (calc_context *Context, int VariableID,
+                               calc_number *Value);
+static int          PrepareConstants (calc_program *Program);
+static long double  LongDivide (long double a, long double b, int *Error);
+static long double  LongFunction (function_t Function, long double a,
+                                  int *Error);
+#ifdef __SIZEOF_INT128__
+static void         MultiplyWide (ufixed_t a, ufixed_t b, ufixed_t *High,
+                                  ufixed_t *Low);
+static fixed_t      DivideWide (ufixed_t High, ufixed_t Low, ufixed_t d,
+                                BOOLEAN Negative, int *Error);
+static fixed_t      FixedAdd (fixed_t a, fixed_t b, int *Error);
+static fixed_t      FixedSubtract (fixed_t a, fixed_t b, int *Error);
+static fixed_t      FixedNegate (fixed_t a, int *Error);
+static fixed_t      FixedMultiply (fixed_t a, fixed_t b, int *Error);
+static fixed_t      FixedDivide (fixed_t a, fixed_t b, int *Error);
+static fixed_t      FixedPower (fixed_t a, fixed_t b, int *Error);
+static fixed_t      FixedFunction (function_t Function, fixed_t a,
+                                   int *Error);
+static fixed_t      FixedFromLong (long double x, int *Error);
+static long double  FixedToLong (fixed_t a);
+static int          FixedParse (const char *s, size_t Length, fixed_t *Value);
+static int          FixedFormat (fixed_t Value, char *Text, size_t Size);
+#endif
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  SHORTEST TEXT THAT READS BACK AS Value  */
+static void ShortestText (double Value, char *Text, size_t Size)
+   {
+   int Digits;
+
+   for (Digits=15; Digits<17; Digits++)
+      {
+      snprintf (Text, Size, "%.*g", Digits, Value);
+      if (strtod (Text, NULL) == Value)
+         return;
+      }
+   snprintf (Text, Size, "%.17g", Value);
+   }
+
+
+/*  MAKE ROOM FOR A NUMBER FOR EVERY VARIABLE  */
+static BOOLEAN GrowNumbers (calc_context *Context)
+   {
+   calc_numvalue *NewNumbers;
+   int            NewSize;
+
+   NewSize = Context->Variables.NumberOfSymbols;
+   if (NewSize <= Context->NumberSize)
+      return TRUE;
+   if (NewSize < 2*Context->NumberSize)
+      NewSize = 2*Context->NumberSize;
+   NewNumbers = (calc_numvalue *)
+      ArenaResize (Context->Arena, Context->Numbers,
+                   Context->NumberSize * sizeof(calc_numvalue),
+                   NewSize * sizeof(calc_numvalue));
+   if (NewNumbers == NULL)
+      return FALSE;
+   memset (NewNumbers + Context->NumberSize, 0,
+           (NewSize - Context->NumberSize) * sizeof(calc_numvalue));
+   Context->Numbers    = NewNumbers;
+   Context->NumberSize = NewSize;
+   return TRUE;
+   }
+
+
+/*  SET VARIABLE, KEEPING ITS DOUBLE IN STEP - GrowNumbers MUST BE DONE  */
+static void SetNumber (calc_context *Context, int VariableID,
+                       const calc_number *Value)
+   {
+   SetVariableValue (Context, VariableID,
+                     calc_number_double (Context->Numeric, Value));
+   Context->Numbers[VariableID].Value   = *Value;
+   Context->Numbers[VariableID].Version = GetVariableVersion (Context,
+                                                              VariableID);
+   }
+
+
+/*  VALUE OF VARIABLE IN THE ARITHMETIC OF THE CONTEXT - 0 IF OK  */
+static int GetNumber (calc_context *Context, int VariableID,
+                      calc_number *Value)
+   {
+   double Double;
+
+   Double = GetVariableValue (Context, VariableID);
+   if (Context->Definitions != NULL &&
+       VariableError (Context, VariableID) != ERROR_none)
+      return VariableError (Context, VariableID);
+   if (VariableID < Context->NumberSize &&
+       Context->Numbers[VariableID].Version != 0 &&
+       Context->Numbers[VariableID].Version ==
+       GetVariableVersion (Context, VariableID))
+      {
+      *Value = Context->Numbers[VariableID].Value;
+      return ERROR_none;
+      }
+   return calc_number_from_double (Context->Numeric, Double, Value);
+   }
+
+
+/*  CONVERT CONSTANTS OF PROGRAM TO THE ARITHMETIC OF ITS CONTEXT - FROM
+    THEIR TEXT IF THE COMPILER KEPT IT  */
+static int PrepareConstants (calc_program *Program)
+   {
+   calc_number *Constants;
+   const calc_instr *Instr;
+   const char  *Text;
+   int          Numeric;
+   int          Register;
+   int          ErrorCode;
+
+   Numeric = Program->Context->Numeric;
+   if (Program->Numbers != NULL && Program->NumbersNumeric == Numeric)
+      return ERROR_none;
+   Constants = (calc_number *) ArenaAllocate
+      (&Program->Arena, Program->CodeLength * sizeof(calc_number));
+   if (Constants == NULL)
+      return ERROR_heap_full;
+   for (Register=0; Register<Program->CodeLength; Register++)
+      {
+      Instr = Program->Code + Register;
+      if (Instr->Opcode != OPC_Const)
+         continue;
+      if (Instr->A > 0 && Instr->A <= Program->NumberOfLiterals)
+         {
+         Text = Program->Literals[Instr->A - 1];
+         ErrorCode = calc_number_parse ((calc_numeric) Numeric, Text,
+                                        strlen (Text), Constants + Register);
+         }
+      else
+         ErrorCode = calc_number_from_double (Numeric, Instr->Value,
+                                              Constants + Register);
+      if (ErrorCode != ERROR_none)
+         return ErrorCode;
+      }
+   Program->Numbers = Constants;
+   Program->NumbersNumeric = Numeric;
+   return ERROR_none;
+   }
+
+
+/*
+   LONG DOUBLE
+*/
+static long double LongDivide (long double a, long double b, int *Error)
+   {
+   if (b == 0)
+      {
+      *Error = ERROR_division;
+      return 0;
+      }
+   return a / b;
+   }
+
+
+static long double LongFunction (function_t Function, long double a,
+                                 int *Error)
+   {
+   if (!FunctionArgumentOk (Function, (double) a))
+      {
+      *Error = ERROR_parameter;
+      return 0;
+      }
+   switch (Function)
+      {
+      case FUNC_sin    : return sinl (a);
+      case FUNC_cos    : return cosl (a);
+      case FUNC_tan    : return tanl (a);
+      case FUNC_exp    : return expl (a);
+      case FUNC_log    : return logl (a);
+      case FUNC_log10  : return log10l (a);
+      case FUNC_fabs   : return fabsl (a);
+      case FUNC_acos   : return acosl (a);
+      case FUNC_asin   : return asinl (a);
+      case FUNC_atan   : return atanl (a);
+      case FUNC_sqrt   : return sqrtl (a);
+      case FUNC_int    : return truncl (a);
+      default          : return (long double) ApplyFunction (Function, a);
+      }
+   }
+
+
+#define RUNNAME          RunLong
+#define VALUE(n)         ((n).Long)
+#define NEGATE(a)        (-(a))
+#define ADD(a,b)         ((a) + (b))
+#define SUBTRACT(a,b)    ((a) - (b))
+#define MULTIPLY(a,b)    ((a) * (b))
+#define DIVIDE(a,b)      LongDivide (a, b, &Error)
+#define POWER(a,b)       powl (a, b)
+#define FUNCTION(f,a)    LongFunction (f, a, &Error)
+#define MINIMUM(a,b)     fminl (a, b)
+#define MAXIMUM(a,b)     fmaxl (a, b)
+#define ATAN2(a,b)       atan2l (a, b)
+#define HYPOT(a,b)       hypotl (a, b)
+#define FMA(a,b,c)       fmal (a, b, c)
+#include "numrun.h"
+
+
+#ifdef __SIZEOF_INT128__
+/*
+   FIXED POINT - A VALUE IS ITS NUMBER OF 10^-18THS
+*/
+
+/*  256-BIT PRODUCT OF a AND b  */
+static void MultiplyWide (ufixed_t a, ufixed_t b, ufixed_t *High,
+                          ufixed_t *Low)
+   {
+   ufixed_t Low0;
+   ufixed_t Cross1;
+   ufixed_t Cross2;
+   ufixed_t High1;
+   ufixed_t Middle;
+
+   Low0   = (ufixed_t) (unsigned long long) a * (unsigned long long) b;
+   Cross1 = (ufixed_t) (unsigned long long) a * (unsigned long long) (b >> 64);
+   Cross2 = (ufixed_t) (unsigned long long) (a >> 64) * (unsigned long long) b;
+   High1  = (ufixed_t) (unsigned long long) (a >> 64)
+            * (unsigned long long) (b >> 64);
+   Middle = (Low0 >> 64) + (unsigned long long) Cross1
+            + (unsigned long long) Cross2;
+   *Low  = (Middle << 64) | (unsigned long long) Low0;
+   *High = High1 + (Cross1 >> 64) + (Cross2 >> 64) + (Middle >> 64);
+   }
+
+
+/*  (High,Low) / d ROUNDED HALF AWAY FROM ZERO, WITH SIGN  */
+static fixed_t DivideWide (ufixed_t High, ufixed_t Low, ufixed_t d,
+                           BOOLEAN Negative, int *Error)
+   {
+   ufixed_t Quotient;
+   ufixed_t Carry;
+   int      ibit;
+
+   if (High >= d)
+      {
+      *Error = ERROR_overflow;
+      return 0;
+      }
+   for (ibit=0; ibit<128; ibit++)
+      {
+      Carry = High >> 127;
+      High  = (High << 1) | (Low >> 127);
+      Low <<= 1;
+      if (Carry || High >= d)
+         {
+         High -= d;
+         Low  |= 1;
+         }
+      }
+   Quotient = Low;
+   if (High >= d - High)
+      Quotient++;
+   if ((Quotient == 0 && Low != 0) ||
+       Quotient > (ufixed_t) FIXEDMAX + (Negative ? 1 : 0))
+      {
+      *Error = ERROR_overflow;
+      return 0;
+      }
+   return Negative ? (fixed_t) -Quotient : (fixed_t) Quotient;
+   }
+
+
+static fixed_t FixedAdd (fixed_t a, fixed_t b, int *Error)
+   {
+   fixed_t Sum;
+
+   if (__builtin_add_overflow (a, b, &Sum))
+      *Error = ERROR_overflow;
+   return Sum;
+   }
+
+
+static fixed_t FixedSubtract (fixed_t a, fixed_t b, int *Error)
+   {
+   fixed_t Difference;
+
+   if (__builtin_sub_overflow (a, b, &Difference))
+      *Error = ERROR_overflow;
+   return Difference;
+   }
+
+
+static fixed_t FixedNegate (fixed_t a, int *Error)
+   {
+   if (a == FIXEDMIN)
+      {
+      *Error = ERROR_overflow;
+      return 0;
+      }
+   return -a;
+   }
+
+
+static fixed_t FixedMultiply (fixed_t a, fixed_t b, int *Error)
+   {
+   ufixed_t High;
+   ufixed_t Low;
+
+   MultiplyWide (a < 0 ? -(ufixed_t) a : (ufixed_t) a,
+                 b < 0 ? -(ufixed_t) b : (ufixed_t) b, &High, &Low);
+   return DivideWide (High, Low, (ufixed_t) FIXEDONE, (a < 0) != (b < 0),
+                      Error);
+   }
+
+
+static fixed_t FixedDivide (fixed_t a, fixed_t b, int *Error)
+   {
+   ufixed_t High;
+   ufixed_t Low;
+
+   if (b == 0)
+      {
+      *Error = ERROR_division;
+      return 0;
+      }
+   MultiplyWide (a < 0 ? -(ufixed_t) a : (ufixed_t) a, (ufixed_t) FIXEDONE,
+                 &High, &Low);
+   return DivideWide (High, Low, b < 0 ? -(ufixed_t) b : (ufixed_t) b,
+                      (a < 0) != (b < 0), Error);
+   }
+
+
+/*  WHOLE POWERS BY SQUARING, EXACT AS FAR AS 18 PLACES GO  */
+static fixed_t FixedPower (fixed_t a, fixed_t b, int *Error)
+   {
+   fixed_t  Result;
+   fixed_t  Square;
+   ufixed_t Exponent;
+
+   if (b % FIXEDONE != 0)
+      return FixedFromLong (powl (FixedToLong (a), FixedToLong (b)), Error);
+
+   Exponent = b < 0 ? -(ufixed_t) b : (ufixed_t) b;
+   Exponent /= (ufixed_t) FIXEDONE;
+   Result = FIXEDONE;
+   Square = a;
+   while (Exponent != 0 && *Error == ERROR_none)
+      {
+      if (Exponent & 1)
+         Result = FixedMultiply (Result, Square, Error);
+      Exponent >>= 1;
+      if (Exponent != 0)
+         Square = FixedMultiply (Square, Square, Error);
+      }
+   if (b >= 0 || *Error != ERROR_none)
+      return Result;
+   if (Result == 0)
+      {
+      *Error = (a == 0) ? ERROR_division : ERROR_overflow;
+      return 0;
+      }
+   return FixedDivide (FIXEDONE, Result, Error);
+   }
+
+
+static fixed_t FixedFunction (function_t Function, fixed_t a, int *Error)
+   {
+   switch (Function)
+      {
+      case FUNC_fabs:
+         return (a < 0) ? FixedNegate (a, Error) : a;
+      case FUNC_int:
+         return a / FIXEDONE * FIXEDONE;
+      default:
+         return FixedFromLong (LongFunction (Function, FixedToLong (a),
+                                             Error), Error);
+      }
+   }
+
+
+/*  NEAREST FIXED VALUE TO x  */
+static fixed_t FixedFromLong (long double x, int *Error)
+   {
+   if (*Error != ERROR_none)
+      return 0;
+   if (isnan (x))
+      {
+      *Error = ERROR_parameter;
+      return 0;
+      }
+   if (!(fabsl (x) < FIXEDRANGE))
+      {
+      *Error = ERROR_overflow;
+      return 0;
+      }
+   return (fixed_t) roundl (x * 1e18L);
+   }
+
+
+static long double FixedToLong (fixed_t a)
+   {
+   return (long double) a / 1e18L;
+   }
+
+
+/*
+   EXACT VALUE OF DECIMAL TEXT [-+]digits[.digits][e[-+]digits], ROUNDED
+   TO 18 PLACES - 0 IF OK
+*/
+static int FixedParse (const char *s, size_t Length, fixed_t *Value)
+   {
+   const char *End;
+   ufixed_t    Mantissa;
+   ufixed_t    Power;
+   ufixed_t    High;
+   ufixed_t    Low;
+   BOOLEAN     Negative;
+   BOOLEAN     Point;
+   BOOLEAN     AnyDigit;
+   BOOLEAN     RoundUp;
+   int         Digits;
+   int         Exponent;
+   int         ExponentSign;
+   int         Shift;
+   int         Error;
+
+   End = s + Length;
+   Negative = FALSE;
+   if (s < End && (*s == '-' || *s == '+'))
+      Negative = (*s++ == '-');
+
+   /*  UP TO MAXDIGITS SIGNIFICANT DIGITS, WITH THEIR DECIMAL EXPONENT  */
+   Mantissa = 0;
+   Digits = 0;
+   Exponent = 0;
+   Point = FALSE;
+   AnyDigit = FALSE;
+   RoundUp = FALSE;
+   for (; s < End && (isdigit ((unsigned char) *s) || (*s == '.' && !Point));
+        s++)
+      {
+      if (*s == '.')
+         {
+         Point = TRUE;
+         continue;
+         }
+      AnyDigit = TRUE;
+      if (Mantissa == 0 && *s == '0')
+         {
+         Exponent -= Point ? 1 : 0;
+         continue;
+         }
+      Digits++;
+      if (Digits <= MAXDIGITS)
+         {
+         Mantissa = 10*Mantissa + (*s - '0');
+         Exponent -= Point ? 1 : 0;
+         }
+      else
+         {
+         if (Digits == MAXDIGITS+1)
+            RoundUp = (*s >= '5');
+         Exponent += Point ? 0 : 1;
+         }
+      }
+   if (!AnyDigit)
+      return ERROR_operand;
+   Mantissa += RoundUp;
+
+   /*  EXPONENT  */
+   if (s < End && (*s == 'e' || *s == 'E'))
+      {
+      s++;
+      ExponentSign = 1;
+      if (s < End && (*s == '-' || *s == '+'))
+         ExponentSign = (*s++ == '-') ? -1 : 1;
+      if (s == End || !isdigit ((unsigned char) *s))
+         return ERROR_operand;
+      for (Shift = 0; s < End && isdigit ((unsigned char) *s); s++)
+         if (Shift < 10000)
+            Shift = 10*Shift + (*s - '0');
+      Exponent += ExponentSign * Shift;
+      }
+   if (s != End)
+      return ERROR_operand;
+
+   /*  SCALE TO 10^-18THS  */
+   Error = ERROR_none;
+   Shift = Exponent + PLACES;
+   if (Mantissa == 0)
+      *Value = 0;
+   else if (Shift >= 0)
+      {
+      if (Shift > MAXDIGITS)
+         return ERROR_overflow;
+      for (Power=1; Shift>0; Shift--)
+         Power *= 10;
+      MultiplyWide (Mantissa, Power, &High, &Low);
+      *Value = DivideWide (High, Low, 1, Negative, &Error);
+      }
+   else if (-Shift > MAXDIGITS)
+      *Value = 0;
+   else
+      {
+      for (Power=1; Shift<0; Shift++)
+         Power *= 10;
+      *Value = DivideWide (0, Mantissa, Power, Negative, &Error);
+      }
+   return Error;
+   }
+
+
+/*  DECIMAL TEXT WITHOUT TRAILING ZEROS - LENGTH, OR -1 IF NO ROOM  */
+static int FixedFormat (fixed_t Value, char *Text, size_t Size)
+   {
+   char     Digits[64];
+   ufixed_t Magnitude;
+   ufixed_t Whole;
+   unsigned long long Fraction;
+   int      Length;
+   int      Places;
+
+   Magnitude = Value < 0 ? -(ufixed_t) Value : (ufixed_t) Value;
+   Whole     = Magnitude / (ufixed_t) FIXEDONE;
+   Fraction  = (unsigned long long) (Magnitude % (ufixed_t) FIXEDONE);
+
+   /*  DIGITS BACKWARDS: FRACTION, POINT, WHOLE PART, SIGN  */
+   Length = 0;
+   if (Fraction != 0)
+      {
+      for (Places=PLACES; Fraction % 10 == 0; Places--)
+         Fraction /= 10;
+      for (; Places>0; Places--)
+         {
+         Digits[Length++] = (char) ('0' + Fraction % 10);
+         Fraction /= 10;
+         }
+      Digits[Length++] = '.';
+      }
+   do
+      {
+      Digits[Length++] = (char) ('0' + (int) (Whole % 10));
+      Whole /= 10;
+      }
+   while (Whole != 0);
+   if (Value < 0)
+      Digits[Length++] = '-';
+
+   if ((size_t) Length >= Size)
+      return -1;
+   for (Places=0; Places<Length; Places++)
+      Text[Places] = Digits[Length-1-Places];
+   Text[Length] = '\0';
+   return Length;
+   }
+
+
+#define RUNNAME          RunFixed
+#define VALUE(n)         ((n).Fixed)
+#define NEGATE(a)        FixedNegate (a, &Error)
+#define ADD(a,b)         FixedAdd (a, b, &Error)
+#define SUBTRACT(a,b)    FixedSubtract (a, b, &Error)
+#define MULTIPLY(a,b)    FixedMultiply (a, b, &Error)
+#define DIVIDE(a,b)      FixedDivide (a, b, &Error)
+#define POWER(a,b)       FixedPower (a, b, &Error)
+#define FUNCTION(f,a)    FixedFunction (f, a, &Error)
+#define MINIMUM(a,b)     ((a) < (b) ? (a) : (b))
+#define MAXIMUM(a,b)     ((a) > (b) ? (a) : (b))
+#define ATAN2(a,b)       FixedFromLong (atan2l (FixedToLong (a), \
+                                                FixedToLong (b)), &Error)
+#define HYPOT(a,b)       FixedFromLong (hypotl (FixedToLong (a), \
+                                                FixedToLong (b)), &Error)
+#define FMA(a,b,c)       FixedAdd (FixedMultiply (a, b, &Error), c, &Error)
+#include "numrun.h"
+#endif
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+/*  RETURN ARITHMETIC NAMED name ("double", "long", "fixed"), OR -1  */
+int calc_numeric_find (const char *Name)
+   {
+   int inumeric;
+
+   for (inumeric=0; NumericNames_m[inumeric] != NULL; inumeric++)
+      if (strcmp (Name, NumericNames_m[inumeric]) == 0)
+         break;
+#ifndef __SIZEOF_INT128__
+   if (inumeric == NUMERIC_fixed)
+      return -1;
+#endif
+   return (NumericNames_m[inumeric] != NULL) ? inumeric : -1;
+   }
+
+
+int calc_context_set_numeric (calc_context *Context, calc_numeric Numeric)
+   {
+#ifndef __SIZEOF_INT128__
+   if (Numeric == NUMERIC_fixed)
+      return ERROR_parameter;
+#endif
+   if ((int) Numeric < 0 || Numeric >= CALC_NUMERICS)
+      return ERROR_parameter;
+
+   /*  VALUES IN THE OLD ARITHMETIC ARE READ AS DOUBLES  */
+   if ((int) Numeric != Context->Numeric && Context->Numbers != NULL)
+      memset (Context->Numbers, 0,
+              Context->NumberSize * sizeof(calc_numvalue));
+   Context->Numeric = Numeric;
+   return ERROR_none;
+   }
+
+
+double calc_eval_number_r (calc_context *Context, const char *Formula,
+                           size_t Length, calc_number *Value, int *ErrorResult)
+   {
+   calc_program *Program;
+   char          LocalText[LOCALTEXT];
+   char         *Text;
+   char         *f;
+   double        Result;
+   int           ErrorCode;
+
+   memset (Value, 0, sizeof(calc_number));
+   if (Context->Numeric == NUMERIC_double)
+      {
+      Value->Double = calc_eval (Context, Formula, Length, NULL,
+                                 ErrorResult);
+      return Value->Double;
+      }
+
+   /*  calc_compile_r READS A STRING  */
+   Text = LocalText;
+   if (Length >= sizeof(LocalText))
+      Text = (char *) malloc (Length+1);
+   if (Text == NULL)
+      {
+      *ErrorResult = ERROR_heap_full;
+      return 0.0;
+      }
+   memcpy (Text, Formula, Length);
+   Text[Length] = '\0';
+
+   Program = calc_compile_r (Context, Text, &ErrorCode);
+   if (Program != NULL)
+      {
+      Result = calc_run_number (Program, NULL, Value, ErrorResult);
+      calc_free (Program);
+      }
+
+   /*  DEFINITIONS AND ERRORS ARE LEFT TO evalform  */
+   else
+      {
+      f = Text;
+      Result = evalform_r (Context, &f, ErrorResult);
+      if (*ErrorResult == ERROR_none)
+         *ErrorResult = calc_number_from_double (Context->Numeric, Result,
+                                                 Value);
+      }
+
+   if (Text != LocalText)
+      free (Text);
+   return (*ErrorResult == ERROR_none) ? Result : 0.0;
+   }
+
+
+double calc_run_number (calc_program *Program, calc_number *Variables,
+                        calc_number *Value, int *ErrorResult)
+   {
+   calc_context *Context;
+   calc_number   LocalRegisters[LOCALREGISTERS];
+   calc_number   LocalSlots[LOCALSLOTS];
+   double        LocalDoubles[LOCALSLOTS];
+   calc_number  *Registers;
+   calc_number  *Slots;
+   double       *Doubles;
+   double        Result;
+   int           Slot;
+   int           Register;
+
+   Context = Program->Context;
+   memset (Value, 0, sizeof(calc_number));
+   *ErrorResult = ERROR_none;
+
+   /*  DOUBLES RUN AS EVER  */
+   if (Context->Numeric == NUMERIC_double)
+      {
+      if (Variables == NULL)
+         {
+         Value->Double = calc_run (Program, NULL, ErrorResult);
+         return Value->Double;
+         }
+      Doubles = LocalDoubles;
+      if (Program->NumberOfSlots > LOCALSLOTS)
+         Doubles = (double *) ArenaAllocate
+            (Context->Arena, Program->NumberOfSlots * sizeof(double));
+      if (Doubles == NULL)
+         {
+         *ErrorResult = ERROR_heap_full;
+         return 0.0;
+         }
+      for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+         Doubles[Slot] = Variables[Slot].Double;
+      Value->Double = calc_run (Program, Doubles, ErrorResult);
+      for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+         Variables[Slot].Double = Doubles[Slot];
+      if (Doubles != LocalDoubles)
+         ArenaRewind (Context->Arena, Doubles);
+      return Value->Double;
+      }
+
+   /*  ROOM FOR THE NUMBERS OF ASSIGNED VARIABLES AHEAD OF TEMPORARIES  */
+   *ErrorResult = PrepareConstants (Program);
+   if (*ErrorResult == ERROR_none && Variables == NULL &&
+       !GrowNumbers (Context))
+      *ErrorResult = ERROR_heap_full;
+   if (*ErrorResult != ERROR_none)
+      return 0.0;
+
+   Registers = LocalRegisters;
+   if (Program->CodeLength > LOCALREGISTERS)
+      Registers = (calc_number *) ArenaAllocate
+         (Context->Arena, Program->CodeLength * sizeof(calc_number));
+   Slots = Variables;
+   if (Variables == NULL)
+      {
+      Slots = LocalSlots;
+      if (Program->NumberOfSlots > LOCALSLOTS)
+         Slots = (calc_number *) ArenaAllocate
+            (Context->Arena, Program->NumberOfSlots * sizeof(calc_number));
+      }
+   if (Registers == NULL || Slots == NULL)
+      *ErrorResult = ERROR_heap_full;
+
+   /*  VARIABLES OF THE CONTEXT  */
+   for (Slot=0; Variables == NULL && *ErrorResult == ERROR_none &&
+        Slot<Program->NumberOfSlots; Slot++)
+      *ErrorResult = GetNumber (Context, Program->VariableIDs[Slot],
+                                Slots + Slot);
+
+   if (*ErrorResult == ERROR_none)
+      {
+#ifdef __SIZEOF_INT128__
+      if (Context->Numeric == NUMERIC_fixed)
+         *ErrorResult = RunFixed (Program, (calc_number *) Program->Numbers,
+                                  Registers, Slots);
+      else
+#endif
+         *ErrorResult = RunLong (Program, (calc_number *) Program->Numbers,
+                                 Registers, Slots);
+      }
+
+   /*  ASSIGNMENTS REACH THE CONTEXT ONLY IF THE FORMULA WORKED  */
+   Result = 0.0;
+   if (*ErrorResult == ERROR_none)
+      {
+      if (Variables == NULL)
+         for (Register=0; Register<Program->CodeLength; Register++)
+            if (Program->Code[Register].Opcode == OPC_Store)
+               SetNumber (Context,
+                          Program->VariableIDs[Program->Code[Register].A],
+                          Registers + Register);
+      *Value = Registers[Program->Result];
+      Result = calc_number_double (Context->Numeric, Value);
+      }
+
+   if (Slots != Variables && Slots != LocalSlots)
+      ArenaRewind (Context->Arena, Slots);
+   if (Registers != LocalRegisters)
+      ArenaRewind (Context->Arena, Registers);
+   return Result;
+   }
+
+
+int calc_assign_number_r (calc_context *Context, const char *Name,
+                          const calc_number *Value)
+   {
+   int VariableID;
+
+   VariableID = AssignVariable_r (Context, (char *) Name,
+                                  calc_number_double (Context->Numeric,
+                                                      Value));
+   if (VariableID == NOROOM)
+      return ERROR_variable_full;
+   if (VariableID < 0)
+      return ERROR_heap_full;
+   if (Context->Numeric == NUMERIC_double)
+      return ERROR_none;
+   if (!GrowNumbers (Context))
+      return ERROR_heap_full;
+   SetNumber (Context, VariableID, Value);
+   return ERROR_none;
+   }
+
+
+/*  VALUE OF NUMBER IN THE n BYTES AT s - 0 IF OK  */
+int calc_number_parse (calc_numeric Numeric, const char *s, size_t Length,
+                       calc_number *Value)
+   {
+   char  LocalText[CALC_NUMBERTEXT];
+   char *Text;
+   char *End;
+   int   ErrorCode;
+
+   memset (Value, 0, sizeof(calc_number));
+   switch (Numeric)
+      {
+      case NUMERIC_double:
+         Value->Double = calc_strntod (s, Length, &End);
+         return (End == s + Length && Length > 0) ? ERROR_none
+                                                   : ERROR_operand;
+      /*  strtold READS A STRING - LONG DIGIT STRINGS ARE COPIED TO THE HEAP  */
+      case NUMERIC_long:
+         if (Length == 0)
+            return ERROR_operand;
+         Text = LocalText;
+         if (Length >= sizeof(LocalText))
+            Text = (char *) malloc (Length+1);
+         if (Text == NULL)
+            return ERROR_heap_full;
+         memcpy (Text, s, Length);
+         Text[Length] = '\0';
+         Value->Long = strtold (Text, &End);
+         ErrorCode = (*End == '\0') ? ERROR_none : ERROR_operand;
+         if (Text != LocalText)
+            free (Text);
+         return ErrorCode;
+#ifdef __SIZEOF_INT128__
+      case NUMERIC_fixed:
+         return FixedParse (s, Length, &Value->Fixed);
+#endif
+      default:
+         return ERROR_parameter;
+      }
+   }
+
+
+/*  NUMBER CLOSEST TO THE SHORTEST TEXT OF v - 0 IF OK  */
+int calc_number_from_double (calc_numeric Numeric, double v,
+                             calc_number *Value)
+   {
+   char Text[CALC_NUMBERTEXT];
+   int  ErrorCode;
+
+   memset (Value, 0, sizeof(calc_number));
+   ErrorCode = ERROR_none;
+   switch (Numeric)
+      {
+      case NUMERIC_double:
+         Value->Double = v;
+         break;
+      case NUMERIC_long:
+         if (v == M_PI)
+            Value->Long = LONGPI;
+         else if (v == M_E)
+            Value->Long = LONGE;
+         else if (!isfinite (v))
+            Value->Long = v;
+         else
+            {
+            ShortestText (v, Text, sizeof(Text));
+            Value->Long = strtold (Text, NULL);
+            }
+         break;
+#ifdef __SIZEOF_INT128__
+      case NUMERIC_fixed:
+         if (v == M_PI)
+            Value->Fixed = FIXEDPI;
+         else if (v == M_E)
+            Value->Fixed = FIXEDE;
+         else if (isnan (v))
+            ErrorCode = ERROR_parameter;
+         else if (!isfinite (v))
+            ErrorCode = ERROR_overflow;
+         else
+            {
+            ShortestText (v, Text, sizeof(Text));
+            ErrorCode = FixedParse (Text, strlen (Text), &Value->Fixed);
+            }
+         break;
+#endif
+      default:
+         ErrorCode = ERROR_parameter;
+         break;
+      }
+   return ErrorCode;
+   }
+
+
+double calc_number_double (calc_numeric Numeric, const calc_number *Value)
+   {
+   switch (Numeric)
+      {
+      case NUMERIC_long:
+         return (double) Value->Long;
+#ifdef __SIZEOF_INT128__
+      case NUMERIC_fixed:
+         return (double) FixedToLong (Value->Fixed);
+#endif
+      default:
+         return Value->Double;
+      }
+   }
+
+
+/*  TEXT OF NUMBER TO ALL ITS PRECISION - LENGTH, OR -1 IF NO ROOM  */
+int calc_number_format (calc_numeric Numeric, const calc_number *Value,
+                        char *Text, size_t Size)
+   {
+   int Length;
+
+   switch (Numeric)
+      {
+      case NUMERIC_long:
+         Length = snprintf (Text, Size, "%.18Lg", Value->Long);
+         break;
+#ifdef __SIZEOF_INT128__
+      case NUMERIC_fixed:
+         return FixedFormat (Value->Fixed, Text, Size);
+#endif
+      default:
+         Length = snprintf (Text, Size, "%.17g", Value->Double);
+         break;
+      }
+   return ((size_t) Length < Size) ? Length : -1;
+   }
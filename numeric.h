@@ -0,0 +1,54 @@
+#ifndef __NUMERIC_H
+#define __NUMERIC_H
+
+#include <stddef.h>
+#include "parse.h"
+#include "compile.h"
+
+/*  ARITHMETIC OF A CONTEXT (SEE numeric.c)  */
+typedef enum
+   {
+   NUMERIC_double,              /*  IEEE double, as evalform         */
+   NUMERIC_long,                /*  long double                      */
+   NUMERIC_fixed                /*  decimal, 18 places, in 128 bits  */
+   } calc_numeric;
+
+#define CALC_NUMERICS (NUMERIC_fixed+1)
+
+/*  ROOM FOR ANY NUMBER PRINTED BY calc_number_format  */
+#define CALC_NUMBERTEXT 64
+
+/*  VALUE IN THE ARITHMETIC OF A CONTEXT  */
+typedef union
+   {
+   double        Double;
+   long double   Long;
+#ifdef __SIZEOF_INT128__
+   __int128      Fixed;         /*  value times 10^18                */
+#endif
+   } calc_number;
+
+/*  VALUE OF A VARIABLE IN THE ARITHMETIC OF ITS CONTEXT  */
+struct calc_numvalue
+   {
+   calc_number   Value;
+   unsigned long Version;       /*  of the variable when set, 0 none */
+   };
+
+int    calc_numeric_find  (const char *name);
+int    calc_context_set_numeric (calc_context *ctx, calc_numeric numeric);
+double calc_eval_number_r (calc_context *ctx, const char *f, size_t len,
+                           calc_number *value, int *err);
+double calc_run_number    (calc_program *prog, calc_number *vars,
+                           calc_number *value, int *err);
+int    calc_assign_number_r (calc_context *ctx, const char *name,
+                             const calc_number *value);
+int    calc_number_parse  (calc_numeric numeric, const char *s, size_t len,
+                           calc_number *value);
+int    calc_number_from_double (calc_numeric numeric, double v,
+                                calc_number *value);
+double calc_number_double (calc_numeric numeric, const calc_number *value);
+int    calc_number_format (calc_numeric numeric, const calc_number *value,
+                           char *buf, size_t size);
+
+#endif
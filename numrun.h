@@ -0,0 +1,112 @@
+/*
+   INTERPRETER OF COMPILED FORMULAS IN ONE ARITHMETIC, INCLUDED BY
+   numeric.c ONCE FOR EACH SO THAT EVERY OPERATION IS INLINE.  BEFORE
+   INCLUDING, DEFINE
+
+      RUNNAME           name of the interpreter
+      VALUE(n)          member of calc_number holding the value
+      NEGATE(a)  ADD(a,b)  SUBTRACT(a,b)  MULTIPLY(a,b)  DIVIDE(a,b)
+      POWER(a,b)  FUNCTION(f,a)  MINIMUM(a,b)  MAXIMUM(a,b)
+      ATAN2(a,b)  HYPOT(a,b)  FMA(a,b,c)
+                        result of each instruction, which may set the
+                        local errorcode_t Error
+
+   Constants holds the converted value of every OPC_Const.  Assignments
+   are stored into Slots.  RUNNAME returns ERROR_none, or the first error,
+   where it stops.  The macros are undefined afterwards.
+*/
+static int RUNNAME (const calc_program *Program, const calc_number *Constants,
+                    calc_number *Registers, calc_number *Slots)
+   {
+   const calc_instr *Instr;
+   const calc_instr *EndCode;
+   calc_number      *r;
+   int               Error;
+
+   Error = ERROR_none;
+   r = Registers;
+   EndCode = Program->Code + Program->CodeLength;
+   for (Instr=Program->Code; Instr<EndCode; Instr++, r++)
+      {
+      switch (Instr->Opcode)
+         {
+         case OPC_Const:
+            *r = Constants[Instr - Program->Code];
+            break;
+         case OPC_Load:
+            *r = Slots[Instr->A];
+            break;
+         case OPC_Store:
+            *r = Registers[Instr->B];
+            Slots[Instr->A] = *r;
+            break;
+         case OPC_Negate:
+            VALUE (*r) = NEGATE (VALUE (Registers[Instr->A]));
+            break;
+         case OPC_Add:
+            VALUE (*r) = ADD (VALUE (Registers[Instr->A]),
+                              VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Subtract:
+            VALUE (*r) = SUBTRACT (VALUE (Registers[Instr->A]),
+                                   VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Multiply:
+            VALUE (*r) = MULTIPLY (VALUE (Registers[Instr->A]),
+                                   VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Divide:
+            VALUE (*r) = DIVIDE (VALUE (Registers[Instr->A]),
+                                 VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Power:
+            VALUE (*r) = POWER (VALUE (Registers[Instr->A]),
+                                VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Function:
+            VALUE (*r) = FUNCTION ((function_t) Instr->B,
+                                   VALUE (Registers[Instr->A]));
+            break;
+         case OPC_Min:
+            VALUE (*r) = MINIMUM (VALUE (Registers[Instr->A]),
+                                  VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Max:
+            VALUE (*r) = MAXIMUM (VALUE (Registers[Instr->A]),
+                                  VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Atan2:
+            VALUE (*r) = ATAN2 (VALUE (Registers[Instr->A]),
+                                VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Hypot:
+            VALUE (*r) = HYPOT (VALUE (Registers[Instr->A]),
+                                VALUE (Registers[Instr->B]));
+            break;
+         case OPC_Fma:
+            VALUE (*r) = FMA (VALUE (Registers[Instr->A]),
+                              VALUE (Registers[Instr->B]),
+                              VALUE (Registers[Instr->C]));
+            break;
+         }
+      /*  STOP AT FIRST ERROR  */
+      if (Error != ERROR_none)
+         break;
+      }
+   return Error;
+   }
+
+#undef RUNNAME
+#undef VALUE
+#undef NEGATE
+#undef ADD
+#undef SUBTRACT
+#undef MULTIPLY
+#undef DIVIDE
+#undef POWER
+#undef FUNCTION
+#undef MINIMUM
+#undef MAXIMUM
+#undef ATAN2
+#undef HYPOT
+#undef FMA
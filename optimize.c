@@ -0,0 +1,309 @@
+/*                                                                       */
+/*                                                                       */
+/*   OPTIMIZER FOR COMPILED FORMULAS                                     */
+/*                                                                       */
+/*        int OptimizeProgram (calc_program *p)                          */
+/*                                                                       */
+/*            rewrites program in place and returns the number of        */
+/*            instructions removed.  Called by calc_compile; the         */
+/*            count is available through calc_nremoved.                  */
+/*                                                                       */
+/*                                                                       */
+/*        PASSES                                                         */
+/*                                                                       */
+/*          (1) constant folding - an instruction whose operands are     */
+/*              all constants becomes a constant.  Division by zero      */
+/*              and out-of-range function parameters are left for        */
+/*              calc_run so that they still report their error.          */
+/*                                                                       */
+/*          (2) common subexpressions - instructions are hash-consed     */
+/*              as they are rewritten, so an instruction identical to    */
+/*              an earlier one (same opcode, operands and constant)      */
+/*              reuses the earlier register.  Loads only see the         */
+/*              values passed to calc_run, so repeated loads of a        */
+/*              slot are merged as well.  Stores are never merged.       */
+/*                                                                       */
+/*          (3) dead code - instructions not needed by the result or     */
+/*              by a store are dropped.  Divisions and functions are     */
+/*              kept since they may still report an error.               */
+/*                                                                       */
+/*          Folded values are computed with the same operations          */
+/*          calc_run would use, so results are bit-identical.  Nothing   */
+/*          is folded for a context in another arithmetic (numeric.c).   */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "parse.h"
+#include "compile.h"
+#include "numeric.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define EMPTY -1
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static unsigned  HashInstruction (const calc_instr *Instr);
+static BOOLEAN   SameInstruction (const calc_instr *a, const calc_instr *b);
+static void      RemapOperands (calc_instr *Instr, const int *Map);
+static BOOLEAN   FoldConstant (calc_instr *Instr, const calc_instr *Code);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+static unsigned HashInstruction (const calc_instr *Instr)
+   {
+   unsigned      Hash;
+   unsigned char Bytes[sizeof(double)];
+   unsigned      ibyte;
+
+   Hash = 2166136261u;
+   Hash = (Hash ^ (unsigned) Instr->Opcode) * 16777619u;
+   Hash = (Hash ^ (unsigned) Instr->A) * 16777619u;
+   Hash = (Hash ^ (unsigned) Instr->B) * 16777619u;
+   Hash = (Hash ^ (unsigned) Instr->C) * 16777619u;
+   memcpy (Bytes, &Instr->Value, sizeof(double));
+   for (ibyte=0; ibyte<sizeof(double); ibyte++)
+      Hash = (Hash ^ Bytes[ibyte]) * 16777619u;
+   return Hash;
+   }
+
+
+/*  CONSTANTS MUST MATCH BIT FOR BIT (0.0 AND -0.0 DIFFER)  */
+static BOOLEAN SameInstruction (const calc_instr *a, const calc_instr *b)
+   {
+   return a->Opcode == b->Opcode && a->A == b->A && a->B == b->B &&
+          a->C == b->C &&
+          memcmp (&a->Value, &b->Value, sizeof(double)) == 0;
+   }
+
+
+/*  REPLACE OPERAND REGISTERS BY THEIR NEW NUMBERS  */
+static void RemapOperands (calc_instr *Instr, const int *Map)
+   {
+   switch (Instr->Opcode)
+      {
+      case OPC_Const:
+      case OPC_Load:
+         break;
+      case OPC_Store:
+         Instr->B = Map[Instr->B];
+         break;
+      case OPC_Negate:
+      case OPC_Function:
+         Instr->A = Map[Instr->A];
+         break;
+      case OPC_Fma:
+         Instr->A = Map[Instr->A];
+         Instr->B = Map[Instr->B];
+         Instr->C = Map[Instr->C];
+         break;
+      default:
+         Instr->A = Map[Instr->A];
+         Instr->B = Map[Instr->B];
+         break;
+      }
+   }
+
+
+/*  TURN INSTRUCTION WITH CONSTANT OPERANDS INTO A CONSTANT  */
+static BOOLEAN FoldConstant (calc_instr *Instr, const calc_instr *Code)
+   {
+   double a;
+   double b;
+   double c;
+   double Value;
+
+   /*  ONLY PURE INSTRUCTIONS WITH CONSTANT OPERANDS  */
+   switch (Instr->Opcode)
+      {
+      case OPC_Negate:
+      case OPC_Function:
+         if (Code[Instr->A].Opcode != OPC_Const)
+            return FALSE;
+         break;
+      case OPC_Add:
+      case OPC_Subtract:
+      case OPC_Multiply:
+      case OPC_Divide:
+      case OPC_Power:
+      case OPC_Min:
+      case OPC_Max:
+      case OPC_Atan2:
+      case OPC_Hypot:
+         if (Code[Instr->A].Opcode != OPC_Const ||
+             Code[Instr->B].Opcode != OPC_Const)
+            return FALSE;
+         break;
+      case OPC_Fma:
+         if (Code[Instr->A].Opcode != OPC_Const ||
+             Code[Instr->B].Opcode != OPC_Const ||
+             Code[Instr->C].Opcode != OPC_Const)
+            return FALSE;
+         break;
+      default:
+         return FALSE;
+      }
+
+   a = Code[Instr->A].Value;
+   b = (Instr->Opcode == OPC_Negate || Instr->Opcode == OPC_Function)
+       ? 0.0 : Code[Instr->B].Value;
+   c = (Instr->Opcode == OPC_Fma) ? Code[Instr->C].Value : 0.0;
+   switch (Instr->Opcode)
+      {
+      case OPC_Negate:   Value = -a;          break;
+      case OPC_Add:      Value = a + b;       break;
+      case OPC_Subtract: Value = a - b;       break;
+      case OPC_Multiply: Value = a * b;       break;
+      case OPC_Divide:
+         /*  LEAVE DIVISION BY ZERO TO REPORT AT RUN TIME  */
+         if (b == 0)
+            return FALSE;
+         Value = a / b;
+         break;
+      case OPC_Power:    Value = pow (a, b);  break;
+      case OPC_Min:      Value = fmin (a, b); break;
+      case OPC_Max:      Value = fmax (a, b); break;
+      case OPC_Atan2:    Value = atan2 (a, b); break;
+      case OPC_Hypot:    Value = hypot (a, b); break;
+      case OPC_Fma:      Value = fma (a, b, c); break;
+      case OPC_Function:
+         if (!FunctionArgumentOk ((function_t) Instr->B, a))
+            return FALSE;
+         Value = ApplyFunction ((function_t) Instr->B, a);
+         break;
+      default:
+         return FALSE;
+      }
+
+   Instr->Opcode = OPC_Const;
+   Instr->A      = 0;
+   Instr->B      = 0;
+   Instr->C      = 0;
+   Instr->Value  = Value;
+   return TRUE;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+int OptimizeProgram (calc_program *Program)
+   {
+   calc_instr *Code = Program->Code;
+   int        *Map;
+   int        *Buckets;
+   char       *Live;
+   int         NumberOfBuckets;
+   int         NewLength;
+   int         OldLength;
+   int         Operand[MAXOPERANDS];
+   int         NumberOfOperands;
+   int         Bucket;
+   int         iinstr;
+   int         iop;
+   calc_instr  Instr;
+
+   OldLength = Program->CodeLength;
+   if (OldLength <= 0)
+      return 0;
+   NumberOfBuckets = 1;
+   while (NumberOfBuckets < 2*OldLength)
+      NumberOfBuckets *= 2;
+   Map     = (int *) ArenaAllocate (&Program->Arena, OldLength * sizeof(int));
+   Buckets = (int *) ArenaAllocate (&Program->Arena,
+                                    NumberOfBuckets * sizeof(int));
+   Live    = (char *) ArenaAllocate (&Program->Arena, OldLength);
+   if (Map == NULL || Buckets == NULL || Live == NULL)
+      {
+      ArenaRewind (&Program->Arena, Map);
+      return 0;
+      }
+   for (Bucket=0; Bucket<NumberOfBuckets; Bucket++)
+      Buckets[Bucket] = EMPTY;
+
+   /*  FOLD AND HASH-CONS - NEW CODE NEVER RUNS AHEAD OF OLD  */
+   NewLength = 0;
+   for (iinstr=0; iinstr<OldLength; iinstr++)
+      {
+      Instr = Code[iinstr];
+      RemapOperands (&Instr, Map);
+      if (Program->Context->Numeric == NUMERIC_double)
+         FoldConstant (&Instr, Code);
+
+      /*  LOOK FOR IDENTICAL EARLIER INSTRUCTION  */
+      if (Instr.Opcode != OPC_Store)
+         {
+         Bucket = HashInstruction (&Instr) & (NumberOfBuckets-1);
+         while (Buckets[Bucket] != EMPTY &&
+                !SameInstruction (&Code[Buckets[Bucket]], &Instr))
+            Bucket = (Bucket+1) & (NumberOfBuckets-1);
+         if (Buckets[Bucket] != EMPTY)
+            {
+            Map[iinstr] = Buckets[Bucket];
+            continue;
+            }
+         Buckets[Bucket] = NewLength;
+         }
+      Code[NewLength] = Instr;
+      Map[iinstr] = NewLength++;
+      }
+   Program->Result = Map[Program->Result];
+
+   /*  MARK INSTRUCTIONS NEEDED BY RESULT AND STORES  */
+   memset (Live, 0, NewLength);
+   Live[Program->Result] = TRUE;
+   for (iinstr=NewLength-1; iinstr>=0; iinstr--)
+      {
+      if (Code[iinstr].Opcode == OPC_Store  ||
+          Code[iinstr].Opcode == OPC_Divide ||
+          Code[iinstr].Opcode == OPC_Function)
+         Live[iinstr] = TRUE;
+      if (!Live[iinstr])
+         continue;
+      NumberOfOperands = InstructionOperands (&Code[iinstr], Operand);
+      for (iop=0; iop<NumberOfOperands; iop++)
+         Live[Operand[iop]] = TRUE;
+      }
+
+   /*  DROP DEAD INSTRUCTIONS  */
+   Program->CodeLength = 0;
+   for (iinstr=0; iinstr<NewLength; iinstr++)
+      {
+      if (!Live[iinstr])
+         continue;
+      Instr = Code[iinstr];
+      RemapOperands (&Instr, Map);
+      Code[Program->CodeLength] = Instr;
+      Map[iinstr] = Program->CodeLength++;
+      }
+   Program->Result = Map[Program->Result];
+
+   ArenaRewind (&Program->Arena, Map);
+   return OldLength - Program->CodeLength;
+   }
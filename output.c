@@ -0,0 +1,301 @@
+/*                                                                       */
+/*                                                                       */
+/*   BATCH RESULTS FOR PROGRAMS                                          */
+/*                                                                       */
+/*      Results written as data rather than text, so that programs       */
+/*      reading them need not parse numbers back.                        */
+/*                                                                       */
+/*        (1) int calc_output_find (const char *name)                    */
+/*                                                                       */
+/*            returns format named name ("binary", "framed" or "csv"),   */
+/*            or -1.                                                     */
+/*                                                                       */
+/*        (2) calc_output *calc_output_new (FILE *stream,                */
+/*                                          calc_resultformat format)    */
+/*                                                                       */
+/*            returns writer of results to stream.  Returns NULL if      */
+/*            memory is exhausted.                                       */
+/*                                                                       */
+/*        (3) void calc_output_result (calc_output *out,                 */
+/*                                     unsigned long line, int err,      */
+/*                                     double value)                     */
+/*                                                                       */
+/*            adds result of input line number line: value if err is     */
+/*            0, else error code err.                                    */
+/*                                                                       */
+/*        (4) int calc_output_flush (calc_output *out)                   */
+/*                                                                       */
+/*            writes buffered results and flushes stream.  Returns 0,    */
+/*            or EOF if writing failed.                                  */
+/*                                                                       */
+/*        (5) int calc_output_free (calc_output *out)                    */
+/*                                                                       */
+/*            flushes and releases writer (not the stream).              */
+/*                                                                       */
+/*        (6) unsigned char *calc_output_frame (unsigned char *record,   */
+/*                                unsigned long line, int err,           */
+/*                                double value)                          */
+/*                                                                       */
+/*            stores the framed record of a result at record (which      */
+/*            must have CALC_FRAMESIZE bytes) and returns the byte       */
+/*            after it, for writers other than a stream (see server.c).  */
+/*                                                                       */
+/*                                                                       */
+/*        FORMATS                                                        */
+/*                                                                       */
+/*          binary   each result is a little-endian IEEE double.  An     */
+/*                   error is a quiet NaN whose low bits hold its code,  */
+/*                   which no result has (their NaNs have no payload).   */
+/*                                                                       */
+/*          framed   each result is 24 bytes, all little-endian: line    */
+/*                   number (8 bytes), error code (4), zero (4) and      */
+/*                   value (8, 0 for errors).                            */
+/*                                                                       */
+/*          csv      a "line,error,value" header, then one row per       */
+/*                   result.  Values are printed with 17 digits, so they */
+/*                   read back exactly; errors have an empty value.      */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Results are encoded into a buffer of OUTPUTBLOCK bytes that  */
+/*          is written with one fwrite when full, which is far cheaper   */
+/*          than formatting each number with printf.                     */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "output.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define OUTPUTBLOCK  (1024 * 1024)
+#define MAXRECORD    64           /*  longest csv row                  */
+#define ERRORNAN     0x7FF8000000000000ULL
+#define MAXWHOLE     1e17         /*  whole numbers %.17g prints as such */
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+struct calc_output
+   {
+   FILE            *Stream;
+   calc_resultformat Format;
+   unsigned char   *Buffer;
+   size_t           Length;
+   int              Failed;       /*  a write has failed               */
+   };
+
+
+/*
+************************************************************************
+Module-Wide Variables
+************************************************************************
+*/
+static const char *FormatNames_m[] = { "binary", "framed", "csv", NULL };
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static unsigned char *PutInteger (unsigned char *Buffer, uint64_t Value,
+                                  int Bytes);
+static unsigned char *PutDouble (unsigned char *Buffer, double Value);
+static unsigned char *PutWhole (unsigned char *Buffer, uint64_t Value);
+static unsigned char *PutText (unsigned char *Buffer, double Value);
+static void           WriteBuffer (calc_output *Output);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  STORE LOW Bytes BYTES OF Value, LEAST SIGNIFICANT FIRST  */
+static unsigned char *PutInteger (unsigned char *Buffer, uint64_t Value,
+                                  int Bytes)
+   {
+   int ibyte;
+
+   for (ibyte=0; ibyte<Bytes; ibyte++)
+      Buffer[ibyte] = (unsigned char) (Value >> (8*ibyte));
+   return Buffer + Bytes;
+   }
+
+
+static unsigned char *PutDouble (unsigned char *Buffer, double Value)
+   {
+   uint64_t Bits;
+
+   memcpy (&Bits, &Value, sizeof(double));
+   return PutInteger (Buffer, Bits, 8);
+   }
+
+
+/*  DECIMAL DIGITS OF Value  */
+static unsigned char *PutWhole (unsigned char *Buffer, uint64_t Value)
+   {
+   unsigned char Digits[20];
+   int           Length = 0;
+
+   do
+      {
+      Digits[Length++] = (unsigned char) ('0' + Value % 10);
+      Value /= 10;
+      }
+   while (Value != 0);
+   while (Length > 0)
+      *Buffer++ = Digits[--Length];
+   return Buffer;
+   }
+
+
+/*  Value AS "%.17g" PRINTS IT - WHOLE NUMBERS WITHOUT printf  */
+static unsigned char *PutText (unsigned char *Buffer, double Value)
+   {
+   if (!(Value < MAXWHOLE && Value > -MAXWHOLE) ||
+       Value != (double) (int64_t) Value || (Value == 0.0 && signbit (Value)))
+      return Buffer + sprintf ((char *) Buffer, "%.17g", Value);
+   if (Value < 0)
+      {
+      *Buffer++ = '-';
+      Value = -Value;
+      }
+   return PutWhole (Buffer, (uint64_t) Value);
+   }
+
+
+static void WriteBuffer (calc_output *Output)
+   {
+   if (Output->Length > 0 &&
+       fwrite (Output->Buffer, 1, Output->Length, Output->Stream)
+       != Output->Length)
+      Output->Failed = 1;
+   Output->Length = 0;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+int calc_output_find (const char *Name)
+   {
+   int iformat;
+
+   for (iformat=0; FormatNames_m[iformat] != NULL; iformat++)
+      if (strcmp (Name, FormatNames_m[iformat]) == 0)
+         return iformat;
+   return -1;
+   }
+
+
+calc_output *calc_output_new (FILE *Stream, calc_resultformat Format)
+   {
+   calc_output *Output;
+
+   Output = (calc_output *) calloc (1, sizeof(calc_output));
+   if (Output == NULL)
+      return NULL;
+   Output->Buffer = (unsigned char *) malloc (OUTPUTBLOCK);
+   if (Output->Buffer == NULL)
+      {
+      free (Output);
+      return NULL;
+      }
+   Output->Stream = Stream;
+   Output->Format = Format;
+   if (Format == OUTPUT_csv)
+      {
+      strcpy ((char *) Output->Buffer, "line,error,value\n");
+      Output->Length = strlen ((char *) Output->Buffer);
+      }
+   return Output;
+   }
+
+
+void calc_output_result (calc_output *Output, unsigned long Line, int Error,
+                         double Value)
+   {
+   unsigned char *Record;
+
+   if (Output->Length + MAXRECORD > OUTPUTBLOCK)
+      WriteBuffer (Output);
+   Record = Output->Buffer + Output->Length;
+
+   switch (Output->Format)
+      {
+      case OUTPUT_binary:
+         if (Error != 0)
+            Record = PutInteger (Record, ERRORNAN | (unsigned) Error, 8);
+         else
+            Record = PutDouble (Record, Value);
+         break;
+      case OUTPUT_framed:
+         Record = calc_output_frame (Record, Line, Error, Value);
+         break;
+      case OUTPUT_csv:
+         Record = PutWhole (Record, Line);
+         *Record++ = ',';
+         Record = PutWhole (Record, (unsigned) Error);
+         *Record++ = ',';
+         if (Error == 0)
+            Record = PutText (Record, Value);
+         *Record++ = '\n';
+         break;
+      }
+   Output->Length = Record - Output->Buffer;
+   }
+
+
+int calc_output_flush (calc_output *Output)
+   {
+   WriteBuffer (Output);
+   if (fflush (Output->Stream) != 0)
+      Output->Failed = 1;
+   return Output->Failed ? EOF : 0;
+   }
+
+
+int calc_output_free (calc_output *Output)
+   {
+   int Result;
+
+   if (Output == NULL)
+      return 0;
+   Result = calc_output_flush (Output);
+   free (Output->Buffer);
+   free (Output);
+   return Result;
+   }
+
+
+unsigned char *calc_output_frame (unsigned char *Record, unsigned long Line,
+                                  int Error, double Value)
+   {
+   Record = PutInteger (Record, Line, 8);
+   Record = PutInteger (Record, (unsigned) Error, 4);
+   Record = PutInteger (Record, 0, 4);
+   return PutDouble (Record, (Error != 0) ? 0.0 : Value);
+   }
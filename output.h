@@ -0,0 +1,28 @@
+#ifndef __OUTPUT_H
+#define __OUTPUT_H
+
+#include <stdio.h>
+
+/*  BATCH RESULT FORMATS OTHER THAN TEXT  */
+typedef enum
+   {
+   OUTPUT_binary,               /*  value, 8 bytes                   */
+   OUTPUT_framed,               /*  line, error, value - 24 bytes    */
+   OUTPUT_csv                   /*  line,error,value                 */
+   } calc_resultformat;
+
+/*  BYTES OF A FRAMED RESULT  */
+#define CALC_FRAMESIZE 24
+
+typedef struct calc_output calc_output;
+
+int          calc_output_find   (const char *name);
+calc_output *calc_output_new    (FILE *stream, calc_resultformat format);
+void         calc_output_result (calc_output *out, unsigned long line,
+                                 int err, double value);
+int          calc_output_flush  (calc_output *out);
+int          calc_output_free   (calc_output *out);
+unsigned char *calc_output_frame (unsigned char *record, unsigned long line,
+                                  int err, double value);
+
+#endif
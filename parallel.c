@@ -0,0 +1,430 @@
+/*                                                                       */
+/*                                                                       */
+/*   PARALLEL REDUCTION OF COMPILED FORMULAS                             */
+/*                                                                       */
+/*      USER CALLABLE ROUTINES                                           */
+/*                                                                       */
+/*        (1) double calc_run_parallel (calc_program *p, double *vars,   */
+/*                                      calc_pool *pool, int *err)       */
+/*                                                                       */
+/*            returns value of compiled formula as calc_run does, but    */
+/*            splits a formula that is a sum or product of at least      */
+/*            CALC_PARALLELTERMS terms over the workers of pool.  The    */
+/*            result is the same on every run and for any number of      */
+/*            workers, pool NULL included.  Other formulas, and those    */
+/*            that assign variables, are run by calc_run.                */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          The terms are the operands of the chain of + and - (or *)    */
+/*          instructions ending at the result, in order.  They are cut   */
+/*          into chunks of CHUNKTERMS, and each instruction is given to  */
+/*          the one chunk whose terms need it, or shared if several do.  */
+/*          Shared instructions run first on the calling thread; then    */
+/*          every chunk runs its own instructions and adds (multiplies)  */
+/*          its terms left to right, and the partial results are         */
+/*          combined in chunk order.  The chunks depend only on the      */
+/*          program, so this order never changes, but it is not the      */
+/*          order of evalform: a sum may differ from calc_run in its     */
+/*          last bits.                                                   */
+/*                                                                       */
+/*          The plan is made on the first run and kept with the          */
+/*          program.  Chunks run with IEEE arithmetic and no checks, as  */
+/*          calc_run first does (see compile.c); if any operation        */
+/*          failed the formula is run again by calc_run, which reports   */
+/*          the error.                                                   */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "parse.h"
+#include "compile.h"
+#include "pool.h"
+#include "parallel.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define CHUNKTERMS 2048
+#define LOCALSLOTS 64
+
+/*  OWNER OF AN INSTRUCTION, BESIDES THE NUMBER OF A CHUNK  */
+#define UNUSED -3
+#define SPINE  -2
+#define SHARED -1
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  HOW A PROGRAM IS SPLIT - NumberOfChunks 0 IF IT IS NOT  */
+typedef struct
+   {
+   opcode_t  Opcode;            /*  OPC_Add (with -) or OPC_Multiply */
+   int       NumberOfChunks;
+   int       NumberOfTerms;
+   int      *Terms;             /*  register of each term, in order  */
+   char     *Negative;          /*  TRUE if term is subtracted       */
+   int      *Select;            /*  instructions, shared then chunks */
+   int      *Start;             /*  Select of shared, each chunk, end */
+   } reduction_t;
+
+/*  ONE RUN OF calc_run_parallel  */
+typedef struct
+   {
+   const calc_program *Program;
+   const reduction_t  *Reduction;
+   double             *Registers;
+   const double       *Slots;
+   double             *Partials;  /*  result of each chunk           */
+   char               *Failed;    /*  TRUE if an operation failed    */
+   } job_t;
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static reduction_t *PlanReduction (calc_program *Program);
+static int          ChainTerms (const calc_program *Program, int *Uses,
+                                int *Terms, char *Negative, opcode_t *Class);
+static void         ReduceChunk (void *Argument, int Worker, int Chunk);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*
+   COLLECT THE TERMS OF THE CHAIN ENDING AT THE RESULT, LAST FIRST, AND
+   MARK ITS INSTRUCTIONS SPINE IN Uses, WHICH HOLDS THE NUMBER OF READS
+   OF EACH REGISTER.  RETURNS THE NUMBER OF TERMS, 0 IF THERE IS NO CHAIN.
+*/
+static int ChainTerms (const calc_program *Program, int *Uses, int *Terms,
+                       char *Negative, opcode_t *Class)
+   {
+   const calc_instr *Instr;
+   int               Register;
+   int               NumberOfTerms;
+
+   Register = Program->Result;
+   Instr = &Program->Code[Register];
+   if (Instr->Opcode == OPC_Add || Instr->Opcode == OPC_Subtract)
+      *Class = OPC_Add;
+   else if (Instr->Opcode == OPC_Multiply)
+      *Class = OPC_Multiply;
+   else
+      return 0;
+
+   /*  LINKS READ ELSEWHERE TOO ARE TERMS, NOT PART OF THE CHAIN  */
+   NumberOfTerms = 0;
+   Uses[Register] = 1;
+   for (;;)
+      {
+      Instr = &Program->Code[Register];
+      if (Uses[Register] != 1 ||
+          (*Class == OPC_Add ? Instr->Opcode != OPC_Add &&
+                               Instr->Opcode != OPC_Subtract
+                             : Instr->Opcode != OPC_Multiply))
+         break;
+      Terms[NumberOfTerms] = Instr->B;
+      Negative[NumberOfTerms] = (Instr->Opcode == OPC_Subtract);
+      NumberOfTerms++;
+      Uses[Register] = SPINE;
+      Register = Instr->A;
+      }
+   Terms[NumberOfTerms] = Register;
+   Negative[NumberOfTerms] = FALSE;
+   return NumberOfTerms + 1;
+   }
+
+
+/*  SPLIT PROGRAM INTO CHUNKS - NULL IF MEMORY IS EXHAUSTED, NO CHUNKS IF
+    IT CANNOT BE SPLIT  */
+static reduction_t *PlanReduction (calc_program *Program)
+   {
+   calc_arena  *Arena;
+   reduction_t *Reduction;
+   int         *Owner;
+   int         *Terms;
+   char        *Negative;
+   int          Operand[MAXOPERANDS];
+   int          NumberOfOperands;
+   int          Group;
+   int          iinstr;
+   int          iterm;
+   int          iop;
+   BOOLEAN      Ok;
+
+   Reduction = (reduction_t *) ArenaAllocate (&Program->Arena,
+                                              sizeof(reduction_t));
+   if (Reduction == NULL)
+      return NULL;
+   memset (Reduction, 0, sizeof(reduction_t));
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      if (Program->Code[iinstr].Opcode == OPC_Store)
+         return Reduction;
+
+   /*  READS OF EACH REGISTER, THEN THE TERMS  */
+   Arena = Program->Context->Arena;
+   Owner    = (int *) ArenaAllocate (Arena, Program->CodeLength * sizeof(int));
+   Terms    = (int *) ArenaAllocate (Arena, Program->CodeLength * sizeof(int));
+   Negative = (char *) ArenaAllocate (Arena, Program->CodeLength);
+   if (Owner == NULL || Terms == NULL || Negative == NULL)
+      {
+      ArenaRewind (Arena, Negative);
+      ArenaRewind (Arena, Terms);
+      ArenaRewind (Arena, Owner);
+      return Reduction;
+      }
+   memset (Owner, 0, Program->CodeLength * sizeof(int));
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      {
+      NumberOfOperands = InstructionOperands (&Program->Code[iinstr],
+                                              Operand);
+      for (iop=0; iop<NumberOfOperands; iop++)
+         Owner[Operand[iop]]++;
+      }
+   Reduction->NumberOfTerms = ChainTerms (Program, Owner, Terms, Negative,
+                                          &Reduction->Opcode);
+   if (Reduction->NumberOfTerms < CALC_PARALLELTERMS)
+      {
+      Reduction->NumberOfTerms = 0;
+      ArenaRewind (Arena, Negative);
+      ArenaRewind (Arena, Terms);
+      ArenaRewind (Arena, Owner);
+      return Reduction;
+      }
+
+   /*  TERMS IN ORDER, EACH OWNED BY ITS CHUNK  */
+   Reduction->NumberOfChunks = (Reduction->NumberOfTerms + CHUNKTERMS - 1)
+                               / CHUNKTERMS;
+   Reduction->Terms    = (int *) ArenaAllocate
+      (&Program->Arena, Reduction->NumberOfTerms * sizeof(int));
+   Reduction->Negative = (char *) ArenaAllocate
+      (&Program->Arena, Reduction->NumberOfTerms);
+   Reduction->Select   = (int *) ArenaAllocate
+      (&Program->Arena, Program->CodeLength * sizeof(int));
+   Reduction->Start    = (int *) ArenaAllocate
+      (&Program->Arena, (Reduction->NumberOfChunks + 2) * sizeof(int));
+   Ok = (Reduction->Terms != NULL && Reduction->Negative != NULL &&
+         Reduction->Select != NULL && Reduction->Start != NULL);
+
+   for (iinstr=0; Ok && iinstr<Program->CodeLength;
+        iinstr++)
+      if (Owner[iinstr] != SPINE)
+         Owner[iinstr] = UNUSED;
+   for (iterm=0; Ok && iterm<Reduction->NumberOfTerms;
+        iterm++)
+      {
+      Reduction->Terms[iterm] = Terms[Reduction->NumberOfTerms-1 - iterm];
+      Reduction->Negative[iterm] =
+         Negative[Reduction->NumberOfTerms-1 - iterm];
+      Group = iterm / CHUNKTERMS;
+      iinstr = Reduction->Terms[iterm];
+      Owner[iinstr] = (Owner[iinstr] == UNUSED ||
+                       Owner[iinstr] == Group) ? Group : SHARED;
+      }
+
+   /*  EVERY READER COMES AFTER WHAT IT READS, SO GO BACKWARDS  */
+   for (iinstr=Program->CodeLength-1; Ok && iinstr>=0;
+        iinstr--)
+      {
+      if (Owner[iinstr] == UNUSED || Owner[iinstr] == SPINE)
+         continue;
+      NumberOfOperands = InstructionOperands (&Program->Code[iinstr],
+                                              Operand);
+      for (iop=0; iop<NumberOfOperands; iop++)
+         if (Owner[Operand[iop]] == UNUSED)
+            Owner[Operand[iop]] = Owner[iinstr];
+         else if (Owner[Operand[iop]] != Owner[iinstr])
+            Owner[Operand[iop]] = SHARED;
+      }
+
+   /*  LIST INSTRUCTIONS BY OWNER, IN PROGRAM ORDER  */
+   if (!Ok)
+      Reduction->NumberOfChunks = 0;
+   else
+      {
+      memset (Reduction->Start, 0,
+              (Reduction->NumberOfChunks + 2) * sizeof(int));
+      for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+         if (Owner[iinstr] >= SHARED)
+            Reduction->Start[Owner[iinstr] + 2]++;
+      for (Group=1; Group<Reduction->NumberOfChunks+2; Group++)
+         Reduction->Start[Group] += Reduction->Start[Group-1];
+      for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+         if (Owner[iinstr] >= SHARED)
+            Reduction->Select[Reduction->Start[Owner[iinstr] + 1]++] =
+               iinstr;
+      for (Group=Reduction->NumberOfChunks+1; Group>0; Group--)
+         Reduction->Start[Group] = Reduction->Start[Group-1];
+      Reduction->Start[0] = 0;
+      }
+
+   ArenaRewind (Arena, Negative);
+   ArenaRewind (Arena, Terms);
+   ArenaRewind (Arena, Owner);
+   return Reduction;
+   }
+
+
+/*  RUN ONE CHUNK AND REDUCE ITS TERMS  */
+static void ReduceChunk (void *Argument, int Worker, int Chunk)
+   {
+   job_t             *Job;
+   const reduction_t *Reduction;
+   const double      *Registers;
+   double             Partial;
+   int                First;
+   int                Last;
+   int                iterm;
+
+   (void) Worker;
+   Job = (job_t *) Argument;
+   Reduction = Job->Reduction;
+   Registers = Job->Registers;
+   Job->Failed[Chunk] = (char) RunSelected
+      (Job->Program, Reduction->Select + Reduction->Start[Chunk+1],
+       Reduction->Start[Chunk+2] - Reduction->Start[Chunk+1],
+       Job->Registers, Job->Slots);
+
+   First = Chunk * CHUNKTERMS;
+   Last  = First + CHUNKTERMS;
+   if (Last > Reduction->NumberOfTerms)
+      Last = Reduction->NumberOfTerms;
+   Partial = Registers[Reduction->Terms[First]];
+   if (Reduction->Opcode == OPC_Multiply)
+      for (iterm=First+1; iterm<Last; iterm++)
+         Partial *= Registers[Reduction->Terms[iterm]];
+   else
+      {
+      if (Reduction->Negative[First])
+         Partial = -Partial;
+      for (iterm=First+1; iterm<Last; iterm++)
+         if (Reduction->Negative[iterm])
+            Partial -= Registers[Reduction->Terms[iterm]];
+         else
+            Partial += Registers[Reduction->Terms[iterm]];
+      }
+   Job->Partials[Chunk] = Partial;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+double calc_run_parallel (calc_program *Program, double *Variables,
+                          calc_pool *Pool, int *ErrorResult)
+   {
+   calc_context *Context;
+   reduction_t  *Reduction;
+   job_t         Job;
+   double        LocalSlots[LOCALSLOTS];
+   double       *Slots;
+   double        Result;
+   BOOLEAN       Failed;
+   int           Slot;
+   int           Chunk;
+
+   if (Program->Reduction == NULL)
+      Program->Reduction = PlanReduction (Program);
+   Reduction = (reduction_t *) Program->Reduction;
+   if (Reduction == NULL || Reduction->NumberOfChunks == 0)
+      return calc_run (Program, Variables, ErrorResult);
+
+   /*  VALUES OF CONTEXT VARIABLES - A FAILED DEFINITION IS LEFT TO calc_run  */
+   Context = Program->Context;
+   Slots = Variables;
+   if (Variables == NULL)
+      {
+      Slots = LocalSlots;
+      if (Program->NumberOfSlots > LOCALSLOTS)
+         Slots = (double *) ArenaAllocate
+            (Context->Arena, Program->NumberOfSlots * sizeof(double));
+      if (Slots == NULL)
+         return calc_run (Program, Variables, ErrorResult);
+      for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+         {
+         Slots[Slot] = GetVariableValue (Context, Program->VariableIDs[Slot]);
+         if (Context->Definitions != NULL &&
+             VariableError (Context, Program->VariableIDs[Slot]))
+            break;
+         }
+      if (Slot < Program->NumberOfSlots)
+         {
+         if (Slots != LocalSlots)
+            ArenaRewind (Context->Arena, Slots);
+         return calc_run (Program, Variables, ErrorResult);
+         }
+      }
+
+   Job.Program   = Program;
+   Job.Reduction = Reduction;
+   Job.Slots     = Slots;
+   Job.Registers = (double *) ArenaAllocate
+      (Context->Arena, Program->CodeLength * sizeof(double));
+   Job.Partials  = (double *) ArenaAllocate
+      (Context->Arena, Reduction->NumberOfChunks * sizeof(double));
+   Job.Failed    = (char *) ArenaAllocate
+      (Context->Arena, Reduction->NumberOfChunks);
+
+   /*  SHARED INSTRUCTIONS, THEN THE CHUNKS, THEN THEIR RESULTS IN ORDER  */
+   Failed = TRUE;
+   Result = 0.0;
+   if (Job.Registers != NULL && Job.Partials != NULL && Job.Failed != NULL)
+      {
+      Failed = RunSelected (Program, Reduction->Select, Reduction->Start[1],
+                            Job.Registers, Slots);
+      if (!Failed && Pool != NULL)
+         calc_pool_run (Pool, Reduction->NumberOfChunks, ReduceChunk, &Job);
+      for (Chunk=0; !Failed && Pool == NULL &&
+           Chunk<Reduction->NumberOfChunks; Chunk++)
+         ReduceChunk (&Job, 0, Chunk);
+
+      for (Chunk=0; !Failed && Chunk<Reduction->NumberOfChunks; Chunk++)
+         {
+         Failed = Job.Failed[Chunk];
+         if (Chunk == 0)
+            Result = Job.Partials[0];
+         else if (Reduction->Opcode == OPC_Multiply)
+            Result *= Job.Partials[Chunk];
+         else
+            Result += Job.Partials[Chunk];
+         }
+      }
+
+   ArenaRewind (Context->Arena, Job.Failed);
+   ArenaRewind (Context->Arena, Job.Partials);
+   ArenaRewind (Context->Arena, Job.Registers);
+   if (Slots != Variables && Slots != LocalSlots)
+      ArenaRewind (Context->Arena, Slots);
+
+   /*  OUT OF MEMORY OR AN ERROR - calc_run REPORTS IT  */
+   if (Failed)
+      return calc_run (Program, Variables, ErrorResult);
+   *ErrorResult = ERROR_none;
+   return Result;
+   }
@@ -0,0 +1,18 @@
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#include "compile.h"
+#include "pool.h"
+
+/*  FEWEST TERMS OF A SUM OR PRODUCT THAT calc_run_parallel SPLITS  */
+#ifndef CALC_PARALLELTERMS
+#define CALC_PARALLELTERMS 8192
+#endif
+
+/*  SHORTEST FORMULA calc RUNS WITH calc_run_parallel UNDER -j, IN BYTES  */
+#define CALC_PARALLELTEXT (64 * 1024)
+
+double calc_run_parallel (calc_program *prog, double *vars, calc_pool *pool,
+                          int *err);
+
+#endif
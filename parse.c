@@ -14,12 +14,54 @@
 /*            *err   Returns 0 if OK, >0 for error.  Use value to        */
 /*                   call *parsemessage for error message                */
 /*                                                                       */
-/*        (2) char   *parsemsg (char err)                                */
+/*        (2) double evalform_r (calc_context *c, char **f, char *err)   */
+/*                                                                       */
+/*            same as evalform, using the variables and parser state     */
+/*            of context c (see calc_context_new).  Separate contexts    */
+/*            may be used by separate threads at the same time.          */
+/*            evalform uses a default context.                           */
+/*                                                                       */
+/*            A context keeps its memory in an arena, and                */
+/*            calc_context_reset gives it all back at once.  With        */
+/*            calc_context_new_arena (a) the memory comes from arena     */
+/*            a (see arena.c), and the context goes when a is reset.     */
+/*                                                                       */
+/*        (3) double calc_eval (calc_context *c, const char *f,          */
+/*                              size_t n, size_t *used, int *err)        */
+/*                                                                       */
+/*            same for the n bytes at f, which are only read and need    */
+/*            not end with a NUL, so formulas can be evaluated where     */
+/*            they lie (network buffers, mapped files).  *used is set    */
+/*            to the number of bytes read: n if OK, otherwise the        */
+/*            offset of the error.  c NULL is the context of evalform.   */
+/*            used may be NULL.                                          */
+/*                                                                       */
+/*        (4) char   *parsemsg (char err)                                */
 /*                                                                       */
 /*            returns pointer to error message                           */
 /*                                                                       */
 /*            err  error value returned by evalfrom                      */
 /*                                                                       */
+/*        (5) int calc_var_handle_r (calc_context *c, const char *name)  */
+/*            void calc_set_r (calc_context *c, int h, double v)         */
+/*            double calc_get_r (calc_context *c, int h)                 */
+/*                                                                       */
+/*            return handle of variable name of context c, creating it   */
+/*            as 0 if new, then set and get its value through handle h   */
+/*            without looking up the name.  Handles are the IDs of       */
+/*            listvar_r and stay valid until c is reset, rolled back or  */
+/*            loaded from a snapshot.  calc_var_handle returns NOTFOUND  */
+/*            if name is not a variable name, and NOROOM or NOHEAP if it */
+/*            cannot be added.  calc_var_handle, calc_set and calc_get   */
+/*            use the context of evalform.                               */
+/*                                                                       */
+/*        (6) double calc_eval_reference (calc_context *c,               */
+/*                  const char *f, size_t n, size_t *used, int *err)     */
+/*                                                                       */
+/*            same as calc_eval with the original recursive parser,      */
+/*            as a reference for tests.  Only built with CALC_REFERENCE; */
+/*            definitions are not recognized.                            */
+/*                                                                       */
 /*                                                                       */
 /*                                                                       */
 /*        FORMULA SYNTAX                                                 */
@@ -28,11 +70,18 @@
 /*                                                                       */
 /*          (1) number constants                                         */
 /*          (2) constants "e" and "pi"                                   */
-/*          (3) operators + - * / ^ ( ) =                                */
+/*          (3) operators + - * / ^ ( ) = ,                              */
 /*              (unlimited number of parenthesis)                        */
+/*              (nested to any depth - see EvaluateFormula)              */
 /*          (4) variables (up to MAXNUMBERVAR of them)                   */
 /*          (5) single argument functions                                */
 /*              ( SIN COS TAN EXP LOG LOG10 ACOS ASIN ATAN ABS SQRT )    */
+/*          (6) functions of several arguments, separated by commas      */
+/*              ( MIN MAX ATAN2 HYPOT FMA )                              */
+/*          (7) functions defined by formulas                            */
+/*                string "f(x,y) = x*y+1" defines F, so that "f(2,3)"    */
+/*                is 7.  Parameters hide variables of the same name      */
+/*                within the formula (see function.c).                   */
 /*                                                                       */
 /*        VARIABLES                                                      */
 /*                                                                       */
@@ -45,6 +94,9 @@
 /*           () can set multiple variables on one line.                  */
 /*                string "a0 = a1 = a2 = sqrt(2)" sets all three         */
 /*                variables to sqrt(2).                                  */
+/*           () define variables with :=                                 */
+/*                string "a := b*2" keeps A equal to twice B as B        */
+/*                changes, until A is set with = (see define.c).         */
 /*                                                                       */
 /*                                                                       */
 /*                                                                       */
@@ -54,6 +106,9 @@ Revision History:
 29 Apr 1996
    Added error codes for out-of-range function parameters
 
+   Variables moved to hashed symbol table (symtab.c); MAXNUMBERVAR
+   raised from 128 to 1048576
+
 */
 
 /*
@@ -67,28 +122,33 @@ Include Files
 #include <string.h>
 #include <ctype.h>
 #include "parse.h"
+#include "symtab.h"
+#include "builtin.h"
+#include "number.h"
+#include "stats.h"
+#include "numeric.h"
 
 /*
 ************************************************************************
 Defines
 ************************************************************************
 */
-#define MAXNUMBERVAR  128
-#define MAXTOKENLENGTH 32
 #define FALSE 0
 #define TRUE  1
-#define NOTFOUND -1
-#define NOROOM   -2
-#define NOHEAP   -3
 #define BOOLEAN int
 #define DEFAULT_RETURN 0.0
+#define INITIALFRAMES  64
+#define INITIALARGUMENTS 16
+
+/*  SMALLEST DOUBLE ABOVE 0, AND LARGEST BELOW 1  */
+#define ABOVEZERO 4.9406564584124654e-324
+#define BELOWONE  0.99999999999999989
+
+/*  CHARACTER AT PARSE POSITION - '\0' AT THE END OF A BOUNDED FORMULA  */
+#define CURRENTCHAR(Context) \
+   ((Context)->FormulaString == (Context)->FormulaEnd ? '\0' : \
+    *(Context)->FormulaString)
 
-#ifndef M_E
-#define M_E        2.7182818284590452354E0
-#endif
-#ifndef M_PI
-#define M_PI       3.1415926535897931160E0
-#endif
 
 
 /*
@@ -97,53 +157,41 @@ Type Definitions
 ************************************************************************
 */
 
-/*  OPERATORS (IN ORDER FROM LOWEST TO HIGHEST PRECEDENCE)   */
-typedef enum
-   {
-   OP_EndLine,
-   OP_BeginLine,
-   OP_CloseParenthesis,
-   OP_OpenParenthesis,
-   OP_Assignment,
-   OP_Add,
-   OP_Subtract,
-   OP_Multiply,
-   OP_Divide,
-   OP_RaisePower
-   } operator_t;
+/*  Operator, function and error code types moved to parse.h  */
 
+/*  WHERE A FRAME OF EvaluateFormula RESUMES  */
 typedef enum
    {
-   FUNC_err,
-   FUNC_sin,
-   FUNC_cos,
-   FUNC_tan,
-   FUNC_exp,
-   FUNC_log,
-   FUNC_log10,
-   FUNC_fabs,
-   FUNC_acos,
-   FUNC_asin,
-   FUNC_atan,
-   FUNC_sqrt,
-   FUNC_int
-   }   function_t;
-
-typedef enum
+   STEP_operand,                /*  parse value                     */
+   STEP_parenthesis,            /*  back from parenthetical value   */
+   STEP_argument,               /*  back from function argument     */
+   STEP_body,                   /*  back from defined function      */
+   STEP_operator,               /*  parse operator                  */
+   STEP_apply,                  /*  apply operator if not pending   */
+   STEP_combine                 /*  back from right operand         */
+   } parsestep_t;
+
+/*  ONE LEVEL OF EvaluateFormula - SAME AS THE LOCALS OF ParseFormula  */
+struct parseframe
    {
-   ERROR_none,
-   ERROR_operand,
-   ERROR_openparen,
-   ERROR_closeparen,
-   ERROR_operator,
-   ERROR_division,
-   ERROR_function,
-   ERROR_variable_expected,
-   ERROR_variable_full,
-   ERROR_variable_long,
-   ERROR_heap_full,
-   ERROR_parameter
-   } errorcode_t;
+   double       Value;
+   operator_t   Operator;
+   operator_t   Applying;       /*  operator whose operand is parsed */
+   function_t   Function;
+   int          Defined;        /*  defined function, or NOTFOUND   */
+   int          Arity;          /*  arguments it takes              */
+   int          ArgumentBase;   /*  its first argument in Arguments */
+   int          VariableID;
+   BOOLEAN      MinusSignPresent;
+   parsestep_t  Step;
+
+   /*  WHERE TO GO ON AFTER THE BODY OF A DEFINED FUNCTION  */
+   const char  *ReturnString;
+   const char  *ReturnEnd;
+   int          ReturnLevel;
+   const calc_function *ReturnLocal;
+   int          ReturnBase;
+   };
 
 
 /*
@@ -151,14 +199,31 @@ typedef enum
 MODULE-WIDE VARIABLES
 ************************************************************************
 */
-static  char         *VariableNames_m   [MAXNUMBERVAR];
-static  double        VariableValues_m [MAXNUMBERVAR];
-static  char         *FormulaString_m;
-static  char         TokenString_m[MAXTOKENLENGTH];
-static  double       DivisorValue_m;
-static  int          ParenthesisLevel_m;
-static  errorcode_t   ErrorCode_m;
-static  int          NumberOfVariables_m = 0;
+
+/*  CONTEXT USED BY THE NON-REENTRANT ROUTINES (evalform ETC.)  */
+static  calc_context  DefaultContext_m;
+
+/*  DOMAIN OF EACH FUNCTION, IN function_t ORDER  */
+static const calc_domain Domains_m[CALC_FUNCTIONS] = {
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_err                        */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_sin                        */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_cos                        */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_tan                        */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_exp                        */
+   { ABOVEZERO,  HUGE_VAL },    /*  FUNC_log                        */
+   { ABOVEZERO,  HUGE_VAL },    /*  FUNC_log10                      */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_fabs                       */
+   { -1.0,       BELOWONE },    /*  FUNC_acos                       */
+   { -1.0,       BELOWONE },    /*  FUNC_asin                       */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_atan                       */
+   { ABOVEZERO,  HUGE_VAL },    /*  FUNC_sqrt                       */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_int                        */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_min                        */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_max                        */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_atan2                      */
+   { -HUGE_VAL,  HUGE_VAL },    /*  FUNC_hypot                      */
+   { -HUGE_VAL,  HUGE_VAL }     /*  FUNC_fma                        */
+   };
 
 
 /*
@@ -172,15 +237,24 @@ Local Function Prototypes
 int        AssignVariable ( char *NewName, double NewValue);
 #endif
 
-char        *_strhed (char **);
-int        GetVariableID (char *TestName);
-function_t LookupFunction (char *FunctionName);
-double     EvaluateFunction (function_t InputFunction, double x);
-static void       SkipWhiteSpace (char **f);
-int        GetNextTokenLength ( char *cptr );
-void        CopyUppercaseString
-            ( char *TargetString, char *SourceString, int Size );
-double     ParseFormula (operator_t *PendingOperator);
+double     EvaluateLine (calc_context *Context, const char **f,
+                         const char *End, int *ErrorResult);
+double     EvaluateDefinition
+           (calc_context *Context, const char **f, int *ErrorResult);
+double     EvaluateFunction
+           (calc_context *Context, function_t InputFunction, double x);
+double     EvaluateFunctionN
+           (calc_context *Context, function_t InputFunction,
+            const double *x);
+static int        PushArgument (calc_context *Context, double Value);
+static void       SkipWhiteSpace (const char **f, const char *End);
+static double     ReadNumber (calc_context *Context);
+#ifdef CALC_REFERENCE
+double     ParseFormula
+           (calc_context *Context, operator_t *PendingOperator);
+#endif
+double     EvaluateFormula
+           (calc_context *Context, operator_t *PendingOperator);
 
 
 /*
@@ -192,19 +266,9 @@ Local Subroutines
 
 
 /*  RETURN Variable Index CORRESPONDING TO VARIABLE NAME  */
-int GetVariableID (char *TestName)
+int GetVariableID (calc_context *Context, char *TestName)
    {
-   int VariableID = NumberOfVariables_m-1;
-
-   /*  SEARCH STORED VARIABLE NAMES  */
-   for (VariableID=0; VariableID<NumberOfVariables_m; VariableID++)
-      {
-      if (strcmp( VariableNames_m [ VariableID ], TestName) == 0)
-         /* RETURN CURRENT INDEX  */
-         return VariableID;
-      }
-   /*  VARIABLE NAME NOT FOUND  */
-   return NOTFOUND;
+   return FindSymbol (&Context->Variables, TestName);
    }
 /*
     ASSIGN VALUE TO STORED VARIABLE NAME or CREATE NEW VARIABLE
@@ -212,85 +276,79 @@ int GetVariableID (char *TestName)
            or ERROR CODE NOROOM IF NO LIST SPACE AVAILABLE
            or ERROR CODE NOHEAP IF NO HEAP SPACE AVAILABLE
 */
-int AssignVariable ( char *NewName, double NewValue)
+int AssignVariable_r (calc_context *Context, char *NewName, double NewValue)
    {
    int VariableID;
 
-   VariableID = GetVariableID (NewName);
+   VariableID = GetVariableID (Context, NewName);
    /*  CREATE NEW VARIABLE  */
    if (VariableID == NOTFOUND)
-      {
-      /*  IS THERE ROOM IN LIST FOR NEW VARIABLE  */
-      if (NumberOfVariables_m >= MAXNUMBERVAR )
-         return (NOROOM);
-      /*  IS THERE ROOM IN HEAP FOR NEW VARIABLE NAME  */
-      VariableNames_m [ NumberOfVariables_m ] =
-         (char *) calloc ( strlen(NewName)+1, sizeof(char) );
-      if ( VariableNames_m [ NumberOfVariables_m ] == NULL)
-         return (NOHEAP);
-      /*  STORE VARIABLE  */
-      strcpy ( VariableNames_m [ NumberOfVariables_m ], NewName );
-      VariableValues_m [ NumberOfVariables_m ] = NewValue;
-      NumberOfVariables_m++;
-      return ( NumberOfVariables_m-1 );
-      }
+      return AddSymbol (&Context->Variables, NewName, NewValue);
    /*  STORE VALUE IN EXISTING VARIABLE  */
    else
       {
-      VariableValues_m [ VariableID ] = NewValue;
+      Context->Variables.Values [ VariableID ] = NewValue;
+      Context->Variables.Versions [ VariableID ]++;
+      if (Context->Definitions != NULL)
+         VariableAssigned (Context, VariableID);
       return VariableID;
       }
    }
 
+/*  RETURN VALUE OF VARIABLE - DEFINED VARIABLES ARE BROUGHT UP TO DATE  */
+double GetVariableValue (calc_context *Context, int VariableID)
+   {
+   if (Context->Definitions != NULL)
+      RefreshVariable (Context, VariableID);
+   return Context->Variables.Values [ VariableID ];
+   }
+
+/*  STORE VALUE IN EXISTING VARIABLE  */
+void SetVariableValue (calc_context *Context, int VariableID,
+                       double NewValue)
+   {
+   Context->Variables.Values [ VariableID ] = NewValue;
+   Context->Variables.Versions [ VariableID ]++;
+   if (Context->Definitions != NULL)
+      VariableAssigned (Context, VariableID);
+   }
+
+/*  RETURN NUMBER OF TIMES VARIABLE HAS BEEN SET  */
+unsigned long GetVariableVersion (calc_context *Context, int VariableID)
+   {
+   return Context->Variables.Versions [ VariableID ];
+   }
+
+/*  RETURN FUNCTION WITH UPPER CASE NAME, OR FUNC_err  */
 function_t LookupFunction (char *FunctionName)
    {
-   if (!strcmp(FunctionName, "SIN"  ))   return( FUNC_sin);
-   if (!strcmp(FunctionName, "COS"  ))   return( FUNC_cos);
-   if (!strcmp(FunctionName, "TAN"  ))   return( FUNC_tan);
-   if (!strcmp(FunctionName, "EXP"  ))   return( FUNC_exp);
-   if (!strcmp(FunctionName, "LOG"  ))   return( FUNC_log);
-   if (!strcmp(FunctionName, "LOG10"))   return( FUNC_log10);
-   if (!strcmp(FunctionName, "ACOS" ))   return( FUNC_acos);
-   if (!strcmp(FunctionName, "ASIN" ))   return( FUNC_asin);
-   if (!strcmp(FunctionName, "ATAN" ))   return( FUNC_atan);
-   if (!strcmp(FunctionName, "ABS"  ))   return( FUNC_fabs);
-   if (!strcmp(FunctionName, "SQRT" ))   return( FUNC_sqrt);
-   if (!strcmp(FunctionName, "INT"  ))   return( FUNC_int );
-   return(FUNC_err);
+   const calc_builtin *Builtin;
+
+   Builtin = FindBuiltin (FunctionName, (int) strlen (FunctionName));
+   if (Builtin == NULL || Builtin->Kind != BUILTIN_function)
+      return FUNC_err;
+   return Builtin->Function;
    }
 
-double EvaluateFunction (function_t InputFunction, double x)
+/*  RETURN TRUE IF x IS IN THE DOMAIN OF THE FUNCTION  */
+int FunctionArgumentOk (function_t InputFunction, double x)
    {
-   BOOLEAN Ok;
+   const calc_domain *Domain;
 
-   /*  Check argument ranges   */
-   Ok = TRUE;
-   switch (InputFunction)
-      {
-      case FUNC_log:
-      case FUNC_log10:
-      case FUNC_sqrt:
-         if (x<=0.0)
-            {
-            Ok = FALSE;
-            }
-         break;
-      case FUNC_acos:
-      case FUNC_asin:
-         if (x<-1.0 || x>=1.0)
-            {
-            Ok = FALSE;
-            }
-      }
+   /*  One table lookup, no switch - NaN passes as before  */
+   Domain = &Domains_m[InputFunction];
+   return !((x < Domain->Low) | (x > Domain->High));
+   }
 
-   /*  If arguments not ok, then return 0  */
-   if (!Ok)
-      {
-      ErrorCode_m = ERROR_parameter;
-      return DEFAULT_RETURN;
-      }
+/*  DOMAINS OF ALL FUNCTIONS, INDEXED BY function_t  */
+const calc_domain *FunctionDomains (void)
+   {
+   return Domains_m;
+   }
 
-   /*  Evaluate function  */
+/*  APPLY FUNCTION WITHOUT CHECKING ITS ARGUMENT  */
+double ApplyFunction (function_t InputFunction, double x)
+   {
    switch (InputFunction)
       {
       case FUNC_sin    : return sin(x);
@@ -319,20 +377,109 @@ double EvaluateFunction (function_t InputFunction, double x)
       }
    }
 
+/*  APPLY FUNCTION OF SEVERAL ARGUMENTS - NONE OF THEM HAS A DOMAIN  */
+double ApplyFunctionN (function_t InputFunction, const double *x)
+   {
+   switch (InputFunction)
+      {
+      case FUNC_min   : return fmin(x[0], x[1]);
+      case FUNC_max   : return fmax(x[0], x[1]);
+      case FUNC_atan2 : return atan2(x[0], x[1]);
+      case FUNC_hypot : return hypot(x[0], x[1]);
+      case FUNC_fma   : return fma(x[0], x[1], x[2]);
+      default:
+         return ApplyFunction (InputFunction, x[0]);
+      }
+   }
 
-static void SkipWhiteSpace (char **f)
+double EvaluateFunction (calc_context *Context, function_t InputFunction,
+                         double x)
    {
-   while (**f==' ' || **f==9 || **f==10 || **f==13)
+   STATS_COUNT (Context, Calls[InputFunction]);
+
+   /*  If arguments not ok, then return 0  */
+   if (!FunctionArgumentOk (InputFunction, x))
+      {
+      Context->ErrorCode = ERROR_parameter;
+      return DEFAULT_RETURN;
+      }
+
+   /*  Evaluate function  */
+   return ApplyFunction (InputFunction, x);
+   }
+
+double EvaluateFunctionN (calc_context *Context, function_t InputFunction,
+                          const double *x)
+   {
+   if (InputFunction < FUNC_min)
+      return EvaluateFunction (Context, InputFunction, x[0]);
+   STATS_COUNT (Context, Calls[InputFunction]);
+   return ApplyFunctionN (InputFunction, x);
+   }
+
+
+/*  KEEP ARGUMENT OF A CALL IN PROGRESS - FALSE IF HEAP FILLED  */
+static int PushArgument (calc_context *Context, double Value)
+   {
+   double *NewArguments;
+   int     NewSize;
+
+   if (Context->NumberOfArguments >= Context->ArgumentSize)
+      {
+      NewSize = Context->ArgumentSize ? 2*Context->ArgumentSize
+                                      : INITIALARGUMENTS;
+      NewArguments = (double *)
+         ArenaResize (Context->Arena, Context->Arguments,
+                      Context->ArgumentSize * sizeof(double),
+                      NewSize * sizeof(double));
+      if (NewArguments == NULL)
+         return FALSE;
+      Context->Arguments    = NewArguments;
+      Context->ArgumentSize = NewSize;
+      }
+   Context->Arguments[Context->NumberOfArguments++] = Value;
+   return TRUE;
+   }
+
+
+/*  End IS THE END OF A LENGTH-BOUNDED FORMULA, NULL IF NUL-TERMINATED  */
+static void SkipWhiteSpace (const char **f, const char *End)
+   {
+   while (*f != End && (**f==' ' || **f==9 || **f==10 || **f==13))
       (*f)++;
    }
 
 
-int GetNextTokenLength ( char *cptr )
+/*  NEXT NUMBER OF THE FORMULA  */
+static double ReadNumber (calc_context *Context)
+   {
+   double  Value;
+   char   *NumberEnd;
+
+   if (Context->FormulaEnd != NULL)
+      Value = calc_strntod (Context->FormulaString,
+                            Context->FormulaEnd - Context->FormulaString,
+                            &NumberEnd);
+   else
+      Value = calc_strtod (Context->FormulaString, &NumberEnd);
+   Context->FormulaString = NumberEnd;
+   return Value;
+   }
+
+
+int GetNextTokenLength ( const char *cptr )
+   {
+   return GetBoundedTokenLength (cptr, NULL);
+   }
+
+
+/*  SAME, BUT NOT READING PAST End (IF NOT NULL)  */
+int GetBoundedTokenLength ( const char *cptr, const char *End )
    {
    int TokenLength;
 
    /* FIRST CHARACTER MUST BE LETTER OR PERCENT  */
-   if (
+   if ( cptr == End ||
         ! (  ( *cptr >= 'A' && *cptr <= 'Z' ) ||
              ( *cptr >= 'a' && *cptr <= 'z' ) ||
              ( *cptr == '%')
@@ -343,7 +490,7 @@ int GetNextTokenLength ( char *cptr )
    /*  REMAINING CHARACTERS CAN BE LETTERS, NUMBERS OR UNDERSCORES  */
    TokenLength = 1;
    cptr++;
-   while ( isalnum(*cptr) || *cptr=='_' )
+   while ( cptr != End && ( isalnum(*cptr) || *cptr=='_' ) )
       {
       cptr++;
       TokenLength++;
@@ -351,7 +498,8 @@ int GetNextTokenLength ( char *cptr )
    return TokenLength;
    }
 
-void CopyUppercaseString ( char *TargetString, char *SourceString, int Size )
+void CopyUppercaseString
+   ( char *TargetString, const char *SourceString, int Size )
    {
    int ichar;
 
@@ -361,15 +509,31 @@ void CopyUppercaseString ( char *TargetString, char *SourceString, int Size )
    TargetString[Size] = 0;
    }
 
-double ParseFormula (operator_t *PendingOperator)
+/*
+   THE ORIGINAL RECURSIVE PARSER, REPLACED BY EvaluateFormula AND KEPT AS
+   THE REFERENCE THAT TESTS (perftest.c) CHECK IT AGAINST.  BUILT ONLY
+   WITH CALC_REFERENCE - SEE calc_eval_reference.
+*/
+#ifdef CALC_REFERENCE
+double ParseFormula (calc_context *Context, operator_t *PendingOperator)
    {
    operator_t CurrentOperator;
    function_t CurrentFunction;
+   const calc_builtin *Builtin;
    double     CurrentValue;
    BOOLEAN     MinusSignPresent;
    BOOLEAN     ApplyOperator;
    int        VariableID;
    int        TokenLength;
+   int        Parameter;
+   int        Defined;
+   int        Arity;
+   int        ArgumentBase;
+   const char *ReturnString;
+   const char *ReturnEnd;
+   int        ReturnLevel;
+   const calc_function *ReturnLocal;
+   int        ReturnBase;
 
                               /*  PARSE VALUE  */
 
@@ -386,112 +550,188 @@ double ParseFormula (operator_t *PendingOperator)
    VariableID = NOTFOUND;
 
    /*  REMOVE OPENING WHITE SPACE   */
-   SkipWhiteSpace (&FormulaString_m);
+   SkipWhiteSpace (&Context->FormulaString, Context->FormulaEnd);
 
    /*  CHECK FOR MINUS SIGN   */
    MinusSignPresent = FALSE;
-   if (*FormulaString_m=='-')
+   if (CURRENTCHAR (Context)=='-')
       {
       MinusSignPresent = TRUE;
-      FormulaString_m++;
+      Context->FormulaString++;
       }
 
    /*  .. OR PLUS SIGN   */
-   else if (*FormulaString_m=='+')
-      FormulaString_m++;
+   else if (CURRENTCHAR (Context)=='+')
+      Context->FormulaString++;
 
 
    /*  GET VALUE -- PARENTHETICAL EXPRESSION .. */
-   if ( *FormulaString_m=='(' )
+   if ( CURRENTCHAR (Context)=='(' )
       {
-      FormulaString_m++;
-      ParenthesisLevel_m++;
+      Context->FormulaString++;
+      Context->ParenthesisLevel++;
       CurrentOperator = OP_OpenParenthesis;
       /*  OPERATOR SHOULD RETURN AS OP_CloseParenthesis ')'  */
-      CurrentValue = ParseFormula (&CurrentOperator);
-      if ( ErrorCode_m != ERROR_none )
+      CurrentValue = ParseFormula (Context, &CurrentOperator);
+      if ( Context->ErrorCode != ERROR_none )
          return DEFAULT_RETURN;
+      /*  COMMAS ONLY SEPARATE FUNCTION ARGUMENTS  */
+      if (CurrentOperator==OP_Comma)
+         {
+         Context->ErrorCode = ERROR_operator;
+         return DEFAULT_RETURN;
+         }
       if (CurrentOperator!=OP_CloseParenthesis)
          {
-         ErrorCode_m = ERROR_openparen;
+         Context->ErrorCode = ERROR_openparen;
          return DEFAULT_RETURN;
          }
       }
    /* .. GET VALUE -- CONSTANT  */
    else if
    (
-   (FormulaString_m[0] >= '0' && FormulaString_m[0] <= '9') ||
-   FormulaString_m[0]=='.'
+   (CURRENTCHAR (Context) >= '0' && CURRENTCHAR (Context) <= '9') ||
+   CURRENTCHAR (Context)=='.'
    )
       {
-
-#ifdef TEST
-      char *TempString;
-      TempString = _strhed (&FormulaString_m);
-      CurrentValue = atof (TempString);
-#endif
-      CurrentValue = strtod (FormulaString_m, &FormulaString_m);
+      CurrentValue = ReadNumber (Context);
       }
    /* .. GET VALUE -- NAME (EITHER FUNCTION, VARIABLE, SPECIAL CONSTANT)   */
    else
       {
       /*  SCAN NAME TOKEN IN FORMULA  */
-      TokenLength = GetNextTokenLength ( FormulaString_m );
+      TokenLength = GetBoundedTokenLength (Context->FormulaString,
+                                           Context->FormulaEnd);
       /*  .. ERROR - NO NAME TOKEN FOUND   */
       if (TokenLength == 0)
       {
-         ErrorCode_m = ERROR_operand;
+         Context->ErrorCode = ERROR_operand;
          return DEFAULT_RETURN;
       }
       /*  .. ERROR - NAME TOKEN TOO LONG   */
       if (TokenLength >= MAXTOKENLENGTH )
          {
-         ErrorCode_m = ERROR_variable_long;
+         Context->ErrorCode = ERROR_variable_long;
          return DEFAULT_RETURN;
          }
       /*  REMOVE LEADING NAME TOKEN FROM FORMULA  */
-      CopyUppercaseString (TokenString_m, FormulaString_m, TokenLength);
-      FormulaString_m += TokenLength;
-      /*  COMPARE TOKEN TO SPECIAL CONSTANTS  */
-      if       (!strcmp(TokenString_m,"%E"))
-         CurrentValue = M_E;
-      else if   (!strcmp(TokenString_m,"%PI"))
-         CurrentValue = M_PI;
+      CopyUppercaseString (Context->TokenString, Context->FormulaString,
+                           TokenLength);
+      Context->FormulaString += TokenLength;
+      /*  COMPARE TOKEN TO BUILT-IN CONSTANTS AND FUNCTIONS  */
+      Builtin = FindBuiltin (Context->TokenString, TokenLength);
+      /*  SKIP WHITE SPACE  */
+      SkipWhiteSpace (&Context->FormulaString, Context->FormulaEnd);
+      if (Builtin != NULL && Builtin->Kind == BUILTIN_constant)
+         CurrentValue = Builtin->Value;
+      /*  PARAMETER OF THE DEFINED FUNCTION BEING EVALUATED  */
+      else if (Builtin == NULL && Context->Local != NULL &&
+               (Parameter = FindParameter (Context->Local,
+                                           Context->TokenString))
+               != NOTFOUND)
+         CurrentValue = Context->Arguments[Context->LocalBase + Parameter];
       /*  INTERPRET FUNCTIONS  */
-      else if ((CurrentFunction=LookupFunction (TokenString_m)) != FUNC_err )
+      else if (Builtin != NULL || CURRENTCHAR (Context)=='(')
          {
-         /*  SKIP WHITE SPACE  */
-         SkipWhiteSpace (&FormulaString_m);
-         /*  GET VALUE -- PARENTHETICAL EXPRESSION .. */
-         if (*FormulaString_m=='(')
+         CurrentFunction = FUNC_err;
+         Defined = NOTFOUND;
+         if (Builtin != NULL)
             {
-            FormulaString_m++;
-            ParenthesisLevel_m++;
-            CurrentOperator = OP_OpenParenthesis;
-            /*  PARSE FUNCTION ARGUEMENT   */
-            CurrentValue = ParseFormula (&CurrentOperator);
-            /*  PASS ANY ERROR BACK UP TO CALLING ROUTINE  */
-            if ( ErrorCode_m != ERROR_none )
+            CurrentFunction = Builtin->Function;
+            Arity = Builtin->Arity;
+            }
+         else
+            {
+            Defined = FindFunction (Context, Context->TokenString);
+            if (Defined == NOTFOUND)
+               {
+               Context->ErrorCode = ERROR_function;
                return DEFAULT_RETURN;
+               }
+            Arity = Context->Functions[Defined].NumberOfParameters;
+            }
+         /*  GET VALUE -- PARENTHETICAL EXPRESSION .. */
+         ArgumentBase = Context->NumberOfArguments;
+         if (CURRENTCHAR (Context)=='(')
+            {
+            Context->FormulaString++;
+            Context->ParenthesisLevel++;
+            /*  PARSE FUNCTION ARGUEMENTS - ALL BUT THE LAST ARE KEPT  */
+            do
+               {
+               CurrentOperator = OP_OpenParenthesis;
+               CurrentValue = ParseFormula (Context, &CurrentOperator);
+               /*  PASS ANY ERROR BACK UP TO CALLING ROUTINE  */
+               if ( Context->ErrorCode != ERROR_none )
+                  return DEFAULT_RETURN;
+               if (CurrentOperator == OP_Comma)
+                  {
+                  if (Context->NumberOfArguments-ArgumentBase+1 >= Arity)
+                     {
+                     Context->ErrorCode = ERROR_arguments;
+                     return DEFAULT_RETURN;
+                     }
+                  if (!PushArgument (Context, CurrentValue))
+                     {
+                     Context->ErrorCode = ERROR_heap_full;
+                     return DEFAULT_RETURN;
+                     }
+                  }
+               }
+            while (CurrentOperator == OP_Comma);
             /*  IF NO CLOSE PARENTHESIS - RETURN ERROR  */
             if (CurrentOperator!=OP_CloseParenthesis)
                {
-               ErrorCode_m = ERROR_openparen;
+               Context->ErrorCode = ERROR_openparen;
+               return DEFAULT_RETURN;
+               }
+            if (Context->NumberOfArguments-ArgumentBase+1 != Arity)
+               {
+               Context->ErrorCode = ERROR_arguments;
+               return DEFAULT_RETURN;
+               }
+            if (!PushArgument (Context, CurrentValue))
+               {
+               Context->ErrorCode = ERROR_heap_full;
                return DEFAULT_RETURN;
                }
             }
          /*  MISSING OPERAND AFTER FUNCTION NAME  */
          else
             {
-            ErrorCode_m = ERROR_operand;
+            Context->ErrorCode = ERROR_operand;
             return DEFAULT_RETURN;
             }
 
          /*  EVALUATE FUNCTION  */
-         CurrentValue = EvaluateFunction (CurrentFunction, CurrentValue);
+         if (Defined == NOTFOUND)
+            CurrentValue = EvaluateFunctionN (Context, CurrentFunction,
+                                    Context->Arguments + ArgumentBase);
+         /*  .. OR FORMULA OF DEFINED FUNCTION, THEN GO ON AFTER CALL  */
+         else
+            {
+            ReturnString = Context->FormulaString;
+            ReturnEnd    = Context->FormulaEnd;
+            ReturnLevel  = Context->ParenthesisLevel;
+            ReturnLocal  = Context->Local;
+            ReturnBase   = Context->LocalBase;
+            Context->FormulaString    = Context->Functions[Defined].Body;
+            Context->FormulaEnd       = NULL;
+            Context->ParenthesisLevel = 0;
+            Context->Local            = Context->Functions + Defined;
+            Context->LocalBase        = ArgumentBase;
+            CurrentOperator = OP_BeginLine;
+            CurrentValue = ParseFormula (Context, &CurrentOperator);
+            Context->FormulaString    = ReturnString;
+            Context->FormulaEnd       = ReturnEnd;
+            Context->ParenthesisLevel = ReturnLevel;
+            Context->Local            = ReturnLocal;
+            Context->LocalBase        = ReturnBase;
+            }
+         Context->NumberOfArguments = ArgumentBase;
 
          /*  Test for error  */
-         if (ErrorCode_m != ERROR_none)
+         if (Context->ErrorCode != ERROR_none)
             {
             return DEFAULT_RETURN;
             }
@@ -499,25 +739,34 @@ double ParseFormula (operator_t *PendingOperator)
       /*  GET VALUE ... VARIABLE  */
       else
          {
-         VariableID = GetVariableID(TokenString_m);
+         VariableID = GetVariableID (Context, Context->TokenString);
          if (VariableID==NOTFOUND)
             {
             /*  CREATE VARIABLE - INITIALIZE TO ZERO   */
-            VariableID = AssignVariable (TokenString_m, 0.0);
+            VariableID =
+               AssignVariable_r (Context, Context->TokenString, 0.0);
             if (VariableID == NOROOM)
                /*  VARIABLE LIST FILLED  */
                {
-               ErrorCode_m = ERROR_variable_full;
+               Context->ErrorCode = ERROR_variable_full;
                return DEFAULT_RETURN;
                }
             else if (VariableID == NOHEAP )
                /*  HEAP FILLED  */
                {
-               ErrorCode_m = ERROR_heap_full;
+               Context->ErrorCode = ERROR_heap_full;
                return DEFAULT_RETURN;
                }
             }
-         CurrentValue = VariableValues_m[VariableID];
+         CurrentValue = GetVariableValue (Context, VariableID);
+         /*  DEFINED VARIABLE WHOSE FORMULA FAILED  */
+         if (Context->Definitions != NULL &&
+             VariableError (Context, VariableID) != ERROR_none)
+            {
+            Context->ErrorCode =
+               (errorcode_t) VariableError (Context, VariableID);
+            return DEFAULT_RETURN;
+            }
          }
       }
 
@@ -528,22 +777,25 @@ double ParseFormula (operator_t *PendingOperator)
                              /*   PARSE OPERATOR  */
 
    /* REMOVE LEADING WHITESPACE   */
-   SkipWhiteSpace (&FormulaString_m);
+   SkipWhiteSpace (&Context->FormulaString, Context->FormulaEnd);
 
    /*  GET OPERATOR   */
-   switch (*FormulaString_m) {
+   switch (CURRENTCHAR (Context)) {
       case '+' : CurrentOperator = OP_Add;                 break;
       case '-' : CurrentOperator = OP_Subtract;            break;
       case '*' : CurrentOperator = OP_Multiply;            break;
       case '/' : CurrentOperator = OP_Divide;              break;
       case '^' : CurrentOperator = OP_RaisePower;          break;
       case ')' : CurrentOperator = OP_CloseParenthesis;    break;
+      case ',' : CurrentOperator = OP_Comma;               break;
       case '=' : CurrentOperator = OP_Assignment;          break;
       case '\0': CurrentOperator = OP_EndLine;             break;
-      default   : ErrorCode_m = ERROR_operator;
+      default   : Context->ErrorCode = ERROR_operator;
                  return DEFAULT_RETURN;
    }
-   ++FormulaString_m;  /* increment pointer beyond operator  */
+   /* increment pointer beyond operator, but not beyond end of formula  */
+   if (Context->FormulaString != Context->FormulaEnd)
+      ++Context->FormulaString;
 
 
    /*  APPLY OPERATOR IF NO HIGHER PENDING OPERATORS   */
@@ -551,7 +803,7 @@ double ParseFormula (operator_t *PendingOperator)
    while (ApplyOperator)
       {
       /*  CRITERIA FOR APPLYING OPERATOR   */
-      if ( ErrorCode_m == ERROR_none )
+      if ( Context->ErrorCode == ERROR_none )
          {
          /*  EVALUATE REPEATING ASSIGNMENT OPERATORS RIGHT TO LEFT  */
          if (CurrentOperator==OP_Assignment)
@@ -568,42 +820,57 @@ double ParseFormula (operator_t *PendingOperator)
          switch (CurrentOperator)
             {
             case OP_Add:
-               CurrentValue += ParseFormula (&CurrentOperator);
+               CurrentValue += ParseFormula (Context, &CurrentOperator);
                break;
             case OP_Subtract:
-               CurrentValue -= ParseFormula (&CurrentOperator);
+               CurrentValue -= ParseFormula (Context, &CurrentOperator);
                break;
             case OP_Multiply :
-               CurrentValue *= ParseFormula (&CurrentOperator);
+               CurrentValue *= ParseFormula (Context, &CurrentOperator);
                break;
             case OP_Divide :
-               DivisorValue_m = ParseFormula(&CurrentOperator);
-               if ( DivisorValue_m == 0 )
+               Context->DivisorValue =
+                  ParseFormula (Context, &CurrentOperator);
+               if ( Context->DivisorValue == 0 )
                   {
-                  ErrorCode_m = ERROR_division;
+                  Context->ErrorCode = ERROR_division;
                   CurrentValue = 0.0;
                   }
                else
-                  CurrentValue /= DivisorValue_m;
+                  CurrentValue /= Context->DivisorValue;
                break;
             case OP_RaisePower:
                CurrentValue  =
-                  pow (CurrentValue, ParseFormula (&CurrentOperator));
+                  pow (CurrentValue,
+                       ParseFormula (Context, &CurrentOperator));
                break;
             case OP_CloseParenthesis :
-               ParenthesisLevel_m--;
-               if ( ParenthesisLevel_m<0 )
-                  ErrorCode_m = ERROR_closeparen;
+               Context->ParenthesisLevel--;
+               if ( Context->ParenthesisLevel<0 )
+                  Context->ErrorCode = ERROR_closeparen;
+               break;
+            /*  COMMA OUTSIDE FUNCTION ARGUMENTS  */
+            case OP_Comma :
+               Context->ErrorCode = ERROR_operator;
                break;
             case OP_Assignment:
                if (VariableID == NOTFOUND)
                   {
                   /*  VARIABLE EXPECTED  */
-                  ErrorCode_m = ERROR_variable_expected;
+                  Context->ErrorCode = ERROR_variable_expected;
                   return DEFAULT_RETURN;
                   }
-               VariableValues_m[ VariableID ]
-                  = CurrentValue = ParseFormula ( &CurrentOperator);
+               Context->Variables.Values[ VariableID ]
+                  = CurrentValue = ParseFormula (Context, &CurrentOperator);
+               Context->Variables.Versions[ VariableID ]++;
+               if (Context->Definitions != NULL)
+                  VariableAssigned (Context, VariableID);
+               break;
+            /*  NEVER APPLIED - NOTHING RANKS BELOW THE END OF THE LINE,
+                AND THE OTHERS ARE NOT READ AS OPERATORS  */
+            case OP_EndLine:
+            case OP_BeginLine:
+            case OP_OpenParenthesis:
                break;
             }
          }
@@ -612,31 +879,565 @@ double ParseFormula (operator_t *PendingOperator)
    *PendingOperator = CurrentOperator;
    return (CurrentValue);
    }
+#endif
 
 
-/*  PULLS AND RETURNS POINTER TO FIRST TOKEN  */
-char *_strhed (char **tadd)
-{
-   char *head, *sep, *tail;
-   tail = (*tadd);
-   /* FIND FIRST NONBLANK CHARACTER  */
-   while (    (*tail)
-          && ( (*tail)==' ' || (*tail)=='\t' || (*tail)=='\n' )  )
-             tail++;
-   /* FIND NEXT WHITE SPACE CHARCTER  */
-   head = (sep = tail);
-   while ((*sep) && (*sep)!=' ' && (*sep)!='\n' && (*sep)!='\t') sep++;
-   /* INSERT NULL CHARACTER  */
-   tail = sep;
-   if (*sep)
-      { (*sep) = 0;
-        tail++;
+/*  EVALUATE FORMULA ENDING AT End, OR AT ITS NUL IF End IS NULL  */
+double EvaluateLine (calc_context *Context, const char **f,
+                     const char *End, int *ErrorResult)
+   {
+   double      ValueResult;
+   operator_t  CurrentOperator;
+   const char *Definition;
+   const char *CopyPtr;
+   char       *Copy;
+   int         TokenLength;
+   BOOLEAN     IsFunction;
+
+   STATS_ENTER (Context);
+   STATS_COUNT (Context, Formulas);
+
+   /*  DEFINITION "name := formula" OR "name(x) = formula" - KEPT, SO A
+       BOUNDED ONE IS COPIED  */
+   Definition = *f;
+   SkipWhiteSpace (&Definition, End);
+   TokenLength = GetBoundedTokenLength (Definition, End);
+   if (TokenLength > 0)
+      {
+      Definition += TokenLength;
+      SkipWhiteSpace (&Definition, End);
+      IsFunction = (Definition != End && Definition[0] == '(' &&
+                    IsFunctionDefinition (*f, End));
+      if (IsFunction ||
+          (Definition != End && Definition[0] == ':' &&
+           Definition+1 != End && Definition[1] == '='))
+         {
+         if (End == NULL && IsFunction)
+            {
+            ValueResult = DefineFunction (Context, *f, ErrorResult);
+            *f += strlen (*f);
+            goto Done;
+            }
+         if (End == NULL)
+            {
+            ValueResult = EvaluateDefinition (Context, f, ErrorResult);
+            goto Done;
+            }
+         Copy = (char *) malloc (End - *f + 1);
+         if (Copy == NULL)
+            {
+            *ErrorResult = ERROR_heap_full;
+            ValueResult  = DEFAULT_RETURN;
+            goto Done;
+            }
+         memcpy (Copy, *f, End - *f);
+         Copy[End - *f] = 0;
+         CopyPtr = Copy;
+         if (IsFunction)
+            {
+            ValueResult = DefineFunction (Context, Copy, ErrorResult);
+            CopyPtr += strlen (Copy);
+            }
+         else
+            ValueResult = EvaluateDefinition (Context, &CopyPtr,
+                                              ErrorResult);
+         *f += CopyPtr - Copy;
+         free (Copy);
+         goto Done;
+         }
       }
-   /*  RETURN FIRST TOKEN   */
-   SkipWhiteSpace (&tail);
-   *tadd = tail;
-   return(head);
-}
+
+   /*  SET CONTEXT VARIABLES  */
+   Context->ErrorCode        = ERROR_none;
+   Context->ParenthesisLevel = 0;
+   Context->FormulaString    = *f;
+   Context->FormulaEnd       = End;
+   /*  SET INPUT OPERATOR   */
+   CurrentOperator = OP_BeginLine;
+   /*  CALL PARSEING ROUTINE   */
+   ValueResult = EvaluateFormula (Context, &CurrentOperator);
+   /*  SET PARAMETER OUTPUT VARIALBES   */
+   *ErrorResult  = (int ) Context->ErrorCode;
+   *f = Context->FormulaString;
+   Context->FormulaEnd = NULL;
+
+Done:
+   STATS_COUNT (Context, Errors[*ErrorResult]);
+   STATS_LEAVE (Context);
+   return(ValueResult);
+   }
+
+
+/*  DEFINE VARIABLE BY FORMULA "name := formula"  */
+double EvaluateDefinition (calc_context *Context, const char **f,
+                           int *ErrorResult)
+   {
+   const char *Formula;
+   int         TokenLength;
+
+   Formula = *f;
+   SkipWhiteSpace (&Formula, NULL);
+   TokenLength = GetNextTokenLength (Formula);
+   if (TokenLength >= MAXTOKENLENGTH)
+      {
+      *ErrorResult = ERROR_variable_long;
+      return DEFAULT_RETURN;
+      }
+   CopyUppercaseString (Context->TokenString, Formula, TokenLength);
+   Formula += TokenLength;
+   SkipWhiteSpace (&Formula, NULL);
+   Formula += 2;
+   SkipWhiteSpace (&Formula, NULL);
+
+   /*  CONSTANTS AND FUNCTIONS CANNOT BE DEFINED  */
+   if (FindBuiltin (Context->TokenString, TokenLength) != NULL)
+      {
+      *ErrorResult = ERROR_variable_expected;
+      return DEFAULT_RETURN;
+      }
+
+   *f = Formula + strlen (Formula);
+   return DefineVariable (Context, Context->TokenString, Formula,
+                          ErrorResult);
+   }
+
+
+/*
+   Same as ParseFormula without recursion.  Each call ParseFormula
+   would make pushes a frame holding its value (operand stack) and
+   operator (operator stack) on Context->Frames instead of the C
+   stack, so frames follow ParseFormula's calls one for one: the same
+   operators are applied in the same order, with the same errors and
+   the same partial assignments.  The frame stack is kept by the
+   context and grows as needed, so nesting is limited only by memory.
+*/
+double EvaluateFormula (calc_context *Context, operator_t *PendingOperator)
+   {
+   parseframe_t *Frame;
+   parseframe_t *NewFrames;
+   operator_t   *Pending;
+   const calc_builtin *Builtin;
+   const calc_function *Function;
+   double        Returned;
+   int           Depth;
+   int           NewSize;
+   int           TokenLength;
+   int           Parameter;
+   int           NumberOfArguments;
+   BOOLEAN       ApplyOperator;
+   BOOLEAN       Normal;
+
+   Depth    = 0;
+   Returned = DEFAULT_RETURN;
+   Context->NumberOfArguments = 0;
+   Context->Local             = NULL;
+   if (Context->FrameSize == 0)
+      {
+      Context->Frames = (parseframe_t *)
+         ArenaAllocate (Context->Arena, INITIALFRAMES * sizeof(parseframe_t));
+      if (Context->Frames == NULL)
+         {
+         Context->ErrorCode = ERROR_heap_full;
+         return DEFAULT_RETURN;
+         }
+      Context->FrameSize = INITIALFRAMES;
+      }
+   Context->Frames[0].Step = STEP_operand;
+   STATS_DEPTH (Context, 1);
+
+   for (;;)
+      {
+      Frame   = Context->Frames + Depth;
+      Pending = Depth ? &Frame[-1].Operator : PendingOperator;
+      Normal  = FALSE;
+
+      switch (Frame->Step)
+         {
+         /*  PARSE VALUE  */
+         case STEP_operand:
+            Frame->VariableID = NOTFOUND;
+            SkipWhiteSpace (&Context->FormulaString, Context->FormulaEnd);
+            Frame->MinusSignPresent = FALSE;
+            if (CURRENTCHAR (Context)=='-')
+               {
+               Frame->MinusSignPresent = TRUE;
+               Context->FormulaString++;
+               }
+            else if (CURRENTCHAR (Context)=='+')
+               Context->FormulaString++;
+
+            /*  PARENTHETICAL EXPRESSION - PUSH FRAME FOR IT  */
+            if ( CURRENTCHAR (Context)=='(' )
+               {
+               STATS_COUNT (Context, Tokens);
+               Context->FormulaString++;
+               Context->ParenthesisLevel++;
+               Frame->Operator = OP_OpenParenthesis;
+               Frame->Step     = STEP_parenthesis;
+               goto PushFrame;
+               }
+            /*  CONSTANT  */
+            else if ((CURRENTCHAR (Context) >= '0' &&
+                      CURRENTCHAR (Context) <= '9') ||
+                     CURRENTCHAR (Context)=='.')
+               {
+               STATS_COUNT (Context, Tokens);
+               STATS_PHASE (Context, PHASE_tokenize);
+               Frame->Value = ReadNumber (Context);
+               STATS_PHASE (Context, PHASE_evaluate);
+               }
+            /*  NAME (EITHER FUNCTION, VARIABLE, SPECIAL CONSTANT)  */
+            else
+               {
+               STATS_COUNT (Context, Tokens);
+               STATS_PHASE (Context, PHASE_tokenize);
+               TokenLength = GetBoundedTokenLength (Context->FormulaString,
+                                                    Context->FormulaEnd);
+               if (TokenLength == 0)
+                  {
+                  Context->ErrorCode = ERROR_operand;
+                  goto PopFrame;
+                  }
+               if (TokenLength >= MAXTOKENLENGTH)
+                  {
+                  Context->ErrorCode = ERROR_variable_long;
+                  goto PopFrame;
+                  }
+               CopyUppercaseString (Context->TokenString,
+                                    Context->FormulaString, TokenLength);
+               Context->FormulaString += TokenLength;
+               Builtin = FindBuiltin (Context->TokenString, TokenLength);
+               SkipWhiteSpace (&Context->FormulaString,
+                               Context->FormulaEnd);
+               STATS_PHASE (Context, PHASE_evaluate);
+               if (Builtin != NULL && Builtin->Kind == BUILTIN_constant)
+                  Frame->Value = Builtin->Value;
+               /*  PARAMETER OF THE DEFINED FUNCTION BEING EVALUATED  */
+               else if (Builtin == NULL && Context->Local != NULL &&
+                        (Parameter = FindParameter (Context->Local,
+                                                    Context->TokenString))
+                        != NOTFOUND)
+                  Frame->Value =
+                     Context->Arguments[Context->LocalBase + Parameter];
+               /*  FUNCTION - PUSH FRAME FOR FIRST ARGUMENT  */
+               else if (Builtin != NULL || CURRENTCHAR (Context)=='(')
+                  {
+                  Frame->Defined = NOTFOUND;
+                  if (Builtin != NULL)
+                     {
+                     Frame->Function = Builtin->Function;
+                     Frame->Arity    = Builtin->Arity;
+                     }
+                  else
+                     {
+                     Frame->Defined =
+                        FindFunction (Context, Context->TokenString);
+                     if (Frame->Defined == NOTFOUND)
+                        {
+                        Context->ErrorCode = ERROR_function;
+                        goto PopFrame;
+                        }
+                     Frame->Arity = Context->Functions[Frame->Defined]
+                                    .NumberOfParameters;
+                     }
+                  if (CURRENTCHAR (Context)!='(')
+                     {
+                     Context->ErrorCode = ERROR_operand;
+                     goto PopFrame;
+                     }
+                  STATS_COUNT (Context, Tokens);
+                  Context->FormulaString++;
+                  Context->ParenthesisLevel++;
+                  Frame->ArgumentBase = Context->NumberOfArguments;
+                  Frame->Operator = OP_OpenParenthesis;
+                  Frame->Step     = STEP_argument;
+                  goto PushFrame;
+                  }
+               /*  VARIABLE  */
+               else
+                  {
+                  STATS_PHASE (Context, PHASE_lookup);
+                  Frame->VariableID =
+                     GetVariableID (Context, Context->TokenString);
+                  if (Frame->VariableID==NOTFOUND)
+                     {
+                     Frame->VariableID = AssignVariable_r
+                        (Context, Context->TokenString, 0.0);
+                     if (Frame->VariableID == NOROOM)
+                        {
+                        Context->ErrorCode = ERROR_variable_full;
+                        goto PopFrame;
+                        }
+                     else if (Frame->VariableID == NOHEAP)
+                        {
+                        Context->ErrorCode = ERROR_heap_full;
+                        goto PopFrame;
+                        }
+                     }
+                  Frame->Value =
+                     GetVariableValue (Context, Frame->VariableID);
+                  STATS_PHASE (Context, PHASE_evaluate);
+                  if (Context->Definitions != NULL &&
+                      VariableError (Context, Frame->VariableID)
+                      != ERROR_none)
+                     {
+                     Context->ErrorCode = (errorcode_t)
+                        VariableError (Context, Frame->VariableID);
+                     goto PopFrame;
+                     }
+                  }
+               }
+            Frame->Step = STEP_operator;
+            break;
+
+         /*  BACK FROM PARENTHETICAL EXPRESSION  */
+         case STEP_parenthesis:
+            Frame->Value = Returned;
+            if (Context->ErrorCode != ERROR_none)
+               goto PopFrame;
+            /*  COMMAS ONLY SEPARATE FUNCTION ARGUMENTS  */
+            if (Frame->Operator==OP_Comma)
+               {
+               Context->ErrorCode = ERROR_operator;
+               goto PopFrame;
+               }
+            if (Frame->Operator!=OP_CloseParenthesis)
+               {
+               Context->ErrorCode = ERROR_openparen;
+               goto PopFrame;
+               }
+            Frame->Step = STEP_operator;
+            break;
+
+         /*  BACK FROM FUNCTION ARGUMENT - ALL BUT THE LAST ARE KEPT  */
+         case STEP_argument:
+            Frame->Value = Returned;
+            if (Context->ErrorCode != ERROR_none)
+               goto PopFrame;
+            NumberOfArguments =
+               Context->NumberOfArguments - Frame->ArgumentBase + 1;
+            if (Frame->Operator==OP_Comma)
+               {
+               if (NumberOfArguments >= Frame->Arity)
+                  {
+                  Context->ErrorCode = ERROR_arguments;
+                  goto PopFrame;
+                  }
+               if (!PushArgument (Context, Returned))
+                  {
+                  Context->ErrorCode = ERROR_heap_full;
+                  goto PopFrame;
+                  }
+               Frame->Operator = OP_OpenParenthesis;
+               goto PushFrame;
+               }
+            if (Frame->Operator!=OP_CloseParenthesis)
+               {
+               Context->ErrorCode = ERROR_openparen;
+               goto PopFrame;
+               }
+            if (NumberOfArguments != Frame->Arity)
+               {
+               Context->ErrorCode = ERROR_arguments;
+               goto PopFrame;
+               }
+            if (Frame->Defined == NOTFOUND && NumberOfArguments == 1)
+               Frame->Value = EvaluateFunction (Context, Frame->Function,
+                                                Frame->Value);
+            else if (!PushArgument (Context, Returned))
+               Context->ErrorCode = ERROR_heap_full;
+            else if (Frame->Defined == NOTFOUND)
+               {
+               Frame->Value = EvaluateFunctionN (Context, Frame->Function,
+                                 Context->Arguments + Frame->ArgumentBase);
+               Context->NumberOfArguments = Frame->ArgumentBase;
+               }
+            /*  DEFINED FUNCTION - PUSH FRAME FOR ITS FORMULA  */
+            else
+               {
+               Function = Context->Functions + Frame->Defined;
+               Frame->ReturnString = Context->FormulaString;
+               Frame->ReturnEnd    = Context->FormulaEnd;
+               Frame->ReturnLevel  = Context->ParenthesisLevel;
+               Frame->ReturnLocal  = Context->Local;
+               Frame->ReturnBase   = Context->LocalBase;
+               Context->FormulaString    = Function->Body;
+               Context->FormulaEnd       = NULL;
+               Context->ParenthesisLevel = 0;
+               Context->Local            = Function;
+               Context->LocalBase        = Frame->ArgumentBase;
+               Frame->Operator = OP_BeginLine;
+               Frame->Step     = STEP_body;
+               goto PushFrame;
+               }
+            if (Context->ErrorCode != ERROR_none)
+               goto PopFrame;
+            Frame->Step = STEP_operator;
+            break;
+
+         /*  BACK FROM FORMULA OF DEFINED FUNCTION - GO ON AFTER CALL  */
+         case STEP_body:
+            Context->FormulaString     = Frame->ReturnString;
+            Context->FormulaEnd        = Frame->ReturnEnd;
+            Context->ParenthesisLevel  = Frame->ReturnLevel;
+            Context->Local             = Frame->ReturnLocal;
+            Context->LocalBase         = Frame->ReturnBase;
+            Context->NumberOfArguments = Frame->ArgumentBase;
+            Frame->Value = Returned;
+            if (Context->ErrorCode != ERROR_none)
+               goto PopFrame;
+            Frame->Step = STEP_operator;
+            break;
+
+         /*  APPLY UNARY OPERATOR, THEN PARSE OPERATOR  */
+         case STEP_operator:
+            if (Frame->MinusSignPresent)
+               Frame->Value = -Frame->Value;
+            STATS_COUNT (Context, Tokens);
+            STATS_PHASE (Context, PHASE_tokenize);
+            SkipWhiteSpace (&Context->FormulaString, Context->FormulaEnd);
+            switch (CURRENTCHAR (Context)) {
+               case '+' : Frame->Operator = OP_Add;               break;
+               case '-' : Frame->Operator = OP_Subtract;          break;
+               case '*' : Frame->Operator = OP_Multiply;          break;
+               case '/' : Frame->Operator = OP_Divide;            break;
+               case '^' : Frame->Operator = OP_RaisePower;        break;
+               case ')' : Frame->Operator = OP_CloseParenthesis;  break;
+               case ',' : Frame->Operator = OP_Comma;             break;
+               case '=' : Frame->Operator = OP_Assignment;        break;
+               case '\0': Frame->Operator = OP_EndLine;           break;
+               default   : Context->ErrorCode = ERROR_operator;
+                          goto PopFrame;
+            }
+            if (Context->FormulaString != Context->FormulaEnd)
+               ++Context->FormulaString;
+            STATS_PHASE (Context, PHASE_evaluate);
+            Frame->Step = STEP_apply;
+            break;
+
+         /*  BACK FROM RIGHT OPERAND - COMBINE WITH LEFT  */
+         case STEP_combine:
+            switch (Frame->Applying)
+               {
+               case OP_Add:
+                  Frame->Value += Returned;
+                  break;
+               case OP_Subtract:
+                  Frame->Value -= Returned;
+                  break;
+               case OP_Multiply:
+                  Frame->Value *= Returned;
+                  break;
+               case OP_Divide:
+                  Context->DivisorValue = Returned;
+                  if ( Context->DivisorValue == 0 )
+                     {
+                     Context->ErrorCode = ERROR_division;
+                     Frame->Value = 0.0;
+                     }
+                  else
+                     Frame->Value /= Context->DivisorValue;
+                  break;
+               case OP_RaisePower:
+                  Frame->Value = pow (Frame->Value, Returned);
+                  break;
+               default:
+                  Context->Variables.Values[ Frame->VariableID ]
+                     = Frame->Value = Returned;
+                  Context->Variables.Versions[ Frame->VariableID ]++;
+                  if (Context->Definitions != NULL)
+                     VariableAssigned (Context, Frame->VariableID);
+                  break;
+               }
+            Frame->Step = STEP_apply;
+            /*  FALL THROUGH  */
+
+         /*  APPLY OPERATOR IF NO HIGHER PENDING OPERATORS  */
+         case STEP_apply:
+            if (Context->ErrorCode != ERROR_none)
+               ApplyOperator = FALSE;
+            else if (Frame->Operator==OP_Assignment)
+               ApplyOperator = (Frame->Operator >= *Pending);
+            else
+               ApplyOperator = (Frame->Operator >  *Pending);
+            if (!ApplyOperator)
+               {
+               Normal = TRUE;
+               goto PopFrame;
+               }
+            switch (Frame->Operator)
+               {
+               case OP_Add:
+               case OP_Subtract:
+               case OP_Multiply:
+               case OP_Divide:
+               case OP_RaisePower:
+                  Frame->Applying = Frame->Operator;
+                  Frame->Step     = STEP_combine;
+                  goto PushFrame;
+               case OP_CloseParenthesis:
+                  Context->ParenthesisLevel--;
+                  if ( Context->ParenthesisLevel<0 )
+                     Context->ErrorCode = ERROR_closeparen;
+                  break;
+               /*  COMMA OUTSIDE FUNCTION ARGUMENTS  */
+               case OP_Comma:
+                  Context->ErrorCode = ERROR_operator;
+                  break;
+               case OP_Assignment:
+                  if (Frame->VariableID == NOTFOUND)
+                     {
+                     Context->ErrorCode = ERROR_variable_expected;
+                     goto PopFrame;
+                     }
+                  Frame->Applying = OP_Assignment;
+                  Frame->Step     = STEP_combine;
+                  goto PushFrame;
+               default:
+                  break;
+               }
+            break;
+         }
+      continue;
+
+      /*  START NEW FRAME FOR NESTED VALUE  */
+PushFrame:
+      if (Depth+1 >= Context->FrameSize)
+         {
+         NewSize = 2*Context->FrameSize;
+         NewFrames = (parseframe_t *)
+            ArenaResize (Context->Arena, Context->Frames,
+                         Context->FrameSize * sizeof(parseframe_t),
+                         NewSize * sizeof(parseframe_t));
+         if (NewFrames == NULL)
+            {
+            Context->ErrorCode = ERROR_heap_full;
+            Returned = DEFAULT_RETURN;
+            Frame = Context->Frames + Depth;
+            continue;
+            }
+         Context->Frames    = NewFrames;
+         Context->FrameSize = NewSize;
+         }
+      Depth++;
+      STATS_DEPTH (Context, Depth+1);
+      Context->Frames[Depth].Step = STEP_operand;
+      continue;
+
+      /*  RETURN VALUE TO CALLING FRAME - ERRORS RETURN DEFAULT_RETURN  */
+PopFrame:
+      Returned = DEFAULT_RETURN;
+      if (Normal)
+         {
+         *Pending = Frame->Operator;
+         Returned = Frame->Value;
+         }
+      if (Depth == 0)
+         return Returned;
+      Depth--;
+      }
+   }
+
 
 
 /*
@@ -646,17 +1447,208 @@ Exported Subroutines
 */
 
 
+/*  CONTEXT IN ITS OWN ARENA  */
+calc_context *calc_context_new (void)
+   {
+   calc_arena    Arena;
+   calc_context *Context;
+
+   calc_arena_init (&Arena, NULL, NULL, NULL);
+   Context = calc_context_new_arena (&Arena);
+   if (Context == NULL)
+      {
+      calc_arena_free (&Arena);
+      return NULL;
+      }
+   Context->OwnArena = Arena;
+   Context->Arena    = &Context->OwnArena;
+   Context->Variables.Arena = Context->Arena;
+   Context->FunctionNames.Arena = Context->Arena;
+   return Context;
+   }
+
+/*  CONTEXT IN CALLER'S ARENA - FREED WHEN THE CALLER FREES THE ARENA  */
+calc_context *calc_context_new_arena (calc_arena *Arena)
+   {
+   calc_context *Context;
+
+   Context = (calc_context *) ArenaAllocate (Arena, sizeof(calc_context));
+   if (Context == NULL)
+      return NULL;
+   memset (Context, 0, sizeof(calc_context));
+   Context->Arena = Arena;
+   Context->Variables.Arena = Arena;
+   Context->FunctionNames.Arena = Arena;
+   Context->Start = ArenaAllocate (Arena, 0);
+   return Context;
+   }
+
+/*  FORGET ALL VARIABLES - PROGRAMS COMPILED IN CONTEXT MUST BE FREED FIRST  */
+void calc_context_reset (calc_context *Context)
+   {
+   FreeDefinitions (Context);
+   FreeFunctions (Context);
+   if (Context->Arena == NULL)
+      {
+      FreeSymbolTable (&Context->Variables);
+      free (Context->Frames);
+      free (Context->Arguments);
+      free (Context->Numbers);
+      }
+   else
+      {
+      ArenaRewind (Context->Arena, Context->Start);
+      memset (&Context->Variables, 0, sizeof(symtab_t));
+      Context->Variables.Arena = Context->Arena;
+      }
+   Context->Frames       = NULL;
+   Context->FrameSize    = 0;
+   Context->Arguments    = NULL;
+   Context->ArgumentSize = 0;
+   Context->Numbers      = NULL;
+   Context->NumberSize   = 0;
+   Context->FunctionVersion++;
+   }
+
+void calc_context_free (calc_context *Context)
+   {
+   calc_arena Arena;
+
+   if (Context == NULL || Context == &DefaultContext_m)
+      return;
+   FreeDefinitions (Context);
+   FreeFunctions (Context);
+   if (Context->Arena == &Context->OwnArena)
+      {
+      Arena = Context->OwnArena;
+      calc_arena_free (&Arena);
+      }
+   }
+
+/*
+   Make Mirror hold the variables of Context, with the same IDs and
+   values, so that formulas without assignments give the same results
+   in both.  Mirror must start empty and only be changed by this,
+   calc_context_rollback and formulas without assignments.  Defined
+   variables are copied with the value they were last computed with,
+   and defined functions are copied when they have changed.
+*/
+int calc_context_mirror (calc_context *Mirror, calc_context *Context)
+   {
+   symtab_t *From = &Context->Variables;
+   symtab_t *To   = &Mirror->Variables;
+   int       VariableID;
+
+   TruncateSymbols (To, From->NumberOfSymbols);
+   for (VariableID=To->NumberOfSymbols; VariableID<From->NumberOfSymbols;
+        VariableID++)
+      if (AddSymbol (To, SymbolName (From, VariableID), 0.0) < 0)
+         return ERROR_heap_full;
+   if (From->NumberOfSymbols > 0)
+      memcpy (To->Values, From->Values,
+              From->NumberOfSymbols * sizeof(double));
+   return MirrorFunctions (Mirror, Context);
+   }
+
+/*  REMOVE VARIABLES CREATED AFTER THE FIRST nvars - NONE MAY BE DEFINED  */
+void calc_context_rollback (calc_context *Context, int NumberOfVariables)
+   {
+   TruncateSymbols (&Context->Variables, NumberOfVariables);
+
+   /*  VARIABLES MADE AGAIN WITH THE SAME IDS HAVE NO OTHER VALUES YET  */
+   if (NumberOfVariables < Context->NumberSize)
+      memset (Context->Numbers + NumberOfVariables, 0,
+              (Context->NumberSize - NumberOfVariables)
+              * sizeof(calc_numvalue));
+   }
+
+int calc_context_nvars (calc_context *Context)
+   {
+   return Context->Variables.NumberOfSymbols;
+   }
+
+/*  RETURN CONTEXT USED BY evalform, listvar AND AssignVariable  */
+calc_context *calc_default_context (void)
+   {
+   return &DefaultContext_m;
+   }
+
+int AssignVariable ( char *NewName, double NewValue)
+   {
+   return AssignVariable_r (&DefaultContext_m, NewName, NewValue);
+   }
+
+int calc_var_handle (const char *Name)
+   {
+   return calc_var_handle_r (&DefaultContext_m, Name);
+   }
+
+/*  NAMES OF CONSTANTS AND FUNCTIONS WOULD NEVER BE READ AS VARIABLES  */
+int calc_var_handle_r (calc_context *Context, const char *Name)
+   {
+   char UpperName[MAXTOKENLENGTH];
+   int  TokenLength;
+   int  VariableID;
+
+   TokenLength = GetNextTokenLength (Name);
+   if (TokenLength == 0 || TokenLength >= MAXTOKENLENGTH ||
+       Name[TokenLength] != '\0')
+      return NOTFOUND;
+   CopyUppercaseString (UpperName, Name, TokenLength);
+   if (FindBuiltin (UpperName, TokenLength) != NULL)
+      return NOTFOUND;
+   VariableID = FindSymbol (&Context->Variables, UpperName);
+   if (VariableID == NOTFOUND)
+      VariableID = AddSymbol (&Context->Variables, UpperName, 0.0);
+   return VariableID;
+   }
+
+void calc_set (int Handle, double Value)
+   {
+   SetVariableValue (&DefaultContext_m, Handle, Value);
+   }
+
+void calc_set_r (calc_context *Context, int Handle, double Value)
+   {
+   SetVariableValue (Context, Handle, Value);
+   }
+
+double calc_get (int Handle)
+   {
+   return GetVariableValue (&DefaultContext_m, Handle);
+   }
+
+double calc_get_r (calc_context *Context, int Handle)
+   {
+   return GetVariableValue (Context, Handle);
+   }
+
 char *listvar (int VariableID, double *val)
    {
-   if (VariableID>=NumberOfVariables_m)
+   return listvar_r (&DefaultContext_m, VariableID, val);
+   }
+
+char *listvar_r (calc_context *Context, int VariableID, double *val)
+   {
+   if (VariableID>=Context->Variables.NumberOfSymbols)
       return (NULL);
    else
       {
-      *val = VariableValues_m[VariableID];
-      return (VariableNames_m[VariableID]);
+      *val = GetVariableValue (Context, VariableID);
+      return (SymbolName (&Context->Variables, VariableID));
       }
    }
 
+char *listdef (int VariableID)
+   {
+   return listdef_r (&DefaultContext_m, VariableID);
+   }
+
+char *listfunc (int FunctionID)
+   {
+   return listfunc_r (&DefaultContext_m, FunctionID);
+   }
+
 char *parsemsg (int InputErrorCode)
    {
    char *msg;
@@ -699,6 +1691,24 @@ char *parsemsg (int InputErrorCode)
       case ERROR_parameter:
          msg = "error: function parameter is out of range.";
          break;
+      case ERROR_definition:
+         msg = "error: definition cannot assign variables.";
+         break;
+      case ERROR_cycle:
+         msg = "error: definition depends on itself.";
+         break;
+      case ERROR_nesting:
+         msg = "error: formula nested too deeply.";
+         break;
+      case ERROR_arguments:
+         msg = "error: wrong function arguments.";
+         break;
+      case ERROR_snapshot:
+         msg = "error: cannot write or read snapshot.";
+         break;
+      case ERROR_overflow:
+         msg = "error: result out of range.";
+         break;
       default:
          msg = "internal error:  Unknown error code.";
          break;
@@ -708,29 +1718,106 @@ char *parsemsg (int InputErrorCode)
 
 double evalform (char **f, int *ErrorResult)
    {
-   double     ValueResult;
-   operator_t CurrentOperator;
+   return evalform_r (&DefaultContext_m, f, ErrorResult);
+   }
 
-   /*  SET GLOBAL VARIABLES  */
-   ErrorCode_m        = ERROR_none;
-   ParenthesisLevel_m = 0;
-   FormulaString_m    = *f;
-   /*  SET INPUT OPERATOR   */
+double evalform_n (char **f, size_t Length, int *ErrorResult)
+   {
+   return evalform_rn (&DefaultContext_m, f, Length, ErrorResult);
+   }
+
+double evalform_r (calc_context *Context, char **f, int *ErrorResult)
+   {
+   const char *Formula;
+   double      Result;
+
+   Formula = *f;
+   Result = EvaluateLine (Context, &Formula, NULL, ErrorResult);
+   *f += Formula - *f;
+   return Result;
+   }
+
+/*  FORMULA OF Length BYTES, NOT NUL-TERMINATED - *f IS LEFT AT ITS END  */
+double evalform_rn (calc_context *Context, char **f, size_t Length,
+                    int *ErrorResult)
+   {
+   const char *Formula;
+   double      Result;
+
+   Formula = *f;
+   Result = EvaluateLine (Context, &Formula, Formula + Length, ErrorResult);
+   *f += Formula - *f;
+   return Result;
+   }
+
+/*
+   FORMULA OF Length BYTES AT Formula, WHICH ARE ONLY READ AND NEED NOT BE
+   NUL-TERMINATED.  *Used IS SET TO THE BYTES READ: ALL OF THEM IF OK, OR
+   WHERE THE ERROR WAS FOUND.  Context NULL IS THAT OF evalform.
+*/
+double calc_eval (calc_context *Context, const char *Formula, size_t Length,
+                  size_t *Used, int *ErrorResult)
+   {
+   const char *FormulaPtr;
+   double      Result;
+
+   if (Context == NULL)
+      Context = &DefaultContext_m;
+   FormulaPtr = Formula;
+   Result = EvaluateLine (Context, &FormulaPtr, Formula + Length,
+                          ErrorResult);
+   if (Used != NULL)
+      *Used = FormulaPtr - Formula;
+   return Result;
+   }
+
+#ifdef CALC_REFERENCE
+/*
+   SAME AS calc_eval, THROUGH THE RECURSIVE ParseFormula.  DEFINITIONS ARE
+   NOT RECOGNIZED, AND NESTING IS LIMITED BY THE C STACK.
+*/
+double calc_eval_reference (calc_context *Context, const char *Formula,
+                            size_t Length, size_t *Used, int *ErrorResult)
+   {
+   operator_t  CurrentOperator;
+   double      Result;
+
+   if (Context == NULL)
+      Context = &DefaultContext_m;
+   Context->ErrorCode         = ERROR_none;
+   Context->ParenthesisLevel  = 0;
+   Context->NumberOfArguments = 0;
+   Context->Local             = NULL;
+   Context->FormulaString     = Formula;
+   Context->FormulaEnd        = Formula + Length;
    CurrentOperator = OP_BeginLine;
-   /*  CALL PARSEING ROUTINE   */
-   ValueResult = ParseFormula (&CurrentOperator);
-   /*  SET PARAMETER OUTPUT VARIALBES   */
-   *ErrorResult  = (int ) ErrorCode_m;
-   *f = FormulaString_m;
-   return(ValueResult);
+   Result = ParseFormula (Context, &CurrentOperator);
+   *ErrorResult = (int) Context->ErrorCode;
+   if (Used != NULL)
+      *Used = Context->FormulaString - Formula;
+   Context->FormulaEnd = NULL;
+   return Result;
    }
+#endif
 
 /*  PULLS LEADING TOKEN: EVALUATES AS EXPRESSION AND RETURNS DOUBLE   */
 double dblstrf (char **tadd)   {
-   char *f;
+   const char *head, *sep, *tail;
    int  err;
-   f = _strhed(tadd);
-   return (evalform(&f, &err));
+   tail = (*tadd);
+   /* FIND FIRST NONBLANK CHARACTER  */
+   while (    (*tail)
+          && ( (*tail)==' ' || (*tail)=='\t' || (*tail)=='\n' )  )
+             tail++;
+   /* FIND NEXT WHITE SPACE CHARCTER - THE TOKEN IS READ IN PLACE  */
+   head = (sep = tail);
+   while ((*sep) && (*sep)!=' ' && (*sep)!='\n' && (*sep)!='\t') sep++;
+   tail = sep;
+   if (*sep)
+      tail++;
+   SkipWhiteSpace (&tail, NULL);
+   *tadd += tail - *tadd;
+   return (calc_eval (NULL, head, sep - head, NULL, &err));
 }
 
 /*  PULLS LEADING TOKEN: EVALUATES AS EXPRESSION AND RETURNS INT      */
@@ -1,7 +1,178 @@
 #ifndef __PARSE_H
 #define __PARSE_H
 
+#include <stdio.h>
+#include "symtab.h"
+
+/*  MAXIMUM LENGTH OF A NAME TOKEN (VARIABLE OR FUNCTION)  */
+#define MAXTOKENLENGTH 32
+
+/*  RETURN CODES OF GetVariableID AND AssignVariable  */
+#define NOTFOUND -1
+#define NOROOM   -2
+#define NOHEAP   -3
+
+/*  OPERATORS (IN ORDER FROM LOWEST TO HIGHEST PRECEDENCE)   */
+typedef enum
+   {
+   OP_EndLine,
+   OP_BeginLine,
+   OP_CloseParenthesis,
+   OP_Comma,                    /*  between function arguments       */
+   OP_OpenParenthesis,
+   OP_Assignment,
+   OP_Add,
+   OP_Subtract,
+   OP_Multiply,
+   OP_Divide,
+   OP_RaisePower
+   } operator_t;
+
+typedef enum
+   {
+   FUNC_err,
+   FUNC_sin,
+   FUNC_cos,
+   FUNC_tan,
+   FUNC_exp,
+   FUNC_log,
+   FUNC_log10,
+   FUNC_fabs,
+   FUNC_acos,
+   FUNC_asin,
+   FUNC_atan,
+   FUNC_sqrt,
+   FUNC_int,
+   FUNC_min,                    /*  functions of several arguments   */
+   FUNC_max,
+   FUNC_atan2,
+   FUNC_hypot,
+   FUNC_fma
+   }   function_t;
+
+/*  ARGUMENTS ACCEPTED BY A FUNCTION - Low <= x <= High, OR NaN  */
+typedef struct
+   {
+   double        Low;
+   double        High;
+   } calc_domain;
+
+/*  MOST ARGUMENTS OF A FUNCTION  */
+#define MAXARGUMENTS 8
+
+typedef enum
+   {
+   ERROR_none,
+   ERROR_operand,
+   ERROR_openparen,
+   ERROR_closeparen,
+   ERROR_operator,
+   ERROR_division,
+   ERROR_function,
+   ERROR_variable_expected,
+   ERROR_variable_full,
+   ERROR_variable_long,
+   ERROR_heap_full,
+   ERROR_parameter,
+   ERROR_definition,
+   ERROR_cycle,
+   ERROR_nesting,
+   ERROR_arguments,
+   ERROR_snapshot,
+   ERROR_overflow
+   } errorcode_t;
+
+/*  PHASES OF evalform TIMED WHEN BUILT WITH CALC_STATS  */
+typedef enum
+   {
+   PHASE_none,
+   PHASE_tokenize,              /*  numbers, names and operators     */
+   PHASE_lookup,                /*  variables                        */
+   PHASE_evaluate               /*  everything else                  */
+   } calc_phase;
+
+#define CALC_PHASES     (PHASE_evaluate+1)
+#define CALC_FUNCTIONS  (FUNC_fma+1)
+#define CALC_ERRORS     (ERROR_overflow+1)
+#define CALC_STATSNESTING 8
+
+/*  COUNTS AND TIMES OF evalform (SEE stats.c) - ZERO WITHOUT CALC_STATS  */
+typedef struct
+   {
+   unsigned long Formulas;        /*  lines evaluated                */
+   unsigned long Tokens;          /*  numbers, names and operators   */
+   unsigned long Lookups;         /*  variable names looked up       */
+   unsigned long Probes;          /*  buckets probed by lookups      */
+   unsigned long LongestProbe;
+   unsigned long Calls[CALC_FUNCTIONS];  /*  by function_t           */
+   unsigned long Errors[CALC_ERRORS];    /*  by errorcode_t          */
+   int           MaxDepth;        /*  deepest ParseFormula nesting   */
+   unsigned long long Ticks[CALC_PHASES]; /*  by calc_phase          */
+
+   /*  PHASE BEING TIMED, AND THOSE OF OUTER FORMULAS  */
+   calc_phase    Phase;
+   unsigned long long PhaseStart;
+   int           Nesting;
+   calc_phase    Outer[CALC_STATSNESTING];
+   } calc_stats;
+
+/*  DEFINITION OF A VARIABLE BY A FORMULA (SEE define.c)  */
+typedef struct calc_definition calc_definition;
+
+/*  VALUE OF A VARIABLE IN ANOTHER ARITHMETIC (SEE numeric.c)  */
+typedef struct calc_numvalue calc_numvalue;
+
+
+/*  FUNCTION DEFINED BY A FORMULA ("f(x,y) = x*y+1", SEE function.c)  */
+typedef struct
+   {
+   char          *Text;         /*  whole definition, upper case     */
+   char          *Body;         /*  formula after "=", within Text   */
+   int            NumberOfParameters;
+   char           Parameters[MAXARGUMENTS][MAXTOKENLENGTH];
+   } calc_function;
+
+
+/*  FRAME OF THE NON-RECURSIVE PARSER (SEE parse.c)  */
+typedef struct parseframe parseframe_t;
+
+/*  PARSER STATE AND VARIABLES - ONE PER THREAD  */
+typedef struct calc_context
+   {
+   const char   *FormulaString;
+   const char   *FormulaEnd;    /*  end of bounded formula, or NULL  */
+   char          TokenString[MAXTOKENLENGTH];
+   double        DivisorValue;
+   int           ParenthesisLevel;
+   errorcode_t   ErrorCode;
+   symtab_t      Variables;
+   calc_definition *Definitions;  /*  one per variable, or NULL      */
+   int           DefinitionSize;
+   parseframe_t *Frames;        /*  stack of EvaluateFormula         */
+   int           FrameSize;
+   symtab_t      FunctionNames; /*  names of defined functions       */
+   calc_function *Functions;    /*  one per name                     */
+   int           FunctionSize;
+   unsigned long FunctionVersion; /*  changed by each definition     */
+   double       *Arguments;     /*  arguments of calls in progress   */
+   int           NumberOfArguments;
+   int           ArgumentSize;
+   const calc_function *Local;  /*  function whose body is parsed    */
+   int           LocalBase;     /*  its first argument in Arguments  */
+   calc_arena   *Arena;         /*  memory of context, NULL for heap */
+   calc_arena    OwnArena;      /*  arena of calc_context_new        */
+   void         *Start;         /*  first allocation after context   */
+   int           Numeric;       /*  calc_numeric of calc_eval_number_r */
+   calc_numvalue *Numbers;      /*  one per variable, or NULL        */
+   int           NumberSize;
+#ifdef CALC_STATS
+   calc_stats    Stats;
+#endif
+   } calc_context;
+
+
 double evalform (char **f, int *err);
+double evalform_n (char **f, size_t len, int *err);
 char *parsemsg (int err);
 char *listvar  (int varid, double *val);
 double  dblstrf (char **);
@@ -9,4 +180,80 @@ int     intstrf (char **);
 long	  lngstrf (char **);
 int     AssignVariable (char *, double);
 
+/*  Reentrant versions  */
+calc_context *calc_context_new (void);
+calc_context *calc_context_new_arena (calc_arena *arena);
+void          calc_context_reset (calc_context *ctx);
+void          calc_context_free (calc_context *ctx);
+int           calc_context_mirror (calc_context *mirror, calc_context *ctx);
+void          calc_context_rollback (calc_context *ctx, int nvars);
+int           calc_context_nvars (calc_context *ctx);
+calc_context *calc_default_context (void);
+double        evalform_r (calc_context *ctx, char **f, int *err);
+double        evalform_rn (calc_context *ctx, char **f, size_t len,
+                           int *err);
+double        calc_eval  (calc_context *ctx, const char *f, size_t len,
+                          size_t *used, int *err);
+#ifdef CALC_REFERENCE
+double        calc_eval_reference (calc_context *ctx, const char *f,
+                                   size_t len, size_t *used, int *err);
+#endif
+char         *listvar_r  (calc_context *ctx, int varid, double *val);
+int           AssignVariable_r (calc_context *ctx, char *, double);
+
+/*  Variables by handle - the ID of the variable, without name lookups  */
+int           calc_var_handle   (const char *name);
+int           calc_var_handle_r (calc_context *ctx, const char *name);
+void          calc_set   (int handle, double value);
+void          calc_set_r (calc_context *ctx, int handle, double value);
+double        calc_get   (int handle);
+double        calc_get_r (calc_context *ctx, int handle);
+
+/*  Instrumentation - counts are only kept when built with CALC_STATS  */
+int           calc_stats_enabled (void);
+void          calc_stats_get   (calc_context *ctx, calc_stats *stats);
+void          calc_stats_add   (calc_stats *total, const calc_stats *stats);
+void          calc_stats_reset (calc_context *ctx);
+void          calc_stats_print (FILE *stream, const calc_stats *stats);
+
+/*  Variables defined by formulas ("a := b*2")  */
+char         *listdef   (int varid);
+char         *listdef_r (calc_context *ctx, int varid);
+
+/*  Functions defined by formulas ("f(x,y) = x*y+1")  */
+char         *listfunc   (int funcid);
+char         *listfunc_r (calc_context *ctx, int funcid);
+
+/*  Tokenizer, function and variable access shared with other modules  */
+int        GetVariableID (calc_context *Context, char *TestName);
+double     GetVariableValue (calc_context *Context, int VariableID);
+void       SetVariableValue
+           (calc_context *Context, int VariableID, double Value);
+unsigned long GetVariableVersion (calc_context *Context, int VariableID);
+function_t LookupFunction (char *FunctionName);
+int        FunctionArgumentOk (function_t InputFunction, double x);
+const calc_domain *FunctionDomains (void);
+double     ApplyFunction (function_t InputFunction, double x);
+double     ApplyFunctionN (function_t InputFunction, const double *x);
+int        GetNextTokenLength (const char *cptr);
+int        GetBoundedTokenLength (const char *cptr, const char *end);
+void       CopyUppercaseString
+           (char *TargetString, const char *SourceString, int Size);
+double     DefineVariable (calc_context *Context, char *Name,
+                           const char *Formula, int *ErrorResult);
+void       RefreshVariable (calc_context *Context, int VariableID);
+void       VariableAssigned (calc_context *Context, int VariableID);
+int        VariableError (calc_context *Context, int VariableID);
+void       FreeDefinitions (calc_context *Context);
+int        RecompileDefinitions (calc_context *Context);
+int        IsFunctionDefinition (const char *Formula, const char *End);
+double     DefineFunction (calc_context *Context, const char *Text,
+                           int *ErrorResult);
+int        FindFunction (calc_context *Context, const char *Name);
+int        FindParameter (const calc_function *Function, const char *Name);
+int        MirrorFunctions (calc_context *Mirror, calc_context *Context);
+int        AddFunction (calc_context *Context, const char *Name,
+                        const calc_function *Function);
+void       FreeFunctions (calc_context *Context);
+
 #endif
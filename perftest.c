@@ -0,0 +1,1626 @@
+/*                                                                       */
+/*                                                                       */
+/*   CORRECTNESS AND THROUGHPUT OF EVERY EVALUATION ENGINE               */
+/*                                                                       */
+/*        calcperf [-n formulas] [-s seed] [-u ulps] [-t seconds]        */
+/*                 [-o file] [-c baseline] [-r percent]                  */
+/*                                                                       */
+/*            generates random formulas using every operator, built-in   */
+/*            function and constant, evaluates each with the recursive   */
+/*            parser of parse.c (calc_eval_reference, the reference) and */
+/*            then with every other engine, and counts the results that  */
+/*            differ by more than ulps units in the last place (default  */
+/*            0) or in their error.  Each engine is then timed over the  */
+/*            formulas for at least seconds (default 0.25) and one line  */
+/*            per engine is printed:                                     */
+/*                                                                       */
+/*            checked     results compared with the reference            */
+/*            differ      results that did not agree (the first few      */
+/*                        are listed on stderr)                          */
+/*            ns/op       time per evaluation                            */
+/*            ops/s       evaluations per second                         */
+/*                                                                       */
+/*            -o writes the same as csv to file, and -c reads such a     */
+/*            file from an earlier run and reports every engine of it    */
+/*            that is now more than percent (default 10) slower.  The    */
+/*            exit status has bit 0 set if any result differed and       */
+/*            bit 1 if any engine is slower.  The formulas depend only   */
+/*            on seed (default 1) and their number (default 2000).       */
+/*                                                                       */
+/*            Built with -DCALC_REFERENCE and run by "make perftest".    */
+/*                                                                       */
+/*                                                                       */
+/*        ENGINES                                                        */
+/*                                                                       */
+/*          evalform           the iterative parser (parse.c)            */
+/*          calc_eval          read-only parser (parse.c)                */
+/*          calc_memo_eval     cache of results (memo.c)                 */
+/*          calc_run           compiled instructions (compile.c)         */
+/*          calc_jit           native code (jit.c), where supported      */
+/*          calc_run_columns   blocks of CALC_BLOCK rows (vector.c)      */
+/*          calc_run_parallel  sums of SUMTERMS terms split over         */
+/*                             threads (parallel.c), which may round     */
+/*                             differently: their tolerance is SUMTERMS  */
+/*          calc_run_long      a sum of LONGTERMS variables, run past    */
+/*                             CALC_JITTHRESHOLD: programs too long for  */
+/*                             native code keep running as instructions  */
+/*          calc_gradient      value and derivatives in reverse mode     */
+/*                             (derive.c); each finite derivative must   */
+/*                             agree, within DERIVEDIGITS digits, with   */
+/*                             the program of calc_derive                */
+/*          calc_eval_long     formulas of whole numbers with + - * ^,   */
+/*          calc_eval_fixed    exact in every arithmetic, in long double */
+/*                             and fixed point (numeric.c)               */
+/*          calc_eval_number   numbers a double cannot hold, in long     */
+/*                             double and fixed point, against their     */
+/*                             exact text                                */
+/*          calc_memo_define   lines mixing := with assignments in       */
+/*                             formulas, through the cache, twice,       */
+/*                             against evalform_r                        */
+/*          calc_snapshot      a context saved and loaded again          */
+/*                             (snapshot.c): its variables, definitions  */
+/*                             and functions must give the same results  */
+/*          calc_strtod        against strtod, exactly (number.c)        */
+/*          calc_format        against snprintf "%f" and "%e"            */
+/*                                                                       */
+/*          Each engine runs each formula twice, and both results are    */
+/*          checked, so a second run (a cached result, or native code)   */
+/*          is covered too.  Native code that returns NaN is run again   */
+/*          as instructions, as calc_run does.                           */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <unistd.h>
+#include "parse.h"
+#include "builtin.h"
+#include "number.h"
+#include "compile.h"
+#include "memo.h"
+#include "vector.h"
+#include "pool.h"
+#include "parallel.h"
+#include "numeric.h"
+#include "snapshot.h"
+
+#ifndef CALC_REFERENCE
+#error "perftest.c needs calc_eval_reference: build it with -DCALC_REFERENCE"
+#endif
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define MINTIME      0.25
+#define MAXFORMULA   4096
+#define LEAFROOM     256          /*  left in a formula for one more item  */
+#define MAXDEPTH     4
+#define VARIABLES    "ABCDEF"
+#define SUMFORMULAS  4
+#define SUMTERMS     (2*CALC_PARALLELTERMS)
+#define SUMTERMSIZE  32
+#define NUMBERS      4096
+#define LONGTERMS    (1L << 20)   /*  registers far beyond a native stack  */
+#define MAXREPORTED  5            /*  differences listed per engine        */
+#define MAXSLOTS     16
+#define MAXNAME      64
+#define UNEQUALROWS  -2           /*  Evaluate: rows of a block disagree   */
+#define UNEQUALSLOPE -3           /*  Evaluate: derivatives disagree       */
+#define EXACTFORMULAS 500
+#define EXACTBOUND   1e15         /*  largest value exact in every one     */
+#define DERIVEDIGITS 9
+#define SNAPSHOTNAME "/tmp/calcperf-XXXXXX"
+
+/*  FORMULAS AN ENGINE OF FORMULAS RUNS  */
+#define CORPUS_random 0
+#define CORPUS_sums   1           /*  SUMFORMULAS long sums                */
+#define CORPUS_exact  2           /*  whole numbers, exact in any numeric  */
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  FORMULA OF A CORPUS, WITH ITS RESULT BY THE REFERENCE  */
+typedef struct
+   {
+   char         *Text;
+   size_t        Length;
+   double        Value;
+   int           Error;
+   calc_program *Program;       /*  instructions, NULL if not compiled  */
+   int           CompileError;
+   calc_program *Native;        /*  program translated to native code   */
+   calc_jitfn    Jit;           /*  NULL if it was not                  */
+   double        Slots[MAXSLOTS];  /*  values of the slots of Native    */
+   double        Slopes[MAXSLOTS]; /*  derivatives by calc_derive       */
+   int           SlopeError;       /*  of the first that failed         */
+   } formula_t;
+
+/*  ENGINE - FORMULAS GO THROUGH Evaluate, OTHER TESTS THROUGH Check AND
+    Pass  */
+typedef struct
+   {
+   const char  *Name;
+   int        (*Evaluate) (formula_t *Formula, double *Value);
+   int          Corpus;         /*  CORPUS_ of the formulas it runs     */
+   int          Rows;           /*  evaluations per call of Evaluate,   */
+                                /*  or per Pass                         */
+   long       (*Check) (long *Checked);
+   void       (*Pass) (void);
+   } engine_t;
+
+/*  FORMULA OF NUMBERS IN AN ARITHMETIC, AND ITS RESULT TO ALL DIGITS  */
+typedef struct
+   {
+   calc_numeric  Numeric;
+   const char   *Formula;
+   const char   *Expected;
+   } literal_t;
+
+/*  RESULT OF AN ENGINE  */
+typedef struct
+   {
+   long          Checked;
+   long          Differ;
+   double        PerOp;         /*  seconds per evaluation              */
+   } result_t;
+
+
+/*
+************************************************************************
+Module-Wide Variables
+************************************************************************
+*/
+
+/*  SETTINGS  */
+static int            NumberOfFormulas_m = 2000;
+static uint64_t       Seed_m = 1;
+static uint64_t       Ulps_m = 0;
+static double         MinTime_m = MINTIME;
+static double         Slower_m = 10.0;
+
+/*  FORMULAS AND LONG SUMS, AND WHAT THE ENGINES NEED TO RUN THEM  */
+static formula_t     *Formulas_m = NULL;
+static formula_t      Sums_m[SUMFORMULAS];
+static calc_memo     *Memo_m = NULL;
+static calc_pool     *Pool_m = NULL;
+static BOOLEAN        JitAvailable_m = FALSE;
+static BOOLEAN        FixedAvailable_m = FALSE;
+static const double  *NoColumns_m[MAXSLOTS];
+static double         Rows_m[CALC_BLOCK];
+static int            RowErrors_m[CALC_BLOCK];
+
+/*  TEXT AND VALUES FOR THE NUMBER ENGINES  */
+static char          *NumberTexts_m[NUMBERS];
+static double         NumberValues_m[NUMBERS];
+
+/*  DIVISORS THAT FAIL - AS IN THE ORIGINAL PARSER, A DIVISOR THAT FAILS
+    WITH ITS VALUE STILL 0 IS A DIVISION BY ZERO, WHATEVER ITS OWN ERROR  */
+static const char    *Divisors_m[] = {
+   "1/log(0)",
+   "A/sqrt(-1)",
+   "1/(log(0)+5)",
+   "1/(5+log(0))",
+   "B/g(asin(2),A)"
+};
+
+#define NUMBEROFDIVISORS (int) (sizeof(Divisors_m) / sizeof(char *))
+
+/*  FORMULAS EXACT IN EVERY ARITHMETIC, AND CONTEXTS TO RUN THEM IN  */
+static formula_t      Exact_m[EXACTFORMULAS];
+static calc_context  *LongContext_m = NULL;
+static calc_context  *FixedContext_m = NULL;
+
+/*  LONG PROGRAM, COMPILED BY CheckLong  */
+static calc_program  *Long_m = NULL;
+
+/*  LITERALS, EVALUATED IN A CONTEXT OF THEIR OWN - %PI IS IN EACH
+    ARITHMETIC TOO, AND n KEEPS ITS DIGITS FROM ONE LINE TO THE NEXT  */
+static const literal_t Literals_m[] = {
+   { NUMERIC_long,  "9007199254740993",        "9007199254740993" },
+   { NUMERIC_long,  "0.1",                     "0.1" },
+   { NUMERIC_long,  "9007199254740993-1",      "9007199254740992" },
+   { NUMERIC_fixed, "9007199254740993",        "9007199254740993" },
+   { NUMERIC_fixed, "0.123456789012345678",    "0.123456789012345678" },
+   { NUMERIC_fixed, "123456789012345678.9",    "123456789012345678.9" },
+   { NUMERIC_fixed, "0.1+0.2",                 "0.3" },
+   { NUMERIC_fixed, "3e-18",                   "0.000000000000000003" },
+   { NUMERIC_fixed, "2*4611686018427387905",   "9223372036854775810" },
+   { NUMERIC_fixed, "n = 0.123456789012345678", "0.123456789012345678" },
+   { NUMERIC_fixed, "n*10",                    "1.23456789012345678" },
+   { NUMERIC_fixed, "%pi",                     "3.141592653589793238" }
+};
+
+#define NUMBEROFLITERALS (int) (sizeof(Literals_m) / sizeof(literal_t))
+
+static calc_context  *NumberContext_m = NULL;
+
+/*  CONTEXT SAVED BY calc_snapshot, AND THE ONE IT IS LOADED INTO  */
+static calc_context  *SavedContext_m = NULL;
+static calc_context  *LoadedContext_m = NULL;
+static char           SnapshotFile_m[] = SNAPSHOTNAME;
+static const char    *Definitions_m[] = {
+   "P := A*B - C",
+   "Q := P/2 + sin(D)",
+   "h(x) = x^2 + P"
+};
+
+static const char    *Uses_m[] = { "P", "Q", "h(E)", "h(Q) - g(P,F)" };
+
+#define NUMBEROFDEFINITIONS (int) (sizeof(Definitions_m) / sizeof(char *))
+#define NUMBEROFUSES        (int) (sizeof(Uses_m) / sizeof(char *))
+
+/*  LINES MIXING := WITH ASSIGNMENTS IN FORMULAS, RUN THROUGH A CACHE AND
+    THROUGH evalform_r (calc_eval_reference READS NO DEFINITIONS), EACH IN
+    A CONTEXT OF ITS OWN  */
+static const char    *Script_m[] = {
+   "x = 1",
+   "y := x*2",
+   "(x=2)+y",
+   "y",
+   "(x=x+1)*y",
+   "z := y+x",
+   "(x=1)+z",
+   "(y=5)+z",
+   "z",
+   "y := x*3",
+   "(x=2)+y+z",
+   "(w=y)+(x=3)+w+y",
+   "x"
+};
+
+#define NUMBEROFLINES       (int) (sizeof(Script_m) / sizeof(char *))
+
+static calc_context  *ScriptContext_m = NULL;
+static calc_memo     *ScriptMemo_m = NULL;
+
+/*  RESULTS ARE ADDED HERE SO THAT NO WORK IS OPTIMIZED AWAY  */
+static volatile double Sink_m;
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static double   Seconds (void);
+static uint64_t Random (uint64_t Range);
+static double   RandomValue (void);
+static void     Put (char *Buffer, size_t *Length, const char *Text);
+static void     PutLeaf (char *Buffer, size_t *Length);
+static void     PutItem (char *Buffer, size_t *Length, int Item, int Depth);
+static void     PutFormula (char *Buffer, size_t *Length, int Depth);
+static double   PutExact (char *Buffer, size_t *Length, int Depth);
+static int      NumberOfItems (void);
+static BOOLEAN  SetupFormula (formula_t *Formula, const char *Text);
+static BOOLEAN  SetupFormulas (void);
+static BOOLEAN  SetupSums (void);
+static BOOLEAN  SetupExact (void);
+static void     SetupSlopes (formula_t *Formula);
+static void     SetupNumbers (void);
+static uint64_t Ulps (double x, double y);
+static BOOLEAN  Agrees (const formula_t *Formula, int Error, double Value,
+                        uint64_t Tolerance);
+static int      EvaluateEvalform (formula_t *Formula, double *Value);
+static int      EvaluateCalcEval (formula_t *Formula, double *Value);
+static int      EvaluateMemo (formula_t *Formula, double *Value);
+static int      EvaluateRun (formula_t *Formula, double *Value);
+static int      EvaluateJit (formula_t *Formula, double *Value);
+static int      EvaluateColumns (formula_t *Formula, double *Value);
+static int      EvaluateParallel (formula_t *Formula, double *Value);
+static BOOLEAN  SlopeAgrees (double Slope, double Reference,
+                             double Value);
+static int      EvaluateGradient (formula_t *Formula, double *Value);
+static int      EvaluateNumber (calc_context *Context, formula_t *Formula,
+                                double *Value);
+static int      EvaluateLong (formula_t *Formula, double *Value);
+static int      EvaluateFixed (formula_t *Formula, double *Value);
+static long     CheckLong (long *Checked);
+static void     PassLong (void);
+static BOOLEAN  EvaluateLiteral (const literal_t *Literal, char *Text,
+                                 size_t Size);
+static long     CheckLiterals (long *Checked);
+static void     PassLiterals (void);
+static long     CheckScript (long *Checked);
+static void     PassScript (void);
+static long     CheckSnapshot (long *Checked);
+static void     PassSnapshot (void);
+static long     CheckStrtod (long *Checked);
+static void     PassStrtod (void);
+static long     CheckFormat (long *Checked);
+static void     PassFormat (void);
+static formula_t *Corpus (const engine_t *Engine, int *Count);
+static long     CheckFormulas (const engine_t *Engine, long *Checked);
+static void     PassFormulas (const engine_t *Engine);
+static long     Operations (const engine_t *Engine);
+static void     RunEngine (const engine_t *Engine, result_t *Result);
+static int      CompareBaseline (const char *FileName, const result_t *Results);
+
+
+/*
+************************************************************************
+Engines
+************************************************************************
+*/
+
+static const engine_t Engines_m[] = {
+   { "evalform",          EvaluateEvalform, CORPUS_random, 1,   NULL, NULL },
+   { "calc_eval",         EvaluateCalcEval, CORPUS_random, 1,   NULL, NULL },
+   { "calc_memo_eval",    EvaluateMemo,     CORPUS_random, 1,   NULL, NULL },
+   { "calc_run",          EvaluateRun,      CORPUS_random, 1,   NULL, NULL },
+   { "calc_jit",          EvaluateJit,      CORPUS_random, 1,   NULL, NULL },
+   { "calc_run_columns",  EvaluateColumns,  CORPUS_random, CALC_BLOCK,
+                                               NULL, NULL },
+   { "calc_run_parallel", EvaluateParallel, CORPUS_sums,   1,   NULL, NULL },
+   { "calc_run_long",     NULL,             CORPUS_random, 1,
+                                               CheckLong, PassLong },
+   { "calc_gradient",     EvaluateGradient, CORPUS_random, 1,   NULL, NULL },
+   { "calc_eval_long",    EvaluateLong,     CORPUS_exact,  1,   NULL, NULL },
+   { "calc_eval_fixed",   EvaluateFixed,    CORPUS_exact,  1,   NULL, NULL },
+   { "calc_eval_number",  NULL,             CORPUS_random, NUMBEROFLITERALS,
+                                               CheckLiterals, PassLiterals },
+   { "calc_memo_define",  NULL,             CORPUS_random, NUMBEROFLINES,
+                                               CheckScript, PassScript },
+   { "calc_snapshot",     NULL,             CORPUS_random, 1,
+                                               CheckSnapshot, PassSnapshot },
+   { "calc_strtod",       NULL,             CORPUS_random, NUMBERS,
+                                               CheckStrtod, PassStrtod },
+   { "calc_format",       NULL,             CORPUS_random, NUMBERS,
+                                               CheckFormat, PassFormat },
+   { NULL,                NULL,             CORPUS_random, 0,   NULL, NULL }
+};
+
+#define NUMBEROFENGINES (sizeof(Engines_m) / sizeof(engine_t) - 1)
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+static double Seconds (void)
+   {
+   struct timespec Now;
+
+   clock_gettime (CLOCK_MONOTONIC, &Now);
+   return Now.tv_sec + 1e-9 * Now.tv_nsec;
+   }
+
+
+/*  XORSHIFT64* - THE SAME NUMBERS FOR THE SAME SEED EVERYWHERE  */
+static uint64_t Random (uint64_t Range)
+   {
+   Seed_m ^= Seed_m >> 12;
+   Seed_m ^= Seed_m << 25;
+   Seed_m ^= Seed_m >> 27;
+   return ((Seed_m * 2685821657736338717ULL) >> 11) % Range;
+   }
+
+
+/*  VALUE OF A VARIABLE - AWAY FROM 0, EITHER SIGN  */
+static double RandomValue (void)
+   {
+   double Value;
+
+   Value = 0.125 + Random (1000) / 250.0;
+   return Random (2) ? Value : -Value;
+   }
+
+
+static void Put (char *Buffer, size_t *Length, const char *Text)
+   {
+   size_t TextLength = strlen (Text);
+
+   memcpy (Buffer + *Length, Text, TextLength + 1);
+   *Length += TextLength;
+   }
+
+
+/*  NUMBER IN ONE OF THE FORMS THE PARSER READS, VARIABLE OR CONSTANT  */
+static void PutLeaf (char *Buffer, size_t *Length)
+   {
+   const char *Names = VARIABLES;
+   char        Text[32];
+
+   switch (Random (8))
+      {
+      case 0:
+         sprintf (Text, "%d", (int) Random (1000));
+         break;
+      case 1:
+         sprintf (Text, "%d.%03d", (int) Random (100), (int) Random (1000));
+         break;
+      case 2:
+         sprintf (Text, "%d.%de%s%d", 1 + (int) Random (9), (int) Random (100),
+                  Random (2) ? "-" : "", (int) Random (4));
+         break;
+      case 3:
+         strcpy (Text, Random (2) ? "%pi" : "%e");
+         break;
+      default:
+         Text[0] = Names[Random (strlen (Names))];
+         Text[1] = 0;
+         if (Random (2))
+            Text[0] = (char) (Text[0] - 'A' + 'a');
+      }
+   Put (Buffer, Length, Text);
+   }
+
+
+/*  ITEMS ARE THE BUILT-INS, THEN + - * / ^, NEGATION AND A DEFINED
+    FUNCTION - NEW BUILT-INS ARE COVERED WITHOUT CHANGING THIS FILE  */
+static int NumberOfItems (void)
+   {
+   const calc_builtin *Builtin;
+   int                 Items = 0;
+
+   for (Builtin=calc_builtins (); Builtin->Name != NULL; Builtin++)
+      Items++;
+   return Items + 7;
+   }
+
+
+static void PutItem (char *Buffer, size_t *Length, int Item, int Depth)
+   {
+   static const char  *Operators[] = { "+", "-", "*", "/", "^" };
+   const calc_builtin *Builtins = calc_builtins ();
+   int                 NumberOfBuiltins;
+   int                 Argument;
+   BOOLEAN             Parenthesized;
+
+   NumberOfBuiltins = NumberOfItems () - 7;
+
+   /*  BUILT-IN FUNCTION OR CONSTANT  */
+   if (Item < NumberOfBuiltins)
+      {
+      Put (Buffer, Length, Builtins[Item].Name);
+      if (Builtins[Item].Kind == BUILTIN_constant)
+         return;
+      Put (Buffer, Length, "(");
+      for (Argument=0; Argument<Builtins[Item].Arity; Argument++)
+         {
+         if (Argument > 0)
+            Put (Buffer, Length, ",");
+         PutFormula (Buffer, Length, Depth-1);
+         }
+      Put (Buffer, Length, ")");
+      return;
+      }
+
+   /*  OPERATOR - WITHOUT PARENTHESES HALF OF THE TIME, FOR PRECEDENCE  */
+   Item -= NumberOfBuiltins;
+   if (Item < 5)
+      {
+      Parenthesized = (Random (2) == 0);
+      if (Parenthesized)
+         Put (Buffer, Length, "(");
+      PutFormula (Buffer, Length, Depth-1);
+      Put (Buffer, Length, Operators[Item]);
+      if (Item == 4)
+         PutLeaf (Buffer, Length);
+      else
+         PutFormula (Buffer, Length, Depth-1);
+      if (Parenthesized)
+         Put (Buffer, Length, ")");
+      }
+   else if (Item == 5)
+      {
+      Put (Buffer, Length, "-(");
+      PutFormula (Buffer, Length, Depth-1);
+      Put (Buffer, Length, ")");
+      }
+   else
+      {
+      Put (Buffer, Length, "g(");
+      PutFormula (Buffer, Length, Depth-1);
+      Put (Buffer, Length, ",");
+      PutFormula (Buffer, Length, Depth-1);
+      Put (Buffer, Length, ")");
+      }
+   }
+
+
+static void PutFormula (char *Buffer, size_t *Length, int Depth)
+   {
+   if (Depth <= 0 || *Length > MAXFORMULA - LEAFROOM || Random (4) == 0)
+      PutLeaf (Buffer, Length);
+   else
+      PutItem (Buffer, Length, (int) Random (NumberOfItems ()), Depth);
+   }
+
+
+/*  WHOLE NUMBERS WITH + - * ^ AND NEGATION - RETURNS A BOUND OF THE VALUE
+    AND OF EVERY PART OF IT, WHICH IS KEPT UNDER EXACTBOUND  */
+static double PutExact (char *Buffer, size_t *Length, int Depth)
+   {
+   static const char *Operators[] = { "+", "-", "*" };
+   char    Text[32];
+   size_t  Start = *Length;
+   double  Bound;
+   double  Right;
+   int     Item;
+   int     Power;
+
+   Item = (Depth <= 0 || Random (4) == 0) ? 5 : (int) Random (5);
+   if (Item < 3)
+      {
+      Put (Buffer, Length, "(");
+      Bound = PutExact (Buffer, Length, Depth-1);
+      Put (Buffer, Length, Operators[Item]);
+      Right = PutExact (Buffer, Length, Depth-1);
+      Put (Buffer, Length, ")");
+      Bound = (Item < 2) ? Bound + Right : Bound * Right;
+      }
+   else if (Item == 3)
+      {
+      Put (Buffer, Length, "(");
+      Bound = PutExact (Buffer, Length, Depth-1);
+      Power = 1 + (int) Random (3);
+      sprintf (Text, ")^%d", Power);
+      Put (Buffer, Length, Text);
+      Bound = pow (Bound, Power);
+      }
+   else if (Item == 4)
+      {
+      Put (Buffer, Length, "-(");
+      Bound = PutExact (Buffer, Length, Depth-1);
+      Put (Buffer, Length, ")");
+      }
+   else
+      Bound = EXACTBOUND + 1;
+
+   /*  A NUMBER INSTEAD OF WHAT GREW TOO LARGE  */
+   if (Bound > EXACTBOUND)
+      {
+      *Length = Start;
+      Bound = (double) Random (50);
+      sprintf (Text, "%d", (int) Bound);
+      Put (Buffer, Length, Text);
+      }
+   return Bound;
+   }
+
+
+/*  EVALUATE Text WITH THE REFERENCE, AND COMPILE IT FOR THE OTHER ENGINES  */
+static BOOLEAN SetupFormula (formula_t *Formula, const char *Text)
+   {
+   int   Error;
+   int   Slot;
+
+   memset (Formula, 0, sizeof(formula_t));
+   Formula->Length = strlen (Text);
+   Formula->Text   = (char *) malloc (Formula->Length + 1);
+   if (Formula->Text == NULL)
+      return FALSE;
+   strcpy (Formula->Text, Text);
+   Formula->Value = calc_eval_reference (NULL, Formula->Text,
+                                         Formula->Length, NULL,
+                                         &Formula->Error);
+
+   /*  calc_run NEVER TRANSLATES Program, SO ITS INSTRUCTIONS ARE TIMED  */
+   Formula->Program = calc_compile (Text, &Formula->CompileError);
+   if (Formula->Program == NULL)
+      return TRUE;
+   Formula->Program->RunCount = CALC_JITTHRESHOLD;
+   if (calc_nslots (Formula->Program) > MAXSLOTS)
+      return TRUE;
+   Formula->Native = calc_compile (Text, &Error);
+   if (Formula->Native != NULL)
+      {
+      Formula->Native->RunCount = CALC_JITTHRESHOLD;
+      Formula->Jit = calc_jit (Formula->Native);
+      for (Slot=0; Slot<calc_nslots (Formula->Native); Slot++)
+         Formula->Slots[Slot] =
+            GetVariableValue (calc_default_context (),
+                              Formula->Native->VariableIDs[Slot]);
+      }
+   return TRUE;
+   }
+
+
+static BOOLEAN SetupFormulas (void)
+   {
+   const char *Names = VARIABLES;
+   char        Name[2];
+   char        Text[MAXFORMULA];
+   size_t      Length;
+   char       *DefinitionPtr;
+   int         Error;
+   int         Items;
+   int         iformula;
+
+   for (Name[1]=0; *Names; Names++)
+      {
+      Name[0] = *Names;
+      AssignVariable (Name, RandomValue ());
+      }
+   DefinitionPtr = "g(x,y) = x*y - x/2";
+   evalform (&DefinitionPtr, &Error);
+
+   /*  THE FIRST FORMULAS ARE Divisors_m, THEN ONE STARTING WITH EACH ITEM
+       IN TURN  */
+   Formulas_m = (formula_t *) calloc (NumberOfFormulas_m, sizeof(formula_t));
+   if (Formulas_m == NULL)
+      return FALSE;
+   Items = NumberOfItems ();
+   for (iformula=0; iformula<NumberOfFormulas_m; iformula++)
+      {
+      Length = 0;
+      Text[0] = 0;
+      if (iformula < NUMBEROFDIVISORS)
+         strcpy (Text, Divisors_m[iformula]);
+      else if (iformula < NUMBEROFDIVISORS + Items)
+         PutItem (Text, &Length, iformula - NUMBEROFDIVISORS, MAXDEPTH);
+      else
+         PutFormula (Text, &Length, MAXDEPTH);
+      if (!SetupFormula (Formulas_m + iformula, Text))
+         return FALSE;
+      SetupSlopes (Formulas_m + iformula);
+      }
+
+   Memo_m = calc_memo_new (calc_default_context (), NumberOfFormulas_m);
+   return Memo_m != NULL;
+   }
+
+
+/*  SUMS OF POSITIVE TERMS, LONG ENOUGH TO BE SPLIT OVER THREADS  */
+static BOOLEAN SetupSums (void)
+   {
+   char    *Text;
+   char    *End;
+   BOOLEAN  Done;
+   int      isum;
+   int      iterm;
+
+   Text = (char *) malloc (SUMTERMS * SUMTERMSIZE);
+   if (Text == NULL)
+      return FALSE;
+   Done = TRUE;
+   for (isum=0; Done && isum<SUMFORMULAS; isum++)
+      {
+      End = Text;
+      for (iterm=0; iterm<SUMTERMS; iterm++)
+         End += sprintf (End, "%s%d.%d*abs(%c)*sqrt(%c^2+%d)",
+                         iterm ? "+" : "", (int) Random (1000),
+                         (int) Random (10), VARIABLES[Random (6)],
+                         VARIABLES[Random (6)], iterm % 7);
+      Done = SetupFormula (Sums_m + isum, Text);
+      }
+   free (Text);
+   Pool_m = calc_pool_new ((int) sysconf (_SC_NPROCESSORS_ONLN));
+   return Done;
+   }
+
+
+/*  DERIVATIVES BY EVERY SLOT OF Native, IN FORWARD MODE  */
+static void SetupSlopes (formula_t *Formula)
+   {
+   calc_program *Derivative;
+   double        Slots[MAXSLOTS];
+   int           Error;
+   int           Slot;
+
+   if (Formula->Native == NULL)
+      return;
+   for (Slot=0; Slot<calc_nslots (Formula->Native); Slot++)
+      {
+      Derivative = calc_derive (Formula->Native, Slot, &Error);
+      if (Derivative != NULL)
+         {
+         memcpy (Slots, Formula->Slots, sizeof(Slots));
+         Formula->Slopes[Slot] = calc_run (Derivative, Slots, &Error);
+         calc_free (Derivative);
+         }
+      if (Error != ERROR_none && Formula->SlopeError == ERROR_none)
+         Formula->SlopeError = Error;
+      }
+   }
+
+
+/*  FORMULAS OF WHOLE NUMBERS, AND THE ARITHMETICS TO RUN THEM IN  */
+static BOOLEAN SetupExact (void)
+   {
+   char   Text[MAXFORMULA];
+   size_t Length;
+   int    iformula;
+
+   for (iformula=0; iformula<EXACTFORMULAS; iformula++)
+      {
+      Length = 0;
+      Text[0] = 0;
+      PutExact (Text, &Length, MAXDEPTH);
+      if (!SetupFormula (Exact_m + iformula, Text))
+         return FALSE;
+      }
+   LongContext_m  = calc_context_new ();
+   FixedContext_m = calc_context_new ();
+   if (LongContext_m == NULL || FixedContext_m == NULL)
+      return FALSE;
+   calc_context_set_numeric (LongContext_m, NUMERIC_long);
+   FixedAvailable_m =
+      (calc_context_set_numeric (FixedContext_m, NUMERIC_fixed) == 0);
+   return TRUE;
+   }
+
+
+/*  DECIMAL TEXT OF UP TO 24 DIGITS, AND VALUES FROM RANDOM BITS  */
+static void SetupNumbers (void)
+   {
+   char     Text[64];
+   char    *End;
+   uint64_t Bits;
+   int      Digits;
+   int      Point;
+   int      idigit;
+   int      inum;
+
+   for (inum=0; inum<NUMBERS; inum++)
+      {
+      /*  DECIMAL POINT AFTER ANY DIGIT BUT THE LAST, OR NONE  */
+      End = Text;
+      Digits = 1 + (int) Random (24);
+      Point  = (int) Random (2*Digits);
+      for (idigit=0; idigit<Digits; idigit++)
+         {
+         *End++ = (char) ('0' + Random (10));
+         if (idigit == Point && idigit < Digits-1)
+            *End++ = '.';
+         }
+      *End = 0;
+      if (Random (2))
+         sprintf (End, "e%d", (int) Random (640) - 330);
+      NumberTexts_m[inum] = (char *) malloc (strlen (Text) + 1);
+      if (NumberTexts_m[inum] != NULL)
+         strcpy (NumberTexts_m[inum], Text);
+
+      /*  HALF SPREAD OVER ALL DOUBLES, HALF OVER USUAL RESULTS  */
+      if (Random (2))
+         {
+         do
+            Bits = (Random (1ULL << 32) << 32) | Random (1ULL << 32);
+         while (((Bits >> 52) & 0x7FF) == 0x7FF);
+         memcpy (&NumberValues_m[inum], &Bits, sizeof(double));
+         }
+      else
+         NumberValues_m[inum] = RandomValue () * pow (10.0, (int) Random (20) - 8);
+      }
+   }
+
+
+/*  UNITS IN THE LAST PLACE BETWEEN x AND y - 0 FOR TWO NaNs  */
+static uint64_t Ulps (double x, double y)
+   {
+   int64_t ix;
+   int64_t iy;
+
+   if (isnan (x) || isnan (y))
+      return (isnan (x) && isnan (y)) ? 0 : UINT64_MAX;
+   memcpy (&ix, &x, sizeof(double));
+   memcpy (&iy, &y, sizeof(double));
+   if (ix < 0)
+      ix = INT64_MIN - ix;
+   if (iy < 0)
+      iy = INT64_MIN - iy;
+   return (ix > iy) ? (uint64_t) ix - (uint64_t) iy
+                    : (uint64_t) iy - (uint64_t) ix;
+   }
+
+
+static BOOLEAN Agrees (const formula_t *Formula, int Error, double Value,
+                       uint64_t Tolerance)
+   {
+   if (Error != Formula->Error)
+      return FALSE;
+   return Error != ERROR_none || Ulps (Value, Formula->Value) <= Tolerance;
+   }
+
+
+/*
+************************************************************************
+Engines of Formulas - Return Error Code, or UNEQUALROWS
+************************************************************************
+*/
+
+static int EvaluateEvalform (formula_t *Formula, double *Value)
+   {
+   char *FormulaPtr;
+   int   Error;
+
+   FormulaPtr = Formula->Text;
+   *Value = evalform (&FormulaPtr, &Error);
+   return Error;
+   }
+
+
+static int EvaluateCalcEval (formula_t *Formula, double *Value)
+   {
+   int Error;
+
+   *Value = calc_eval (NULL, Formula->Text, Formula->Length, NULL, &Error);
+   return Error;
+   }
+
+
+static int EvaluateMemo (formula_t *Formula, double *Value)
+   {
+   int Error;
+
+   *Value = calc_memo_eval_n (Memo_m, Formula->Text, Formula->Length, &Error);
+   return Error;
+   }
+
+
+static int EvaluateRun (formula_t *Formula, double *Value)
+   {
+   int Error;
+
+   *Value = 0.0;
+   if (Formula->Program == NULL)
+      return Formula->CompileError;
+   *Value = calc_run (Formula->Program, NULL, &Error);
+   return Error;
+   }
+
+
+/*  NaN MAY BE AN ERROR OR AN EARLY RETURN, SO IT RUNS THE INSTRUCTIONS
+    AS calc_run DOES, AS DO FORMULAS THAT WERE NOT TRANSLATED  */
+static int EvaluateJit (formula_t *Formula, double *Value)
+   {
+   if (Formula->Jit != NULL)
+      {
+      *Value = Formula->Jit (Formula->Slots);
+      if (!isnan (*Value))
+         return ERROR_none;
+      }
+   return EvaluateRun (Formula, Value);
+   }
+
+
+/*  ALL ROWS TAKE THE VARIABLES FROM THE CONTEXT, SO THEY MUST AGREE  */
+static int EvaluateColumns (formula_t *Formula, double *Value)
+   {
+   int Row;
+
+   if (Formula->Program == NULL || calc_nslots (Formula->Program) > MAXSLOTS)
+      return EvaluateRun (Formula, Value);
+   calc_run_columns (Formula->Program, NoColumns_m, CALC_BLOCK, Rows_m,
+                     RowErrors_m);
+   *Value = Rows_m[0];
+   for (Row=1; Row<CALC_BLOCK; Row++)
+      if (RowErrors_m[Row] != RowErrors_m[0] ||
+          Ulps (Rows_m[Row], Rows_m[0]) != 0)
+         return UNEQUALROWS;
+   return RowErrors_m[0];
+   }
+
+
+static int EvaluateParallel (formula_t *Formula, double *Value)
+   {
+   int Error;
+
+   *Value = 0.0;
+   if (Formula->Program == NULL)
+      return Formula->CompileError;
+   *Value = calc_run_parallel (Formula->Program, NULL, Pool_m, &Error);
+   return Error;
+   }
+
+
+/*  WITHIN DERIVEDIGITS DIGITS OF THE LARGEST OF BOTH, THE VALUE AND 1:
+    TERMS THAT CANCEL LEAVE DIFFERENT ROUNDING IN EACH MODE, AND THE
+    VARIABLES ARE NEAR 1, SO TERMS ARE AS LARGE AS THE VALUE.  A DERIVATIVE
+    THROUGH A PART THAT IS NaN OR OVERFLOWS HAS NO MEANING, AND THE TWO
+    MODES NEED NOT AGREE ON IT  */
+static BOOLEAN SlopeAgrees (double Slope, double Reference, double Value)
+   {
+   if (!isfinite (Slope) || !isfinite (Reference) || !isfinite (Value))
+      return TRUE;
+   return fabs (Slope - Reference) <=
+          pow (10.0, -DERIVEDIGITS) *
+          fmax (fmax (fabs (Slope), fabs (Reference)),
+                fmax (fabs (Value), 1.0));
+   }
+
+
+/*  THE VALUE MUST BE THE REFERENCE'S AND EACH DERIVATIVE calc_derive'S.  A
+    DERIVATIVE THAT DOES NOT EXIST IS AN ERROR OF THE GRADIENT ALONE, SO
+    THE VALUE IS THEN CHECKED THROUGH calc_run - calc_derive MAY NOT FIND
+    IT WHERE IT IS MULTIPLIED BY 0, AS IN sin(acos(int(x)))  */
+static int EvaluateGradient (formula_t *Formula, double *Value)
+   {
+   double Gradient[MAXSLOTS];
+   int    Error;
+   int    Slot;
+
+   if (Formula->Native == NULL)
+      return EvaluateRun (Formula, Value);
+   *Value = calc_gradient (Formula->Program, NULL, Gradient, &Error);
+   if (Error == ERROR_none)
+      {
+      if (Formula->SlopeError != ERROR_none)
+         return UNEQUALSLOPE;
+      for (Slot=0; Slot<calc_nslots (Formula->Program); Slot++)
+         if (!SlopeAgrees (Gradient[Slot], Formula->Slopes[Slot], *Value))
+            return UNEQUALSLOPE;
+      return ERROR_none;
+      }
+   if ((Error == ERROR_parameter || Error == ERROR_division) &&
+       Formula->Error == ERROR_none)
+      return EvaluateRun (Formula, Value);
+   return Error;
+   }
+
+
+static int EvaluateNumber (calc_context *Context, formula_t *Formula,
+                           double *Value)
+   {
+   calc_number Number;
+   int         Error;
+
+   *Value = calc_eval_number_r (Context, Formula->Text, Formula->Length,
+                                &Number, &Error);
+   return Error;
+   }
+
+
+static int EvaluateLong (formula_t *Formula, double *Value)
+   {
+   return EvaluateNumber (LongContext_m, Formula, Value);
+   }
+
+
+static int EvaluateFixed (formula_t *Formula, double *Value)
+   {
+   return EvaluateNumber (FixedContext_m, Formula, Value);
+   }
+
+
+/*
+************************************************************************
+Engines of Long Programs and Numbers
+************************************************************************
+*/
+
+/*  EVERY RUN UP TO AND PAST CALC_JITTHRESHOLD MUST GIVE THE REFERENCE  */
+static long CheckLong (long *Checked)
+   {
+   char   *Text;
+   char   *End;
+   double  Reference;
+   double  Value;
+   long    Differ = 0;
+   long    iterm;
+   int     Error;
+   int     ReferenceError;
+   int     irun;
+
+   Text = (char *) malloc (2 * LONGTERMS);
+   if (Text == NULL)
+      return 1;
+   End = Text;
+   for (iterm=0; iterm<LONGTERMS; iterm++)
+      {
+      *End++ = VARIABLES[iterm % 6];
+      *End++ = '+';
+      }
+   End[-1] = 0;
+   Reference = calc_eval_reference (NULL, Text, (size_t) (End - 1 - Text),
+                                    NULL, &ReferenceError);
+   Long_m = calc_compile (Text, &Error);
+   free (Text);
+   if (Long_m == NULL)
+      {
+      fprintf (stderr, "calcperf: sum of %ld terms not compiled "
+               "(error %d)\n", LONGTERMS, Error);
+      (*Checked)++;
+      return 1;
+      }
+
+   for (irun=0; irun<CALC_JITTHRESHOLD+2; irun++)
+      {
+      Value = calc_run (Long_m, NULL, &Error);
+      (*Checked)++;
+      if (Error != ReferenceError || Ulps (Value, Reference) != 0)
+         {
+         if (Differ < MAXREPORTED)
+            fprintf (stderr, "calcperf: run %d of sum of %ld terms gives "
+                     "%.17g (error %d), the reference %.17g (error %d)\n",
+                     irun+1, LONGTERMS, Value, Error, Reference,
+                     ReferenceError);
+         Differ++;
+         }
+      }
+   return Differ;
+   }
+
+
+static void PassLong (void)
+   {
+   int Error;
+
+   if (Long_m != NULL)
+      Sink_m += calc_run (Long_m, NULL, &Error);
+   }
+
+
+/*  TEXT OF FORMULA IN ITS ARITHMETIC - FALSE IF THAT IS NOT BUILT IN, OR
+    (ON MACHINES WHERE IT IS DOUBLE) LONG DOUBLE HOLDS NO MORE DIGITS  */
+static BOOLEAN EvaluateLiteral (const literal_t *Literal, char *Text,
+                                size_t Size)
+   {
+   calc_number Value;
+   int         Error;
+
+   if ((Literal->Numeric == NUMERIC_long && LDBL_MANT_DIG < 64) ||
+       calc_context_set_numeric (NumberContext_m, Literal->Numeric) != 0)
+      return FALSE;
+   calc_eval_number_r (NumberContext_m, Literal->Formula,
+                       strlen (Literal->Formula), &Value, &Error);
+   if (Error != ERROR_none)
+      snprintf (Text, Size, "error %d", Error);
+   else if (calc_number_format (Literal->Numeric, &Value, Text, Size) < 0)
+      snprintf (Text, Size, "(too long)");
+   return TRUE;
+   }
+
+
+/*  EVERY LITERAL TWICE, AND EACH TIME TO ALL ITS DIGITS  */
+static long CheckLiterals (long *Checked)
+   {
+   char Text[CALC_NUMBERTEXT];
+   long Differ = 0;
+   int  ilit;
+   int  irun;
+
+   NumberContext_m = calc_context_new ();
+   if (NumberContext_m == NULL)
+      return 1;
+   for (irun=0; irun<2; irun++)
+      for (ilit=0; ilit<NUMBEROFLITERALS; ilit++)
+         {
+         if (!EvaluateLiteral (Literals_m + ilit, Text, sizeof(Text)))
+            continue;
+         (*Checked)++;
+         if (strcmp (Text, Literals_m[ilit].Expected) != 0)
+            {
+            if (Differ < MAXREPORTED)
+               fprintf (stderr, "calcperf: %s in %s arithmetic is %s, "
+                        "not %s\n", Literals_m[ilit].Formula,
+                        Literals_m[ilit].Numeric == NUMERIC_long ? "long"
+                        : "fixed", Text, Literals_m[ilit].Expected);
+            Differ++;
+            }
+         }
+   return Differ;
+   }
+
+
+static void PassLiterals (void)
+   {
+   char Text[CALC_NUMBERTEXT];
+   long Length = 0;
+   int  ilit;
+
+   if (NumberContext_m == NULL)
+      return;
+   for (ilit=0; ilit<NUMBEROFLITERALS; ilit++)
+      if (EvaluateLiteral (Literals_m + ilit, Text, sizeof(Text)))
+         Length += strlen (Text);
+   Sink_m += Length;
+   }
+
+
+/*  THE SCRIPT TWICE, SO THE SECOND TIME EVERY LINE IS IN THE CACHE  */
+static long CheckScript (long *Checked)
+   {
+   calc_context *Reference;
+   char         *FormulaPtr;
+   double        Value;
+   double        Expected;
+   long          Differ = 0;
+   int           Error;
+   int           ExpectedError;
+   int           iline;
+   int           irun;
+
+   Reference       = calc_context_new ();
+   ScriptContext_m = calc_context_new ();
+   if (Reference == NULL || ScriptContext_m == NULL)
+      return 1;
+   ScriptMemo_m = calc_memo_new (ScriptContext_m, NUMBEROFLINES);
+   if (ScriptMemo_m == NULL)
+      return 1;
+   for (irun=0; irun<2; irun++)
+      for (iline=0; iline<NUMBEROFLINES; iline++)
+         {
+         FormulaPtr = (char *) Script_m[iline];
+         Expected = evalform_r (Reference, &FormulaPtr, &ExpectedError);
+         Value = calc_memo_eval (ScriptMemo_m, Script_m[iline], &Error);
+         (*Checked)++;
+         if (Error == ExpectedError &&
+             (Error != ERROR_none || Ulps (Value, Expected) == 0))
+            continue;
+         if (Differ < MAXREPORTED)
+            fprintf (stderr, "calcperf: line %d of the script, %s, gives "
+                     "%.17g (error %d), evalform_r %.17g (error %d)\n",
+                     iline+1, Script_m[iline], Value, Error, Expected,
+                     ExpectedError);
+         Differ++;
+         }
+   calc_context_free (Reference);
+   return Differ;
+   }
+
+
+static void PassScript (void)
+   {
+   double Sum = 0.0;
+   int    Error;
+   int    iline;
+
+   if (ScriptMemo_m == NULL)
+      return;
+   for (iline=0; iline<NUMBEROFLINES; iline++)
+      Sum += calc_memo_eval (ScriptMemo_m, Script_m[iline], &Error);
+   Sink_m += Sum;
+   }
+
+
+/*  SAVE A CONTEXT OF THE VARIABLES, g AND Definitions_m AND LOAD IT INTO
+    ANOTHER: THE FORMULAS MUST GIVE THE REFERENCE THERE, AND Uses_m WHAT
+    THEY GIVE IN THE SAVED ONE  */
+static long CheckSnapshot (long *Checked)
+   {
+   char   *FormulaPtr;
+   double  Value;
+   double  Reference;
+   long    Differ = 0;
+   int     Error;
+   int     ReferenceError;
+   int     File;
+   int     iformula;
+   int     iuse;
+
+   File = mkstemp (SnapshotFile_m);
+   if (File < 0)
+      {
+      fprintf (stderr, "calcperf: cannot create %s\n", SnapshotFile_m);
+      return 1;
+      }
+   close (File);
+   SavedContext_m  = calc_context_new ();
+   LoadedContext_m = calc_context_new ();
+   if (SavedContext_m == NULL || LoadedContext_m == NULL ||
+       calc_context_mirror (SavedContext_m, calc_default_context ()) != 0)
+      return 1;
+   for (iuse=0; iuse<NUMBEROFDEFINITIONS; iuse++)
+      {
+      FormulaPtr = (char *) Definitions_m[iuse];
+      evalform_r (SavedContext_m, &FormulaPtr, &Error);
+      }
+   (*Checked)++;
+   Error = calc_snapshot_save (SavedContext_m, SnapshotFile_m);
+   if (Error == 0)
+      Error = calc_snapshot_load (LoadedContext_m, SnapshotFile_m);
+   if (Error != 0)
+      {
+      fprintf (stderr, "calcperf: snapshot %s not saved and loaded "
+               "(error %d)\n", SnapshotFile_m, Error);
+      return 1;
+      }
+
+   for (iformula=0; iformula<NumberOfFormulas_m; iformula++)
+      {
+      Value = calc_eval (LoadedContext_m, Formulas_m[iformula].Text,
+                         Formulas_m[iformula].Length, NULL, &Error);
+      (*Checked)++;
+      if (Agrees (Formulas_m + iformula, Error, Value, Ulps_m))
+         continue;
+      if (Differ < MAXREPORTED)
+         fprintf (stderr, "calcperf: %.60s in the loaded snapshot gives "
+                  "%.17g (error %d), the reference %.17g (error %d)\n",
+                  Formulas_m[iformula].Text, Value, Error,
+                  Formulas_m[iformula].Value, Formulas_m[iformula].Error);
+      Differ++;
+      }
+   for (iuse=0; iuse<NUMBEROFUSES; iuse++)
+      {
+      Reference = calc_eval (SavedContext_m, Uses_m[iuse],
+                             strlen (Uses_m[iuse]), NULL, &ReferenceError);
+      Value     = calc_eval (LoadedContext_m, Uses_m[iuse],
+                             strlen (Uses_m[iuse]), NULL, &Error);
+      (*Checked)++;
+      if (ReferenceError == ERROR_none && Error == ERROR_none &&
+          Ulps (Value, Reference) == 0)
+         continue;
+      if (Differ < MAXREPORTED)
+         fprintf (stderr, "calcperf: %s in the loaded snapshot gives %.17g "
+                  "(error %d), saved %.17g (error %d)\n", Uses_m[iuse],
+                  Value, Error, Reference, ReferenceError);
+      Differ++;
+      }
+   return Differ;
+   }
+
+
+static void PassSnapshot (void)
+   {
+   if (SavedContext_m != NULL &&
+       calc_snapshot_save (SavedContext_m, SnapshotFile_m) == 0)
+      Sink_m += calc_snapshot_load (LoadedContext_m, SnapshotFile_m);
+   }
+
+
+static long CheckStrtod (long *Checked)
+   {
+   char   *Expected;
+   char   *End;
+   double  Value;
+   double  Reference;
+   long    Differ = 0;
+   int     inum;
+
+   for (inum=0; inum<NUMBERS; inum++)
+      {
+      if (NumberTexts_m[inum] == NULL)
+         continue;
+      Reference = strtod (NumberTexts_m[inum], &Expected);
+      Value     = calc_strtod (NumberTexts_m[inum], &End);
+      (*Checked)++;
+      if (Ulps (Value, Reference) != 0 || End != Expected)
+         {
+         if (Differ < MAXREPORTED)
+            fprintf (stderr, "calcperf: calc_strtod (\"%s\") is %.17g, "
+                     "strtod %.17g\n", NumberTexts_m[inum], Value, Reference);
+         Differ++;
+         }
+      }
+   return Differ;
+   }
+
+
+static void PassStrtod (void)
+   {
+   double Sum = 0.0;
+   int    inum;
+
+   for (inum=0; inum<NUMBERS; inum++)
+      if (NumberTexts_m[inum] != NULL)
+         Sum += calc_strtod (NumberTexts_m[inum], NULL);
+   Sink_m += Sum;
+   }
+
+
+static long CheckFormat (long *Checked)
+   {
+   static const char *Conversions = "fe";
+   char   Text[CALC_NUMBERSIZE];
+   char   Reference[CALC_NUMBERSIZE];
+   char   Format[4];
+   long   Differ = 0;
+   int    iconv;
+   int    inum;
+
+   for (inum=0; inum<NUMBERS; inum++)
+      for (iconv=0; Conversions[iconv] != 0; iconv++)
+         {
+         sprintf (Format, "%%%c", Conversions[iconv]);
+         snprintf (Reference, sizeof(Reference), Format,
+                   NumberValues_m[inum]);
+         calc_format (Text, sizeof(Text), NumberValues_m[inum],
+                      Conversions[iconv]);
+         (*Checked)++;
+         if (strcmp (Text, Reference) != 0)
+            {
+            if (Differ < MAXREPORTED)
+               fprintf (stderr, "calcperf: calc_format (%.17g, '%c') is %s, "
+                        "snprintf %s\n", NumberValues_m[inum],
+                        Conversions[iconv], Text, Reference);
+            Differ++;
+            }
+         }
+   return Differ;
+   }
+
+
+static void PassFormat (void)
+   {
+   char Text[CALC_NUMBERSIZE];
+   long Length = 0;
+   int  inum;
+
+   for (inum=0; inum<NUMBERS; inum++)
+      Length += calc_format (Text, sizeof(Text), NumberValues_m[inum], 'f');
+   Sink_m += Length;
+   }
+
+
+/*
+************************************************************************
+Checking and Timing
+************************************************************************
+*/
+
+/*  FORMULAS ENGINE RUNS, AND HOW MANY  */
+static formula_t *Corpus (const engine_t *Engine, int *Count)
+   {
+   switch (Engine->Corpus)
+      {
+      case CORPUS_sums:
+         *Count = SUMFORMULAS;
+         return Sums_m;
+      case CORPUS_exact:
+         *Count = EXACTFORMULAS;
+         return Exact_m;
+      default:
+         *Count = NumberOfFormulas_m;
+         return Formulas_m;
+      }
+   }
+
+
+/*  RUN EACH FORMULA TWICE AND COMPARE BOTH RESULTS WITH THE REFERENCE  */
+static long CheckFormulas (const engine_t *Engine, long *Checked)
+   {
+   formula_t *Formulas;
+   formula_t *f;
+   uint64_t   Tolerance;
+   double     Value;
+   long       Differ = 0;
+   int        Count;
+   int        Error;
+   int        iformula;
+   int        irun;
+
+   Formulas  = Corpus (Engine, &Count);
+   Tolerance = (Engine->Corpus == CORPUS_sums) ? Ulps_m + SUMTERMS : Ulps_m;
+   for (iformula=0; iformula<Count; iformula++)
+      for (irun=0; irun<2; irun++)
+         {
+         f = Formulas + iformula;
+         Error = Engine->Evaluate (f, &Value);
+         (*Checked)++;
+         if (Agrees (f, Error, Value, Tolerance))
+            continue;
+         if (Differ < MAXREPORTED)
+            fprintf (stderr, "calcperf: %s run %d of %.*s%s\n   gives %.17g "
+                     "(error %d), the reference %.17g (error %d)\n",
+                     Engine->Name, irun+1, (int) (f->Length < 200 ? f->Length
+                     : 200), f->Text, f->Length < 200 ? "" : "...",
+                     Value, Error, f->Value, f->Error);
+         Differ++;
+         }
+   return Differ;
+   }
+
+
+static void PassFormulas (const engine_t *Engine)
+   {
+   formula_t *Formulas;
+   double     Sum = 0.0;
+   double     Value;
+   int        Count;
+   int        iformula;
+
+   Formulas = Corpus (Engine, &Count);
+   for (iformula=0; iformula<Count; iformula++)
+      {
+      Engine->Evaluate (Formulas + iformula, &Value);
+      Sum += Value;
+      }
+   Sink_m += Sum;
+   }
+
+
+/*  EVALUATIONS IN ONE PASS OF ENGINE  */
+static long Operations (const engine_t *Engine)
+   {
+   int Count;
+
+   if (Engine->Evaluate == NULL)
+      return Engine->Rows;
+   Corpus (Engine, &Count);
+   return (long) Engine->Rows * Count;
+   }
+
+
+static void RunEngine (const engine_t *Engine, result_t *Result)
+   {
+   double Start;
+   double Elapsed;
+   long   Passes;
+   long   ipass;
+
+   Result->Checked = 0;
+   if (Engine->Evaluate == NULL)
+      Result->Differ = Engine->Check (&Result->Checked);
+   else
+      Result->Differ = CheckFormulas (Engine, &Result->Checked);
+
+   /*  DOUBLE NUMBER OF PASSES UNTIL LONG ENOUGH TO TIME  */
+   Passes = 1;
+   do
+      {
+      Start = Seconds ();
+      for (ipass=0; ipass<Passes; ipass++)
+         if (Engine->Evaluate == NULL)
+            Engine->Pass ();
+         else
+            PassFormulas (Engine);
+      Elapsed = Seconds () - Start;
+      Passes *= 2;
+      }
+   while (Elapsed < MinTime_m);
+   Result->PerOp = Elapsed / (Passes/2) / Operations (Engine);
+   }
+
+
+/*  REPORT ENGINES OF FileName THAT ARE NOW SLOWER - TRUE IF ANY  */
+static int CompareBaseline (const char *FileName, const result_t *Results)
+   {
+   FILE         *Input;
+   char          Line[256];
+   char          Name[MAXNAME];
+   double        OpsPerSecond;
+   double        Now;
+   BOOLEAN       Slower = FALSE;
+   unsigned      iengine;
+
+   Input = fopen (FileName, "r");
+   if (Input == NULL)
+      {
+      fprintf (stderr, "calcperf: cannot read %s\n", FileName);
+      return TRUE;
+      }
+   while (fgets (Line, sizeof(Line), Input) != NULL)
+      {
+      if (sscanf (Line, "%63[^,],%*d,%*d,%*f,%lf", Name, &OpsPerSecond) != 2)
+         continue;
+      for (iengine=0; iengine<NUMBEROFENGINES; iengine++)
+         {
+         if (strcmp (Engines_m[iengine].Name, Name) != 0 ||
+             Results[iengine].PerOp <= 0)
+            continue;
+         Now = 1.0 / Results[iengine].PerOp;
+         if (Now < OpsPerSecond * (1.0 - Slower_m / 100.0))
+            {
+            fprintf (stderr, "calcperf: %s is %.1f%% slower than in %s "
+                     "(%.0f ops/s, was %.0f)\n", Name,
+                     100.0 * (1.0 - Now / OpsPerSecond), FileName, Now,
+                     OpsPerSecond);
+            Slower = TRUE;
+            }
+         }
+      }
+   fclose (Input);
+   return Slower;
+   }
+
+
+/*
+************************************************************************
+Main Function
+************************************************************************
+*/
+
+int main (int argc, char *argv[])
+   {
+   result_t  Results[NUMBEROFENGINES];
+   const char *OutputFile = NULL;
+   const char *Baseline = NULL;
+   FILE     *Output;
+   calc_program *Probe;
+   int       Status = 0;
+   int       Error;
+   unsigned  iengine;
+   int       iarg;
+
+   for (iarg=1; iarg<argc; iarg++)
+      {
+      if (strcmp (argv[iarg], "-n") == 0 && iarg+1 < argc)
+         NumberOfFormulas_m = atoi (argv[++iarg]);
+      else if (strcmp (argv[iarg], "-s") == 0 && iarg+1 < argc)
+         Seed_m = strtoull (argv[++iarg], NULL, 10);
+      else if (strcmp (argv[iarg], "-u") == 0 && iarg+1 < argc)
+         Ulps_m = strtoull (argv[++iarg], NULL, 10);
+      else if (strcmp (argv[iarg], "-t") == 0 && iarg+1 < argc)
+         MinTime_m = atof (argv[++iarg]);
+      else if (strcmp (argv[iarg], "-o") == 0 && iarg+1 < argc)
+         OutputFile = argv[++iarg];
+      else if (strcmp (argv[iarg], "-c") == 0 && iarg+1 < argc)
+         Baseline = argv[++iarg];
+      else if (strcmp (argv[iarg], "-r") == 0 && iarg+1 < argc)
+         Slower_m = atof (argv[++iarg]);
+      else
+         {
+         fprintf (stderr, "usage: calcperf [-n formulas] [-s seed] [-u ulps] "
+                  "[-t seconds]\n"
+                  "                [-o file] [-c baseline] [-r percent]\n");
+         return 2;
+         }
+      }
+   if (NumberOfFormulas_m < 1)
+      NumberOfFormulas_m = 1;
+   if (Seed_m == 0)
+      Seed_m = 1;
+
+   /*  NATIVE CODE IS ONLY CHECKED WHERE THERE IS ANY  */
+   Probe = calc_compile ("1+x", &Error);
+   JitAvailable_m = (Probe != NULL && calc_jit (Probe) != NULL);
+   calc_free (Probe);
+
+   if (!SetupFormulas () || !SetupSums () || !SetupExact ())
+      {
+      fprintf (stderr, "calcperf: out of memory\n");
+      return 2;
+      }
+   SetupNumbers ();
+
+   printf ("%-20s %10s %8s %10s %14s\n", "engine", "checked", "differ",
+           "ns/op", "ops/s");
+   for (iengine=0; iengine<NUMBEROFENGINES; iengine++)
+      {
+      Results[iengine].PerOp = 0;
+      if ((Engines_m[iengine].Evaluate == EvaluateJit && !JitAvailable_m) ||
+          (Engines_m[iengine].Evaluate == EvaluateFixed && !FixedAvailable_m))
+         {
+         printf ("%-20s not available on this machine\n",
+                 Engines_m[iengine].Name);
+         continue;
+         }
+      RunEngine (Engines_m + iengine, Results + iengine);
+      printf ("%-20s %10ld %8ld %10.1f %14.0f\n", Engines_m[iengine].Name,
+              Results[iengine].Checked, Results[iengine].Differ,
+              1e9 * Results[iengine].PerOp, 1.0 / Results[iengine].PerOp);
+      fflush (stdout);
+      if (Results[iengine].Differ != 0)
+         Status |= 1;
+      }
+
+   /*  CSV FOR LATER RUNS TO COMPARE WITH  */
+   if (OutputFile != NULL)
+      {
+      Output = fopen (OutputFile, "w");
+      if (Output == NULL)
+         {
+         fprintf (stderr, "calcperf: cannot write %s\n", OutputFile);
+         return Status | 2;
+         }
+      fprintf (Output, "engine,checked,differ,ns_per_op,ops_per_s\n");
+      for (iengine=0; iengine<NUMBEROFENGINES; iengine++)
+         if (Results[iengine].PerOp > 0)
+            fprintf (Output, "%s,%ld,%ld,%.1f,%.0f\n", Engines_m[iengine].Name,
+                     Results[iengine].Checked, Results[iengine].Differ,
+                     1e9 * Results[iengine].PerOp,
+                     1.0 / Results[iengine].PerOp);
+      if (fclose (Output) != 0)
+         Status |= 2;
+      }
+
+   if (strcmp (SnapshotFile_m, SNAPSHOTNAME) != 0)
+      remove (SnapshotFile_m);
+
+   if (Baseline != NULL && CompareBaseline (Baseline, Results))
+      Status |= 2;
+   return Status;
+   }
@@ -0,0 +1,294 @@
+/*                                                                       */
+/*                                                                       */
+/*   WORK-STEALING THREAD POOL                                           */
+/*                                                                       */
+/*        (1) calc_pool *calc_pool_new (int workers)                     */
+/*                                                                       */
+/*            starts workers-1 threads; the thread calling               */
+/*            calc_pool_run is the remaining worker.  Returns NULL if    */
+/*            threads cannot be started.                                 */
+/*                                                                       */
+/*        (2) void calc_pool_run (calc_pool *p, int nchunks,             */
+/*                                calc_task task, void *arg)             */
+/*                                                                       */
+/*            calls task (arg, worker, chunk) once for every chunk       */
+/*            0..nchunks-1, spread over the workers, and returns when    */
+/*            all calls are done.  Calls on one worker never overlap,    */
+/*            so task may keep state per worker.                         */
+/*                                                                       */
+/*        (3) int calc_pool_size (calc_pool *p)                          */
+/*                                                                       */
+/*            returns number of workers.                                 */
+/*                                                                       */
+/*        (4) void calc_pool_free (calc_pool *p)                         */
+/*                                                                       */
+/*            stops the threads.                                         */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Each worker is given an equal run of consecutive chunks and  */
+/*          takes them from the front.  A worker whose run is used up    */
+/*          steals from the back of another's, so chunks that take       */
+/*          longer than others do not leave workers idle.  Every run     */
+/*          has its own lock and is only touched when a chunk is         */
+/*          taken, which is rare against the work of a chunk.            */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <pthread.h>
+#include "pool.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define NOCHUNK -1
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  CHUNKS NOT YET TAKEN FROM ONE WORKER'S RUN  */
+typedef struct
+   {
+   pthread_mutex_t  Lock;
+   int              Head;       /*  next chunk of owner              */
+   int              Tail;       /*  one past last chunk              */
+   } run_t;
+
+/*  ARGUMENT OF EACH THREAD  */
+typedef struct
+   {
+   calc_pool       *Pool;
+   int              Worker;
+   } worker_t;
+
+struct calc_pool
+   {
+   int              NumberOfWorkers;
+   int              NumberOfThreads;  /*  threads started            */
+   pthread_t       *Threads;
+   worker_t        *Workers;
+   run_t           *Runs;
+   pthread_mutex_t  Lock;             /*  guards the fields below    */
+   pthread_cond_t   Start;
+   pthread_cond_t   Done;
+   unsigned long    Job;              /*  incremented for each job   */
+   int              Busy;             /*  threads still in job       */
+   int              Stop;
+   calc_task        Task;
+   void            *Argument;
+   };
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static int    TakeChunk (calc_pool *Pool, int Worker);
+static void   RunChunks (calc_pool *Pool, int Worker);
+static void  *RunThread (void *Argument);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  RETURN NEXT CHUNK OF WORKER, STOLEN IF ITS OWN RUN IS EMPTY  */
+static int TakeChunk (calc_pool *Pool, int Worker)
+   {
+   run_t *Run;
+   int    Chunk;
+   int    ivictim;
+
+   Run = Pool->Runs + Worker;
+   pthread_mutex_lock (&Run->Lock);
+   Chunk = (Run->Head < Run->Tail) ? Run->Head++ : NOCHUNK;
+   pthread_mutex_unlock (&Run->Lock);
+
+   for (ivictim=1; Chunk==NOCHUNK && ivictim<Pool->NumberOfWorkers;
+        ivictim++)
+      {
+      Run = Pool->Runs + (Worker + ivictim) % Pool->NumberOfWorkers;
+      pthread_mutex_lock (&Run->Lock);
+      if (Run->Head < Run->Tail)
+         Chunk = --Run->Tail;
+      pthread_mutex_unlock (&Run->Lock);
+      }
+   return Chunk;
+   }
+
+
+/*  RUN CHUNKS UNTIL NONE ARE LEFT  */
+static void RunChunks (calc_pool *Pool, int Worker)
+   {
+   int Chunk;
+
+   while ((Chunk = TakeChunk (Pool, Worker)) != NOCHUNK)
+      Pool->Task (Pool->Argument, Worker, Chunk);
+   }
+
+
+static void *RunThread (void *Argument)
+   {
+   worker_t      *Worker = (worker_t *) Argument;
+   calc_pool     *Pool = Worker->Pool;
+   unsigned long  Job;
+
+   /*  NO JOB RAN BEFORE THE POOL EXISTED - THE FIRST MAY ALREADY BE
+       POSTED IF THIS THREAD STARTED LATE  */
+   Job = 0;
+   pthread_mutex_lock (&Pool->Lock);
+   for (;;)
+      {
+      while (Pool->Job == Job && !Pool->Stop)
+         pthread_cond_wait (&Pool->Start, &Pool->Lock);
+      if (Pool->Stop)
+         break;
+      Job = Pool->Job;
+      pthread_mutex_unlock (&Pool->Lock);
+
+      RunChunks (Pool, Worker->Worker);
+
+      pthread_mutex_lock (&Pool->Lock);
+      if (--Pool->Busy == 0)
+         pthread_cond_signal (&Pool->Done);
+      }
+   pthread_mutex_unlock (&Pool->Lock);
+   return NULL;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+calc_pool *calc_pool_new (int NumberOfWorkers)
+   {
+   calc_pool *Pool;
+   int        iworker;
+
+   if (NumberOfWorkers < 1)
+      NumberOfWorkers = 1;
+   Pool = (calc_pool *) calloc (1, sizeof(calc_pool));
+   if (Pool == NULL)
+      return NULL;
+   Pool->NumberOfWorkers = NumberOfWorkers;
+   Pool->Threads = (pthread_t *) malloc (NumberOfWorkers * sizeof(pthread_t));
+   Pool->Workers = (worker_t *) malloc (NumberOfWorkers * sizeof(worker_t));
+   Pool->Runs    = (run_t *) malloc (NumberOfWorkers * sizeof(run_t));
+   if (Pool->Threads == NULL || Pool->Workers == NULL || Pool->Runs == NULL)
+      {
+      free (Pool->Threads);
+      free (Pool->Workers);
+      free (Pool->Runs);
+      free (Pool);
+      return NULL;
+      }
+   pthread_mutex_init (&Pool->Lock, NULL);
+   pthread_cond_init (&Pool->Start, NULL);
+   pthread_cond_init (&Pool->Done, NULL);
+   for (iworker=0; iworker<NumberOfWorkers; iworker++)
+      {
+      pthread_mutex_init (&Pool->Runs[iworker].Lock, NULL);
+      Pool->Runs[iworker].Head = 0;
+      Pool->Runs[iworker].Tail = 0;
+      Pool->Workers[iworker].Pool   = Pool;
+      Pool->Workers[iworker].Worker = iworker;
+      }
+
+   /*  WORKER 0 IS THE CALLER OF calc_pool_run  */
+   for (iworker=1; iworker<NumberOfWorkers; iworker++)
+      {
+      if (pthread_create (&Pool->Threads[iworker], NULL, RunThread,
+                          &Pool->Workers[iworker]) != 0)
+         {
+         calc_pool_free (Pool);
+         return NULL;
+         }
+      Pool->NumberOfThreads++;
+      }
+   return Pool;
+   }
+
+
+int calc_pool_size (calc_pool *Pool)
+   {
+   return Pool->NumberOfWorkers;
+   }
+
+
+void calc_pool_run (calc_pool *Pool, int NumberOfChunks, calc_task Task,
+                    void *Argument)
+   {
+   int iworker;
+
+   if (NumberOfChunks <= 0)
+      return;
+
+   /*  SPLIT CHUNKS INTO EQUAL RUNS - THREADS ARE WAITING, SO NO LOCKS  */
+   for (iworker=0; iworker<Pool->NumberOfWorkers; iworker++)
+      {
+      Pool->Runs[iworker].Head =
+         (int) ((long) NumberOfChunks * iworker / Pool->NumberOfWorkers);
+      Pool->Runs[iworker].Tail =
+         (int) ((long) NumberOfChunks * (iworker+1) / Pool->NumberOfWorkers);
+      }
+
+   pthread_mutex_lock (&Pool->Lock);
+   Pool->Task     = Task;
+   Pool->Argument = Argument;
+   Pool->Busy     = Pool->NumberOfWorkers - 1;
+   Pool->Job++;
+   pthread_cond_broadcast (&Pool->Start);
+   pthread_mutex_unlock (&Pool->Lock);
+
+   RunChunks (Pool, 0);
+
+   pthread_mutex_lock (&Pool->Lock);
+   while (Pool->Busy > 0)
+      pthread_cond_wait (&Pool->Done, &Pool->Lock);
+   pthread_mutex_unlock (&Pool->Lock);
+   }
+
+
+void calc_pool_free (calc_pool *Pool)
+   {
+   int iworker;
+
+   if (Pool == NULL)
+      return;
+   pthread_mutex_lock (&Pool->Lock);
+   Pool->Stop = 1;
+   pthread_cond_broadcast (&Pool->Start);
+   pthread_mutex_unlock (&Pool->Lock);
+   for (iworker=1; iworker<=Pool->NumberOfThreads; iworker++)
+      pthread_join (Pool->Threads[iworker], NULL);
+
+   for (iworker=0; iworker<Pool->NumberOfWorkers; iworker++)
+      pthread_mutex_destroy (&Pool->Runs[iworker].Lock);
+   pthread_mutex_destroy (&Pool->Lock);
+   pthread_cond_destroy (&Pool->Start);
+   pthread_cond_destroy (&Pool->Done);
+   free (Pool->Threads);
+   free (Pool->Workers);
+   free (Pool->Runs);
+   free (Pool);
+   }
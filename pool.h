@@ -0,0 +1,15 @@
+#ifndef __POOL_H
+#define __POOL_H
+
+typedef struct calc_pool calc_pool;
+
+/*  RUNS ONE CHUNK OF A JOB - WORKER 0 IS THE THREAD CALLING calc_pool_run  */
+typedef void (*calc_task) (void *arg, int worker, int chunk);
+
+calc_pool *calc_pool_new  (int workers);
+int        calc_pool_size (calc_pool *pool);
+void       calc_pool_run  (calc_pool *pool, int nchunks, calc_task task,
+                           void *arg);
+void       calc_pool_free (calc_pool *pool);
+
+#endif
@@ -0,0 +1,795 @@
+/*                                                                       */
+/*                                                                       */
+/*   FORMULA SERVER                                                      */
+/*                                                                       */
+/*      Keeps calc running behind a socket, so that programs send it     */
+/*      formulas instead of starting a process for each.                 */
+/*                                                                       */
+/*        (1) calc_server *calc_server_new (const char *address,         */
+/*                                          int threads, int memosize)   */
+/*                                                                       */
+/*            returns server listening at address, or NULL (with errno   */
+/*            set) if it cannot listen there.                            */
+/*                                                                       */
+/*            address  path of a Unix socket if it holds a '/', else     */
+/*                     "port" or "host:port" of TCP (host defaults to    */
+/*                     127.0.0.1; use 0.0.0.0 for every interface).      */
+/*            threads  number of event loops connections are spread      */
+/*                     over, each on a thread of its own.                */
+/*            memosize formulas kept in the result cache of each         */
+/*                     connection (see memo.c), 0 for none.              */
+/*                                                                       */
+/*        (2) int calc_server_run (calc_server *s)                       */
+/*                                                                       */
+/*            serves connections until calc_server_stop is called.       */
+/*            Returns 0, or -1 (with errno set) if waiting failed.       */
+/*                                                                       */
+/*        (3) void calc_server_stop (calc_server *s)                     */
+/*                                                                       */
+/*            makes calc_server_run return.  May be called from a        */
+/*            signal handler or another thread.                          */
+/*                                                                       */
+/*        (4) void calc_server_free (calc_server *s)                     */
+/*                                                                       */
+/*            closes the socket, removing the path of a Unix socket.     */
+/*                                                                       */
+/*                                                                       */
+/*        PROTOCOL                                                       */
+/*                                                                       */
+/*          A request is a 4-byte little-endian length n, then n bytes   */
+/*          of formula (at most CALC_MAXREQUEST), read as by calc_eval:  */
+/*          variables, ":=" and function definitions are accepted, but   */
+/*          the commands and comments of batch input are not.  A command */
+/*          such as LIST is read as a variable name, and a comment fails */
+/*          with an operand error.  Each is answered in order with the   */
+/*          framed record of output.c: request number on the             */
+/*          connection (from 1), error code and value - 24 bytes.        */
+/*          Clients may send any number of requests before reading the   */
+/*          answers.  A longer request closes the connection after the   */
+/*          answers before it.                                           */
+/*                                                                       */
+/*          Every connection has a context of its own (variables,        */
+/*          definitions and functions), empty when it is accepted and    */
+/*          released when it closes.                                     */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Each event loop waits on an epoll set of its own holding     */
+/*          the listening socket, a stop event and the connections it    */
+/*          accepted.  The listening socket is added with                */
+/*          EPOLLEXCLUSIVE, so a new connection wakes one loop, and a    */
+/*          connection stays on the loop that accepted it, so its        */
+/*          context is only used by one thread.  Sockets do not block.   */
+/*          Every request complete in what one read brought is           */
+/*          answered before the answers are written, so a pipelined      */
+/*          batch costs one read and one write.  A connection with       */
+/*          OUTPUTLIMIT bytes of answers unread is not read from until   */
+/*          they are taken.                                              */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Compile Switches
+************************************************************************
+*/
+
+/*  accept4 AND EPOLLEXCLUSIVE ARE LINUX EXTENSIONS  */
+#define _GNU_SOURCE
+
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "parse.h"
+#include "memo.h"
+#include "output.h"
+#include "server.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define NOSOCKET -1
+#define DEFAULTHOST "127.0.0.1"
+#define LENGTHBYTES 4
+#define INPUTBLOCK  16384
+#define OUTPUTBLOCK 4096
+#define OUTPUTLIMIT (1024 * 1024)   /*  unread answers that stop reading */
+#define MAXEVENTS   256
+
+/*  KERNELS BEFORE 4.5 WAKE EVERY LOOP - ONE OF THEM GETS THE CONNECTION  */
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE 0
+#endif
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  CLIENT CONNECTION AND ITS VARIABLES  */
+typedef struct connection_s
+   {
+   int            Socket;
+   calc_context  *Context;
+   calc_memo     *Memo;         /*  NULL if not caching              */
+   unsigned char *Input;        /*  requests read, not yet answered  */
+   size_t         InputLength;
+   size_t         InputSize;
+   unsigned char *Output;       /*  answers not yet written          */
+   size_t         OutputStart;  /*  first byte not written           */
+   size_t         OutputLength;
+   size_t         OutputSize;
+   unsigned long  Requests;     /*  answered so far                  */
+   unsigned int   Events;       /*  waited for in the epoll set      */
+   BOOLEAN        Closing;      /*  nothing more is read             */
+   struct connection_s *Next;
+   struct connection_s *Previous;
+   } connection_t;
+
+/*  EVENT LOOP AND THE CONNECTIONS IT ACCEPTED  */
+typedef struct
+   {
+   calc_server   *Server;
+   int            Epoll;
+   pthread_t      Thread;
+   BOOLEAN        Started;      /*  Thread is running                */
+   int            Result;       /*  of RunLoop                       */
+   connection_t  *Connections;
+   } loop_t;
+
+struct calc_server
+   {
+   int            Listener;
+   int            Stop;         /*  eventfd, readable once stopped   */
+   BOOLEAN        Unix;
+   char           Path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+   int            MemoSize;
+   int            NumberOfLoops;
+   loop_t        *Loops;
+   };
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static int      ListenUnix (calc_server *Server, const char *Path);
+static int      ListenTcp (const char *Address);
+static int      WatchSocket (int Epoll, int Socket, void *Data);
+static void     OpenConnection (loop_t *Loop, int Socket);
+static void     CloseConnection (loop_t *Loop, connection_t *Connection);
+static void     AcceptConnections (loop_t *Loop);
+static BOOLEAN  ReadInput (connection_t *Connection);
+static BOOLEAN  Answer (connection_t *Connection, const char *Formula,
+                        size_t Length);
+static BOOLEAN  AnswerRequests (connection_t *Connection, BOOLEAN *Pending);
+static BOOLEAN  WriteOutput (connection_t *Connection);
+static void     ServeConnection (loop_t *Loop, connection_t *Connection,
+                                 unsigned int Events);
+static int      RunLoop (loop_t *Loop);
+static void    *RunThread (void *Argument);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  RETURN LISTENING UNIX SOCKET AT Path, REPLACING A STALE ONE  */
+static int ListenUnix (calc_server *Server, const char *Path)
+   {
+   struct sockaddr_un Address;
+   struct stat        Status;
+   int                Socket;
+
+   if (strlen (Path) >= sizeof(Address.sun_path))
+      {
+      errno = ENAMETOOLONG;
+      return NOSOCKET;
+      }
+   memset (&Address, 0, sizeof(Address));
+   Address.sun_family = AF_UNIX;
+   strcpy (Address.sun_path, Path);
+
+   /*  ONLY A SOCKET IS REMOVED - NEVER ANY OTHER FILE  */
+   if (stat (Path, &Status) == 0 && S_ISSOCK (Status.st_mode))
+      unlink (Path);
+
+   Socket = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if (Socket == NOSOCKET)
+      return NOSOCKET;
+   if (bind (Socket, (struct sockaddr *) &Address, sizeof(Address)) != 0 ||
+       listen (Socket, SOMAXCONN) != 0)
+      {
+      close (Socket);
+      return NOSOCKET;
+      }
+   Server->Unix = TRUE;
+   strcpy (Server->Path, Path);
+   return Socket;
+   }
+
+
+/*  RETURN LISTENING TCP SOCKET AT "port" OR "host:port"  */
+static int ListenTcp (const char *Address)
+   {
+   struct addrinfo  Hints;
+   struct addrinfo *Found;
+   char             Host[256];
+   const char      *Port;
+   char            *End;
+   long             Number;
+   int              Socket;
+   int              One;
+
+   Port = strrchr (Address, ':');
+   if (Port == NULL)
+      {
+      strcpy (Host, DEFAULTHOST);
+      Port = Address;
+      }
+   else
+      {
+      if ((size_t) (Port - Address) >= sizeof(Host))
+         {
+         errno = ENAMETOOLONG;
+         return NOSOCKET;
+         }
+      memcpy (Host, Address, Port - Address);
+      Host[Port - Address] = '\0';
+      Port++;
+      }
+   Number = strtol (Port, &End, 10);
+   if (End == Port || *End != '\0' || Number < 1 || Number > 65535)
+      {
+      errno = EINVAL;
+      return NOSOCKET;
+      }
+
+   memset (&Hints, 0, sizeof(Hints));
+   Hints.ai_family   = AF_UNSPEC;
+   Hints.ai_socktype = SOCK_STREAM;
+   Hints.ai_flags    = AI_PASSIVE | AI_NUMERICSERV;
+   if (getaddrinfo (Host[0] ? Host : NULL, Port, &Hints, &Found) != 0)
+      {
+      errno = EADDRNOTAVAIL;
+      return NOSOCKET;
+      }
+   Socket = socket (Found->ai_family,
+                    SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if (Socket != NOSOCKET)
+      {
+      One = 1;
+      setsockopt (Socket, SOL_SOCKET, SO_REUSEADDR, &One, sizeof(One));
+      if (bind (Socket, Found->ai_addr, Found->ai_addrlen) != 0 ||
+          listen (Socket, SOMAXCONN) != 0)
+         {
+         close (Socket);
+         Socket = NOSOCKET;
+         }
+      }
+   freeaddrinfo (Found);
+   return Socket;
+   }
+
+
+/*  ADD SOCKET TO EPOLL SET, WAITING FOR INPUT - 0 IF OK  */
+static int WatchSocket (int Epoll, int Socket, void *Data)
+   {
+   struct epoll_event Event;
+
+   memset (&Event, 0, sizeof(Event));
+   Event.events   = EPOLLIN;
+   Event.data.ptr = Data;
+   return epoll_ctl (Epoll, EPOLL_CTL_ADD, Socket, &Event);
+   }
+
+
+/*  GIVE NEW CONNECTION A CONTEXT AND ADD IT TO THE LOOP - CLOSED IF NO ROOM  */
+static void OpenConnection (loop_t *Loop, int Socket)
+   {
+   connection_t *Connection;
+
+   Connection = (connection_t *) calloc (1, sizeof(connection_t));
+   if (Connection == NULL)
+      {
+      close (Socket);
+      return;
+      }
+   Connection->Socket  = Socket;
+   Connection->Events  = EPOLLIN;
+   Connection->Context = calc_context_new ();
+   if (Connection->Context != NULL && Loop->Server->MemoSize > 0)
+      Connection->Memo = calc_memo_new (Connection->Context,
+                                        Loop->Server->MemoSize);
+   if (Connection->Context == NULL ||
+       (Loop->Server->MemoSize > 0 && Connection->Memo == NULL) ||
+       WatchSocket (Loop->Epoll, Socket, Connection) != 0)
+      {
+      if (Connection->Memo != NULL)
+         calc_memo_free (Connection->Memo);
+      if (Connection->Context != NULL)
+         calc_context_free (Connection->Context);
+      free (Connection);
+      close (Socket);
+      return;
+      }
+
+   Connection->Next = Loop->Connections;
+   if (Loop->Connections != NULL)
+      Loop->Connections->Previous = Connection;
+   Loop->Connections = Connection;
+   }
+
+
+static void CloseConnection (loop_t *Loop, connection_t *Connection)
+   {
+   if (Connection->Previous != NULL)
+      Connection->Previous->Next = Connection->Next;
+   else
+      Loop->Connections = Connection->Next;
+   if (Connection->Next != NULL)
+      Connection->Next->Previous = Connection->Previous;
+
+   close (Connection->Socket);
+   if (Connection->Memo != NULL)
+      calc_memo_free (Connection->Memo);
+   calc_context_free (Connection->Context);
+   free (Connection->Input);
+   free (Connection->Output);
+   free (Connection);
+   }
+
+
+/*  ACCEPT EVERY WAITING CONNECTION  */
+static void AcceptConnections (loop_t *Loop)
+   {
+   int Socket;
+   int One;
+
+   for (;;)
+      {
+      Socket = accept4 (Loop->Server->Listener, NULL, NULL,
+                        SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (Socket == NOSOCKET)
+         {
+         if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+         return;
+         }
+
+      /*  ANSWERS GO OUT AS SOON AS THEY ARE WRITTEN  */
+      if (!Loop->Server->Unix)
+         {
+         One = 1;
+         setsockopt (Socket, IPPROTO_TCP, TCP_NODELAY, &One, sizeof(One));
+         }
+      OpenConnection (Loop, Socket);
+      }
+   }
+
+
+/*  READ WHAT HAS ARRIVED - FALSE IF THE CONNECTION FAILED  */
+static BOOLEAN ReadInput (connection_t *Connection)
+   {
+   unsigned char *NewInput;
+   size_t         NewSize;
+   ssize_t        Length;
+
+   /*  GROW FOR A REQUEST LONGER THAN THE BUFFER  */
+   if (Connection->InputLength == Connection->InputSize)
+      {
+      NewSize = Connection->InputSize ? 2*Connection->InputSize : INPUTBLOCK;
+      if (NewSize > CALC_MAXREQUEST + LENGTHBYTES)
+         NewSize = CALC_MAXREQUEST + LENGTHBYTES;
+      NewInput = (unsigned char *) realloc (Connection->Input, NewSize);
+      if (NewInput == NULL)
+         return FALSE;
+      Connection->Input = NewInput;
+      Connection->InputSize = NewSize;
+      }
+
+   do
+      Length = recv (Connection->Socket,
+                     Connection->Input + Connection->InputLength,
+                     Connection->InputSize - Connection->InputLength, 0);
+   while (Length < 0 && errno == EINTR);
+
+   if (Length > 0)
+      Connection->InputLength += Length;
+   else if (Length == 0)
+      Connection->Closing = TRUE;
+   else if (errno != EAGAIN && errno != EWOULDBLOCK)
+      return FALSE;
+   return TRUE;
+   }
+
+
+/*  EVALUATE ONE REQUEST AND ADD ITS ANSWER - FALSE IF NO ROOM  */
+static BOOLEAN Answer (connection_t *Connection, const char *Formula,
+                       size_t Length)
+   {
+   unsigned char *NewOutput;
+   size_t         NewSize;
+   double         Result;
+   int            ErrorCode;
+
+   if (Connection->OutputLength + CALC_FRAMESIZE > Connection->OutputSize)
+      {
+      NewSize = Connection->OutputSize ? 2*Connection->OutputSize
+                                       : OUTPUTBLOCK;
+      NewOutput = (unsigned char *) realloc (Connection->Output, NewSize);
+      if (NewOutput == NULL)
+         return FALSE;
+      Connection->Output = NewOutput;
+      Connection->OutputSize = NewSize;
+      }
+
+   if (Connection->Memo != NULL)
+      Result = calc_memo_eval_n (Connection->Memo, Formula, Length,
+                                 &ErrorCode);
+   else
+      Result = calc_eval (Connection->Context, Formula, Length, NULL,
+                          &ErrorCode);
+   calc_output_frame (Connection->Output + Connection->OutputLength,
+                      ++Connection->Requests, ErrorCode, Result);
+   Connection->OutputLength += CALC_FRAMESIZE;
+   return TRUE;
+   }
+
+
+/*
+   ANSWER THE COMPLETE REQUESTS READ, UP TO OUTPUTLIMIT BYTES OF ANSWERS.
+   *Pending TELLS IF ANY WERE LEFT FOR LATER.  FALSE IF A REQUEST IS TOO
+   LONG OR MEMORY RAN OUT.
+*/
+static BOOLEAN AnswerRequests (connection_t *Connection, BOOLEAN *Pending)
+   {
+   const unsigned char *Request;
+   size_t               Start;
+   size_t               Length;
+   BOOLEAN              Ok;
+
+   /*  MOVE UNWRITTEN ANSWERS TO THE FRONT  */
+   if (Connection->OutputStart > 0)
+      {
+      Connection->OutputLength -= Connection->OutputStart;
+      memmove (Connection->Output,
+               Connection->Output + Connection->OutputStart,
+               Connection->OutputLength);
+      Connection->OutputStart = 0;
+      }
+
+   Ok = TRUE;
+   *Pending = FALSE;
+   Start = 0;
+   while (Connection->InputLength - Start >= LENGTHBYTES)
+      {
+      Request = Connection->Input + Start;
+      Length = (size_t) Request[0]       | (size_t) Request[1] << 8 |
+               (size_t) Request[2] << 16 | (size_t) Request[3] << 24;
+      if (Length > CALC_MAXREQUEST)
+         {
+         Ok = FALSE;
+         break;
+         }
+      if (Connection->InputLength - Start - LENGTHBYTES < Length)
+         break;
+      if (Connection->OutputLength >= OUTPUTLIMIT)
+         {
+         *Pending = TRUE;
+         break;
+         }
+      if (!Answer (Connection, (const char *) Request + LENGTHBYTES, Length))
+         {
+         Ok = FALSE;
+         break;
+         }
+      Start += LENGTHBYTES + Length;
+      }
+
+   /*  KEEP THE PART OF A REQUEST NOT YET ARRIVED  */
+   Connection->InputLength -= Start;
+   memmove (Connection->Input, Connection->Input + Start,
+            Connection->InputLength);
+   return Ok;
+   }
+
+
+/*  WRITE AS MANY ANSWERS AS THE SOCKET TAKES - FALSE IF IT FAILED  */
+static BOOLEAN WriteOutput (connection_t *Connection)
+   {
+   ssize_t Length;
+
+   while (Connection->OutputStart < Connection->OutputLength)
+      {
+      Length = send (Connection->Socket,
+                     Connection->Output + Connection->OutputStart,
+                     Connection->OutputLength - Connection->OutputStart,
+                     MSG_NOSIGNAL);
+      if (Length < 0)
+         {
+         if (errno == EINTR)
+            continue;
+         if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+         return FALSE;
+         }
+      Connection->OutputStart += Length;
+      }
+   if (Connection->OutputStart == Connection->OutputLength)
+      Connection->OutputStart = Connection->OutputLength = 0;
+   return TRUE;
+   }
+
+
+/*  READ, ANSWER AND WRITE FOR EVENTS OF A CONNECTION  */
+static void ServeConnection (loop_t *Loop, connection_t *Connection,
+                             unsigned int Events)
+   {
+   struct epoll_event Event;
+   unsigned int       Wanted;
+   BOOLEAN            Pending;
+
+   if ((Events & EPOLLERR) ||
+       ((Events & (EPOLLIN | EPOLLHUP)) && !Connection->Closing &&
+        !ReadInput (Connection)))
+      {
+      CloseConnection (Loop, Connection);
+      return;
+      }
+
+   /*  ANSWER, AND AGAIN WHILE ANSWERS HELD BACK CAN BE WRITTEN AT ONCE  */
+   do
+      {
+      if (!AnswerRequests (Connection, &Pending))
+         {
+         Connection->Closing = TRUE;
+         Connection->InputLength = 0;
+         Pending = FALSE;
+         }
+      if (!WriteOutput (Connection))
+         {
+         CloseConnection (Loop, Connection);
+         return;
+         }
+      }
+   while (Pending && Connection->OutputLength == 0);
+
+   /*  CLOSED BY THE CLIENT OR FOR AN ERROR ONCE ALL IS WRITTEN  */
+   if (Connection->Closing && Connection->OutputLength == 0)
+      {
+      CloseConnection (Loop, Connection);
+      return;
+      }
+
+   /*  READ ONLY WHILE ANSWERS ARE TAKEN - WRITE WHEN THEY WERE NOT  */
+   Wanted = 0;
+   if (!Connection->Closing && !Pending &&
+       Connection->OutputLength < OUTPUTLIMIT)
+      Wanted |= EPOLLIN;
+   if (Connection->OutputLength > 0)
+      Wanted |= EPOLLOUT;
+   if (Wanted != Connection->Events)
+      {
+      memset (&Event, 0, sizeof(Event));
+      Event.events   = Wanted;
+      Event.data.ptr = Connection;
+      if (epoll_ctl (Loop->Epoll, EPOLL_CTL_MOD, Connection->Socket, &Event)
+          != 0)
+         {
+         CloseConnection (Loop, Connection);
+         return;
+         }
+      Connection->Events = Wanted;
+      }
+   }
+
+
+/*  SERVE UNTIL STOPPED, THEN CLOSE THE CONNECTIONS - 0 IF OK  */
+static int RunLoop (loop_t *Loop)
+   {
+   struct epoll_event Events[MAXEVENTS];
+   int                NumberOfEvents;
+   int                ievent;
+   int                Result;
+   void              *Data;
+
+   Result = 0;
+   for (;;)
+      {
+      NumberOfEvents = epoll_wait (Loop->Epoll, Events, MAXEVENTS, -1);
+      if (NumberOfEvents < 0)
+         {
+         if (errno == EINTR)
+            continue;
+         Result = -1;
+         break;
+         }
+
+      /*  EVENTS AFTER A STOP ARE DROPPED  */
+      for (ievent=0; ievent<NumberOfEvents; ievent++)
+         if (Events[ievent].data.ptr == Loop->Server)
+            break;
+      if (ievent < NumberOfEvents)
+         break;
+
+      for (ievent=0; ievent<NumberOfEvents; ievent++)
+         {
+         Data = Events[ievent].data.ptr;
+         if (Data == NULL)
+            AcceptConnections (Loop);
+         else
+            ServeConnection (Loop, (connection_t *) Data,
+                             Events[ievent].events);
+         }
+      }
+
+   while (Loop->Connections != NULL)
+      CloseConnection (Loop, Loop->Connections);
+   return Result;
+   }
+
+
+static void *RunThread (void *Argument)
+   {
+   loop_t *Loop = (loop_t *) Argument;
+
+   Loop->Result = RunLoop (Loop);
+   return NULL;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+calc_server *calc_server_new (const char *Address, int NumberOfLoops,
+                              int MemoSize)
+   {
+   calc_server        *Server;
+   struct epoll_event  Event;
+   loop_t             *Loop;
+   int                 iloop;
+   int                 Error;
+
+   if (NumberOfLoops < 1)
+      NumberOfLoops = 1;
+   Server = (calc_server *) calloc (1, sizeof(calc_server));
+   if (Server == NULL)
+      return NULL;
+   Server->Stop          = NOSOCKET;
+   Server->MemoSize      = MemoSize;
+   Server->NumberOfLoops = NumberOfLoops;
+   Server->Loops = (loop_t *) calloc (NumberOfLoops, sizeof(loop_t));
+   for (iloop=0; Server->Loops != NULL && iloop<NumberOfLoops; iloop++)
+      Server->Loops[iloop].Epoll = NOSOCKET;
+
+   Server->Listener = (strchr (Address, '/') != NULL)
+                      ? ListenUnix (Server, Address)
+                      : ListenTcp (Address);
+   if (Server->Listener != NOSOCKET)
+      Server->Stop = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (Server->Loops == NULL || Server->Stop == NOSOCKET)
+      {
+      Error = (Server->Loops == NULL) ? ENOMEM : errno;
+      calc_server_free (Server);
+      errno = Error;
+      return NULL;
+      }
+
+   /*  EVERY LOOP WATCHES THE LISTENER AND THE STOP EVENT  */
+   for (iloop=0; iloop<NumberOfLoops; iloop++)
+      {
+      Loop = Server->Loops + iloop;
+      Loop->Server = Server;
+      Loop->Epoll  = epoll_create1 (EPOLL_CLOEXEC);
+      memset (&Event, 0, sizeof(Event));
+      Event.events   = EPOLLIN | EPOLLEXCLUSIVE;
+      Event.data.ptr = NULL;
+      if (Loop->Epoll == NOSOCKET ||
+          epoll_ctl (Loop->Epoll, EPOLL_CTL_ADD, Server->Listener, &Event)
+          != 0 ||
+          WatchSocket (Loop->Epoll, Server->Stop, Server) != 0)
+         {
+         Error = errno;
+         calc_server_free (Server);
+         errno = Error;
+         return NULL;
+         }
+      }
+   return Server;
+   }
+
+
+int calc_server_run (calc_server *Server)
+   {
+   loop_t *Loop;
+   int     iloop;
+   int     Result;
+
+   /*  THE CALLING THREAD RUNS THE FIRST LOOP  */
+   for (iloop=1; iloop<Server->NumberOfLoops; iloop++)
+      {
+      Loop = Server->Loops + iloop;
+      Loop->Started = (pthread_create (&Loop->Thread, NULL, RunThread,
+                                       Loop) == 0);
+      }
+   Result = RunLoop (Server->Loops);
+
+   for (iloop=1; iloop<Server->NumberOfLoops; iloop++)
+      {
+      Loop = Server->Loops + iloop;
+      if (!Loop->Started)
+         continue;
+      pthread_join (Loop->Thread, NULL);
+      Loop->Started = FALSE;
+      if (Loop->Result != 0)
+         Result = Loop->Result;
+      }
+   return Result;
+   }
+
+
+void calc_server_stop (calc_server *Server)
+   {
+   unsigned long long One = 1;
+   ssize_t            Written;
+
+   Written = write (Server->Stop, &One, sizeof(One));
+   (void) Written;
+   }
+
+
+void calc_server_free (calc_server *Server)
+   {
+   int iloop;
+
+   if (Server == NULL)
+      return;
+   for (iloop=0; Server->Loops != NULL && iloop<Server->NumberOfLoops;
+        iloop++)
+      if (Server->Loops[iloop].Epoll != NOSOCKET)
+         close (Server->Loops[iloop].Epoll);
+   if (Server->Stop != NOSOCKET)
+      close (Server->Stop);
+   if (Server->Listener != NOSOCKET)
+      {
+      close (Server->Listener);
+      if (Server->Unix)
+         unlink (Server->Path);
+      }
+   free (Server->Loops);
+   free (Server);
+   }
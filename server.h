@@ -0,0 +1,15 @@
+#ifndef __SERVER_H
+#define __SERVER_H
+
+typedef struct calc_server calc_server;
+
+/*  LONGEST FORMULA OF A REQUEST  */
+#define CALC_MAXREQUEST (1024 * 1024)
+
+calc_server *calc_server_new  (const char *address, int threads,
+                               int memosize);
+int          calc_server_run  (calc_server *server);
+void         calc_server_stop (calc_server *server);
+void         calc_server_free (calc_server *server);
+
+#endif
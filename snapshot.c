@@ -0,0 +1,806 @@
+/*                                                                       */
+/*                                                                       */
+/*   SESSION SNAPSHOTS                                                   */
+/*                                                                       */
+/*      The variables, defined variables and defined functions of a      */
+/*      context, saved to a file that is loaded again without parsing    */
+/*      any formula.                                                     */
+/*                                                                       */
+/*        (1) int calc_snapshot_save (calc_context *c, const char *path) */
+/*                                                                       */
+/*            writes snapshot of context c to file path.  Returns 0 if   */
+/*            OK, else an error code for parsemsg; a file that could     */
+/*            not be written completely is removed.                      */
+/*                                                                       */
+/*        (2) int calc_snapshot_load (calc_context *c, const char *path) */
+/*                                                                       */
+/*            replaces everything in context c by the snapshot in file   */
+/*            path.  Returns 0 if OK, else an error code for parsemsg;   */
+/*            c is unchanged if the file is not a whole snapshot         */
+/*            written by this version on the same kind of machine, and   */
+/*            empty if memory ran out.  Programs compiled in c and       */
+/*            caches of its results (see memo.c) must be freed first,    */
+/*            and mirrors of it reset.                                   */
+/*                                                                       */
+/*                                                                       */
+/*        FORMAT                                                         */
+/*                                                                       */
+/*          A header identifies the file, its version, the sizes of      */
+/*          the machine types it holds and the length and checksum of    */
+/*          what follows.  The rest is in the machine's own format,      */
+/*          each part starting on an 8-byte boundary:                    */
+/*                                                                       */
+/*             the name characters, name offsets, hashes, values and     */
+/*             buckets of the variable table, exactly as it holds them   */
+/*                                                                       */
+/*             each defined variable: its state, the instructions and    */
+/*             variable slots of its compiled program, and its formula.  */
+/*             Inputs come before the variables defined from them.       */
+/*                                                                       */
+/*             each defined function: its parameters, name and text      */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          The file is mapped into memory and checked in full before    */
+/*          the context is touched.  Loading then copies whole arrays:   */
+/*          the variable table is not rebuilt, no formula is compiled    */
+/*          and nothing is computed, so a defined variable keeps its     */
+/*          value until one of its inputs changes.  Native code is not   */
+/*          saved; it is generated again once a program has run          */
+/*          CALC_JITTHRESHOLD times.                                     */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parse.h"
+#include "compile.h"
+#include "snapshot.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define SNAPSHOTMAGIC    "CALCSNAP"
+#define SNAPSHOTVERSION  1
+#define BYTEORDER        0x01020304u
+#define SNAPSHOTBLOCK    65536     /*  bytes written at a time         */
+#define ALIGNMENT        8
+#define ALIGN(n)         (((n) + ALIGNMENT-1) & ~(size_t) (ALIGNMENT-1))
+#define HEADERSIZE       ALIGN (sizeof(snapheader_t))
+
+/*  STATE OF A VARIABLE WHILE THE DEFINITIONS ARE CHECKED  */
+#define UNUSED   0
+#define READ     1                /*  by a definition                 */
+#define DEFINED  2
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+
+/*  START OF FILE  */
+typedef struct
+   {
+   char          Magic[8];
+   unsigned      Version;
+   unsigned      ByteOrder;     /*  BYTEORDER as written            */
+   unsigned      SizeOfSize;    /*  of size_t                       */
+   unsigned      SizeOfInstruction;
+   int           NumberOfVariables;
+   int           NumberOfBuckets;
+   int           NumberOfDefinitions;
+   int           NumberOfFunctions;
+   size_t        NamesLength;
+   size_t        Length;        /*  bytes after header              */
+   unsigned long long Checksum; /*  of those bytes                  */
+   } snapheader_t;
+
+/*  DEFINED VARIABLE - FOLLOWED BY CODE, SLOTS AND FORMULA  */
+typedef struct
+   {
+   int           VariableID;
+   int           Dirty;
+   int           Error;
+   int           Result;
+   int           NumberRemoved;
+   int           CodeLength;
+   int           NumberOfSlots;
+   int           FormulaLength;
+   } snapdefinition_t;
+
+/*  DEFINED FUNCTION - FOLLOWED BY NAME AND TEXT  */
+typedef struct
+   {
+   int           NameLength;
+   int           TextLength;
+   int           BodyOffset;
+   int           NumberOfParameters;
+   char          Parameters[MAXARGUMENTS][MAXTOKENLENGTH];
+   } snapfunction_t;
+
+/*  SNAPSHOT BEING WRITTEN  */
+typedef struct
+   {
+   FILE         *Stream;
+   unsigned char *Buffer;
+   size_t        Buffered;
+   size_t        Length;        /*  bytes after header so far       */
+   unsigned long long Checksum;
+   BOOLEAN       Failed;
+   } writer_t;
+
+/*  SNAPSHOT BEING READ  */
+typedef struct
+   {
+   const char   *Next;
+   const char   *End;
+   } reader_t;
+
+/*  POSITION IN DEPTH-FIRST WALK OF DEFINITIONS  */
+typedef struct
+   {
+   int  VariableID;
+   int  Next;                   /*  next input to visit             */
+   } walk_t;
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static unsigned long long Checksum (unsigned long long Sum,
+                                    const unsigned char *Data,
+                                    size_t Length);
+static void     FlushWriter (writer_t *Writer);
+static void     Write (writer_t *Writer, const void *Data, size_t Length);
+static void     WriteVariables (writer_t *Writer, symtab_t *Variables);
+static int      WriteDefinitions (writer_t *Writer, calc_context *Context);
+static void     WriteDefinition (writer_t *Writer, int VariableID,
+                                 const calc_program *Program, int Dirty,
+                                 int ErrorResult);
+static int      WriteFunctions (writer_t *Writer, calc_context *Context);
+static const void *Take (reader_t *Reader, size_t Length);
+static BOOLEAN  IsString (const char *String, int Length);
+static BOOLEAN  IsProgram (const calc_instr *Code, int CodeLength,
+                           int NumberOfSlots);
+static int      ReadVariables (calc_context *Context,
+                               const snapheader_t *Header,
+                               reader_t *Reader, BOOLEAN Install);
+static int      ReadDefinitions (calc_context *Context,
+                                 const snapheader_t *Header,
+                                 reader_t *Reader, BOOLEAN Install);
+static int      ReadFunctions (calc_context *Context,
+                               const snapheader_t *Header,
+                               reader_t *Reader, BOOLEAN Install);
+static int      ReadSnapshot (calc_context *Context,
+                              const snapheader_t *Header, BOOLEAN Install);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  FNV-1a HASH OF 8-BYTE WORDS - Length IS A MULTIPLE OF 8  */
+static unsigned long long Checksum (unsigned long long Sum,
+                                    const unsigned char *Data,
+                                    size_t Length)
+   {
+   unsigned long long Word;
+   size_t             Offset;
+
+   for (Offset=0; Offset<Length; Offset+=8)
+      {
+      memcpy (&Word, Data + Offset, 8);
+      Sum ^= Word;
+      Sum *= 1099511628211ULL;
+      }
+   return Sum;
+   }
+
+
+/*  THE BUFFER IS FLUSHED WHEN FULL OR AT THE END, SO IT HOLDS WHOLE WORDS  */
+static void FlushWriter (writer_t *Writer)
+   {
+   if (Writer->Failed || Writer->Buffered == 0)
+      return;
+   Writer->Checksum = Checksum (Writer->Checksum, Writer->Buffer,
+                                Writer->Buffered);
+   if (fwrite (Writer->Buffer, 1, Writer->Buffered, Writer->Stream)
+       != Writer->Buffered)
+      Writer->Failed = TRUE;
+   Writer->Buffered = 0;
+   }
+
+
+/*  WRITE ONE ITEM, PADDED SO THE NEXT ONE IS ALIGNED  */
+static void Write (writer_t *Writer, const void *Data, size_t Length)
+   {
+   const unsigned char *Bytes = (const unsigned char *) Data;
+   size_t               Padded;
+   size_t               Part;
+
+   Padded = ALIGN (Length);
+   while (Padded > 0 && !Writer->Failed)
+      {
+      Part = SNAPSHOTBLOCK - Writer->Buffered;
+      if (Part > Padded)
+         Part = Padded;
+      if (Length >= Part)
+         memcpy (Writer->Buffer + Writer->Buffered, Bytes, Part);
+      else
+         {
+         memcpy (Writer->Buffer + Writer->Buffered, Bytes, Length);
+         memset (Writer->Buffer + Writer->Buffered + Length, 0,
+                 Part - Length);
+         }
+      Bytes  += (Length >= Part) ? Part : Length;
+      Length -= (Length >= Part) ? Part : Length;
+      Padded -= Part;
+      Writer->Buffered += Part;
+      Writer->Length   += Part;
+      if (Writer->Buffered == SNAPSHOTBLOCK)
+         FlushWriter (Writer);
+      }
+   }
+
+
+/*  THE TABLE AS IT IS HELD, SO IT NEED NOT BE REBUILT  */
+static void WriteVariables (writer_t *Writer, symtab_t *Variables)
+   {
+   int NumberOfSymbols = Variables->NumberOfSymbols;
+
+   if (NumberOfSymbols == 0)
+      return;
+   Write (Writer, Variables->Names, Variables->NamesLength);
+   Write (Writer, Variables->NameOffsets, NumberOfSymbols * sizeof(size_t));
+   Write (Writer, Variables->Hashes, NumberOfSymbols * sizeof(unsigned));
+   Write (Writer, Variables->Values, NumberOfSymbols * sizeof(double));
+   Write (Writer, Variables->Buckets,
+          (Variables->BucketMask + 1) * sizeof(int));
+   }
+
+
+/*  EACH DEFINITION AFTER ITS INPUTS - RETURNS NUMBER WRITTEN, OR -1  */
+static int WriteDefinitions (writer_t *Writer, calc_context *Context)
+   {
+   const calc_program *Program;
+   char               *Seen;
+   walk_t             *Stack;
+   int                 NumberOfVariables;
+   int                 NumberOfDefinitions;
+   int                 Depth;
+   int                 VariableID;
+   int                 Input;
+   int                 Dirty;
+   int                 Error;
+
+   NumberOfVariables = Context->Variables.NumberOfSymbols;
+   if (NumberOfVariables == 0)
+      return 0;
+   Seen  = (char *) ArenaAllocate (Context->Arena, NumberOfVariables);
+   Stack = (walk_t *) ArenaAllocate (Context->Arena,
+                                     NumberOfVariables * sizeof(walk_t));
+   if (Seen == NULL || Stack == NULL)
+      {
+      ArenaRewind (Context->Arena, Stack);
+      ArenaRewind (Context->Arena, Seen);
+      return -1;
+      }
+   memset (Seen, 0, NumberOfVariables);
+
+   NumberOfDefinitions = 0;
+   for (VariableID=0; VariableID<NumberOfVariables; VariableID++)
+      {
+      if (Seen[VariableID] ||
+          GetDefinition (Context, VariableID, &Dirty, &Error) == NULL)
+         continue;
+      Seen[VariableID] = TRUE;
+      Depth = 0;
+      Stack[0].VariableID = VariableID;
+      Stack[0].Next       = 0;
+      while (Depth >= 0)
+         {
+         Program = GetDefinition (Context, Stack[Depth].VariableID,
+                                  &Dirty, &Error);
+         if (Stack[Depth].Next < Program->NumberOfSlots)
+            {
+            Input = Program->VariableIDs[Stack[Depth].Next++];
+            if (!Seen[Input] &&
+                GetDefinition (Context, Input, &Dirty, &Error) != NULL)
+               {
+               Seen[Input] = TRUE;
+               Depth++;
+               Stack[Depth].VariableID = Input;
+               Stack[Depth].Next       = 0;
+               }
+            continue;
+            }
+         WriteDefinition (Writer, Stack[Depth].VariableID, Program, Dirty,
+                          Error);
+         NumberOfDefinitions++;
+         Depth--;
+         }
+      }
+   ArenaRewind (Context->Arena, Stack);
+   ArenaRewind (Context->Arena, Seen);
+   return NumberOfDefinitions;
+   }
+
+
+static void WriteDefinition (writer_t *Writer, int VariableID,
+                             const calc_program *Program, int Dirty,
+                             int ErrorResult)
+   {
+   snapdefinition_t Record;
+
+   memset (&Record, 0, sizeof(Record));
+   Record.VariableID    = VariableID;
+   Record.Dirty         = Dirty;
+   Record.Error         = ErrorResult;
+   Record.Result        = Program->Result;
+   Record.NumberRemoved = Program->NumberRemoved;
+   Record.CodeLength    = Program->CodeLength;
+   Record.NumberOfSlots = Program->NumberOfSlots;
+   Record.FormulaLength = (int) strlen (Program->Formula);
+   Write (Writer, &Record, sizeof(Record));
+   Write (Writer, Program->Code, Program->CodeLength * sizeof(calc_instr));
+   Write (Writer, Program->VariableIDs, Program->NumberOfSlots * sizeof(int));
+   Write (Writer, Program->Formula, Record.FormulaLength + 1);
+   }
+
+
+/*  RETURNS NUMBER OF FUNCTIONS WRITTEN  */
+static int WriteFunctions (writer_t *Writer, calc_context *Context)
+   {
+   const calc_function *Function;
+   snapfunction_t       Record;
+   const char          *Name;
+   int                  NumberOfFunctions;
+   int                  FunctionID;
+
+   NumberOfFunctions = 0;
+   for (FunctionID=0; FunctionID<Context->FunctionNames.NumberOfSymbols;
+        FunctionID++)
+      {
+      Function = Context->Functions + FunctionID;
+      if (Function->Body == NULL)
+         continue;
+      Name = SymbolName (&Context->FunctionNames, FunctionID);
+      memset (&Record, 0, sizeof(Record));
+      Record.NameLength         = (int) strlen (Name);
+      Record.TextLength         = (int) strlen (Function->Text);
+      Record.BodyOffset         = (int) (Function->Body - Function->Text);
+      Record.NumberOfParameters = Function->NumberOfParameters;
+      memcpy (Record.Parameters, Function->Parameters,
+              sizeof(Record.Parameters));
+      Write (Writer, &Record, sizeof(Record));
+      Write (Writer, Name, Record.NameLength + 1);
+      Write (Writer, Function->Text, Record.TextLength + 1);
+      NumberOfFunctions++;
+      }
+   return NumberOfFunctions;
+   }
+
+
+/*  NEXT ITEM OF Length BYTES, OR NULL IF THE SNAPSHOT ENDS FIRST  */
+static const void *Take (reader_t *Reader, size_t Length)
+   {
+   const char *Item;
+
+   if ((size_t) (Reader->End - Reader->Next) < ALIGN (Length))
+      return NULL;
+   Item = Reader->Next;
+   Reader->Next += ALIGN (Length);
+   return Item;
+   }
+
+
+/*  TRUE IF String OF Length CHARACTERS IS FOLLOWED BY ITS ONLY NUL  */
+static BOOLEAN IsString (const char *String, int Length)
+   {
+   return String != NULL && String[Length] == '\0' &&
+          memchr (String, '\0', Length) == NULL;
+   }
+
+
+/*  TRUE IF INSTRUCTIONS ARE ONES THE COMPILER COULD HAVE MADE  */
+static BOOLEAN IsProgram (const calc_instr *Code, int CodeLength,
+                          int NumberOfSlots)
+   {
+   int Operand[MAXOPERANDS];
+   int NumberOfOperands;
+   int iinstr;
+   int iop;
+
+   for (iinstr=0; iinstr<CodeLength; iinstr++)
+      {
+      /*  DEFINITIONS DO NOT ASSIGN VARIABLES  */
+      if (Code[iinstr].Opcode < OPC_Const || Code[iinstr].Opcode > OPC_Fma ||
+          Code[iinstr].Opcode == OPC_Store)
+         return FALSE;
+      if (Code[iinstr].Opcode == OPC_Load &&
+          (Code[iinstr].A < 0 || Code[iinstr].A >= NumberOfSlots))
+         return FALSE;
+      if (Code[iinstr].Opcode == OPC_Function &&
+          (Code[iinstr].B <= FUNC_err || Code[iinstr].B >= FUNC_min))
+         return FALSE;
+      NumberOfOperands = InstructionOperands (Code + iinstr, Operand);
+      for (iop=0; iop<NumberOfOperands; iop++)
+         if (Operand[iop] < 0 || Operand[iop] >= iinstr)
+            return FALSE;
+      }
+   return TRUE;
+   }
+
+
+/*  ENTRIES ARE CHECKED SO THAT LOOKUPS STAY WITHIN THE TABLE AND END  */
+static int ReadVariables (calc_context *Context, const snapheader_t *Header,
+                          reader_t *Reader, BOOLEAN Install)
+   {
+   symtab_t     Image;
+   int          NumberOfBuckets;
+   int          NumberUsed;
+   int          VariableID;
+   int          Bucket;
+
+   memset (&Image, 0, sizeof(symtab_t));
+   Image.NumberOfSymbols = Header->NumberOfVariables;
+   NumberOfBuckets       = Header->NumberOfBuckets;
+   if (Image.NumberOfSymbols == 0)
+      return (NumberOfBuckets == 0 && Header->NamesLength == 0)
+             ? ERROR_none : ERROR_snapshot;
+   if (Image.NumberOfSymbols < 0 || Image.NumberOfSymbols > MAXNUMBERVAR ||
+       NumberOfBuckets < 2*Image.NumberOfSymbols ||
+       (NumberOfBuckets & (NumberOfBuckets-1)) != 0)
+      return ERROR_snapshot;
+   Image.NamesLength = Header->NamesLength;
+   Image.Names       = (char *) Take (Reader, Image.NamesLength);
+   Image.NameOffsets = (size_t *) Take (Reader,
+                                        Image.NumberOfSymbols * sizeof(size_t));
+   Image.Hashes      = (unsigned *) Take (Reader,
+                                          Image.NumberOfSymbols *
+                                          sizeof(unsigned));
+   Image.Values      = (double *) Take (Reader,
+                                        Image.NumberOfSymbols * sizeof(double));
+   Image.Buckets     = (int *) Take (Reader, NumberOfBuckets * sizeof(int));
+   Image.BucketMask  = NumberOfBuckets - 1;
+   if (Image.Names == NULL || Image.NameOffsets == NULL ||
+       Image.Hashes == NULL || Image.Values == NULL || Image.Buckets == NULL ||
+       Image.NamesLength == 0 || Image.Names[Image.NamesLength-1] != '\0')
+      return ERROR_snapshot;
+
+   if (Install)
+      return CopySymbols (&Context->Variables, &Image) ? ERROR_none
+                                                       : ERROR_heap_full;
+   for (VariableID=0; VariableID<Image.NumberOfSymbols; VariableID++)
+      if (Image.NameOffsets[VariableID] >= Image.NamesLength)
+         return ERROR_snapshot;
+   NumberUsed = 0;
+   for (Bucket=0; Bucket<NumberOfBuckets; Bucket++)
+      if (Image.Buckets[Bucket] != NOTFOUND)
+         {
+         if (Image.Buckets[Bucket] < 0 ||
+             Image.Buckets[Bucket] >= Image.NumberOfSymbols)
+            return ERROR_snapshot;
+         NumberUsed++;
+         }
+   return (NumberUsed == Image.NumberOfSymbols) ? ERROR_none
+                                                : ERROR_snapshot;
+   }
+
+
+/*  A VARIABLE READ BY ONE DEFINITION MAY NOT BE DEFINED AFTER IT  */
+static int ReadDefinitions (calc_context *Context, const snapheader_t *Header,
+                            reader_t *Reader, BOOLEAN Install)
+   {
+   const snapdefinition_t *Record;
+   const calc_instr       *Code;
+   const int              *VariableIDs;
+   const char             *Formula;
+   calc_program           *Program;
+   char                   *State;
+   int                     ErrorCode;
+   int                     idef;
+   int                     Slot;
+
+   if (Header->NumberOfDefinitions == 0)
+      return ERROR_none;
+   if (Header->NumberOfDefinitions < 0 ||
+       Header->NumberOfDefinitions > Header->NumberOfVariables)
+      return ERROR_snapshot;
+   State = NULL;
+   if (!Install)
+      {
+      State = (char *) ArenaAllocate (Context->Arena,
+                                      Header->NumberOfVariables);
+      if (State == NULL)
+         return ERROR_heap_full;
+      memset (State, UNUSED, Header->NumberOfVariables);
+      }
+
+   ErrorCode = ERROR_none;
+   for (idef=0; idef<Header->NumberOfDefinitions && ErrorCode == ERROR_none;
+        idef++)
+      {
+      ErrorCode = ERROR_snapshot;
+      Record = (const snapdefinition_t *) Take (Reader, sizeof(*Record));
+      if (Record == NULL || Record->VariableID < 0 ||
+          Record->VariableID >= Header->NumberOfVariables ||
+          Record->CodeLength < 1 ||
+          Record->CodeLength > Reader->End - Reader->Next ||
+          Record->Result < 0 || Record->Result >= Record->CodeLength ||
+          Record->NumberOfSlots < 0 ||
+          Record->NumberOfSlots > Header->NumberOfVariables ||
+          Record->FormulaLength < 0 ||
+          Record->FormulaLength >= Reader->End - Reader->Next ||
+          Record->Error < ERROR_none || Record->Error >= CALC_ERRORS)
+         break;
+      Code        = (const calc_instr *)
+         Take (Reader, Record->CodeLength * sizeof(calc_instr));
+      VariableIDs = (const int *)
+         Take (Reader, Record->NumberOfSlots * sizeof(int));
+      Formula     = (const char *) Take (Reader, Record->FormulaLength + 1);
+      if (Code == NULL || VariableIDs == NULL ||
+          !IsString (Formula, Record->FormulaLength))
+         break;
+
+      if (Install)
+         {
+         ErrorCode = ERROR_heap_full;
+         Program = RestoreProgram (Context, Formula, Code, Record->CodeLength,
+                                   VariableIDs, Record->NumberOfSlots);
+         if (Program == NULL)
+            break;
+         Program->Result        = Record->Result;
+         Program->NumberRemoved = Record->NumberRemoved;
+         if (!RestoreDefinition (Context, Record->VariableID, Program,
+                                 Record->Dirty, Record->Error))
+            break;
+         ErrorCode = ERROR_none;
+         continue;
+         }
+
+      /*  INPUTS MUST BE PLAIN VARIABLES OR DEFINED ALREADY  */
+      if (!IsProgram (Code, Record->CodeLength, Record->NumberOfSlots))
+         break;
+      for (Slot=0; Slot<Record->NumberOfSlots; Slot++)
+         {
+         if (VariableIDs[Slot] < 0 ||
+             VariableIDs[Slot] >= Header->NumberOfVariables)
+            break;
+         if (State[VariableIDs[Slot]] == UNUSED)
+            State[VariableIDs[Slot]] = READ;
+         }
+      if (Slot < Record->NumberOfSlots ||
+          State[Record->VariableID] != UNUSED)
+         break;
+      State[Record->VariableID] = DEFINED;
+      ErrorCode = ERROR_none;
+      }
+   ArenaRewind (Context->Arena, State);
+   return ErrorCode;
+   }
+
+
+/*  NAMES ARE ENTERED IN A TABLE OF THEIR OWN TO FIND ANY NAMED TWICE  */
+static int ReadFunctions (calc_context *Context, const snapheader_t *Header,
+                          reader_t *Reader, BOOLEAN Install)
+   {
+   const snapfunction_t *Record;
+   const char           *Name;
+   const char           *Text;
+   calc_function         Function;
+   symtab_t              Names;
+   int                   ErrorCode;
+   int                   ifunc;
+   int                   iparam;
+
+   if (Header->NumberOfFunctions < 0 ||
+       Header->NumberOfFunctions > MAXNUMBERVAR)
+      return ERROR_snapshot;
+   memset (&Names, 0, sizeof(symtab_t));
+   Names.Arena = Context->Arena;
+
+   ErrorCode = ERROR_none;
+   for (ifunc=0; ifunc<Header->NumberOfFunctions && ErrorCode == ERROR_none;
+        ifunc++)
+      {
+      ErrorCode = ERROR_snapshot;
+      Record = (const snapfunction_t *) Take (Reader, sizeof(*Record));
+      if (Record == NULL || Record->NameLength < 1 ||
+          Record->NameLength >= MAXTOKENLENGTH || Record->TextLength < 0 ||
+          Record->TextLength >= Reader->End - Reader->Next ||
+          Record->BodyOffset < 0 || Record->BodyOffset > Record->TextLength ||
+          Record->NumberOfParameters < 1 ||
+          Record->NumberOfParameters > MAXARGUMENTS)
+         break;
+      Name = (const char *) Take (Reader, Record->NameLength + 1);
+      Text = (const char *) Take (Reader, Record->TextLength + 1);
+      if (!IsString (Name, Record->NameLength) ||
+          !IsString (Text, Record->TextLength))
+         break;
+      for (iparam=0; iparam<Record->NumberOfParameters; iparam++)
+         if (memchr (Record->Parameters[iparam], '\0', MAXTOKENLENGTH)
+             == NULL)
+            break;
+      if (iparam < Record->NumberOfParameters)
+         break;
+
+      if (Install)
+         {
+         memset (&Function, 0, sizeof(calc_function));
+         Function.Text = (char *) Text;
+         Function.Body = Function.Text + Record->BodyOffset;
+         Function.NumberOfParameters = Record->NumberOfParameters;
+         memcpy (Function.Parameters, Record->Parameters,
+                 sizeof(Function.Parameters));
+         ErrorCode = AddFunction (Context, Name, &Function);
+         continue;
+         }
+      if (FindSymbol (&Names, Name) != NOTFOUND)
+         break;
+      ErrorCode = (AddSymbol (&Names, Name, 0.0) < 0) ? ERROR_heap_full
+                                                      : ERROR_none;
+      }
+   FreeSymbolTable (&Names);
+   return ErrorCode;
+   }
+
+
+/*  CHECK SNAPSHOT AFTER HEADER, OR ADD ITS CONTENTS TO EMPTY CONTEXT  */
+static int ReadSnapshot (calc_context *Context, const snapheader_t *Header,
+                         BOOLEAN Install)
+   {
+   reader_t  Reader;
+   int       ErrorCode;
+
+   Reader.Next = (const char *) Header + HEADERSIZE;
+   Reader.End  = Reader.Next + Header->Length;
+   ErrorCode = ReadVariables (Context, Header, &Reader, Install);
+   if (ErrorCode == ERROR_none)
+      ErrorCode = ReadDefinitions (Context, Header, &Reader, Install);
+   if (ErrorCode == ERROR_none)
+      ErrorCode = ReadFunctions (Context, Header, &Reader, Install);
+   if (ErrorCode == ERROR_none && Reader.Next != Reader.End)
+      ErrorCode = ERROR_snapshot;
+   return ErrorCode;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+int calc_snapshot_save (calc_context *Context, const char *Path)
+   {
+   snapheader_t  Header;
+   unsigned char Padding[ALIGNMENT];
+   writer_t      Writer;
+   int           NumberOfDefinitions;
+
+   memset (&Writer, 0, sizeof(writer_t));
+   Writer.Checksum = 14695981039346656037ULL;
+   Writer.Buffer = (unsigned char *) malloc (SNAPSHOTBLOCK);
+   if (Writer.Buffer == NULL)
+      return ERROR_heap_full;
+   Writer.Stream = fopen (Path, "wb");
+   if (Writer.Stream == NULL)
+      {
+      free (Writer.Buffer);
+      return ERROR_snapshot;
+      }
+
+   /*  CONTENTS FIRST, THEN THE HEADER THAT COUNTS THEM  */
+   memset (&Header, 0, sizeof(snapheader_t));
+   memset (Padding, 0, sizeof(Padding));
+   if (fwrite (&Header, 1, sizeof(Header), Writer.Stream) != sizeof(Header) ||
+       fwrite (Padding, 1, HEADERSIZE - sizeof(Header), Writer.Stream)
+       != HEADERSIZE - sizeof(Header))
+      Writer.Failed = TRUE;
+   WriteVariables (&Writer, &Context->Variables);
+   NumberOfDefinitions = WriteDefinitions (&Writer, Context);
+   Header.NumberOfFunctions = WriteFunctions (&Writer, Context);
+   FlushWriter (&Writer);
+   free (Writer.Buffer);
+
+   memcpy (Header.Magic, SNAPSHOTMAGIC, sizeof(Header.Magic));
+   Header.Version             = SNAPSHOTVERSION;
+   Header.ByteOrder           = BYTEORDER;
+   Header.SizeOfSize          = sizeof(size_t);
+   Header.SizeOfInstruction   = sizeof(calc_instr);
+   Header.NumberOfVariables   = Context->Variables.NumberOfSymbols;
+   Header.NumberOfBuckets     = Header.NumberOfVariables
+                                ? Context->Variables.BucketMask + 1 : 0;
+   Header.NumberOfDefinitions = NumberOfDefinitions;
+   Header.NamesLength         = Header.NumberOfVariables
+                                ? Context->Variables.NamesLength : 0;
+   Header.Length              = Writer.Length;
+   Header.Checksum            = Writer.Checksum;
+   if (NumberOfDefinitions < 0 || Writer.Failed ||
+       fseek (Writer.Stream, 0L, SEEK_SET) != 0 ||
+       fwrite (&Header, 1, sizeof(Header), Writer.Stream) != sizeof(Header))
+      Writer.Failed = TRUE;
+   if (fclose (Writer.Stream) != 0 || Writer.Failed)
+      {
+      remove (Path);
+      return (NumberOfDefinitions < 0) ? ERROR_heap_full : ERROR_snapshot;
+      }
+   return ERROR_none;
+   }
+
+
+int calc_snapshot_load (calc_context *Context, const char *Path)
+   {
+   const snapheader_t *Header;
+   struct stat         Status;
+   void               *Image;
+   size_t              Length;
+   int                 File;
+   int                 ErrorCode;
+
+   File = open (Path, O_RDONLY);
+   if (File < 0)
+      return ERROR_snapshot;
+   if (fstat (File, &Status) != 0 || !S_ISREG (Status.st_mode) ||
+       Status.st_size < (off_t) HEADERSIZE)
+      {
+      close (File);
+      return ERROR_snapshot;
+      }
+   Length = (size_t) Status.st_size;
+   Image  = mmap (NULL, Length, PROT_READ, MAP_PRIVATE, File, 0);
+   close (File);
+   if (Image == MAP_FAILED)
+      return ERROR_snapshot;
+
+   /*  ONLY A WHOLE SNAPSHOT OF THIS VERSION AND MACHINE IS READ  */
+   Header = (const snapheader_t *) Image;
+   ErrorCode = ERROR_snapshot;
+   if (memcmp (Header->Magic, SNAPSHOTMAGIC, sizeof(Header->Magic)) == 0 &&
+       Header->Version == SNAPSHOTVERSION &&
+       Header->ByteOrder == BYTEORDER &&
+       Header->SizeOfSize == sizeof(size_t) &&
+       Header->SizeOfInstruction == sizeof(calc_instr) &&
+       Header->Length == Length - HEADERSIZE &&
+       Header->Length % ALIGNMENT == 0 &&
+       Header->Checksum ==
+       Checksum (14695981039346656037ULL,
+                 (const unsigned char *) Image + HEADERSIZE, Header->Length))
+      ErrorCode = ReadSnapshot (Context, Header, FALSE);
+
+   /*  CHECKED - NOW REPLACE THE CONTEXT  */
+   if (ErrorCode == ERROR_none)
+      {
+      calc_context_reset (Context);
+      ErrorCode = ReadSnapshot (Context, Header, TRUE);
+      if (ErrorCode != ERROR_none)
+         calc_context_reset (Context);
+      Context->FunctionVersion++;
+      }
+   munmap (Image, Length);
+   return ErrorCode;
+   }
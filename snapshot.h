@@ -0,0 +1,9 @@
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include "parse.h"
+
+int calc_snapshot_save (calc_context *ctx, const char *path);
+int calc_snapshot_load (calc_context *ctx, const char *path);
+
+#endif
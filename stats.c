@@ -0,0 +1,275 @@
+/*                                                                       */
+/*                                                                       */
+/*   EVALUATOR INSTRUMENTATION                                           */
+/*                                                                       */
+/*      Counts and times kept by evalform when calc is built with        */
+/*      CALC_STATS defined (make CFLAGS="-O2 -DCALC_STATS").  Without    */
+/*      it the hooks in parse.c and symtab.c compile to nothing and      */
+/*      every count reads zero.                                          */
+/*                                                                       */
+/*        (1) int calc_stats_enabled (void)                              */
+/*                                                                       */
+/*            returns 1 if counts are kept, else 0.                      */
+/*                                                                       */
+/*        (2) void calc_stats_get (calc_context *c, calc_stats *s)       */
+/*                                                                       */
+/*            copies counts of context c to s.                           */
+/*                                                                       */
+/*        (3) void calc_stats_add (calc_stats *total,                    */
+/*                                 const calc_stats *s)                  */
+/*                                                                       */
+/*            adds counts s to total, as for the contexts of several     */
+/*            threads.                                                   */
+/*                                                                       */
+/*        (4) void calc_stats_reset (calc_context *c)                    */
+/*                                                                       */
+/*            sets counts of context c to zero.                          */
+/*                                                                       */
+/*        (5) void calc_stats_print (FILE *stream, const calc_stats *s)  */
+/*                                                                       */
+/*            lists counts s on stream.                                  */
+/*                                                                       */
+/*                                                                       */
+/*        COUNTS                                                         */
+/*                                                                       */
+/*          Formulas, tokens (numbers, names, parentheses and            */
+/*          operators), variable lookups with the buckets they probed,   */
+/*          calls of each function, errors by code and the deepest       */
+/*          nesting of ParseFormula (frames of EvaluateFormula).         */
+/*                                                                       */
+/*          Time is split into tokenizing, variable lookup and the rest  */
+/*          of evaluation.  It is read from the time-stamp counter       */
+/*          where there is one (cycles) and from the monotonic clock     */
+/*          elsewhere (nanoseconds).  Reading it costs some tens of      */
+/*          cycles per token, so times are relative to each other more   */
+/*          than absolute.                                               */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Each context keeps its own counts, so threads never share    */
+/*          them.  The phase being timed changes at each token; a        */
+/*          formula evaluated while another is (the definition of a      */
+/*          variable, say) saves the outer phase and restores it when    */
+/*          it is done, up to CALC_STATSNESTING levels deep.             */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdio.h>
+#include <string.h>
+#include "parse.h"
+#include "builtin.h"
+#include "stats.h"
+
+#ifdef CALC_STATS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#if defined(__x86_64__) || defined(__i386__)
+#define TICKNAME "cycles"
+#else
+#define TICKNAME "ns"
+#endif
+
+
+/*
+************************************************************************
+Module-Wide Variables
+************************************************************************
+*/
+static const char *PhaseNames_m[CALC_PHASES] =
+   { NULL, "tokenize", "lookup", "evaluate" };
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+#ifdef CALC_STATS
+static unsigned long long ReadTicks (void);
+#endif
+static const char        *FunctionName (int Function);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+#ifdef CALC_STATS
+static unsigned long long ReadTicks (void)
+   {
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc ();
+#else
+   struct timespec Now;
+
+   clock_gettime (CLOCK_MONOTONIC, &Now);
+   return (unsigned long long) Now.tv_sec * 1000000000ULL + Now.tv_nsec;
+#endif
+   }
+#endif
+
+
+/*  NAME OF BUILT-IN FUNCTION, AS IN FORMULAS  */
+static const char *FunctionName (int Function)
+   {
+   const calc_builtin *Builtin;
+
+   for (Builtin=calc_builtins (); Builtin->Name != NULL; Builtin++)
+      if (Builtin->Kind == BUILTIN_function &&
+          (int) Builtin->Function == Function)
+         return Builtin->Name;
+   return "?";
+   }
+
+
+/*
+************************************************************************
+Hooks of parse.c (see stats.h)
+************************************************************************
+*/
+#ifdef CALC_STATS
+
+/*  CHARGE TIME SINCE LAST CHANGE TO CURRENT PHASE, THEN START Phase  */
+void StatsPhase (calc_stats *Stats, calc_phase Phase)
+   {
+   unsigned long long Now;
+
+   Now = ReadTicks ();
+   if (Stats->Phase != PHASE_none)
+      Stats->Ticks[Stats->Phase] += Now - Stats->PhaseStart;
+   Stats->PhaseStart = Now;
+   Stats->Phase      = Phase;
+   }
+
+
+/*  FORMULA STARTS - SAVE PHASE OF ANY FORMULA IT IS PART OF  */
+void StatsEnter (calc_stats *Stats)
+   {
+   if (Stats->Nesting < CALC_STATSNESTING)
+      Stats->Outer[Stats->Nesting] = Stats->Phase;
+   Stats->Nesting++;
+   StatsPhase (Stats, PHASE_evaluate);
+   }
+
+
+void StatsLeave (calc_stats *Stats)
+   {
+   Stats->Nesting--;
+   StatsPhase (Stats, (Stats->Nesting < CALC_STATSNESTING)
+                      ? Stats->Outer[Stats->Nesting] : PHASE_evaluate);
+   }
+
+#endif
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+int calc_stats_enabled (void)
+   {
+#ifdef CALC_STATS
+   return 1;
+#else
+   return 0;
+#endif
+   }
+
+
+void calc_stats_get (calc_context *Context, calc_stats *Stats)
+   {
+#ifdef CALC_STATS
+   *Stats = Context->Stats;
+   Stats->Lookups      = Context->Variables.Lookups;
+   Stats->Probes       = Context->Variables.Probes;
+   Stats->LongestProbe = Context->Variables.LongestProbe;
+#else
+   (void) Context;
+   memset (Stats, 0, sizeof(calc_stats));
+#endif
+   }
+
+
+void calc_stats_add (calc_stats *Total, const calc_stats *Stats)
+   {
+   int index;
+
+   Total->Formulas += Stats->Formulas;
+   Total->Tokens   += Stats->Tokens;
+   Total->Lookups  += Stats->Lookups;
+   Total->Probes   += Stats->Probes;
+   if (Stats->LongestProbe > Total->LongestProbe)
+      Total->LongestProbe = Stats->LongestProbe;
+   for (index=0; index<CALC_FUNCTIONS; index++)
+      Total->Calls[index] += Stats->Calls[index];
+   for (index=0; index<CALC_ERRORS; index++)
+      Total->Errors[index] += Stats->Errors[index];
+   if (Stats->MaxDepth > Total->MaxDepth)
+      Total->MaxDepth = Stats->MaxDepth;
+   for (index=0; index<CALC_PHASES; index++)
+      Total->Ticks[index] += Stats->Ticks[index];
+   }
+
+
+void calc_stats_reset (calc_context *Context)
+   {
+#ifdef CALC_STATS
+   memset (&Context->Stats, 0, sizeof(calc_stats));
+   Context->Variables.Lookups      = 0;
+   Context->Variables.Probes       = 0;
+   Context->Variables.LongestProbe = 0;
+#else
+   (void) Context;
+#endif
+   }
+
+
+void calc_stats_print (FILE *Stream, const calc_stats *Stats)
+   {
+   unsigned long long TotalTicks;
+   int index;
+
+   fprintf (Stream, "   formulas  %lu\n", Stats->Formulas);
+   fprintf (Stream, "   tokens    %lu\n", Stats->Tokens);
+   fprintf (Stream, "   lookups   %lu (%lu probes, longest %lu)\n",
+            Stats->Lookups, Stats->Probes, Stats->LongestProbe);
+   fprintf (Stream, "   depth     %d\n", Stats->MaxDepth);
+
+   TotalTicks = 0;
+   for (index=PHASE_tokenize; index<CALC_PHASES; index++)
+      TotalTicks += Stats->Ticks[index];
+   for (index=PHASE_tokenize; index<CALC_PHASES; index++)
+      fprintf (Stream, "   %-9s %llu " TICKNAME " (%.1f%%)\n",
+               PhaseNames_m[index], Stats->Ticks[index],
+               TotalTicks ? 100.0 * Stats->Ticks[index] / TotalTicks : 0.0);
+
+   for (index=0; index<CALC_FUNCTIONS; index++)
+      if (Stats->Calls[index] != 0)
+         fprintf (Stream, "   calls     %-8s %lu\n", FunctionName (index),
+                  Stats->Calls[index]);
+   for (index=ERROR_none+1; index<CALC_ERRORS; index++)
+      if (Stats->Errors[index] != 0)
+         fprintf (Stream, "   errors    %lu  %s\n", Stats->Errors[index],
+                  parsemsg (index));
+   }
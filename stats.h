@@ -0,0 +1,27 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include "parse.h"
+
+/*  HOOKS OF THE EVALUATOR - THEY COMPILE TO NOTHING WITHOUT CALC_STATS  */
+#ifdef CALC_STATS
+void StatsPhase (calc_stats *Stats, calc_phase Phase);
+void StatsEnter (calc_stats *Stats);
+void StatsLeave (calc_stats *Stats);
+
+#define STATS_COUNT(Context, Field)  ((Context)->Stats.Field++)
+#define STATS_DEPTH(Context, Depth) \
+   ((Depth) > (Context)->Stats.MaxDepth ? \
+    (void) ((Context)->Stats.MaxDepth = (Depth)) : (void) 0)
+#define STATS_PHASE(Context, Phase)  StatsPhase (&(Context)->Stats, Phase)
+#define STATS_ENTER(Context)         StatsEnter (&(Context)->Stats)
+#define STATS_LEAVE(Context)         StatsLeave (&(Context)->Stats)
+#else
+#define STATS_COUNT(Context, Field)  ((void) 0)
+#define STATS_DEPTH(Context, Depth)  ((void) 0)
+#define STATS_PHASE(Context, Phase)  ((void) 0)
+#define STATS_ENTER(Context)         ((void) 0)
+#define STATS_LEAVE(Context)         ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,374 @@
+/*                                                                       */
+/*                                                                       */
+/*   SYMBOL TABLE                                                        */
+/*                                                                       */
+/*      Hash table of names used for the variables of the formula        */
+/*      parser.                                                          */
+/*                                                                       */
+/*        (1) int FindSymbol (symtab_t *t, const char *name)             */
+/*                                                                       */
+/*            returns ID of name, or NOTFOUND.                           */
+/*                                                                       */
+/*        (2) int AddSymbol (symtab_t *t, const char *name, double v)    */
+/*                                                                       */
+/*            adds name (which must not be in the table yet) with        */
+/*            value v and version 0.  Returns ID of the new symbol,      */
+/*            or NOROOM if the table holds MAXNUMBERVAR symbols, or      */
+/*            NOHEAP if memory is exhausted.                             */
+/*                                                                       */
+/*        (3) char *SymbolName (symtab_t *t, int id)                     */
+/*                                                                       */
+/*            returns name of symbol.  The pointer is valid until        */
+/*            the next call to AddSymbol.                                */
+/*                                                                       */
+/*        (4) void TruncateSymbols (symtab_t *t, int n)                  */
+/*                                                                       */
+/*            removes all symbols but the first n added.                 */
+/*                                                                       */
+/*        (5) void FreeSymbolTable (symtab_t *t)                         */
+/*                                                                       */
+/*            releases all memory and leaves the table empty.  Memory    */
+/*            of a table in an arena is reclaimed with the arena.        */
+/*                                                                       */
+/*        (6) int CopySymbols (symtab_t *t, const symtab_t *from)        */
+/*                                                                       */
+/*            makes empty table t an exact copy of from, with the same   */
+/*            IDs, values and buckets and version 0.  Returns FALSE if   */
+/*            memory is exhausted, leaving t empty.                      */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Buckets hold symbol IDs and are probed linearly.  The        */
+/*          bucket count is a power of two and at least twice the        */
+/*          number of symbols.  The hash of every name is kept so        */
+/*          that most mismatches are rejected without strcmp and so      */
+/*          the table can be rebuilt without rehashing names.            */
+/*                                                                       */
+/*          The values are kept apart from the names and hashes, in      */
+/*          one array that starts on a cache line (VALUEALIGNMENT), so   */
+/*          programs and hosts setting variables by ID (see calc_set)    */
+/*          touch only the lines holding values.                         */
+/*                                                                       */
+/*          All storage is grown by doubling, so a table in an arena     */
+/*          leaves behind at most as much as it uses.                    */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "parse.h"
+#include "symtab.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define INITIALSYMBOLS   16
+#define INITIALNAMES     256
+#define VALUEALIGNMENT   64          /*  bytes of a cache line           */
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static unsigned  HashName (const char *Name);
+static int       GrowBuckets (symtab_t *Table, int NumberOfBuckets);
+static int       GrowSymbols (symtab_t *Table);
+static double   *AllocateValues (symtab_t *Table, int Size, void **Block);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  FNV-1a HASH OF NAME  */
+static unsigned HashName (const char *Name)
+   {
+   unsigned Hash = 2166136261u;
+
+   while (*Name)
+      {
+      Hash ^= (unsigned char) *Name++;
+      Hash *= 16777619u;
+      }
+   return Hash;
+   }
+
+
+/*  REBUILD HASH TABLE WITH NEW NUMBER OF BUCKETS - RETURN FALSE IF NO HEAP  */
+static int GrowBuckets (symtab_t *Table, int NumberOfBuckets)
+   {
+   int *NewBuckets;
+   int  Bucket;
+   int  SymbolID;
+
+   NewBuckets = (int *) ArenaAllocate (Table->Arena,
+                                       NumberOfBuckets * sizeof(int));
+   if (NewBuckets == NULL)
+      return 0;
+   for (Bucket=0; Bucket<NumberOfBuckets; Bucket++)
+      NewBuckets[Bucket] = NOTFOUND;
+
+   /*  RE-ENTER EXISTING SYMBOLS  */
+   for (SymbolID=0; SymbolID<Table->NumberOfSymbols; SymbolID++)
+      {
+      Bucket = Table->Hashes[SymbolID] & (NumberOfBuckets-1);
+      while (NewBuckets[Bucket] != NOTFOUND)
+         Bucket = (Bucket+1) & (NumberOfBuckets-1);
+      NewBuckets[Bucket] = SymbolID;
+      }
+
+   ArenaDiscard (Table->Arena, Table->Buckets);
+   Table->Buckets    = NewBuckets;
+   Table->BucketMask = NumberOfBuckets-1;
+   return 1;
+   }
+
+
+/*  Size VALUES STARTING ON A CACHE LINE - *Block IS WHAT TO DISCARD  */
+static double *AllocateValues (symtab_t *Table, int Size, void **Block)
+   {
+   *Block = ArenaAllocate (Table->Arena,
+                           Size * sizeof(double) + VALUEALIGNMENT);
+   if (*Block == NULL)
+      return NULL;
+   return (double *) (((uintptr_t) *Block + VALUEALIGNMENT-1) &
+                      ~(uintptr_t) (VALUEALIGNMENT-1));
+   }
+
+
+/*  DOUBLE SPACE FOR SYMBOLS - RETURN FALSE IF NO HEAP  */
+static int GrowSymbols (symtab_t *Table)
+   {
+   int        NewSize;
+   size_t    *NewOffsets;
+   unsigned  *NewHashes;
+   double    *NewValues;
+   void      *NewValueBlock;
+   unsigned long *NewVersions;
+
+   NewSize = Table->SymbolSize ? 2*Table->SymbolSize : INITIALSYMBOLS;
+
+   NewOffsets = (size_t *) ArenaResize (Table->Arena, Table->NameOffsets,
+                                        Table->SymbolSize * sizeof(size_t),
+                                        NewSize * sizeof(size_t));
+   if (NewOffsets == NULL)
+      return 0;
+   Table->NameOffsets = NewOffsets;
+
+   NewHashes = (unsigned *) ArenaResize (Table->Arena, Table->Hashes,
+                                         Table->SymbolSize * sizeof(unsigned),
+                                         NewSize * sizeof(unsigned));
+   if (NewHashes == NULL)
+      return 0;
+   Table->Hashes = NewHashes;
+
+   NewValues = AllocateValues (Table, NewSize, &NewValueBlock);
+   if (NewValues == NULL)
+      return 0;
+   if (Table->NumberOfSymbols > 0)
+      memcpy (NewValues, Table->Values,
+              Table->NumberOfSymbols * sizeof(double));
+   ArenaDiscard (Table->Arena, Table->ValueBlock);
+   Table->Values     = NewValues;
+   Table->ValueBlock = NewValueBlock;
+
+   NewVersions = (unsigned long *)
+      ArenaResize (Table->Arena, Table->Versions,
+                   Table->SymbolSize * sizeof(unsigned long),
+                   NewSize * sizeof(unsigned long));
+   if (NewVersions == NULL)
+      return 0;
+   Table->Versions = NewVersions;
+
+   if (!GrowBuckets (Table, 2*NewSize))
+      return 0;
+   Table->SymbolSize = NewSize;
+   return 1;
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+int FindSymbol (symtab_t *Table, const char *Name)
+   {
+   unsigned Hash;
+   int      Bucket;
+   int      SymbolID;
+#ifdef CALC_STATS
+   unsigned long Probes = 1;
+
+   Table->Lookups++;
+#endif
+
+   if (Table->NumberOfSymbols == 0)
+      return NOTFOUND;
+
+   Hash   = HashName (Name);
+   Bucket = Hash & Table->BucketMask;
+   while ((SymbolID = Table->Buckets[Bucket]) != NOTFOUND)
+      {
+      if (Table->Hashes[SymbolID] == Hash &&
+          strcmp (Table->Names + Table->NameOffsets[SymbolID], Name) == 0)
+         break;
+      Bucket = (Bucket+1) & Table->BucketMask;
+#ifdef CALC_STATS
+      Probes++;
+#endif
+      }
+#ifdef CALC_STATS
+   Table->Probes += Probes;
+   if (Probes > Table->LongestProbe)
+      Table->LongestProbe = Probes;
+#endif
+   return SymbolID;
+   }
+
+
+int AddSymbol (symtab_t *Table, const char *Name, double Value)
+   {
+   size_t  NameLength;
+   size_t  NewSize;
+   char   *NewNames;
+   int     SymbolID;
+   int     Bucket;
+
+   if (Table->NumberOfSymbols >= MAXNUMBERVAR)
+      return NOROOM;
+
+   /*  MAKE ROOM FOR SYMBOL AND NAME  */
+   if (Table->NumberOfSymbols >= Table->SymbolSize && !GrowSymbols (Table))
+      return NOHEAP;
+   NameLength = strlen (Name) + 1;
+   if (Table->NamesLength + NameLength > Table->NamesSize)
+      {
+      NewSize = Table->NamesSize ? 2*Table->NamesSize : INITIALNAMES;
+      while (NewSize < Table->NamesLength + NameLength)
+         NewSize *= 2;
+      NewNames = (char *) ArenaResize (Table->Arena, Table->Names,
+                                       Table->NamesSize, NewSize);
+      if (NewNames == NULL)
+         return NOHEAP;
+      Table->Names     = NewNames;
+      Table->NamesSize = NewSize;
+      }
+
+   /*  STORE SYMBOL  */
+   SymbolID = Table->NumberOfSymbols++;
+   memcpy (Table->Names + Table->NamesLength, Name, NameLength);
+   Table->NameOffsets[SymbolID] = Table->NamesLength;
+   Table->NamesLength += NameLength;
+   Table->Hashes[SymbolID] = HashName (Name);
+   Table->Values[SymbolID] = Value;
+   Table->Versions[SymbolID] = 0;
+
+   /*  ENTER IN HASH TABLE  */
+   Bucket = Table->Hashes[SymbolID] & Table->BucketMask;
+   while (Table->Buckets[Bucket] != NOTFOUND)
+      Bucket = (Bucket+1) & Table->BucketMask;
+   Table->Buckets[Bucket] = SymbolID;
+   return SymbolID;
+   }
+
+
+char *SymbolName (symtab_t *Table, int SymbolID)
+   {
+   return Table->Names + Table->NameOffsets[SymbolID];
+   }
+
+
+/*  SYMBOLS ARE REMOVED LAST FIRST - EACH IS THEN AT THE END OF ITS PROBES  */
+void TruncateSymbols (symtab_t *Table, int NumberOfSymbols)
+   {
+   int SymbolID;
+   int Bucket;
+
+   for (SymbolID=Table->NumberOfSymbols-1; SymbolID>=NumberOfSymbols;
+        SymbolID--)
+      {
+      Bucket = Table->Hashes[SymbolID] & Table->BucketMask;
+      while (Table->Buckets[Bucket] != SymbolID)
+         Bucket = (Bucket+1) & Table->BucketMask;
+      Table->Buckets[Bucket] = NOTFOUND;
+      Table->NamesLength = Table->NameOffsets[SymbolID];
+      Table->NumberOfSymbols = SymbolID;
+      }
+   }
+
+
+void FreeSymbolTable (symtab_t *Table)
+   {
+   calc_arena *Arena = Table->Arena;
+
+   ArenaDiscard (Arena, Table->Names);
+   ArenaDiscard (Arena, Table->NameOffsets);
+   ArenaDiscard (Arena, Table->Hashes);
+   ArenaDiscard (Arena, Table->ValueBlock);
+   ArenaDiscard (Arena, Table->Versions);
+   ArenaDiscard (Arena, Table->Buckets);
+   memset (Table, 0, sizeof(symtab_t));
+   Table->Arena = Arena;
+   }
+
+
+/*  ARRAYS ARE COPIED WHOLE - NOTHING IS HASHED OR PROBED  */
+int CopySymbols (symtab_t *Table, const symtab_t *From)
+   {
+   int NumberOfBuckets;
+   int Size;
+
+   if (From->NumberOfSymbols == 0)
+      return 1;
+   NumberOfBuckets = From->BucketMask + 1;
+   Size = NumberOfBuckets / 2;
+   Table->Names       = (char *) ArenaAllocate (Table->Arena,
+                                                From->NamesLength);
+   Table->NameOffsets = (size_t *) ArenaAllocate (Table->Arena,
+                                                  Size * sizeof(size_t));
+   Table->Hashes      = (unsigned *) ArenaAllocate (Table->Arena,
+                                                    Size * sizeof(unsigned));
+   Table->Values      = AllocateValues (Table, Size, &Table->ValueBlock);
+   Table->Versions    = (unsigned long *)
+      ArenaAllocate (Table->Arena, Size * sizeof(unsigned long));
+   Table->Buckets     = (int *) ArenaAllocate (Table->Arena,
+                                               NumberOfBuckets * sizeof(int));
+   if (Table->Names == NULL || Table->NameOffsets == NULL ||
+       Table->Hashes == NULL || Table->Values == NULL ||
+       Table->Versions == NULL || Table->Buckets == NULL)
+      {
+      FreeSymbolTable (Table);
+      return 0;
+      }
+
+   memcpy (Table->Names, From->Names, From->NamesLength);
+   memcpy (Table->NameOffsets, From->NameOffsets,
+           From->NumberOfSymbols * sizeof(size_t));
+   memcpy (Table->Hashes, From->Hashes,
+           From->NumberOfSymbols * sizeof(unsigned));
+   memcpy (Table->Values, From->Values,
+           From->NumberOfSymbols * sizeof(double));
+   memset (Table->Versions, 0, From->NumberOfSymbols * sizeof(unsigned long));
+   memcpy (Table->Buckets, From->Buckets, NumberOfBuckets * sizeof(int));
+   Table->NamesLength     = From->NamesLength;
+   Table->NamesSize       = From->NamesLength;
+   Table->NumberOfSymbols = From->NumberOfSymbols;
+   Table->SymbolSize      = Size;
+   Table->BucketMask      = From->BucketMask;
+   return 1;
+   }
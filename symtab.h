@@ -0,0 +1,48 @@
+#ifndef __SYMTAB_H
+#define __SYMTAB_H
+
+#include <stddef.h>
+#include "arena.h"
+
+/*  MAXIMUM NUMBER OF SYMBOLS IN ONE TABLE  */
+#define MAXNUMBERVAR  1048576
+
+/*
+   Symbol table - names are kept in one character arena and found
+   through an open-addressing hash table.  Symbol IDs are assigned in
+   insertion order and never change.  Whoever changes a value also
+   increments its version, so cached results can tell whether a
+   symbol changed.  Values are contiguous and cache-line aligned, apart
+   from the names.  A zero-filled symtab_t is an empty table on the
+   heap; set Arena to take its memory from an arena instead.
+*/
+typedef struct
+   {
+   char      *Names;           /*  arena of NUL-terminated names       */
+   size_t     NamesLength;     /*  characters used in arena            */
+   size_t     NamesSize;       /*  characters allocated in arena       */
+   size_t    *NameOffsets;     /*  arena offset of each name           */
+   unsigned  *Hashes;          /*  hash value of each name             */
+   double    *Values;          /*  value of each symbol                */
+   void      *ValueBlock;      /*  allocation holding Values           */
+   unsigned long *Versions;    /*  changed each time value is set      */
+   int        NumberOfSymbols;
+   int        SymbolSize;      /*  allocated symbols                   */
+   int       *Buckets;         /*  symbol IDs, NOTFOUND if empty       */
+   int        BucketMask;      /*  number of buckets - 1               */
+   calc_arena *Arena;          /*  memory of table, NULL for heap      */
+#ifdef CALC_STATS
+   unsigned long Lookups;      /*  calls of FindSymbol                 */
+   unsigned long Probes;       /*  buckets they probed                 */
+   unsigned long LongestProbe;
+#endif
+   } symtab_t;
+
+int    FindSymbol      (symtab_t *Table, const char *Name);
+int    AddSymbol       (symtab_t *Table, const char *Name, double Value);
+char  *SymbolName      (symtab_t *Table, int SymbolID);
+void   TruncateSymbols (symtab_t *Table, int NumberOfSymbols);
+void   FreeSymbolTable (symtab_t *Table);
+int    CopySymbols     (symtab_t *Table, const symtab_t *From);
+
+#endif
@@ -0,0 +1,522 @@
+/*                                                                       */
+/*                                                                       */
+/*   TRACE OF BATCH RUNS                                                 */
+/*                                                                       */
+/*      The cost of each formula evaluated by calc, written to a file    */
+/*      as it runs, and a report ranking the formulas that cost most.    */
+/*                                                                       */
+/*        (1) calc_trace *calc_trace_open (const char *path)             */
+/*                                                                       */
+/*            returns writer of a new trace file path.  Returns NULL if  */
+/*            the file cannot be created or memory is exhausted.         */
+/*                                                                       */
+/*        (2) void calc_trace_begin (calc_trace *t, calc_context *c)     */
+/*                                                                       */
+/*            starts timing a formula evaluated in context c.            */
+/*                                                                       */
+/*        (3) void calc_trace_end (calc_trace *t, calc_context *c,       */
+/*                                 unsigned long line, const char *f,    */
+/*                                 size_t n, int err)                    */
+/*                                                                       */
+/*            adds record of formula f (n bytes) on input line line,     */
+/*            evaluated with error code err since calc_trace_begin.      */
+/*                                                                       */
+/*        (4) int calc_trace_close (calc_trace *t)                       */
+/*                                                                       */
+/*            writes buffered records, closes file and releases writer.  */
+/*            Returns 0, or EOF if writing failed.                       */
+/*                                                                       */
+/*        (5) int calc_trace_report (FILE *stream, const char *path,     */
+/*                                   int top)                            */
+/*                                                                       */
+/*            lists on stream the top formulas of trace file path that   */
+/*            took longest in all, with their counts.  Returns 0, or -1  */
+/*            if path cannot be read or is not a trace.                  */
+/*                                                                       */
+/*                                                                       */
+/*        FORMAT                                                         */
+/*                                                                       */
+/*          A 16-byte header: "CALCTRCE", the version (4 bytes) and      */
+/*          flags (4), of which bit 0 tells that counts were kept.       */
+/*          Then one record per formula, all little-endian: line         */
+/*          number (8 bytes), parse and evaluation time in nanoseconds   */
+/*          (8 each), tokens (4), deepest nesting (4), error code (4)    */
+/*          and length of the formula (4), followed by its first         */
+/*          CALC_TRACETEXT bytes at most.                                */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Time is read from the monotonic clock around each formula.   */
+/*          evalform parses and evaluates in one pass, so the share of   */
+/*          parsing is that of tokenizing in the counts of stats.c.      */
+/*          Those, the tokens and the nesting are only kept when calc    */
+/*          is built with CALC_STATS; otherwise they read zero and the   */
+/*          whole time counts as evaluation.                             */
+/*                                                                       */
+/*          The report adds up the records of each formula text in a     */
+/*          hash table, then sorts the formulas by their total time.     */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "parse.h"
+#include "trace.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define EMPTY -1
+#define TRACEMAGIC    "CALCTRCE"
+#define TRACEVERSION  1
+#define TRACECOUNTED  1           /*  flag: tokens and nesting kept    */
+#define HEADERSIZE    16
+#define RECORDSIZE    40          /*  without the formula              */
+#define INITIALFORMULAS 256
+
+
+/*
+************************************************************************
+Type Definitions
+************************************************************************
+*/
+struct calc_trace
+   {
+   FILE              *Stream;
+   int                Failed;     /*  a write has failed               */
+   uint64_t           Start;      /*  of formula being timed, in ns    */
+   calc_stats         Before;     /*  counts of context at its start   */
+#ifdef CALC_STATS
+   int                OuterDepth; /*  deepest nesting before it        */
+#endif
+   };
+
+/*  ALL RECORDS OF ONE FORMULA TEXT IN A REPORT  */
+typedef struct
+   {
+   size_t             Text;       /*  offset in report's Texts         */
+   int                Length;     /*  bytes kept                       */
+   BOOLEAN            Truncated;
+   unsigned           Hash;
+   int                HashNext;
+   unsigned long      Count;
+   unsigned long      Errors;
+   uint64_t           ParseTime;
+   uint64_t           EvaluateTime;
+   unsigned long      Tokens;     /*  most of any record               */
+   int                Depth;
+   } traceformula_t;
+
+/*  REPORT BEING READ  */
+typedef struct
+   {
+   traceformula_t    *Formulas;
+   int                NumberOfFormulas;
+   int                FormulaSize;
+   int               *Buckets;    /*  first formula of each hash chain */
+   int                BucketMask;
+   char              *Texts;
+   size_t             TextLength;
+   size_t             TextSize;
+   unsigned long      Lines;
+   uint64_t           ParseTime;
+   uint64_t           EvaluateTime;
+   } tracereport_t;
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static uint64_t        Now (void);
+static unsigned char  *PutInteger (unsigned char *Buffer, uint64_t Value,
+                                   int Bytes);
+static uint64_t        GetInteger (const unsigned char *Buffer, int Bytes);
+static unsigned        HashText (const char *Text, int Length);
+static BOOLEAN         Rehash (tracereport_t *Report, int Size);
+static traceformula_t *FindFormula (tracereport_t *Report, const char *Text,
+                                    int Length);
+static int             CompareTotal (const void *First, const void *Second);
+static void            FreeReport (tracereport_t *Report);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*  MONOTONIC CLOCK IN NANOSECONDS  */
+static uint64_t Now (void)
+   {
+   struct timespec Time;
+
+   clock_gettime (CLOCK_MONOTONIC, &Time);
+   return (uint64_t) Time.tv_sec * 1000000000u + (uint64_t) Time.tv_nsec;
+   }
+
+
+/*  STORE LOW Bytes BYTES OF Value, LEAST SIGNIFICANT FIRST  */
+static unsigned char *PutInteger (unsigned char *Buffer, uint64_t Value,
+                                  int Bytes)
+   {
+   int ibyte;
+
+   for (ibyte=0; ibyte<Bytes; ibyte++)
+      Buffer[ibyte] = (unsigned char) (Value >> (8*ibyte));
+   return Buffer + Bytes;
+   }
+
+
+static uint64_t GetInteger (const unsigned char *Buffer, int Bytes)
+   {
+   uint64_t Value;
+   int      ibyte;
+
+   Value = 0;
+   for (ibyte=Bytes-1; ibyte>=0; ibyte--)
+      Value = (Value << 8) | Buffer[ibyte];
+   return Value;
+   }
+
+
+/*  FNV-1a HASH OF TEXT  */
+static unsigned HashText (const char *Text, int Length)
+   {
+   unsigned Hash;
+   int      ichar;
+
+   Hash = 2166136261u;
+   for (ichar=0; ichar<Length; ichar++)
+      Hash = (Hash ^ (unsigned char) Text[ichar]) * 16777619u;
+   return Hash;
+   }
+
+
+/*  MAKE ROOM FOR Size FORMULAS AND CHAIN THEM IN TWICE AS MANY BUCKETS  */
+static BOOLEAN Rehash (tracereport_t *Report, int Size)
+   {
+   traceformula_t *Formulas;
+   int            *Buckets;
+   int             Bucket;
+   int             Formula;
+
+   Formulas = (traceformula_t *) realloc (Report->Formulas,
+                                          Size * sizeof(traceformula_t));
+   if (Formulas == NULL)
+      return FALSE;
+   Report->Formulas    = Formulas;
+   Report->FormulaSize = Size;
+
+   Buckets = (int *) malloc (2 * Size * sizeof(int));
+   if (Buckets == NULL)
+      return FALSE;
+   free (Report->Buckets);
+   Report->Buckets    = Buckets;
+   Report->BucketMask = 2*Size - 1;
+   for (Bucket=0; Bucket<2*Size; Bucket++)
+      Buckets[Bucket] = EMPTY;
+   for (Formula=0; Formula<Report->NumberOfFormulas; Formula++)
+      {
+      Bucket = Formulas[Formula].Hash & Report->BucketMask;
+      Formulas[Formula].HashNext = Buckets[Bucket];
+      Buckets[Bucket] = Formula;
+      }
+   return TRUE;
+   }
+
+
+/*  FORMULA OF Text IN REPORT, ADDED IF NEW - NULL IF NO HEAP  */
+static traceformula_t *FindFormula (tracereport_t *Report, const char *Text,
+                                    int Length)
+   {
+   traceformula_t *f;
+   char           *Texts;
+   unsigned        Hash;
+   int             Bucket;
+   int             Formula;
+
+   Hash   = HashText (Text, Length);
+   Bucket = Hash & Report->BucketMask;
+   for (Formula=Report->Buckets[Bucket]; Formula!=EMPTY; Formula=f->HashNext)
+      {
+      f = Report->Formulas + Formula;
+      if (f->Hash == Hash && f->Length == Length &&
+          memcmp (Report->Texts + f->Text, Text, Length) == 0)
+         return f;
+      }
+
+   /*  NEW FORMULA  */
+   if (Report->NumberOfFormulas == Report->FormulaSize &&
+       !Rehash (Report, 2 * Report->FormulaSize))
+      return NULL;
+   if (Report->TextLength + Length > Report->TextSize)
+      {
+      Texts = (char *) realloc (Report->Texts,
+                                2*Report->TextSize + Length);
+      if (Texts == NULL)
+         return NULL;
+      Report->Texts    = Texts;
+      Report->TextSize = 2*Report->TextSize + Length;
+      }
+   memcpy (Report->Texts + Report->TextLength, Text, Length);
+
+   Formula = Report->NumberOfFormulas++;
+   f = Report->Formulas + Formula;
+   memset (f, 0, sizeof(traceformula_t));
+   f->Text     = Report->TextLength;
+   f->Length   = Length;
+   f->Hash     = Hash;
+   Bucket      = Hash & Report->BucketMask;
+   f->HashNext = Report->Buckets[Bucket];
+   Report->Buckets[Bucket] = Formula;
+   Report->TextLength += Length;
+   return f;
+   }
+
+
+/*  ORDER OF qsort - LONGEST TOTAL TIME FIRST  */
+static int CompareTotal (const void *First, const void *Second)
+   {
+   const traceformula_t *f1 = (const traceformula_t *) First;
+   const traceformula_t *f2 = (const traceformula_t *) Second;
+   uint64_t              Total1;
+   uint64_t              Total2;
+
+   Total1 = f1->ParseTime + f1->EvaluateTime;
+   Total2 = f2->ParseTime + f2->EvaluateTime;
+   return (Total1 < Total2) - (Total1 > Total2);
+   }
+
+
+static void FreeReport (tracereport_t *Report)
+   {
+   free (Report->Formulas);
+   free (Report->Buckets);
+   free (Report->Texts);
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+calc_trace *calc_trace_open (const char *Path)
+   {
+   calc_trace    *Trace;
+   unsigned char  Header[HEADERSIZE];
+
+   Trace = (calc_trace *) calloc (1, sizeof(calc_trace));
+   if (Trace == NULL)
+      return NULL;
+   Trace->Stream = fopen (Path, "wb");
+   if (Trace->Stream == NULL)
+      {
+      free (Trace);
+      return NULL;
+      }
+   memcpy (Header, TRACEMAGIC, 8);
+   PutInteger (Header+8, TRACEVERSION, 4);
+   PutInteger (Header+12, calc_stats_enabled () ? TRACECOUNTED : 0, 4);
+   if (fwrite (Header, 1, HEADERSIZE, Trace->Stream) != HEADERSIZE)
+      Trace->Failed = 1;
+   return Trace;
+   }
+
+
+void calc_trace_begin (calc_trace *Trace, calc_context *Context)
+   {
+   calc_stats_get (Context, &Trace->Before);
+
+   /*  DEEPEST NESTING OF THIS FORMULA ALONE  */
+#ifdef CALC_STATS
+   Trace->OuterDepth = Context->Stats.MaxDepth;
+   Context->Stats.MaxDepth = 0;
+#endif
+   Trace->Start = Now ();
+   }
+
+
+void calc_trace_end (calc_trace *Trace, calc_context *Context,
+                     unsigned long Line, const char *Formula, size_t Length,
+                     int Error)
+   {
+   unsigned char       Record[RECORDSIZE];
+   unsigned char      *r;
+   calc_stats          After;
+   unsigned long long  Ticks;
+   uint64_t            Elapsed;
+   uint64_t            ParseTime;
+   size_t              Kept;
+   int                 index;
+
+   Elapsed = Now () - Trace->Start;
+   calc_stats_get (Context, &After);
+#ifdef CALC_STATS
+   if (Context->Stats.MaxDepth < Trace->OuterDepth)
+      Context->Stats.MaxDepth = Trace->OuterDepth;
+#endif
+
+   /*  TIME SHARED IN PROPORTION TO TICKS OF TOKENIZING AND THE REST  */
+   Ticks = 0;
+   for (index=PHASE_tokenize; index<CALC_PHASES; index++)
+      Ticks += After.Ticks[index] - Trace->Before.Ticks[index];
+   ParseTime = 0;
+   if (Ticks > 0)
+      ParseTime = (uint64_t) ((double) Elapsed *
+                              (After.Ticks[PHASE_tokenize] -
+                               Trace->Before.Ticks[PHASE_tokenize]) / Ticks);
+
+   Kept = (Length < CALC_TRACETEXT) ? Length : CALC_TRACETEXT;
+   r = PutInteger (Record, Line, 8);
+   r = PutInteger (r, ParseTime, 8);
+   r = PutInteger (r, Elapsed - ParseTime, 8);
+   r = PutInteger (r, After.Tokens - Trace->Before.Tokens, 4);
+   r = PutInteger (r, (unsigned) After.MaxDepth, 4);
+   r = PutInteger (r, (unsigned) Error, 4);
+   PutInteger (r, Length, 4);
+   if (fwrite (Record, 1, RECORDSIZE, Trace->Stream) != RECORDSIZE ||
+       fwrite (Formula, 1, Kept, Trace->Stream) != Kept)
+      Trace->Failed = 1;
+   }
+
+
+int calc_trace_close (calc_trace *Trace)
+   {
+   int Result;
+
+   if (Trace == NULL)
+      return 0;
+   Result = Trace->Failed ? EOF : 0;
+   if (fclose (Trace->Stream) != 0)
+      Result = EOF;
+   free (Trace);
+   return Result;
+   }
+
+
+int calc_trace_report (FILE *Stream, const char *Path, int Top)
+   {
+   tracereport_t   Report;
+   traceformula_t *f;
+   FILE           *Input;
+   unsigned char   Header[HEADERSIZE];
+   unsigned char   Record[RECORDSIZE];
+   char            Text[CALC_TRACETEXT];
+   uint64_t        Total;
+   uint64_t        ParseTime;
+   uint64_t        Length;
+   unsigned long   Tokens;
+   BOOLEAN         Counted;
+   BOOLEAN         Failed;
+   int             Kept;
+   int             Formula;
+
+   Input = fopen (Path, "rb");
+   if (Input == NULL)
+      return -1;
+   if (fread (Header, 1, HEADERSIZE, Input) != HEADERSIZE ||
+       memcmp (Header, TRACEMAGIC, 8) != 0 ||
+       GetInteger (Header+8, 4) != TRACEVERSION)
+      {
+      fclose (Input);
+      return -1;
+      }
+   Counted = (GetInteger (Header+12, 4) & TRACECOUNTED) != 0;
+
+   /*  ADD UP RECORDS OF EACH FORMULA - A RECORD CUT SHORT ENDS THE FILE  */
+   memset (&Report, 0, sizeof(tracereport_t));
+   Failed = !Rehash (&Report, INITIALFORMULAS);
+   while (!Failed && fread (Record, 1, RECORDSIZE, Input) == RECORDSIZE)
+      {
+      Length = GetInteger (Record+36, 4);
+      Kept = (int) ((Length < CALC_TRACETEXT) ? Length : CALC_TRACETEXT);
+      if (fread (Text, 1, Kept, Input) != (size_t) Kept)
+         break;
+      f = FindFormula (&Report, Text, Kept);
+      if (f == NULL)
+         {
+         Failed = TRUE;
+         break;
+         }
+      ParseTime = GetInteger (Record+8, 8);
+      Tokens    = (unsigned long) GetInteger (Record+24, 4);
+      f->Truncated     = (Length > (uint64_t) Kept);
+      f->Count++;
+      f->ParseTime    += ParseTime;
+      f->EvaluateTime += GetInteger (Record+16, 8);
+      if (Tokens > f->Tokens)
+         f->Tokens = Tokens;
+      if ((int) GetInteger (Record+28, 4) > f->Depth)
+         f->Depth = (int) GetInteger (Record+28, 4);
+      if (GetInteger (Record+32, 4) != ERROR_none)
+         f->Errors++;
+      Report.Lines++;
+      Report.ParseTime    += ParseTime;
+      Report.EvaluateTime += GetInteger (Record+16, 8);
+      }
+   fclose (Input);
+   if (Failed)
+      {
+      FreeReport (&Report);
+      return -1;
+      }
+
+   /*  LIST THE MOST COSTLY  */
+   qsort (Report.Formulas, Report.NumberOfFormulas, sizeof(traceformula_t),
+          CompareTotal);
+   Total = Report.ParseTime + Report.EvaluateTime;
+   fprintf (Stream, "MOST COSTLY FORMULAS\n");
+   fprintf (Stream, "   %lu lines, %d formulas, %.3f ms", Report.Lines,
+            Report.NumberOfFormulas, Total / 1e6);
+   if (Counted)
+      fprintf (Stream, " (%.1f%% parsing)",
+               Total ? 100.0 * Report.ParseTime / Total : 0.0);
+   else
+      fprintf (Stream, " (tokens, depth and parsing not counted - "
+                       "build with -DCALC_STATS)");
+   fprintf (Stream, "\n\n");
+   fprintf (Stream, "   rank   total ms  share   count    mean us"
+                    "  parse  tokens  depth  errors  formula\n");
+   for (Formula=0; Formula<Report.NumberOfFormulas && Formula<Top; Formula++)
+      {
+      f = Report.Formulas + Formula;
+      fprintf (Stream, "   %4d %10.3f %5.1f%% %7lu %10.3f", Formula+1,
+               (f->ParseTime + f->EvaluateTime) / 1e6,
+               Total ? 100.0 * (f->ParseTime + f->EvaluateTime) / Total : 0.0,
+               f->Count,
+               (f->ParseTime + f->EvaluateTime) / 1e3 / f->Count);
+      if (Counted)
+         fprintf (Stream, " %5.1f%% %7lu %6d",
+                  (f->ParseTime + f->EvaluateTime)
+                  ? 100.0 * f->ParseTime / (f->ParseTime + f->EvaluateTime)
+                  : 0.0,
+                  f->Tokens, f->Depth);
+      else
+         fprintf (Stream, " %6s %7s %6s", "-", "-", "-");
+      fprintf (Stream, " %7lu  %.*s%s\n", f->Errors, f->Length,
+               Report.Texts + f->Text, f->Truncated ? "..." : "");
+      }
+   fprintf (Stream, "\n");
+   FreeReport (&Report);
+   return 0;
+   }
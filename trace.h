@@ -0,0 +1,21 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdio.h>
+#include "parse.h"
+
+/*  LONGEST FORMULA TEXT KEPT PER RECORD, AND FORMULAS RANKED BY calc  */
+#define CALC_TRACETEXT 200
+#define CALC_TRACETOP  10
+
+typedef struct calc_trace calc_trace;
+
+calc_trace *calc_trace_open   (const char *path);
+void        calc_trace_begin  (calc_trace *trace, calc_context *ctx);
+void        calc_trace_end    (calc_trace *trace, calc_context *ctx,
+                               unsigned long line, const char *formula,
+                               size_t len, int err);
+int         calc_trace_close  (calc_trace *trace);
+int         calc_trace_report (FILE *stream, const char *path, int top);
+
+#endif
@@ -0,0 +1,467 @@
+/*                                                                       */
+/*                                                                       */
+/*   COLUMN EVALUATION OF COMPILED FORMULAS                              */
+/*                                                                       */
+/*      USER CALLABLE ROUTINES                                           */
+/*                                                                       */
+/*        (1) size_t calc_run_columns (calc_program *p,                  */
+/*                       const double *const *columns, size_t n,         */
+/*                       double *results, int *errors)                   */
+/*                                                                       */
+/*            evaluates compiled formula n times and returns the         */
+/*            number of evaluations that failed.                         */
+/*                                                                       */
+/*            columns  one pointer per slot of the program (see          */
+/*                     calc_nslots).  columns[s][i] is the value of      */
+/*                     slot s in evaluation i.  A NULL pointer uses      */
+/*                     the current value of the variable in the          */
+/*                     program's context for every evaluation.           */
+/*            results  receives n values.  Failed evaluations give 0.    */
+/*            errors   receives n error codes (0 if OK).  May be NULL.   */
+/*                                                                       */
+/*            Assignments in the formula do not change the columns       */
+/*            or the context.                                            */
+/*                                                                       */
+/*                                                                       */
+/*        IMPLEMENTATION                                                 */
+/*                                                                       */
+/*          Evaluations are done CALC_BLOCK at a time.  Each register    */
+/*          of the program becomes a block of CALC_BLOCK values and      */
+/*          each instruction is one simple fixed-length loop over its    */
+/*          block, which the compiler turns into SIMD code for the       */
+/*          target machine (SSE/AVX on x86, NEON on ARM).  A register's  */
+/*          block is reused once its last reader has run, so storage     */
+/*          depends on the number of live values rather than program     */
+/*          length.                                                      */
+/*                                                                       */
+/*          Division by zero and out-of-range function parameters        */
+/*          only set a flag per element; the few flagged elements are    */
+/*          then evaluated again one at a time with calc_run to get      */
+/*          their exact error code.  When no slot has a column and the   */
+/*          formula assigns nothing, calc_run reads the context itself   */
+/*          and lets evalform report the error, as for the formula       */
+/*          alone; every row is then the same, so it runs once.          */
+/*                                                                       */
+/*                                                                       */
+
+/*
+************************************************************************
+Include Files
+************************************************************************
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "parse.h"
+#include "compile.h"
+#include "vector.h"
+
+/*
+************************************************************************
+Defines
+************************************************************************
+*/
+#define FALSE 0
+#define TRUE  1
+#define BOOLEAN int
+#define NOBLOCK -1
+
+/*  STORAGE OF REGISTER i IN RunBlock  */
+#define REGISTER(i)  (Storage + (size_t) Block[i] * CALC_BLOCK)
+
+
+/*
+************************************************************************
+Local Function Prototypes
+************************************************************************
+*/
+static int   AssignBlocks (calc_program *Program, int *Block);
+static void  FunctionBlock (function_t Function, const double *x,
+                            double *r, long long *Failed, int Count);
+static void  ArithmeticBlock (opcode_t Opcode, double *restrict r,
+                              const double *restrict a,
+                              const double *restrict b,
+                              long long *restrict Failed);
+static void  FillBlock (double *r, double Value);
+static BOOLEAN FromContext (calc_program *Program,
+                            const double *const *Columns);
+static void  RunBlock (calc_program *Program, const double *const *Columns,
+                       const double *Broadcast, size_t Start, int Count,
+                       double *Storage, const int *Block, long long *Failed);
+
+
+/*
+************************************************************************
+Local Subroutines
+************************************************************************
+*/
+
+/*
+   Give every register a block of storage, reusing the block of a
+   register after its last use.  Returns number of blocks needed or
+   NOBLOCK if out of heap.
+*/
+static int AssignBlocks (calc_program *Program, int *Block)
+   {
+   int  *LastUse;
+   int  *FreeBlocks;
+   int   NumberFree;
+   int   NumberOfBlocks;
+   int   Operand[MAXOPERANDS];
+   int   NumberOfOperands;
+   int   iinstr;
+   int   iop;
+
+   LastUse    = (int *) malloc (Program->CodeLength * sizeof(int));
+   FreeBlocks = (int *) malloc (Program->CodeLength * sizeof(int));
+   if (LastUse == NULL || FreeBlocks == NULL)
+      {
+      free (LastUse);
+      free (FreeBlocks);
+      return NOBLOCK;
+      }
+
+   /*  FIND LAST READER OF EACH REGISTER  */
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      {
+      LastUse[iinstr] = iinstr;
+      NumberOfOperands = InstructionOperands (&Program->Code[iinstr], Operand);
+      for (iop=0; iop<NumberOfOperands; iop++)
+         LastUse[Operand[iop]] = iinstr;
+      }
+   LastUse[Program->Result] = Program->CodeLength;
+
+   /*  ASSIGN BLOCKS IN EVALUATION ORDER  */
+   NumberFree = 0;
+   NumberOfBlocks = 0;
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      {
+      /*  RESULT NEVER SHARES A BLOCK WITH AN OPERAND  */
+      if (NumberFree > 0)
+         Block[iinstr] = FreeBlocks[--NumberFree];
+      else
+         Block[iinstr] = NumberOfBlocks++;
+
+      /*  FREE OPERANDS READ FOR THE LAST TIME  */
+      NumberOfOperands = InstructionOperands (&Program->Code[iinstr], Operand);
+      for (iop=0; iop<NumberOfOperands; iop++)
+         if (LastUse[Operand[iop]] == iinstr)
+            {
+            FreeBlocks[NumberFree++] = Block[Operand[iop]];
+            /*  SAME REGISTER USED TWICE - FREE IT ONCE  */
+            LastUse[Operand[iop]] = -1;
+            }
+
+      /*  UNUSED RESULT - BLOCK IS FREE AGAIN  */
+      if (LastUse[iinstr] == iinstr)
+         FreeBlocks[NumberFree++] = Block[iinstr];
+      }
+
+   free (LastUse);
+   free (FreeBlocks);
+   return NumberOfBlocks;
+   }
+
+
+/*  APPLY FUNCTION TO BLOCK - FLAG ELEMENTS OUTSIDE ITS DOMAIN  */
+static void FunctionBlock (function_t Function, const double *x,
+                           double *r, long long *Failed, int Count)
+   {
+   int k;
+
+   /*  CHECK ARGUMENT RANGES  */
+   switch (Function)
+      {
+      case FUNC_log:
+      case FUNC_log10:
+      case FUNC_sqrt:
+         for (k=0; k<Count; k++)
+            Failed[k] |= (x[k] <= 0.0);
+         break;
+      case FUNC_acos:
+      case FUNC_asin:
+         for (k=0; k<Count; k++)
+            Failed[k] |= (x[k] < -1.0) | (x[k] >= 1.0);
+         break;
+      default:
+         break;
+      }
+
+   /*  EVALUATE  */
+   switch (Function)
+      {
+      case FUNC_sin:   for (k=0; k<Count; k++) r[k] = sin(x[k]);    break;
+      case FUNC_cos:   for (k=0; k<Count; k++) r[k] = cos(x[k]);    break;
+      case FUNC_tan:   for (k=0; k<Count; k++) r[k] = tan(x[k]);    break;
+      case FUNC_exp:   for (k=0; k<Count; k++) r[k] = exp(x[k]);    break;
+      case FUNC_log:   for (k=0; k<Count; k++) r[k] = log(x[k]);    break;
+      case FUNC_log10: for (k=0; k<Count; k++) r[k] = log10(x[k]);  break;
+      case FUNC_fabs:  for (k=0; k<Count; k++) r[k] = fabs(x[k]);   break;
+      case FUNC_acos:  for (k=0; k<Count; k++) r[k] = acos(x[k]);   break;
+      case FUNC_asin:  for (k=0; k<Count; k++) r[k] = asin(x[k]);   break;
+      case FUNC_atan:  for (k=0; k<Count; k++) r[k] = atan(x[k]);   break;
+      case FUNC_sqrt:  for (k=0; k<Count; k++) r[k] = sqrt(x[k]);   break;
+      default:
+         for (k=0; k<Count; k++)
+            r[k] = ApplyFunction (Function, x[k]);
+         break;
+      }
+   }
+
+
+/*
+   ARITHMETIC ON WHOLE BLOCKS - r NEVER OVERLAPS a OR b, AND THE FIXED
+   LENGTH LETS THE COMPILER VECTORIZE WITHOUT A REMAINDER LOOP.  ELEMENTS
+   PAST THE END OF A SHORT LAST BLOCK ARE COMPUTED AND IGNORED.
+*/
+static void ArithmeticBlock (opcode_t Opcode, double *restrict r,
+                             const double *restrict a,
+                             const double *restrict b,
+                             long long *restrict Failed)
+   {
+   int k;
+
+   switch (Opcode)
+      {
+      case OPC_Negate:
+         for (k=0; k<CALC_BLOCK; k++) r[k] = -a[k];
+         break;
+      case OPC_Add:
+         for (k=0; k<CALC_BLOCK; k++) r[k] = a[k] + b[k];
+         break;
+      case OPC_Subtract:
+         for (k=0; k<CALC_BLOCK; k++) r[k] = a[k] - b[k];
+         break;
+      case OPC_Multiply:
+         for (k=0; k<CALC_BLOCK; k++) r[k] = a[k] * b[k];
+         break;
+      case OPC_Divide:
+         for (k=0; k<CALC_BLOCK; k++) Failed[k] |= (b[k] == 0.0);
+         for (k=0; k<CALC_BLOCK; k++) r[k] = a[k] / b[k];
+         break;
+      case OPC_Min:
+         for (k=0; k<CALC_BLOCK; k++) r[k] = fmin (a[k], b[k]);
+         break;
+      case OPC_Max:
+         for (k=0; k<CALC_BLOCK; k++) r[k] = fmax (a[k], b[k]);
+         break;
+      default:
+         break;
+      }
+   }
+
+
+/*  FILL BLOCK WITH ONE VALUE  */
+static void FillBlock (double *r, double Value)
+   {
+   int k;
+
+   for (k=0; k<CALC_BLOCK; k++)
+      r[k] = Value;
+   }
+
+
+/*  EVALUATE Count ELEMENTS STARTING AT Start  */
+/*  TRUE IF EVERY SLOT IS READ FROM THE CONTEXT AND NOTHING IS ASSIGNED, SO
+    THAT calc_run WITHOUT SLOTS GIVES THE ERROR OF THE FORMULA ITSELF  */
+static BOOLEAN FromContext (calc_program *Program,
+                            const double *const *Columns)
+   {
+   int Slot;
+   int iinstr;
+
+   if (Program->Formula == NULL)
+      return FALSE;
+   for (Slot=0; Columns != NULL && Slot<Program->NumberOfSlots; Slot++)
+      if (Columns[Slot] != NULL)
+         return FALSE;
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      if (Program->Code[iinstr].Opcode == OPC_Store)
+         return FALSE;
+   return TRUE;
+   }
+
+
+static void RunBlock (calc_program *Program, const double *const *Columns,
+                      const double *Broadcast, size_t Start, int Count,
+                      double *Storage, const int *Block, long long *Failed)
+   {
+   calc_instr          *Instr;
+   int                  iinstr;
+   int                  k;
+   double              *r;
+   const double        *a;
+   const double        *b;
+   const double        *c;
+   const double        *Column;
+
+   for (iinstr=0; iinstr<Program->CodeLength; iinstr++)
+      {
+      Instr = &Program->Code[iinstr];
+      r = REGISTER (iinstr);
+      switch (Instr->Opcode)
+         {
+         case OPC_Const:
+            FillBlock (r, Instr->Value);
+            break;
+         case OPC_Load:
+            Column = Columns ? Columns[Instr->A] : NULL;
+            if (Column != NULL)
+               memcpy (r, Column + Start, Count * sizeof(double));
+            else
+               FillBlock (r, Broadcast[Instr->A]);
+            break;
+         case OPC_Store:
+            memcpy (r, REGISTER (Instr->B), CALC_BLOCK * sizeof(double));
+            break;
+         case OPC_Negate:
+            a = REGISTER (Instr->A);
+            ArithmeticBlock (Instr->Opcode, r, a, a, Failed);
+            break;
+         case OPC_Add:
+         case OPC_Subtract:
+         case OPC_Multiply:
+         case OPC_Divide:
+            a = REGISTER (Instr->A);
+            b = REGISTER (Instr->B);
+            ArithmeticBlock (Instr->Opcode, r, a, b, Failed);
+            break;
+         case OPC_Power:
+            a = REGISTER (Instr->A);
+            b = REGISTER (Instr->B);
+            for (k=0; k<Count; k++) r[k] = pow (a[k], b[k]);
+            break;
+         case OPC_Function:
+            a = REGISTER (Instr->A);
+            FunctionBlock ((function_t) Instr->B, a, r, Failed, Count);
+            break;
+         case OPC_Min:
+         case OPC_Max:
+            a = REGISTER (Instr->A);
+            b = REGISTER (Instr->B);
+            ArithmeticBlock (Instr->Opcode, r, a, b, Failed);
+            break;
+         case OPC_Atan2:
+            a = REGISTER (Instr->A);
+            b = REGISTER (Instr->B);
+            for (k=0; k<Count; k++) r[k] = atan2 (a[k], b[k]);
+            break;
+         case OPC_Hypot:
+            a = REGISTER (Instr->A);
+            b = REGISTER (Instr->B);
+            for (k=0; k<Count; k++) r[k] = hypot (a[k], b[k]);
+            break;
+         case OPC_Fma:
+            a = REGISTER (Instr->A);
+            b = REGISTER (Instr->B);
+            c = REGISTER (Instr->C);
+            for (k=0; k<Count; k++) r[k] = fma (a[k], b[k], c[k]);
+            break;
+         }
+      }
+   }
+
+
+/*
+************************************************************************
+Exported Subroutines
+************************************************************************
+*/
+
+size_t calc_run_columns (calc_program *Program, const double *const *Columns,
+                         size_t n, double *Results, int *Errors)
+   {
+   int        *Block;
+   double     *Storage;
+   double     *Broadcast;
+   double     *LaneSlots;
+   long long   Failed[CALC_BLOCK];
+   const double *Result;
+   int         NumberOfBlocks;
+   int         Count;
+   int         Slot;
+   int         ErrorCode;
+   BOOLEAN     Context;
+   BOOLEAN     ContextRun = FALSE;
+   double      ContextValue = 0.0;
+   int         ContextError = ERROR_none;
+   int         k;
+   size_t      Start;
+   size_t      NumberFailed;
+
+   /*  LAY OUT REGISTER STORAGE  */
+   Block = (int *) malloc (Program->CodeLength * sizeof(int));
+   if (Block == NULL)
+      return n;
+   NumberOfBlocks = AssignBlocks (Program, Block);
+   Storage   = NULL;
+   Broadcast = NULL;
+   LaneSlots = NULL;
+   if (NumberOfBlocks != NOBLOCK)
+      {
+      Storage   = (double *) malloc ((size_t) NumberOfBlocks * CALC_BLOCK
+                                     * sizeof(double));
+      Broadcast = (double *) malloc ((Program->NumberOfSlots + 1)
+                                     * sizeof(double));
+      LaneSlots = (double *) malloc ((Program->NumberOfSlots + 1)
+                                     * sizeof(double));
+      }
+   if (Storage == NULL || Broadcast == NULL || LaneSlots == NULL)
+      {
+      free (Block);
+      free (Storage);
+      free (Broadcast);
+      free (LaneSlots);
+      return n;
+      }
+
+   /*  VALUES OF SLOTS WITHOUT A COLUMN  */
+   for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+      Broadcast[Slot] = GetVariableValue (Program->Context,
+                                          Program->VariableIDs[Slot]);
+
+   NumberFailed = 0;
+   Context = FromContext (Program, Columns);
+   Result = Storage + (size_t) Block[Program->Result] * CALC_BLOCK;
+   for (Start=0; Start<n; Start+=CALC_BLOCK)
+      {
+      Count = (n - Start < CALC_BLOCK) ? (int) (n - Start) : CALC_BLOCK;
+      memset (Failed, 0, sizeof(Failed));
+      RunBlock (Program, Columns, Broadcast, Start, Count,
+                Storage, Block, Failed);
+      memcpy (Results + Start, Result, Count * sizeof(double));
+      if (Errors != NULL)
+         memset (Errors + Start, 0, Count * sizeof(int));
+
+      /*  REDO FLAGGED ELEMENTS ONE AT A TIME FOR THEIR ERROR CODE  */
+      for (k=0; k<Count; k++)
+         {
+         if (!Failed[k])
+            continue;
+         for (Slot=0; Slot<Program->NumberOfSlots; Slot++)
+            LaneSlots[Slot] = (Columns && Columns[Slot])
+                              ? Columns[Slot][Start+k] : Broadcast[Slot];
+         if (!Context)
+            Results[Start+k] = calc_run (Program, LaneSlots, &ErrorCode);
+         else
+            {
+            /*  EVERY ROW IS THE SAME - RUN ONCE  */
+            if (!ContextRun)
+               ContextValue = calc_run (Program, NULL, &ContextError);
+            ContextRun = TRUE;
+            Results[Start+k] = ContextValue;
+            ErrorCode = ContextError;
+            }
+         if (Errors != NULL)
+            Errors[Start+k] = ErrorCode;
+         if (ErrorCode != ERROR_none)
+            NumberFailed++;
+         }
+      }
+
+   free (Block);
+   free (Storage);
+   free (Broadcast);
+   free (LaneSlots);
+   return NumberFailed;
+   }
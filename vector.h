@@ -0,0 +1,13 @@
+#ifndef __VECTOR_H
+#define __VECTOR_H
+
+#include <stddef.h>
+#include "compile.h"
+
+/*  NUMBER OF ELEMENTS EVALUATED TOGETHER  */
+#define CALC_BLOCK 256
+
+size_t calc_run_columns (calc_program *prog, const double *const *columns,
+                         size_t n, double *results, int *errors);
+
+#endif